@@ -0,0 +1,150 @@
+// ============================================================================
+// openni2_arena.cxx: Reusable frame references and frame listeners (oni_Arena)
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <mutex>
+#include <vector>
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_listener_wrapper.h"
+#include "openni2_internal.h"
+
+// openni2_arena_pool: A free list over blocks of 'T' that are allocated
+// 'blockSize' at a time and only freed with the pool, so that a capture loop
+// that creates and drops frame refs or listeners does not touch the heap.
+// When a block runs out, another of the same size is allocated.
+template <class T>
+class openni2_arena_pool
+{
+public:
+    openni2_arena_pool(int blockSize) : m_blockSize(blockSize > 0 ? blockSize : 1)
+    {
+        grow();
+    }
+
+    ~openni2_arena_pool()
+    {
+        for (size_t i = 0; i < m_blocks.size(); ++i) {
+            delete[] m_blocks[i];
+        }
+    }
+
+    T * acquire()
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (m_free.empty()) {
+            grow();
+        }
+        T * obj = m_free.back();
+        m_free.pop_back();
+        return obj;
+    }
+
+    void release(T * obj)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        // Never reallocates: grow() reserved room for every object.
+        m_free.push_back(obj);
+    }
+
+    int blockCount()
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        return (int) m_blocks.size();
+    }
+
+private:
+    void grow()
+    {
+        T * block = new T[m_blockSize];
+        m_blocks.push_back(block);
+        m_free.reserve(m_blocks.size() * m_blockSize);
+        for (int i = m_blockSize - 1; i >= 0; --i) {
+            m_free.push_back(block + i);
+        }
+    }
+
+    const int m_blockSize;
+    std::mutex m_lock;
+    std::vector<T *> m_blocks;
+    std::vector<T *> m_free;
+};
+
+class openni2_arena
+{
+public:
+    openni2_arena(int frameRefs, int listeners)
+        : refs(frameRefs), listeners(listeners) {}
+
+    openni2_arena_pool<openni::VideoFrameRef> refs;
+    openni2_arena_pool<openni2_listener_wrapper> listeners;
+};
+
+// =========
+// oni_Arena
+// =========
+oni_Arena * oni_new_Arena(int frameRefs, int listeners) {
+    EXC_CHECK( return new openni2_arena(frameRefs, listeners); );
+    return NULL;
+}
+
+void oni_delete_Arena(oni_Arena * arena) {
+    EXC_CHECK( delete arena; );
+}
+
+oni_VideoFrameRef * oni_newVideoFrameRef_Arena(oni_Arena * arena,
+                                               oni_VideoFrameRef * other) {
+    EXC_CHECK({
+        openni::VideoFrameRef * ref = arena->refs.acquire();
+        if (other != NULL) {
+            *ref = *other;
+        }
+        return ref;
+    });
+    return NULL;
+}
+
+void oni_deleteVideoFrameRef_Arena(oni_Arena * arena, oni_VideoFrameRef * ref) {
+    EXC_CHECK({
+        ref->release();
+        arena->refs.release(ref);
+    });
+}
+
+oni_Status oni_addNewFrameListener_Arena(oni_Arena * arena,
+                                         oni_VideoStream * stream,
+                                         oni_NewFrameListener * listen) {
+    oni_Status rc = openni::STATUS_ERROR;
+    EXC_CHECK({
+        openni2_listener_wrapper * connected = arena->listeners.acquire();
+        connected->onNewFrame_c.fnPtr = listen->fnPtr;
+        connected->onNewFrame_c._obj = connected;
+        rc = stream->addNewFrameListener(connected);
+        if (rc != openni::STATUS_OK) {
+            arena->listeners.release(connected);
+            return rc;
+        }
+        listen->_obj = connected;
+    });
+    return rc;
+}
+
+void oni_removeNewFrameListener_Arena(oni_Arena * arena,
+                                      oni_VideoStream * stream,
+                                      oni_NewFrameListener * listen) {
+    EXC_CHECK({
+        stream->removeNewFrameListener(listen->_obj);
+        arena->listeners.release(
+            static_cast<openni2_listener_wrapper *>(listen->_obj));
+        listen->_obj = NULL;
+    });
+}
+
+int oni_getBlockCount_Arena(oni_Arena * arena) {
+    EXC_CHECK( return arena->refs.blockCount() + arena->listeners.blockCount(); );
+    return -1;
+}
@@ -0,0 +1,833 @@
+// ============================================================================
+// openni2_bench.cxx: Micro-benchmarks for the wrapper.
+// Usage: openni2_c_wrapper_bench [URI] [FILTER]
+// URI is a device URI or a recording (.oni); without one, the first device
+// found is used.  Benchmarks that need no device (those on synthetic frames)
+// run even if none can be opened.  Only benchmarks whose name contains FILTER
+// are run.
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#ifdef HAVE_LIBJPEG
+extern "C" {
+#include <jpeglib.h>
+}
+#endif
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_wrapper_inline.hpp"
+
+// Everything a benchmark may use.  If there is a device, 'depth' has been
+// started and 'frame' holds one of its frames.  'vga' and 'qvga' are synthetic
+// depth frames: a tilted plane with noise, a box in front of it and holes.
+// 'vgaColor' is a synthetic RGB888 frame registered to 'vga', and 'jpeg' a
+// 1280x960 synthetic color frame compressed as JPEG (if built with libjpeg).
+struct _benchContext {
+    oni_Device * device;
+    oni_VideoStream * depth;
+    oni_VideoFrameRef * frame;
+    oni_FrameDescriptor vga;
+    oni_FrameDescriptor qvga;
+    oni_FrameDescriptor vgaColor;
+    oni_FrameDescriptor jpeg;
+};
+
+typedef void (*_benchFn) (_benchContext & ctx, long iterations);
+
+struct _benchCase {
+    const char * name;
+    _benchFn fn;
+    // How many iterations make up one run.
+    long iterations;
+    bool needsDevice;
+    // Pixels processed per iteration, to report throughput; 0 for none.
+    int pixels;
+};
+
+// Results go here so that the compiler can't drop the work.
+static volatile long _sink;
+
+// ==========================
+// C ABI vs. inline fast path
+// ==========================
+// The compiler is free to hoist inlined accessors out of these loops
+// altogether, which is exactly the advantage being measured.
+static void _benchWidthC(_benchContext & ctx, long iterations)
+{
+    long sum = 0;
+    for (long i = 0; i < iterations; ++i) {
+        sum += oni_getWidth(ctx.frame) + oni_getHeight(ctx.frame);
+    }
+    _sink = sum;
+}
+
+static void _benchWidthInline(_benchContext & ctx, long iterations)
+{
+    long sum = 0;
+    for (long i = 0; i < iterations; ++i) {
+        sum += oni::getWidth(ctx.frame) + oni::getHeight(ctx.frame);
+    }
+    _sink = sum;
+}
+
+static void _benchRowSumC(_benchContext & ctx, long iterations)
+{
+    long sum = 0;
+    for (long i = 0; i < iterations; ++i) {
+        const char * data = (const char *) oni_getData(ctx.frame);
+        int height = oni_getHeight(ctx.frame);
+        for (int y = 0; y < height; ++y) {
+            const oni_DepthPixel * row = (const oni_DepthPixel *)
+                (data + y * oni_getStrideInBytes(ctx.frame));
+            sum += row[oni_getWidth(ctx.frame) / 2];
+        }
+    }
+    _sink = sum;
+}
+
+static void _benchRowSumInline(_benchContext & ctx, long iterations)
+{
+    long sum = 0;
+    for (long i = 0; i < iterations; ++i) {
+        int height = oni::getHeight(ctx.frame);
+        for (int y = 0; y < height; ++y) {
+            sum += oni::row<oni_DepthPixel>(ctx.frame, y)[oni::getWidth(ctx.frame) / 2];
+        }
+    }
+    _sink = sum;
+}
+
+static void _benchPropertyC(_benchContext & ctx, long iterations)
+{
+    long sum = 0;
+    for (long i = 0; i < iterations; ++i) {
+        int value = 0;
+        int size = sizeof(value);
+        oni_getProperty_VideoStream(ctx.depth, openni::STREAM_PROPERTY_MAX_VALUE,
+                                    &value, &size);
+        sum += value;
+    }
+    _sink = sum;
+}
+
+static void _benchPropertyInline(_benchContext & ctx, long iterations)
+{
+    long sum = 0;
+    for (long i = 0; i < iterations; ++i) {
+        int value = 0;
+        oni::getProperty<openni::STREAM_PROPERTY_MAX_VALUE>(ctx.depth, &value);
+        sum += value;
+    }
+    _sink = sum;
+}
+
+// =============
+// Depth filters
+// =============
+static void _benchFilter(const oni_FrameDescriptor & desc, long iterations,
+                         void (*setup) (oni_DepthFilter *))
+{
+    oni_DepthFilter * filter = oni_new_DepthFilter();
+    setup(filter);
+    long sum = 0;
+    for (long i = 0; i < iterations; ++i) {
+        sum += oni_applyDescriptor_DepthFilter(filter, &desc)[desc.width / 2];
+    }
+    _sink = sum;
+    oni_delete_DepthFilter(filter);
+}
+
+static void _setupMedian3(oni_DepthFilter * f) { oni_addMedian_DepthFilter(f, 1); }
+static void _setupMedian5(oni_DepthFilter * f) { oni_addMedian_DepthFilter(f, 2); }
+static void _setupBilateral(oni_DepthFilter * f) { oni_addBilateral_DepthFilter(f, 2, 1.5f, 30.0f); }
+static void _setupTemporal(oni_DepthFilter * f) { oni_addTemporal_DepthFilter(f, 0.4f, 40, 3); }
+static void _setupHoleFill(oni_DepthFilter * f) { oni_addHoleFill_DepthFilter(f, 8); }
+static void _setupChain(oni_DepthFilter * f)
+{
+    _setupMedian3(f);
+    _setupHoleFill(f);
+    _setupBilateral(f);
+    _setupTemporal(f);
+}
+
+#define FILTER_BENCH(name, setup) \
+    static void _bench##name##Vga(_benchContext & ctx, long n) { _benchFilter(ctx.vga, n, setup); } \
+    static void _bench##name##Qvga(_benchContext & ctx, long n) { _benchFilter(ctx.qvga, n, setup); }
+FILTER_BENCH(Median3, &_setupMedian3)
+FILTER_BENCH(Median5, &_setupMedian5)
+FILTER_BENCH(Bilateral, &_setupBilateral)
+FILTER_BENCH(Temporal, &_setupTemporal)
+FILTER_BENCH(HoleFill, &_setupHoleFill)
+FILTER_BENCH(Chain, &_setupChain)
+#undef FILTER_BENCH
+
+// ==============
+// Depth pyramids
+// ==============
+static void _benchPyramid(const oni_FrameDescriptor & desc, long iterations,
+                          int factor, int mode)
+{
+    oni_DepthPyramid * pyramid = oni_new_DepthPyramid(3, factor, mode, false);
+    long sum = 0;
+    for (long i = 0; i < iterations; ++i) {
+        oni_setDescriptor_DepthPyramid(pyramid, &desc);
+        sum += oni_getLevel_DepthPyramid(pyramid, 1, NULL, NULL)[0];
+    }
+    _sink = sum;
+    oni_delete_DepthPyramid(pyramid);
+}
+
+#define PYRAMID_BENCH(name, factor, mode) \
+    static void _bench##name##Vga(_benchContext & ctx, long n) { _benchPyramid(ctx.vga, n, factor, mode); } \
+    static void _bench##name##Qvga(_benchContext & ctx, long n) { _benchPyramid(ctx.qvga, n, factor, mode); }
+PYRAMID_BENCH(PyramidMin2, 2, oni_DECIMATE_MIN)
+PYRAMID_BENCH(PyramidMedian2, 2, oni_DECIMATE_MEDIAN)
+PYRAMID_BENCH(PyramidMean2, 2, oni_DECIMATE_MEAN)
+PYRAMID_BENCH(PyramidMean4, 4, oni_DECIMATE_MEAN)
+#undef PYRAMID_BENCH
+
+// ================
+// Frame statistics
+// ================
+static void _benchStats(const oni_FrameDescriptor & desc, long iterations)
+{
+    std::vector<uint32_t> histogram(256);
+    std::vector<uint8_t> mask(((size_t) desc.width * desc.height + 7) / 8);
+    oni_FrameStats stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.histogram = &histogram[0];
+    stats.histogramBins = (int) histogram.size();
+    stats.histogramMin = 0;
+    stats.histogramMax = 10000;
+    stats.validMask = &mask[0];
+    stats.validMaskSize = (int) mask.size();
+    long sum = 0;
+    for (long i = 0; i < iterations; ++i) {
+        oni_computeDescriptorStats(&desc, &stats);
+        sum += stats.validCount;
+    }
+    _sink = sum;
+}
+
+static void _benchStatsVga(_benchContext & ctx, long n) { _benchStats(ctx.vga, n); }
+static void _benchStatsQvga(_benchContext & ctx, long n) { _benchStats(ctx.qvga, n); }
+
+// ===============
+// Surface normals
+// ===============
+// _benchIntrinsics: Roughly a PrimeSense depth camera's 58 x 45 degree field
+// of view.
+static oni_CameraIntrinsics _benchIntrinsics(const oni_FrameDescriptor & desc)
+{
+    oni_CameraIntrinsics intrinsics = { desc.width, desc.height,
+                                        desc.width * 0.9f, desc.width * 0.9f,
+                                        desc.width / 2.0f, desc.height / 2.0f };
+    return intrinsics;
+}
+
+static void _benchNormals(const oni_FrameDescriptor & desc, long iterations,
+                          int method, bool curvature)
+{
+    oni_CameraIntrinsics intrinsics = _benchIntrinsics(desc);
+    std::vector<float> normals((size_t) desc.width * desc.height * 3);
+    std::vector<float> curv(curvature ? (size_t) desc.width * desc.height : 0);
+    long sum = 0;
+    for (long i = 0; i < iterations; ++i) {
+        oni_computeDescriptorNormals(&desc, &intrinsics, method, 2, 0.05f,
+                                     &normals[0], curvature ? &curv[0] : NULL);
+        sum += normals[normals.size() / 2] > 0.0f;
+    }
+    _sink = sum;
+}
+
+#define NORMALS_BENCH(name, method, curvature) \
+    static void _bench##name##Vga(_benchContext & ctx, long n) { _benchNormals(ctx.vga, n, method, curvature); } \
+    static void _bench##name##Qvga(_benchContext & ctx, long n) { _benchNormals(ctx.qvga, n, method, curvature); }
+NORMALS_BENCH(NormalsCross, oni_NORMALS_CROSS_PRODUCT, false)
+NORMALS_BENCH(NormalsIntegral, oni_NORMALS_INTEGRAL_IMAGE, false)
+NORMALS_BENCH(NormalsCurvature, oni_NORMALS_CROSS_PRODUCT, true)
+#undef NORMALS_BENCH
+
+// ============
+// Point clouds
+// ============
+static void _benchPointCloud(const oni_FrameDescriptor & depth,
+                             const oni_FrameDescriptor * color, long iterations,
+                             float voxelSize)
+{
+    oni_CameraIntrinsics intrinsics = _benchIntrinsics(depth);
+    oni_PointCloud * cloud = oni_new_PointCloud(voxelSize);
+    long sum = 0;
+    for (long i = 0; i < iterations; ++i) {
+        int count = 0;
+        oni_buildDescriptor_PointCloud(cloud, &depth, color, &intrinsics);
+        oni_getPoints_PointCloud(cloud, &count);
+        sum += count;
+    }
+    _sink = sum;
+    oni_delete_PointCloud(cloud);
+}
+
+#define CLOUD_BENCH(name, voxelSize) \
+    static void _bench##name(_benchContext & ctx, long n) { _benchPointCloud(ctx.vga, &ctx.vgaColor, n, voxelSize); }
+CLOUD_BENCH(CloudNoVoxels, 0.0f)
+CLOUD_BENCH(CloudVoxels5, 5.0f)
+CLOUD_BENCH(CloudVoxels10, 10.0f)
+CLOUD_BENCH(CloudVoxels20, 20.0f)
+CLOUD_BENCH(CloudVoxels50, 50.0f)
+#undef CLOUD_BENCH
+
+static void _benchCloudDepthOnly(_benchContext & ctx, long n)
+{
+    _benchPointCloud(ctx.vga, NULL, n, 10.0f);
+}
+
+// ===============
+// Plane detection
+// ===============
+static void _benchPlanes(const oni_FrameDescriptor & desc, long iterations,
+                         bool refine)
+{
+    oni_CameraIntrinsics intrinsics = _benchIntrinsics(desc);
+    oni_PlaneDetector * detector = oni_new_PlaneDetector(4, 20.0f, 1000);
+    oni_setRefine_PlaneDetector(detector, refine);
+    oni_Plane planes[4];
+    long sum = 0;
+    for (long i = 0; i < iterations; ++i) {
+        int count = 0;
+        oni_detectDescriptor_PlaneDetector(detector, &desc, &intrinsics,
+                                           planes, &count);
+        sum += count;
+    }
+    _sink = sum;
+    oni_delete_PlaneDetector(detector);
+}
+
+#define PLANES_BENCH(name, refine) \
+    static void _bench##name##Vga(_benchContext & ctx, long n) { _benchPlanes(ctx.vga, n, refine); } \
+    static void _bench##name##Qvga(_benchContext & ctx, long n) { _benchPlanes(ctx.qvga, n, refine); }
+PLANES_BENCH(PlanesTracked, true)
+PLANES_BENCH(PlanesCold, false)
+#undef PLANES_BENCH
+
+// ===============
+// Occupancy grids
+// ===============
+static void _benchOccupancy(const oni_FrameDescriptor & desc, long iterations)
+{
+    oni_CameraIntrinsics intrinsics = _benchIntrinsics(desc);
+    // 10 x 5 m in 5 cm cells, with the camera 1 m up.
+    oni_OccupancyGrid * grid = oni_new_OccupancyGrid(200, 100, 50.0f,
+                                                     -5000.0f, 0.0f);
+    oni_SensorPose pose = { { 1, 0, 0, 0, 1, 0, 0, 0, 1 }, { 0, 1000, 0 } };
+    long sum = 0;
+    for (long i = 0; i < iterations; ++i) {
+        oni_clear_OccupancyGrid(grid);
+        oni_integrateDescriptor_OccupancyGrid(grid, &desc, &intrinsics, &pose);
+        sum += oni_getOccupancy_OccupancyGrid(grid, NULL, NULL)[0];
+    }
+    _sink = sum;
+    oni_delete_OccupancyGrid(grid);
+}
+
+static void _benchOccupancyVga(_benchContext & ctx, long n) { _benchOccupancy(ctx.vga, n); }
+static void _benchOccupancyQvga(_benchContext & ctx, long n) { _benchOccupancy(ctx.qvga, n); }
+
+// =================
+// Volumetric fusion
+// =================
+static void _benchTsdfIntegrate(const oni_FrameDescriptor & desc, long iterations)
+{
+    oni_CameraIntrinsics intrinsics = _benchIntrinsics(desc);
+    oni_TsdfVolume * volume = oni_new_TsdfVolume(5.0f, 20.0f);
+    for (long i = 0; i < iterations; ++i) {
+        oni_integrateDescriptor_TsdfVolume(volume, &desc, &intrinsics, NULL);
+    }
+    _sink = oni_getBlockCount_TsdfVolume(volume);
+    oni_delete_TsdfVolume(volume);
+}
+
+// _benchTsdfRaycast: The view moves a little every time, so that every
+// raycast is a full one.
+static void _benchTsdfRaycast(const oni_FrameDescriptor & desc, long iterations)
+{
+    oni_CameraIntrinsics intrinsics = _benchIntrinsics(desc);
+    oni_TsdfVolume * volume = oni_new_TsdfVolume(5.0f, 20.0f);
+    oni_integrateDescriptor_TsdfVolume(volume, &desc, &intrinsics, NULL);
+    std::vector<oni_DepthPixel> depth((size_t) desc.width * desc.height);
+    std::vector<float> normals(depth.size() * 3);
+    oni_SensorPose pose = { { 1, 0, 0, 0, 1, 0, 0, 0, 1 }, { 0, 0, 0 } };
+    long sum = 0;
+    for (long i = 0; i < iterations; ++i) {
+        pose.translation[0] = (float) (i & 1);
+        oni_raycast_TsdfVolume(volume, &intrinsics, &pose, &depth[0], &normals[0]);
+        sum += depth[depth.size() / 2];
+    }
+    _sink = sum;
+    oni_delete_TsdfVolume(volume);
+}
+
+static void _benchTsdfIntegrateQvga(_benchContext & ctx, long n) { _benchTsdfIntegrate(ctx.qvga, n); }
+static void _benchTsdfIntegrateVga(_benchContext & ctx, long n) { _benchTsdfIntegrate(ctx.vga, n); }
+static void _benchTsdfRaycastQvga(_benchContext & ctx, long n) { _benchTsdfRaycast(ctx.qvga, n); }
+
+// _benchRewind: Rewind a recording (.oni) and play it as fast as frames are
+// read, so that every run of a device benchmark sees the same frames.
+static void _benchRewind(_benchContext & ctx)
+{
+    if (oni_isFile(ctx.device)) {
+        oni_PlaybackControl * playback = oni_getPlaybackControl(ctx.device);
+        oni_setSpeed(playback, -1.0f);
+        oni_setRepeatEnabled(playback, true);
+        oni_seek(playback, ctx.depth, 0);
+    }
+}
+
+// _benchTsdfDevice: Fuse frames as they come from the device, reading
+// included, from a recording's start (see _benchRewind).  Without odometry
+// the frames are all fused from the same pose.
+static void _benchTsdfDevice(_benchContext & ctx, long iterations)
+{
+    oni_CameraIntrinsics intrinsics;
+    if (oni_getCameraIntrinsics(ctx.depth, &intrinsics) != openni::STATUS_OK) {
+        return;
+    }
+    _benchRewind(ctx);
+    oni_TsdfVolume * volume = oni_new_TsdfVolume(5.0f, 20.0f);
+    for (long i = 0; i < iterations; ++i) {
+        if (oni_readFrame(ctx.depth, ctx.frame) != openni::STATUS_OK) {
+            break;
+        }
+        oni_integrate_TsdfVolume(volume, ctx.frame, &intrinsics, NULL);
+    }
+    _sink = oni_getBlockCount_TsdfVolume(volume);
+    oni_delete_TsdfVolume(volume);
+}
+
+// _benchOdometry: Track alternately the frame and a copy shifted 2 pixels to
+// the left, so that every frame moves.
+static void _benchOdometry(const oni_FrameDescriptor & desc, long iterations)
+{
+    oni_CameraIntrinsics intrinsics = _benchIntrinsics(desc);
+    std::vector<oni_DepthPixel> shifted((size_t) desc.width * desc.height, 0);
+    for (int y = 0; y < desc.height; ++y) {
+        const oni_DepthPixel * row = (const oni_DepthPixel *)
+            ((const char *) desc.data + (size_t) y * desc.strideInBytes);
+        memcpy(&shifted[(size_t) y * desc.width], row + 2,
+               (desc.width - 2) * sizeof(oni_DepthPixel));
+    }
+    oni_FrameDescriptor other = desc;
+    other.data = &shifted[0];
+    other.strideInBytes = desc.width * (int) sizeof(oni_DepthPixel);
+    oni_Odometry * odometry = oni_new_Odometry(3);
+    oni_SensorPose pose;
+    for (long i = 0; i < iterations; ++i) {
+        oni_trackDescriptor_Odometry(odometry, (i & 1) ? &other : &desc,
+                                     &intrinsics, &pose, NULL);
+    }
+    _sink = (long) pose.translation[0];
+    oni_delete_Odometry(odometry);
+}
+
+static void _benchOdometryQvga(_benchContext & ctx, long n) { _benchOdometry(ctx.qvga, n); }
+static void _benchOdometryVga(_benchContext & ctx, long n) { _benchOdometry(ctx.vga, n); }
+
+// _benchOdometryDevice: Track frames as they come from the device, reading
+// included, from a recording's start (see _benchRewind).
+static void _benchOdometryDevice(_benchContext & ctx, long iterations)
+{
+    oni_CameraIntrinsics intrinsics;
+    if (oni_getCameraIntrinsics(ctx.depth, &intrinsics) != openni::STATUS_OK) {
+        return;
+    }
+    _benchRewind(ctx);
+    oni_Odometry * odometry = oni_new_Odometry(3);
+    oni_SensorPose pose;
+    int tracked = 0;
+    for (long i = 0; i < iterations; ++i) {
+        if (oni_readFrame(ctx.depth, ctx.frame) != openni::STATUS_OK) {
+            break;
+        }
+        oni_OdometryStats stats;
+        oni_track_Odometry(odometry, ctx.frame, &intrinsics, &pose, &stats);
+        tracked += stats.tracked;
+    }
+    _sink = tracked;
+    oni_delete_Odometry(odometry);
+}
+
+// _benchBlobs: Learn the frame as background, then find and track the
+// blobs of a copy with a few boxes in front of it.
+static void _benchBlobs(const oni_FrameDescriptor & desc, long iterations)
+{
+    oni_CameraIntrinsics intrinsics = _benchIntrinsics(desc);
+    std::vector<oni_DepthPixel> boxes((size_t) desc.width * desc.height);
+    for (int y = 0; y < desc.height; ++y) {
+        const oni_DepthPixel * row = (const oni_DepthPixel *)
+            ((const char *) desc.data + (size_t) y * desc.strideInBytes);
+        for (int x = 0; x < desc.width; ++x) {
+            bool inBox = (y / (desc.height / 4)) % 2 == 1 &&
+                (x / (desc.width / 8)) % 2 == 1;
+            boxes[(size_t) y * desc.width + x] = inBox ? 500 : row[x];
+        }
+    }
+    oni_FrameDescriptor other = desc;
+    other.data = &boxes[0];
+    other.strideInBytes = desc.width * (int) sizeof(oni_DepthPixel);
+    oni_BlobTracker * tracker = oni_new_BlobTracker(32, 100.0f, 50);
+    oni_Blob blobs[32];
+    int count = 0;
+    oni_updateDescriptor_BlobTracker(tracker, &desc, &intrinsics, blobs, &count);
+    for (long i = 0; i < iterations; ++i) {
+        oni_updateDescriptor_BlobTracker(tracker, &other, &intrinsics, blobs, &count);
+    }
+    _sink = count;
+    oni_delete_BlobTracker(tracker);
+}
+
+static void _benchBlobsQvga(_benchContext & ctx, long n) { _benchBlobs(ctx.qvga, n); }
+static void _benchBlobsVga(_benchContext & ctx, long n) { _benchBlobs(ctx.vga, n); }
+
+// _benchToneMap: Map the (depth) frame to 8 bits with the given options.
+static void _benchToneMap(const oni_FrameDescriptor & desc, long iterations,
+                          bool reuse, int tiles)
+{
+    oni_ToneMapper * mapper = oni_new_ToneMapper(10000);
+    oni_setReuseHistogram_ToneMapper(mapper, reuse);
+    oni_setLocalContrast_ToneMapper(mapper, tiles, tiles, 2.0f);
+    oni_setGamma_ToneMapper(mapper, 2.2f);
+    std::vector<uint8_t> out((size_t) desc.width * desc.height);
+    long sum = 0;
+    for (long i = 0; i < iterations; ++i) {
+        oni_mapDescriptor_ToneMapper(mapper, &desc, &out[0]);
+        sum += out[out.size() / 2];
+    }
+    _sink = sum;
+    oni_delete_ToneMapper(mapper);
+}
+
+static void _benchToneMapStretch(_benchContext & ctx, long n) { _benchToneMap(ctx.vga, n, false, 0); }
+static void _benchToneMapReuse(_benchContext & ctx, long n) { _benchToneMap(ctx.vga, n, true, 0); }
+static void _benchToneMapClahe(_benchContext & ctx, long n) { _benchToneMap(ctx.vga, n, false, 8); }
+
+// =============
+// JPEG decoding
+// =============
+// _benchJpeg: Decode the JPEG frame over and over at 1 / 'scale' of its size,
+// keeping the decoder's queue full so that every worker is busy.
+static void _benchJpeg(const oni_FrameDescriptor & desc, long iterations,
+                       int scale)
+{
+    const int pending = 2 * oni_getParallelism() + 2;
+    oni_JpegDecoder * decoder = oni_new_JpegDecoder(0, pending);
+    if (decoder == NULL) {
+        return;
+    }
+    oni_setOutput_JpegDecoder(decoder, openni::PIXEL_FORMAT_RGB888, scale);
+    long submitted = 0, received = 0, sum = 0;
+    while (received < iterations) {
+        while (submitted < iterations &&
+               oni_submitDescriptor_JpegDecoder(decoder, &desc, NULL) ==
+                   openni::STATUS_OK)
+        {
+            ++submitted;
+        }
+        oni_DecodedFrame frame;
+        if (oni_receive_JpegDecoder(decoder, &frame, -1) == openni::STATUS_OK) {
+            sum += frame.desc.width + frame.status;
+            oni_release_DecodedFrame(decoder, &frame);
+            ++received;
+        }
+    }
+    _sink = sum;
+    oni_delete_JpegDecoder(decoder);
+}
+
+static void _benchJpegFull(_benchContext & ctx, long n) { _benchJpeg(ctx.jpeg, n, 1); }
+static void _benchJpegHalf(_benchContext & ctx, long n) { _benchJpeg(ctx.jpeg, n, 2); }
+static void _benchJpegEighth(_benchContext & ctx, long n) { _benchJpeg(ctx.jpeg, n, 8); }
+
+// ============
+// Frame export
+// ============
+// _benchExport: Export the (depth) frame as a PNG, or as a PLY cloud if
+// 'cloud', to /dev/null, so that encoding is timed rather than the disk.
+// When the budget is used up, wait for the exporter to catch up.
+static void _benchExport(const oni_FrameDescriptor & desc, long iterations,
+                         bool cloud)
+{
+    oni_FrameExporter * exporter = oni_new_FrameExporter(0, 64 << 20);
+    oni_CameraIntrinsics intrinsics = _benchIntrinsics(desc);
+    for (long i = 0; i < iterations; ++i) {
+        oni_Status rc;
+        while ((rc = cloud ?
+                oni_exportCloudDescriptor_FrameExporter(
+                    exporter, &desc, &intrinsics, oni_CLOUD_PLY, "/dev/null") :
+                oni_exportPngDescriptor_FrameExporter(exporter, &desc,
+                                                      "/dev/null")) ==
+               openni::STATUS_OUT_OF_FLOW)
+        {
+            oni_flush_FrameExporter(exporter, -1);
+        }
+        if (rc != openni::STATUS_OK) {
+            break;
+        }
+    }
+    oni_flush_FrameExporter(exporter, -1);
+    oni_ExportStats stats;
+    oni_getStats_FrameExporter(exporter, &stats);
+    _sink = (long) stats.bytesWritten;
+    oni_delete_FrameExporter(exporter);
+}
+
+static void _benchExportPng(_benchContext & ctx, long n) { _benchExport(ctx.vga, n, false); }
+static void _benchExportPly(_benchContext & ctx, long n) { _benchExport(ctx.vga, n, true); }
+
+static const int _vgaPixels = 640 * 480;
+static const int _qvgaPixels = 320 * 240;
+
+static const _benchCase _cases[] = {
+    { "accessor/c", &_benchWidthC, 10000000, true, 0 },
+    { "accessor/inline", &_benchWidthInline, 10000000, true, 0 },
+    { "rowscan/c", &_benchRowSumC, 10000, true, 0 },
+    { "rowscan/inline", &_benchRowSumInline, 10000, true, 0 },
+    { "property/c", &_benchPropertyC, 100000, true, 0 },
+    { "property/inline", &_benchPropertyInline, 100000, true, 0 },
+    { "filter/median3/vga", &_benchMedian3Vga, 200, false, _vgaPixels },
+    { "filter/median3/qvga", &_benchMedian3Qvga, 800, false, _qvgaPixels },
+    { "filter/median5/vga", &_benchMedian5Vga, 20, false, _vgaPixels },
+    { "filter/median5/qvga", &_benchMedian5Qvga, 80, false, _qvgaPixels },
+    { "filter/bilateral/vga", &_benchBilateralVga, 50, false, _vgaPixels },
+    { "filter/bilateral/qvga", &_benchBilateralQvga, 200, false, _qvgaPixels },
+    { "filter/temporal/vga", &_benchTemporalVga, 500, false, _vgaPixels },
+    { "filter/temporal/qvga", &_benchTemporalQvga, 2000, false, _qvgaPixels },
+    { "filter/holefill/vga", &_benchHoleFillVga, 500, false, _vgaPixels },
+    { "filter/holefill/qvga", &_benchHoleFillQvga, 2000, false, _qvgaPixels },
+    { "filter/chain/vga", &_benchChainVga, 50, false, _vgaPixels },
+    { "filter/chain/qvga", &_benchChainQvga, 200, false, _qvgaPixels },
+    { "pyramid/min2/vga", &_benchPyramidMin2Vga, 1000, false, _vgaPixels },
+    { "pyramid/min2/qvga", &_benchPyramidMin2Qvga, 4000, false, _qvgaPixels },
+    { "pyramid/median2/vga", &_benchPyramidMedian2Vga, 200, false, _vgaPixels },
+    { "pyramid/median2/qvga", &_benchPyramidMedian2Qvga, 800, false, _qvgaPixels },
+    { "pyramid/mean2/vga", &_benchPyramidMean2Vga, 1000, false, _vgaPixels },
+    { "pyramid/mean2/qvga", &_benchPyramidMean2Qvga, 4000, false, _qvgaPixels },
+    { "pyramid/mean4/vga", &_benchPyramidMean4Vga, 1000, false, _vgaPixels },
+    { "pyramid/mean4/qvga", &_benchPyramidMean4Qvga, 4000, false, _qvgaPixels },
+    { "stats/vga", &_benchStatsVga, 1000, false, _vgaPixels },
+    { "stats/qvga", &_benchStatsQvga, 4000, false, _qvgaPixels },
+    { "normals/cross/vga", &_benchNormalsCrossVga, 200, false, _vgaPixels },
+    { "normals/cross/qvga", &_benchNormalsCrossQvga, 800, false, _qvgaPixels },
+    { "normals/integral/vga", &_benchNormalsIntegralVga, 50, false, _vgaPixels },
+    { "normals/integral/qvga", &_benchNormalsIntegralQvga, 200, false, _qvgaPixels },
+    { "normals/curvature/vga", &_benchNormalsCurvatureVga, 20, false, _vgaPixels },
+    { "normals/curvature/qvga", &_benchNormalsCurvatureQvga, 80, false, _qvgaPixels },
+    { "cloud/rgb/all/vga", &_benchCloudNoVoxels, 200, false, _vgaPixels },
+    { "cloud/rgb/voxel5/vga", &_benchCloudVoxels5, 100, false, _vgaPixels },
+    { "cloud/rgb/voxel10/vga", &_benchCloudVoxels10, 100, false, _vgaPixels },
+    { "cloud/rgb/voxel20/vga", &_benchCloudVoxels20, 100, false, _vgaPixels },
+    { "cloud/rgb/voxel50/vga", &_benchCloudVoxels50, 100, false, _vgaPixels },
+    { "cloud/depth/voxel10/vga", &_benchCloudDepthOnly, 100, false, _vgaPixels },
+    { "planes/tracked/vga", &_benchPlanesTrackedVga, 200, false, _vgaPixels },
+    { "planes/tracked/qvga", &_benchPlanesTrackedQvga, 800, false, _qvgaPixels },
+    { "planes/cold/vga", &_benchPlanesColdVga, 100, false, _vgaPixels },
+    { "planes/cold/qvga", &_benchPlanesColdQvga, 400, false, _qvgaPixels },
+    { "occupancy/vga", &_benchOccupancyVga, 500, false, _vgaPixels },
+    { "occupancy/qvga", &_benchOccupancyQvga, 2000, false, _qvgaPixels },
+    { "tsdf/integrate/qvga", &_benchTsdfIntegrateQvga, 50, false, _qvgaPixels },
+    { "tsdf/integrate/vga", &_benchTsdfIntegrateVga, 20, false, _vgaPixels },
+    { "tsdf/raycast/qvga", &_benchTsdfRaycastQvga, 20, false, _qvgaPixels },
+    { "tsdf/device", &_benchTsdfDevice, 100, true, 0 },
+    { "odometry/qvga", &_benchOdometryQvga, 200, false, _qvgaPixels },
+    { "odometry/vga", &_benchOdometryVga, 50, false, _vgaPixels },
+    { "odometry/device", &_benchOdometryDevice, 100, true, 0 },
+    { "blobs/vga", &_benchBlobsVga, 500, false, _vgaPixels },
+    { "blobs/qvga", &_benchBlobsQvga, 2000, false, _qvgaPixels },
+    { "tonemap/stretch/vga", &_benchToneMapStretch, 1000, false, _vgaPixels },
+    { "tonemap/reuse/vga", &_benchToneMapReuse, 1000, false, _vgaPixels },
+    { "tonemap/clahe/vga", &_benchToneMapClahe, 500, false, _vgaPixels },
+    { "export/png/vga", &_benchExportPng, 100, false, _vgaPixels },
+    { "export/ply/vga", &_benchExportPly, 100, false, _vgaPixels },
+#ifdef HAVE_LIBJPEG
+    { "jpeg/full/sxga", &_benchJpegFull, 100, false, 1280 * 960 },
+    { "jpeg/half/sxga", &_benchJpegHalf, 200, false, 1280 * 960 },
+    { "jpeg/eighth/sxga", &_benchJpegEighth, 400, false, 1280 * 960 },
+#endif
+};
+
+// _makeDepth: Fill in 'desc' for a synthetic width x height depth frame kept
+// in 'pixels'.
+static void _makeDepth(int width, int height, std::vector<oni_DepthPixel> & pixels,
+                       oni_FrameDescriptor * desc)
+{
+    srand(width);
+    pixels.resize((size_t) width * height);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int z = 1500 + 2000 * y / height + rand() % 16;
+            if (x > width / 3 && x < width / 2 && y > height / 4 && y < height / 2) {
+                z = 900 + rand() % 8;
+            }
+            if (rand() % 20 == 0) {
+                z = 0;
+            }
+            pixels[(size_t) y * width + x] = (oni_DepthPixel) z;
+        }
+    }
+    memset(desc, 0, sizeof(*desc));
+    desc->data = &pixels[0];
+    desc->dataSize = (int) (pixels.size() * sizeof(oni_DepthPixel));
+    desc->width = width;
+    desc->height = height;
+    desc->strideInBytes = width * sizeof(oni_DepthPixel);
+    desc->sensorType = openni::SENSOR_DEPTH;
+    desc->pixelFormat = openni::PIXEL_FORMAT_DEPTH_1_MM;
+}
+
+// _makeColor: Fill in 'desc' for a synthetic width x height RGB888 frame kept
+// in 'pixels'.
+static void _makeColor(int width, int height, std::vector<uint8_t> & pixels,
+                       oni_FrameDescriptor * desc)
+{
+    pixels.resize((size_t) width * height * 3);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            uint8_t * p = &pixels[((size_t) y * width + x) * 3];
+            p[0] = (uint8_t) (x * 255 / width);
+            p[1] = (uint8_t) (y * 255 / height);
+            p[2] = (uint8_t) ((x ^ y) & 0xff);
+        }
+    }
+    memset(desc, 0, sizeof(*desc));
+    desc->data = &pixels[0];
+    desc->dataSize = (int) pixels.size();
+    desc->width = width;
+    desc->height = height;
+    desc->strideInBytes = width * 3;
+    desc->sensorType = openni::SENSOR_COLOR;
+    desc->pixelFormat = openni::PIXEL_FORMAT_RGB888;
+}
+
+#ifdef HAVE_LIBJPEG
+// _makeJpeg: Fill in 'desc' for 'color' (an RGB888 frame) compressed as JPEG
+// into 'jpeg'.
+static void _makeJpeg(const oni_FrameDescriptor & color,
+                      std::vector<uint8_t> & jpeg, oni_FrameDescriptor * desc)
+{
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr error;
+    unsigned char * out = NULL;
+    unsigned long size = 0;
+    cinfo.err = jpeg_std_error(&error);
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &out, &size);
+    cinfo.image_width = color.width;
+    cinfo.image_height = color.height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 90, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = (JSAMPROW) color.data +
+            (size_t) cinfo.next_scanline * color.strideInBytes;
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    jpeg.assign(out, out + size);
+    free(out);
+
+    *desc = color;
+    desc->data = &jpeg[0];
+    desc->dataSize = (int) jpeg.size();
+    desc->strideInBytes = 0;
+    desc->pixelFormat = openni::PIXEL_FORMAT_JPEG;
+}
+#endif
+
+// _runCase: Time a few runs and report the best, in nanoseconds per iteration.
+static void _runCase(const _benchCase & c, _benchContext & ctx)
+{
+    const int runs = 5;
+    double best = 0;
+    c.fn(ctx, c.iterations / 10 + 1);
+    for (int r = 0; r < runs; ++r) {
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        c.fn(ctx, c.iterations);
+        double ns = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - t0).count() / c.iterations;
+        if (r == 0 || ns < best) {
+            best = ns;
+        }
+    }
+    if (c.pixels > 0) {
+        printf("%-32s %12.2f ns/iter %10.1f Mpx/s\n", c.name, best,
+               c.pixels * 1000.0 / best);
+    } else {
+        printf("%-32s %12.2f ns/iter\n", c.name, best);
+    }
+}
+
+int main(int argc, const char ** argv) {
+    const char * uri = argc > 1 && argv[1][0] != '\0' ? argv[1] : NULL;
+    const char * filter = argc > 2 ? argv[2] : "";
+
+    if (oni_initialize() != openni::STATUS_OK) {
+        printf("Initialize failed: %s\n", oni_getExtendedError());
+        return 1;
+    }
+
+    _benchContext ctx;
+    std::vector<oni_DepthPixel> vga, qvga;
+    _makeDepth(640, 480, vga, &ctx.vga);
+    _makeDepth(320, 240, qvga, &ctx.qvga);
+    std::vector<uint8_t> vgaColor;
+    _makeColor(640, 480, vgaColor, &ctx.vgaColor);
+    std::vector<uint8_t> sxgaColor, jpeg;
+    memset(&ctx.jpeg, 0, sizeof(ctx.jpeg));
+#ifdef HAVE_LIBJPEG
+    oni_FrameDescriptor sxga;
+    _makeColor(1280, 960, sxgaColor, &sxga);
+    _makeJpeg(sxga, jpeg, &ctx.jpeg);
+#endif
+    ctx.device = oni_new_Device();
+    ctx.depth = oni_new_VideoStream();
+    ctx.frame = oni_new_VideoFrameRef(NULL);
+    bool haveDevice = true;
+    if (oni_open(ctx.device, uri) != openni::STATUS_OK ||
+        oni_create_VideoStream(ctx.depth, ctx.device, openni::SENSOR_DEPTH) !=
+            openni::STATUS_OK ||
+        oni_start_VideoStream(ctx.depth) != openni::STATUS_OK ||
+        oni_readFrame(ctx.depth, ctx.frame) != openni::STATUS_OK)
+    {
+        printf("Could not get a depth frame (%s); skipping device benchmarks\n",
+               oni_getExtendedError());
+        haveDevice = false;
+    } else {
+        printf("%dx%d depth frames\n", oni_getWidth(ctx.frame),
+               oni_getHeight(ctx.frame));
+    }
+    printf("%d threads\n", oni_getParallelism());
+    for (size_t i = 0; i < sizeof(_cases) / sizeof(_cases[0]); ++i) {
+        if (strstr(_cases[i].name, filter) != NULL &&
+            (haveDevice || !_cases[i].needsDevice))
+        {
+            _runCase(_cases[i], ctx);
+        }
+    }
+
+    oni_delete_VideoFrameRef(ctx.frame);
+    oni_stop_VideoStream(ctx.depth);
+    oni_delete_VideoStream(ctx.depth);
+    oni_delete_Device(ctx.device);
+    oni_shutdown();
+    return 0;
+}
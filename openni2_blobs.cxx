@@ -0,0 +1,596 @@
+// ============================================================================
+// openni2_blobs.cxx: Foreground blobs in depth frames, found against a
+// running background model and tracked from frame to frame
+// (oni_BlobTracker)
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_geometry.h"
+#include "openni2_parallel.h"
+#include "openni2_internal.h"
+
+// _updateBackground: Compare 'n' pixels of one row with the background
+// depths 'background' (mm, 0 where not yet known) and set 'foreground' to 1
+// where they are more than 'threshold' closer.  Other valid pixels update
+// the background: one farther away than it uncovers what was behind and
+// replaces it, and one about as far is blended in at 'rate'.
+static void _updateBackground(const uint16_t * row, float scale, int n,
+                              float threshold, float rate, float * background,
+                              uint8_t * foreground)
+{
+    int x = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128 vthreshold = _mm_set1_ps(threshold);
+    const __m128 vrate = _mm_set1_ps(rate);
+    const __m128 fzero = _mm_setzero_ps();
+    for (; x + 4 <= n; x += 4) {
+        __m128i raw = _mm_unpacklo_epi16(
+            _mm_loadl_epi64((const __m128i *) (row + x)), zero);
+        __m128 d = _mm_mul_ps(_mm_cvtepi32_ps(raw), vscale);
+        __m128 b = _mm_loadu_ps(background + x);
+        __m128 valid = _mm_cmpgt_ps(d, fzero);
+        __m128 unknown = _mm_cmpeq_ps(b, fzero);
+        __m128 closer = _mm_andnot_ps(unknown, _mm_and_ps(
+            valid, _mm_cmplt_ps(d, _mm_sub_ps(b, vthreshold))));
+        __m128 replace = _mm_or_ps(unknown, _mm_cmpgt_ps(d, _mm_add_ps(b, vthreshold)));
+        __m128 blended = _mm_add_ps(b, _mm_mul_ps(vrate, _mm_sub_ps(d, b)));
+        __m128 updated = _mm_or_ps(_mm_and_ps(replace, d),
+                                   _mm_andnot_ps(replace, blended));
+        __m128 learn = _mm_andnot_ps(closer, valid);
+        _mm_storeu_ps(background + x, _mm_or_ps(_mm_and_ps(learn, updated),
+                                                _mm_andnot_ps(learn, b)));
+        __m128i bits = _mm_packs_epi32(_mm_castps_si128(closer), zero);
+        bits = _mm_and_si128(_mm_packs_epi16(bits, zero), _mm_set1_epi8(1));
+        int packed = _mm_cvtsi128_si32(bits);
+        memcpy(foreground + x, &packed, 4);
+    }
+#endif
+    for (; x < n; ++x) {
+        float d = row[x] * scale;
+        float & b = background[x];
+        foreground[x] = 0;
+        if (row[x] == 0) {
+            continue;
+        }
+        if (b != 0.0f && d < b - threshold) {
+            foreground[x] = 1;
+        } else if (b == 0.0f || d > b + threshold) {
+            b = d;
+        } else {
+            b += rate * (d - b);
+        }
+    }
+}
+
+// Union-find over pixel indices.  Sets are always linked under the lower
+// index, so the root of a set is its first pixel in raster order whichever
+// order the unions came in.
+static inline int _findRoot(const int * parent, int i)
+{
+    while (parent[i] != i) {
+        i = parent[i];
+    }
+    return i;
+}
+
+static inline int _find(int * parent, int i)
+{
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+static inline void _union(int * parent, int a, int b)
+{
+    a = _find(parent, a);
+    b = _find(parent, b);
+    if (a < b) {
+        parent[b] = a;
+    } else if (b < a) {
+        parent[a] = b;
+    }
+}
+
+// _blobStats: What is summed up over the pixels of one component.
+struct _blobStats {
+    int pixels;
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+    double sumX;
+    double sumY;
+    double sum[3];
+    float lo[3];
+    float hi[3];
+};
+
+// _blobTrack: A blob followed from frame to frame, with its last world
+// centroid and its motion per frame.
+struct _blobTrack {
+    int id;
+    int age;
+    int missed;
+    float position[3];
+    float velocity[3];
+};
+
+// _blobPair: A blob close enough to where a track is expected.
+struct _blobPair {
+    float distance;
+    int track;
+    int blob;
+
+    bool operator<(const _blobPair & other) const
+    {
+        if (distance != other.distance) {
+            return distance < other.distance;
+        }
+        return track != other.track ? track < other.track : blob < other.blob;
+    }
+};
+
+// ====================
+// openni2_blob_tracker
+// ====================
+// openni2_blob_tracker: Labeling runs in parallel strips (see
+// oni_setParallelism) that are joined at their seams, and all buffers are
+// kept from frame to frame.  Blobs are matched to the last frame's by their
+// centroids in mm, each track being expected to keep moving as it did.
+class openni2_blob_tracker
+{
+public:
+    openni2_blob_tracker(int maxBlobs, float threshold, int minPixels)
+        : m_maxBlobs(maxBlobs), m_threshold(threshold), m_minPixels(minPixels),
+          m_rate(0.05f), m_maxDistance(300.0f), m_maxMissed(10), m_nextId(1),
+          m_width(0), m_height(0) {}
+
+    void setLearningRate(float rate)
+    {
+        m_rate = std::min(std::max(rate, 0.0f), 1.0f);
+    }
+
+    void setTracking(float maxDistance, int maxMissed)
+    {
+        m_maxDistance = maxDistance;
+        m_maxMissed = std::max(maxMissed, 0);
+    }
+
+    void resetBackground()
+    {
+        std::fill(m_background.begin(), m_background.end(), 0.0f);
+    }
+
+    oni_Status update(const oni_FrameDescriptor & desc,
+                      const oni_CameraIntrinsics & intrinsics,
+                      oni_Blob * blobs, int * count)
+    {
+        if (!_makeDepthGeometry(desc, intrinsics, &m_geometry)) {
+            return openni::STATUS_NOT_SUPPORTED;
+        }
+        int w = desc.width, h = desc.height;
+        if (w != m_width || h != m_height) {
+            m_width = w;
+            m_height = h;
+            size_t size = (size_t) w * h;
+            m_background.assign(size, 0.0f);
+            m_foreground.assign(size, 0);
+            m_parent.assign(size, 0);
+            m_component.assign(size, -1);
+            m_labels.assign(size, 0);
+            m_tracks.clear();
+        }
+        int strips = std::max(_parallelism(), 1);
+        int rows = (h + strips - 1) / strips;
+        strips = (h + rows - 1) / rows;
+
+        _parallelFor(h, _band, [&](int y0, int y1) {
+            for (int y = y0; y < y1; ++y) {
+                size_t row = (size_t) y * w;
+                _updateBackground(_depthRow(desc, y), m_geometry.scale, w,
+                                  m_threshold, m_rate, &m_background[row],
+                                  &m_foreground[row]);
+            }
+        });
+        int components = label(strips, rows);
+        measure(desc, components);
+        int found = select(components);
+        track(found);
+
+        for (int i = 0; i < found; ++i) {
+            blobs[i] = m_blobs[i];
+        }
+        if (count != NULL) {
+            *count = found;
+        }
+        return openni::STATUS_OK;
+    }
+
+    const uint8_t * labels(int * width, int * height) const
+    {
+        if (width != NULL) {
+            *width = m_width;
+        }
+        if (height != NULL) {
+            *height = m_height;
+        }
+        return m_labels.empty() ? NULL : &m_labels[0];
+    }
+
+    const uint8_t * foreground(int * width, int * height) const
+    {
+        if (width != NULL) {
+            *width = m_width;
+        }
+        if (height != NULL) {
+            *height = m_height;
+        }
+        return m_foreground.empty() ? NULL : &m_foreground[0];
+    }
+
+private:
+    // Rows per range for the per-pixel passes.
+    static const int _band = 16;
+
+    // label: 8-connected components of the foreground into m_component,
+    // numbered 0, 1, ... in raster order of their first pixels (-1 for
+    // background).  Each strip of 'rows' rows is labeled on its own thread,
+    // the seams between strips are joined, and the final numbers are handed
+    // out strip by strip.  Returns the number of components.
+    int label(int strips, int rows)
+    {
+        int w = m_width, h = m_height;
+        const uint8_t * fg = &m_foreground[0];
+        int * parent = &m_parent[0];
+        _parallelFor(h, rows, [&](int y0, int y1) {
+            for (int y = y0; y < y1; ++y) {
+                for (int x = 0; x < w; ++x) {
+                    int i = y * w + x;
+                    if (!fg[i]) {
+                        continue;
+                    }
+                    parent[i] = i;
+                    if (x > 0 && fg[i - 1]) {
+                        _union(parent, i, i - 1);
+                    }
+                    if (y > y0) {
+                        joinAbove(parent, fg, x, i);
+                    }
+                }
+            }
+        });
+        for (int y = rows; y < h; y += rows) {
+            for (int x = 0; x < w; ++x) {
+                int i = y * w + x;
+                if (fg[i]) {
+                    joinAbove(parent, fg, x, i);
+                }
+            }
+        }
+
+        // Roots per strip, then each strip numbers its own roots from where
+        // the strips before it left off.  The roots' parents are no longer
+        // needed once every pixel knows its root, so they hold the numbers.
+        m_stripRoots.assign(strips + 1, 0);
+        int * component = &m_component[0];
+        _parallelFor(h, rows, [&](int y0, int y1) {
+            int roots = 0;
+            for (int i = y0 * w; i < y1 * w; ++i) {
+                if (!fg[i]) {
+                    component[i] = -1;
+                    continue;
+                }
+                component[i] = _findRoot(parent, i);
+                roots += component[i] == i;
+            }
+            m_stripRoots[y0 / rows + 1] = roots;
+        });
+        for (int s = 0; s < strips; ++s) {
+            m_stripRoots[s + 1] += m_stripRoots[s];
+        }
+        _parallelFor(h, rows, [&](int y0, int y1) {
+            int next = m_stripRoots[y0 / rows];
+            for (int i = y0 * w; i < y1 * w; ++i) {
+                if (fg[i] && component[i] == i) {
+                    parent[i] = next++;
+                }
+            }
+        });
+        _parallelFor(h, _band, [&](int y0, int y1) {
+            for (int i = y0 * w; i < y1 * w; ++i) {
+                if (component[i] >= 0) {
+                    component[i] = parent[component[i]];
+                }
+            }
+        });
+        return m_stripRoots[strips];
+    }
+
+    // joinAbove: Join foreground pixel 'i' at column 'x' with its foreground
+    // neighbors in the row above.
+    void joinAbove(int * parent, const uint8_t * fg, int x, int i) const
+    {
+        int up = i - m_width;
+        if (fg[up]) {
+            _union(parent, i, up);
+        }
+        if (x > 0 && fg[up - 1]) {
+            _union(parent, i, up - 1);
+        }
+        if (x + 1 < m_width && fg[up + 1]) {
+            _union(parent, i, up + 1);
+        }
+    }
+
+    // measure: Sum up each component's pixels and points into m_stats.
+    void measure(const oni_FrameDescriptor & desc, int components)
+    {
+        _blobStats empty;
+        memset(&empty, 0, sizeof(empty));
+        empty.minX = empty.minY = INT_MAX;
+        empty.maxX = empty.maxY = -1;
+        for (int k = 0; k < 3; ++k) {
+            empty.lo[k] = INFINITY;
+            empty.hi[k] = -INFINITY;
+        }
+        m_stats.assign(components, empty);
+        const _depthGeometry & g = m_geometry;
+        for (int y = 0; y < m_height; ++y) {
+            const uint16_t * row = _depthRow(desc, y);
+            const int * component = &m_component[(size_t) y * m_width];
+            for (int x = 0; x < m_width; ++x) {
+                if (component[x] < 0) {
+                    continue;
+                }
+                _blobStats & s = m_stats[component[x]];
+                float z = row[x] * g.scale;
+                float p[3] = { g.ax[x] * z, g.ay[y] * z, z };
+                ++s.pixels;
+                s.minX = std::min(s.minX, x);
+                s.maxX = std::max(s.maxX, x);
+                s.minY = std::min(s.minY, y);
+                s.maxY = std::max(s.maxY, y);
+                s.sumX += x;
+                s.sumY += y;
+                for (int k = 0; k < 3; ++k) {
+                    s.sum[k] += p[k];
+                    s.lo[k] = std::min(s.lo[k], p[k]);
+                    s.hi[k] = std::max(s.hi[k], p[k]);
+                }
+            }
+        }
+    }
+
+    // select: The components of at least m_minPixels pixels, largest first
+    // and at most m_maxBlobs of them, into m_blobs and the label image.
+    // Returns how many there are.
+    int select(int components)
+    {
+        m_order.clear();
+        for (int c = 0; c < components; ++c) {
+            if (m_stats[c].pixels >= m_minPixels) {
+                m_order.push_back(c);
+            }
+        }
+        int found = std::min((int) m_order.size(), m_maxBlobs);
+        std::partial_sort(m_order.begin(), m_order.begin() + found, m_order.end(),
+                          [&](int a, int b) {
+                              if (m_stats[a].pixels != m_stats[b].pixels) {
+                                  return m_stats[a].pixels > m_stats[b].pixels;
+                              }
+                              return a < b;
+                          });
+        m_rank.assign(components, 0);
+        m_blobs.resize(found);
+        for (int i = 0; i < found; ++i) {
+            const _blobStats & s = m_stats[m_order[i]];
+            oni_Blob & b = m_blobs[i];
+            m_rank[m_order[i]] = (uint8_t) (i + 1);
+            b.id = 0;
+            b.age = 0;
+            b.pixels = s.pixels;
+            b.minX = s.minX;
+            b.minY = s.minY;
+            b.maxX = s.maxX;
+            b.maxY = s.maxY;
+            b.centroidX = (float) (s.sumX / s.pixels);
+            b.centroidY = (float) (s.sumY / s.pixels);
+            for (int k = 0; k < 3; ++k) {
+                b.center[k] = (float) (s.sum[k] / s.pixels);
+                b.boundsMin[k] = s.lo[k];
+                b.boundsMax[k] = s.hi[k];
+            }
+        }
+        const int * component = &m_component[0];
+        const uint8_t * rank = m_rank.empty() ? NULL : &m_rank[0];
+        int w = m_width;
+        _parallelFor(m_height, _band, [&](int y0, int y1) {
+            for (int i = y0 * w; i < y1 * w; ++i) {
+                m_labels[i] = component[i] >= 0 ? rank[component[i]] : 0;
+            }
+        });
+        return found;
+    }
+
+    // track: Give each of the first 'found' blobs of m_blobs the id of the
+    // track it continues, closest pairs first, or a new one.  Tracks are
+    // expected to keep moving as they did, and are dropped once they have
+    // gone unmatched for more than m_maxMissed frames.
+    void track(int found)
+    {
+        m_pairs.clear();
+        float maxDistance2 = m_maxDistance * m_maxDistance;
+        for (int t = 0; t < (int) m_tracks.size(); ++t) {
+            const _blobTrack & track = m_tracks[t];
+            for (int b = 0; b < found; ++b) {
+                float d2 = 0.0f;
+                for (int k = 0; k < 3; ++k) {
+                    float d = m_blobs[b].center[k] - track.position[k] -
+                        track.velocity[k];
+                    d2 += d * d;
+                }
+                if (d2 <= maxDistance2) {
+                    _blobPair pair = { d2, t, b };
+                    m_pairs.push_back(pair);
+                }
+            }
+        }
+        std::sort(m_pairs.begin(), m_pairs.end());
+        m_trackMatched.assign(m_tracks.size(), 0);
+        m_blobMatched.assign(found, 0);
+        for (size_t i = 0; i < m_pairs.size(); ++i) {
+            const _blobPair & pair = m_pairs[i];
+            if (m_trackMatched[pair.track] || m_blobMatched[pair.blob]) {
+                continue;
+            }
+            m_trackMatched[pair.track] = 1;
+            m_blobMatched[pair.blob] = 1;
+            _blobTrack & track = m_tracks[pair.track];
+            oni_Blob & blob = m_blobs[pair.blob];
+            for (int k = 0; k < 3; ++k) {
+                track.velocity[k] = 0.5f * track.velocity[k] +
+                    0.5f * (blob.center[k] - track.position[k]);
+                track.position[k] = blob.center[k];
+            }
+            track.missed = 0;
+            blob.id = track.id;
+            blob.age = ++track.age;
+        }
+        size_t kept = 0;
+        for (size_t t = 0; t < m_tracks.size(); ++t) {
+            _blobTrack & track = m_tracks[t];
+            if (!m_trackMatched[t]) {
+                if (++track.missed > m_maxMissed) {
+                    continue;
+                }
+                for (int k = 0; k < 3; ++k) {
+                    track.position[k] += track.velocity[k];
+                }
+            }
+            m_tracks[kept++] = track;
+        }
+        m_tracks.resize(kept);
+        for (int b = 0; b < found; ++b) {
+            if (m_blobMatched[b]) {
+                continue;
+            }
+            _blobTrack track;
+            track.id = m_nextId++;
+            track.age = 1;
+            track.missed = 0;
+            for (int k = 0; k < 3; ++k) {
+                track.position[k] = m_blobs[b].center[k];
+                track.velocity[k] = 0.0f;
+            }
+            m_tracks.push_back(track);
+            m_blobs[b].id = track.id;
+            m_blobs[b].age = 1;
+        }
+    }
+
+    int m_maxBlobs;
+    float m_threshold;
+    int m_minPixels;
+    float m_rate;
+    float m_maxDistance;
+    int m_maxMissed;
+    int m_nextId;
+    int m_width;
+    int m_height;
+    _depthGeometry m_geometry;
+    std::vector<float> m_background;
+    std::vector<uint8_t> m_foreground;
+    std::vector<int> m_parent;
+    std::vector<int> m_component;
+    std::vector<int> m_stripRoots;
+    std::vector<_blobStats> m_stats;
+    std::vector<int> m_order;
+    std::vector<uint8_t> m_rank;
+    std::vector<uint8_t> m_labels;
+    std::vector<oni_Blob> m_blobs;
+    std::vector<_blobTrack> m_tracks;
+    std::vector<_blobPair> m_pairs;
+    std::vector<char> m_trackMatched;
+    std::vector<char> m_blobMatched;
+};
+
+// ===============
+// oni_BlobTracker
+// ===============
+oni_BlobTracker * oni_new_BlobTracker(int maxBlobs, float threshold,
+                                      int minPixels) {
+    if (maxBlobs < 1 || maxBlobs > 255) {
+        return NULL;
+    }
+    EXC_CHECK( return new openni2_blob_tracker(maxBlobs, threshold, minPixels); );
+    return NULL;
+}
+
+void oni_delete_BlobTracker(oni_BlobTracker * tracker) {
+    EXC_CHECK( delete tracker; );
+}
+
+void oni_setLearningRate_BlobTracker(oni_BlobTracker * tracker, float rate) {
+    EXC_CHECK( tracker->setLearningRate(rate); );
+}
+
+void oni_setTracking_BlobTracker(oni_BlobTracker * tracker, float maxDistance,
+                                 int maxMissed) {
+    EXC_CHECK( tracker->setTracking(maxDistance, maxMissed); );
+}
+
+void oni_resetBackground_BlobTracker(oni_BlobTracker * tracker) {
+    EXC_CHECK( tracker->resetBackground(); );
+}
+
+oni_Status oni_update_BlobTracker(oni_BlobTracker * tracker,
+                                  oni_VideoFrameRef * frame,
+                                  const oni_CameraIntrinsics * intrinsics,
+                                  oni_Blob * blobs, int * count) {
+    EXC_CHECK({
+        oni_FrameDescriptor desc;
+        oni_Status rc = oni_getFrameDescriptor(frame, &desc);
+        if (rc != openni::STATUS_OK) {
+            return rc;
+        }
+        return tracker->update(desc, *intrinsics, blobs, count);
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_updateDescriptor_BlobTracker(oni_BlobTracker * tracker,
+                                            const oni_FrameDescriptor * desc,
+                                            const oni_CameraIntrinsics * intrinsics,
+                                            oni_Blob * blobs, int * count) {
+    EXC_CHECK( return tracker->update(*desc, *intrinsics, blobs, count); );
+    return openni::STATUS_ERROR;
+}
+
+const uint8_t * oni_getLabels_BlobTracker(oni_BlobTracker * tracker,
+                                          int * width, int * height) {
+    EXC_CHECK( return tracker->labels(width, height); );
+    return NULL;
+}
+
+const uint8_t * oni_getForeground_BlobTracker(oni_BlobTracker * tracker,
+                                              int * width, int * height) {
+    EXC_CHECK( return tracker->foreground(width, height); );
+    return NULL;
+}
@@ -1,5 +1,8 @@
+#include <math.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "openni2_c.h"
@@ -12,11 +15,91 @@ void deviceDisconnect(oni_DeviceInfo * info);
 void deviceStateChange(oni_DeviceInfo * info, oni_DeviceState state);
 void echoSensorInfo(const oni_SensorInfo * info);
 
+// OpenNI's DEVICE_PROPERTY_IMAGE_REGISTRATION, and an ID no driver knows.
+#define IMAGE_REGISTRATION_PROPERTY 5
+#define BOGUS_PROPERTY 0x7fff
+// OpenNI's STREAM_PROPERTY_MIRRORING, which the stream cache holds.
+#define MIRRORING_PROPERTY 7
+
+int failures = 0;
+oni_VideoFrameRef * listenerFrame = NULL;
+volatile int framesSeen = 0;
+volatile int payloadsReleased = 0;
+
+// pipelineLog: What the sink of checkPipeline saw.  It holds each item until
+// 'open' is set.
+typedef struct {
+    volatile int count;
+    volatile bool open;
+    uint64_t sequences[32];
+    int payloads[32];
+} pipelineLog;
+
+// testJpeg: A 16x8 grayscale JPEG, 40 on the left half and 200 on the right.
+static const uint8_t testJpeg[] = {
+    0xff, 0xd8, 0xff, 0xdb, 0x00, 0x43, 0x00, 0x03, 0x02, 0x02, 0x03, 0x02,
+    0x02, 0x03, 0x03, 0x03, 0x03, 0x04, 0x03, 0x03, 0x04, 0x05, 0x08, 0x05,
+    0x05, 0x04, 0x04, 0x05, 0x0a, 0x07, 0x07, 0x06, 0x08, 0x0c, 0x0a, 0x0c,
+    0x0c, 0x0b, 0x0a, 0x0b, 0x0b, 0x0d, 0x0e, 0x12, 0x10, 0x0d, 0x0e, 0x11,
+    0x0e, 0x0b, 0x0b, 0x10, 0x16, 0x10, 0x11, 0x13, 0x14, 0x15, 0x15, 0x15,
+    0x0c, 0x0f, 0x17, 0x18, 0x16, 0x14, 0x18, 0x12, 0x14, 0x15, 0x14, 0xff,
+    0xc0, 0x00, 0x0b, 0x08, 0x00, 0x08, 0x00, 0x10, 0x01, 0x01, 0x11, 0x00,
+    0xff, 0xc4, 0x00, 0x15, 0x00, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x09, 0xff,
+    0xc4, 0x00, 0x14, 0x10, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xda, 0x00,
+    0x08, 0x01, 0x01, 0x00, 0x00, 0x3f, 0x00, 0x0a, 0x2d, 0x5b, 0xff, 0xd9
+};
+
+void expect(bool ok, const char * what);
+void checkPropertyQueue(oni_Device * device);
+void checkCapabilities();
+void checkSharedFrames(oni_VideoStream * stream);
+void checkFrameEvent(oni_VideoStream * stream);
+void countFrame(oni_VideoStream * stream);
+void checkFrameListener(oni_VideoStream * stream);
+bool tagItem(void * userData, oni_PipelineItem * item);
+bool logItem(void * userData, oni_PipelineItem * item);
+void releasePayload(void * payload);
+void checkPipeline();
+void checkAllocationFree();
+void checkFrameAccessors(oni_VideoStream * stream);
+oni_FrameDescriptor depthDescriptor(const oni_DepthPixel * pixels, int width,
+                                    int height);
+void checkChangeDetector();
+bool allPixels(const oni_DepthPixel * pixels, int count, int value);
+void checkDepthFilter();
+void checkDepthPyramid();
+void checkFrameStats();
+oni_CameraIntrinsics testIntrinsics(int width, int height);
+void checkNormals();
+bool near(float value, float expected);
+void checkPointCloud();
+void checkPlanes();
+oni_SensorPose translation(float x, float y, float z);
+void checkOccupancyGrid();
+void checkTsdf();
+void renderPit(oni_DepthPixel * depth, oni_CameraIntrinsics intrinsics,
+               float z);
+void checkOdometry();
+void fillBox(oni_DepthPixel * depth, int width, int x0, int y0, int x1,
+             int y1, int value);
+void checkBlobs();
+void checkToneMapper();
+bool nearByte(int value, int expected);
+void checkJpegDecoder();
+int readFile(const char * path, uint8_t * buffer, int size);
+void checkFrameExporter();
+void checkFrameHistory(oni_VideoStream * stream);
+void checkClockAligner();
+void checkResilientDevice(const char * uri);
+
 int main(int argc, const char ** argv) {
     int rc;
 
     char * uri = NULL;
     oni_Device * device = NULL;
+    oni_VideoStream * depth = NULL;
 
     oni_DeviceConnectedListener listen1;
     oni_DeviceDisconnectedListener listen2;
@@ -26,6 +109,24 @@ int main(int argc, const char ** argv) {
     printf("OpenNI2 build %d, maintenance %d, v%d.%d\n", ver.build,
            ver.maintenance, ver.major, ver.minor);
 
+    checkCapabilities();
+    checkPipeline();
+    checkChangeDetector();
+    checkDepthFilter();
+    checkDepthPyramid();
+    checkFrameStats();
+    checkNormals();
+    checkPointCloud();
+    checkPlanes();
+    checkOccupancyGrid();
+    checkTsdf();
+    checkOdometry();
+    checkBlobs();
+    checkToneMapper();
+    checkJpegDecoder();
+    checkFrameExporter();
+    checkClockAligner();
+
     listen1.fnPtr = &deviceConnect;
     listen2.fnPtr = &deviceDisconnect;
     listen3.fnPtr = &deviceStateChange;
@@ -40,6 +141,7 @@ int main(int argc, const char ** argv) {
         rc = oni_addDeviceStateChangedListener(&listen3);
 
         listDevices();
+        checkAllocationFree();
 
         uri = getFirstUri();
     }
@@ -83,10 +185,88 @@ int main(int argc, const char ** argv) {
             }
         }
         
+        if (rc == oni_STATUS_OK) {
+            checkPropertyQueue(device);
+
+            depth = oni_new_VideoStream();
+            if (oni_create_VideoStream(depth, device, oni_SENSOR_DEPTH) ==
+                oni_STATUS_OK && oni_start_VideoStream(depth) == oni_STATUS_OK)
+            {
+                checkSharedFrames(depth);
+                checkFrameEvent(depth);
+                checkFrameListener(depth);
+                checkFrameAccessors(depth);
+                checkFrameHistory(depth);
+                oni_stop_VideoStream(depth);
+            } else {
+                printf("No depth stream; skipping frame checks\n");
+            }
+            oni_destroy_VideoStream(depth);
+            oni_delete_VideoStream(depth);
+        }
+
         oni_close(device);
+        if (rc == oni_STATUS_OK) {
+            checkResilientDevice(uri);
+        }
+    }
+
+    printf("%d checks failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
+
+// expect: Report and count a failed check.
+void expect(bool ok, const char * what) {
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        ++failures;
     }
 }
 
+// checkPropertyQueue: Batched sets report each entry, and queued sets are
+// applied in order, with an error reported by exactly one flush.
+void checkPropertyQueue(oni_Device * device) {
+    oni_Status rc;
+    int mode = 0, other, value = -1;
+    int size = sizeof(mode);
+    oni_PropertyRequest requests[2];
+
+    rc = oni_getProperty_Device(device, IMAGE_REGISTRATION_PROPERTY, &mode,
+                                &size);
+    if (rc != oni_STATUS_OK) {
+        printf("No image registration property; skipping queue checks\n");
+        return;
+    }
+    other = oni_isImageRegistrationModeSupported(
+        device, oni_IMAGE_REGISTRATION_DEPTH_TO_COLOR) &&
+        mode == oni_IMAGE_REGISTRATION_OFF ?
+        oni_IMAGE_REGISTRATION_DEPTH_TO_COLOR : mode;
+
+    requests[0].propertyId = IMAGE_REGISTRATION_PROPERTY;
+    requests[0].data = &mode;
+    requests[0].dataSize = sizeof(mode);
+    requests[1].propertyId = BOGUS_PROPERTY;
+    requests[1].data = &mode;
+    requests[1].dataSize = sizeof(mode);
+    rc = oni_setProperties_Device(device, requests, 2);
+    expect(requests[0].status == oni_STATUS_OK, "batched set: good entry");
+    expect(requests[1].status != oni_STATUS_OK, "batched set: bad entry");
+    expect(rc == requests[1].status, "batched set: first error returned");
+
+    oni_setPropertyAsync_Device(device, BOGUS_PROPERTY, &mode, sizeof(mode));
+    oni_setPropertyAsync_Device(device, IMAGE_REGISTRATION_PROPERTY, &other,
+                                sizeof(other));
+    oni_setPropertyAsync_Device(device, IMAGE_REGISTRATION_PROPERTY, &mode,
+                                sizeof(mode));
+    expect(oni_flushPropertyQueue() != oni_STATUS_OK,
+           "property queue: flush returns the error");
+    expect(oni_flushPropertyQueue() == oni_STATUS_OK,
+           "property queue: error returned only once");
+    size = sizeof(value);
+    oni_getProperty_Device(device, IMAGE_REGISTRATION_PROPERTY, &value, &size);
+    expect(value == mode, "property queue: last set wins");
+}
+
 // listDevices: Echo a list of devices to stdout.
 void listDevices() {
     int i;
@@ -164,3 +344,1492 @@ void echoSensorInfo(const oni_SensorInfo * info) {
         }
     }
 }
+
+// checkCapabilities: Mode selection honors the constraints in order, and a
+// snapshot survives the cache file next to another device's entry.
+void checkCapabilities() {
+    int i;
+    oni_Status rc;
+    char path[] = "/tmp/oni_c_test_XXXXXX";
+    oni_VideoModeInfo modes[4], best;
+    oni_PixelFormat formats[2];
+    oni_VideoModeConstraints want;
+    oni_Capabilities caps, other, loaded;
+
+    for (i = 0; i < 4; ++i) {
+        modes[i].sensorType = oni_SENSOR_DEPTH;
+        modes[i].pixelFormat = PIXEL_FORMAT_DEPTH_1_MM;
+        modes[i].resolutionX = 640;
+        modes[i].resolutionY = 480;
+        modes[i].fps = 30;
+    }
+    modes[0].resolutionX = 320;
+    modes[0].resolutionY = 240;
+    modes[2].pixelFormat = PIXEL_FORMAT_DEPTH_100_UM;
+    modes[3].sensorType = oni_SENSOR_COLOR;
+    modes[3].pixelFormat = PIXEL_FORMAT_RGB888;
+    caps.usbVendorId = 0x1d27;
+    caps.usbProductId = 0x0600;
+    strcpy(caps.firmwareVersion, "5.8 beta");
+    caps.modeCount = 4;
+    caps.modes = modes;
+
+    memset(&want, 0, sizeof(want));
+    want.resolutionX = 300;
+    want.resolutionY = 200;
+    rc = oni_selectVideoMode_Capabilities(&caps, oni_SENSOR_DEPTH, &want,
+                                          &best);
+    expect(rc == oni_STATUS_OK && best.resolutionX == 320,
+           "mode selection: nearest resolution");
+    formats[0] = PIXEL_FORMAT_DEPTH_100_UM;
+    formats[1] = PIXEL_FORMAT_DEPTH_1_MM;
+    want.pixelFormats = formats;
+    want.pixelFormatCount = 2;
+    rc = oni_selectVideoMode_Capabilities(&caps, oni_SENSOR_DEPTH, &want,
+                                          &best);
+    expect(rc == oni_STATUS_OK && best.pixelFormat == PIXEL_FORMAT_DEPTH_100_UM,
+           "mode selection: pixel format preferred over resolution");
+    rc = oni_selectVideoMode_Capabilities(&caps, oni_SENSOR_COLOR, &want,
+                                          &best);
+    expect(rc == oni_STATUS_NOT_SUPPORTED,
+           "mode selection: no mode in an allowed format");
+    memset(&want, 0, sizeof(want));
+    want.minFps = 60;
+    rc = oni_selectVideoMode_Capabilities(&caps, oni_SENSOR_DEPTH, &want,
+                                          &best);
+    expect(rc == oni_STATUS_NOT_SUPPORTED, "mode selection: minimum fps");
+
+    close(mkstemp(path));
+    other = caps;
+    other.usbProductId = 0x0601;
+    other.modeCount = 1;
+    expect(oni_saveCapabilities(path, &other) == oni_STATUS_OK &&
+           oni_saveCapabilities(path, &caps) == oni_STATUS_OK,
+           "capability cache: save");
+    rc = oni_loadCapabilities(path, caps.usbVendorId, caps.usbProductId,
+                              caps.firmwareVersion, &loaded);
+    expect(rc == oni_STATUS_OK && loaded.modeCount == 4 &&
+           memcmp(loaded.modes, modes, sizeof(modes)) == 0,
+           "capability cache: round trip");
+    oni_release_Capabilities(&loaded);
+    rc = oni_loadCapabilities(path, other.usbVendorId, other.usbProductId,
+                              other.firmwareVersion, &loaded);
+    expect(rc == oni_STATUS_OK && loaded.modeCount == 1,
+           "capability cache: other device kept");
+    oni_release_Capabilities(&loaded);
+    rc = oni_loadCapabilities(path, caps.usbVendorId, caps.usbProductId,
+                              "5.9", &loaded);
+    expect(rc == oni_STATUS_NO_DEVICE, "capability cache: firmware is a key");
+    unlink(path);
+}
+
+// checkSharedFrames: A subscriber reads published frames in order, notices
+// when the slot it holds is overwritten, and skips what it fell behind on.
+void checkSharedFrames(oni_VideoStream * stream) {
+    int i, indices[4];
+    oni_FramePublisher * pub;
+    oni_FrameSubscriber * sub;
+    oni_SharedFrame first, frame;
+    oni_VideoFrameRef * ref = oni_new_VideoFrameRef(NULL);
+
+    oni_readFrame(stream, ref);
+    pub = oni_new_FramePublisher(NULL, 3, oni_getDataSize(ref));
+    sub = oni_new_FrameSubscriber_Fd(oni_getFd_FramePublisher(pub));
+    expect(oni_readFrame_FrameSubscriber(sub, &frame, 0) == oni_STATUS_TIME_OUT,
+           "shared frames: nothing published yet");
+
+    indices[0] = oni_getFrameIndex(ref);
+    oni_publish_FramePublisher(pub, ref);
+    expect(oni_readFrame_FrameSubscriber(sub, &first, 100) == oni_STATUS_OK &&
+           first.sequence == 0 && first.desc.frameIndex == indices[0] &&
+           first.desc.dataSize == oni_getDataSize(ref) &&
+           memcmp(first.desc.data, oni_getData(ref), first.desc.dataSize) == 0,
+           "shared frames: first frame intact");
+
+    for (i = 1; i < 4; ++i) {
+        oni_readFrame(stream, ref);
+        indices[i] = oni_getFrameIndex(ref);
+        oni_publish_FramePublisher(pub, ref);
+        if (i == 2) {
+            expect(oni_isValid_SharedFrame(sub, &first),
+                   "shared frames: valid until its slot is reused");
+        }
+    }
+    expect(!oni_isValid_SharedFrame(sub, &first),
+           "shared frames: overwritten slot detected");
+    expect(oni_readFrame_FrameSubscriber(sub, &frame, 0) == oni_STATUS_OK &&
+           frame.sequence == 2 && frame.dropped == 1 &&
+           frame.desc.frameIndex == indices[2],
+           "shared frames: skipped to the oldest safe frame");
+    expect(oni_readLatest_FrameSubscriber(sub, &frame, 0) == oni_STATUS_OK &&
+           frame.sequence == 3 && frame.desc.frameIndex == indices[3],
+           "shared frames: latest frame");
+    expect(oni_readFrame_FrameSubscriber(sub, &frame, 0) == oni_STATUS_TIME_OUT,
+           "shared frames: caught up");
+    oni_delete_FrameSubscriber(sub);
+    oni_delete_FramePublisher(pub);
+
+    pub = oni_new_FramePublisher(NULL, 3, oni_getDataSize(ref) - 1);
+    expect(oni_publish_FramePublisher(pub, ref) == oni_STATUS_BAD_PARAMETER,
+           "shared frames: oversized frame refused");
+    oni_delete_FramePublisher(pub);
+    oni_delete_VideoFrameRef(ref);
+}
+
+// checkFrameEvent: The descriptor is readable exactly while frames are
+// queued, and only the newest 'queueDepth' frames of a stream wait.
+void checkFrameEvent(oni_VideoStream * stream) {
+    int i, count;
+    struct pollfd pfd;
+    oni_VideoFrameRef * refs[4];
+    oni_VideoStream * streams[4];
+    oni_FrameEvent * event = oni_new_FrameEvent(2);
+
+    for (i = 0; i < 4; ++i) {
+        refs[i] = oni_new_VideoFrameRef(NULL);
+    }
+    pfd.fd = oni_getFd_FrameEvent(event);
+    pfd.events = POLLIN;
+    expect(poll(&pfd, 1, 0) == 0, "frame event: not readable while empty");
+    expect(oni_attach_FrameEvent(event, stream) == oni_STATUS_OK,
+           "frame event: attach");
+    expect(poll(&pfd, 1, 2000) == 1, "frame event: readable on a frame");
+
+    // Long enough for several frames to arrive, at any frame rate a depth
+    // sensor offers.
+    usleep(300000);
+    count = oni_takeFrames_FrameEvent(event, refs, streams, 1);
+    expect(count == 1 && streams[0] == stream &&
+           oni_isValid_VideoFrameRef(refs[0]), "frame event: take one");
+    expect(oni_getDroppedCount_FrameEvent(event) > 0,
+           "frame event: overflow dropped");
+    expect(poll(&pfd, 1, 0) == 1, "frame event: readable while frames remain");
+    count = oni_takeFrames_FrameEvent(event, refs + 1, NULL, 3);
+    expect(count >= 1 && count <= 2, "frame event: queue depth kept");
+    for (i = 1; i <= count; ++i) {
+        expect(oni_getFrameIndex(refs[i]) > oni_getFrameIndex(refs[i - 1]),
+               "frame event: frames in order");
+    }
+
+    oni_detach_FrameEvent(event, stream);
+    oni_takeFrames_FrameEvent(event, refs, NULL, 4);
+    expect(poll(&pfd, 1, 0) == 0, "frame event: not readable once drained");
+    for (i = 0; i < 4; ++i) {
+        oni_delete_VideoFrameRef(refs[i]);
+    }
+    oni_delete_FrameEvent(event);
+}
+
+// countFrame: Frame listener for checkFrameListener.
+void countFrame(oni_VideoStream * stream) {
+    if (oni_readFrame(stream, listenerFrame) == oni_STATUS_OK &&
+        oni_isValid_VideoFrameRef(listenerFrame))
+    {
+        ++framesSeen;
+    }
+}
+
+// checkFrameListener: Frames reach a listener, which can read them, until it
+// is removed.  The coroutine interface (C++20) is built on exactly this.
+void checkFrameListener(oni_VideoStream * stream) {
+    int i, seen;
+    oni_NewFrameListener listener;
+
+    listenerFrame = oni_new_VideoFrameRef(NULL);
+    framesSeen = 0;
+    listener.fnPtr = &countFrame;
+    expect(oni_addNewFrameListener(stream, &listener) == oni_STATUS_OK,
+           "frame listener: add");
+    for (i = 0; i < 200 && framesSeen < 3; ++i) {
+        usleep(10000);
+    }
+    oni_removeNewFrameListener(stream, &listener);
+    seen = framesSeen;
+    expect(seen >= 3, "frame listener: frames delivered");
+    usleep(100000);
+    expect(framesSeen == seen, "frame listener: none after removal");
+    oni_delete_VideoFrameRef(listenerFrame);
+    listenerFrame = NULL;
+}
+
+// tagItem: Pipeline stage that drops every fifth item and gives the others
+// their sequence number times ten as payload.
+bool tagItem(void * userData, oni_PipelineItem * item) {
+    uint64_t seq = oni_getSequence_PipelineItem(item);
+    int * tag;
+
+    (void) userData;
+    if (seq % 5 == 4) {
+        return false;
+    }
+    tag = (int *) malloc(sizeof(int));
+    *tag = (int) seq * 10;
+    oni_setPayload_PipelineItem(item, tag, sizeof(int), &releasePayload);
+    return true;
+}
+
+// logItem: Pipeline sink that records items into a pipelineLog.
+bool logItem(void * userData, oni_PipelineItem * item) {
+    pipelineLog * log = (pipelineLog *) userData;
+    int * tag = (int *) oni_getPayload_PipelineItem(item, NULL);
+
+    while (!log->open) {
+        usleep(1000);
+    }
+    if (log->count < 32) {
+        log->sequences[log->count] = oni_getSequence_PipelineItem(item);
+        log->payloads[log->count] = tag == NULL ? -1 : *tag;
+    }
+    ++log->count;
+    return true;
+}
+
+void releasePayload(void * payload) {
+    ++payloadsReleased;
+    free(payload);
+}
+
+// checkPipeline: Items pass through the stages in order with their payloads,
+// stages may drop items, and a full KEEP_LATEST edge keeps the newest.
+void checkPipeline() {
+    int i, src, tag, sink, edge;
+    bool inOrder = true;
+    pipelineLog log;
+    oni_PipelineStageStats stageStats;
+    oni_PipelineEdgeStats edgeStats;
+    oni_VideoFrameRef * frame = oni_new_VideoFrameRef(NULL);
+    oni_Pipeline * pipeline = oni_new_Pipeline();
+
+    memset(&log, 0, sizeof(log));
+    log.open = true;
+    payloadsReleased = 0;
+    src = oni_addSource_Pipeline(pipeline, "source", NULL);
+    tag = oni_addStage_Pipeline(pipeline, "tag", &tagItem, NULL);
+    sink = oni_addStage_Pipeline(pipeline, "sink", &logItem, &log);
+    oni_connect_Pipeline(pipeline, src, tag, 2, oni_BACKPRESSURE_BLOCK);
+    oni_connect_Pipeline(pipeline, tag, sink, 2, oni_BACKPRESSURE_BLOCK);
+    expect(oni_connect_Pipeline(pipeline, sink, src, 2,
+                                oni_BACKPRESSURE_BLOCK) == -1,
+           "pipeline: cycle refused");
+    expect(oni_push_Pipeline(pipeline, src, frame) == oni_STATUS_OUT_OF_FLOW,
+           "pipeline: push before start");
+
+    oni_start_Pipeline(pipeline, 0);
+    expect(oni_push_Pipeline(pipeline, sink, frame) ==
+           oni_STATUS_BAD_PARAMETER, "pipeline: push to a non-source");
+    for (i = 0; i < 20; ++i) {
+        oni_push_Pipeline(pipeline, src, frame);
+    }
+    // The last item is dropped by 'tag', so wait for that stage as well.
+    for (i = 0; i < 200; ++i) {
+        oni_getStageStats_Pipeline(pipeline, tag, &stageStats);
+        if (log.count >= 16 && stageStats.itemsProcessed == 20) {
+            break;
+        }
+        usleep(10000);
+    }
+    oni_stop_Pipeline(pipeline);
+    expect(log.count == 16, "pipeline: dropped items not passed on");
+    for (i = 0; i < 16 && i < log.count; ++i) {
+        uint64_t want = i + i / 4;
+        inOrder = inOrder && log.sequences[i] == want &&
+            log.payloads[i] == (int) want * 10;
+    }
+    expect(inOrder, "pipeline: items in order with their payloads");
+    oni_getStageStats_Pipeline(pipeline, tag, &stageStats);
+    expect(stageStats.itemsProcessed == 20 && stageStats.itemsDiscarded == 4,
+           "pipeline: stage stats");
+    expect(oni_push_Pipeline(pipeline, src, frame) == oni_STATUS_OUT_OF_FLOW,
+           "pipeline: push after stop");
+    oni_delete_Pipeline(pipeline);
+    expect(payloadsReleased == 16, "pipeline: payloads released");
+
+    memset(&log, 0, sizeof(log));
+    pipeline = oni_new_Pipeline();
+    src = oni_addSource_Pipeline(pipeline, "source", NULL);
+    sink = oni_addStage_Pipeline(pipeline, "sink", &logItem, &log);
+    edge = oni_connect_Pipeline(pipeline, src, sink, 1,
+                                oni_BACKPRESSURE_KEEP_LATEST);
+    oni_start_Pipeline(pipeline, 0);
+    for (i = 0; i < 10; ++i) {
+        oni_push_Pipeline(pipeline, src, frame);
+    }
+    log.open = true;
+    for (i = 0; i < 200 && (log.count == 0 ||
+                            log.sequences[log.count - 1] != 9); ++i)
+    {
+        usleep(10000);
+    }
+    oni_stop_Pipeline(pipeline);
+    oni_getEdgeStats_Pipeline(pipeline, edge, &edgeStats);
+    expect(log.count >= 1 && log.count <= 2 &&
+           log.sequences[log.count - 1] == 9, "pipeline: newest item kept");
+    expect(edgeStats.itemsPushed == 10 &&
+           edgeStats.itemsDropped == 10 - (uint64_t) log.count,
+           "pipeline: edge stats");
+    oni_delete_Pipeline(pipeline);
+    oni_delete_VideoFrameRef(frame);
+}
+
+// checkAllocationFree: Frame refs live in caller storage or come back from an
+// arena without it growing, and device lists can be refilled in place.
+void checkAllocationFree() {
+    int i, round, blocks = 0;
+    oni_VideoFrameRefStorage storage;
+    oni_VideoFrameRef * refs[5];
+    oni_VideoFrameRef * ref;
+    oni_Arena * arena = oni_new_Arena(4, 1);
+    oni_DeviceInfoArray * devices = oni_new_DeviceInfoArray();
+    oni_DeviceInfoArray * expected = oni_enumerateDevices();
+
+    expect(sizeof(storage) >= (size_t) oni_VIDEOFRAMEREF_SIZE &&
+           (uintptr_t) &storage % oni_VIDEOFRAMEREF_ALIGNMENT == 0,
+           "frame ref storage: size and alignment");
+    ref = oni_initVideoFrameRef(&storage);
+    expect(ref != NULL && !oni_isValid_VideoFrameRef(ref),
+           "frame ref storage: starts empty");
+    oni_deinitVideoFrameRef(ref);
+
+    for (round = 0; round < 3; ++round) {
+        for (i = 0; i < 5; ++i) {
+            refs[i] = oni_newVideoFrameRef_Arena(arena, NULL);
+        }
+        expect(refs[0] != refs[4], "arena: distinct refs");
+        for (i = 0; i < 5; ++i) {
+            oni_deleteVideoFrameRef_Arena(arena, refs[i]);
+        }
+        if (round == 0) {
+            blocks = oni_getBlockCount_Arena(arena);
+        }
+    }
+    expect(blocks == 3 && oni_getBlockCount_Arena(arena) == blocks,
+           "arena: grows once, then reuses");
+    oni_delete_Arena(arena);
+
+    for (round = 0; round < 2; ++round) {
+        expect(oni_enumerateDevicesInto(devices) ==
+               oni_getSize_DeviceInfoArray(expected),
+               "device list: refilled in place");
+    }
+    oni_delete_DeviceInfoArray(devices);
+    oni_delete_DeviceInfoArray(expected);
+}
+
+// checkFrameAccessors: The by-value accessors agree with the single getters
+// (which the inline C++ header mirrors), and a stream property set empties
+// the stream's cache.
+void checkFrameAccessors(oni_VideoStream * stream) {
+    int mirroring = 0, flipped, value = -1;
+    int size = sizeof(mirroring);
+    oni_FrameDescriptor desc;
+    oni_VideoModeInfo mode;
+    oni_VideoFrameRef * ref = oni_new_VideoFrameRef(NULL);
+
+    oni_readFrame(stream, ref);
+    expect(oni_getFrameDescriptor(ref, &desc) == oni_STATUS_OK &&
+           desc.data == oni_getData(ref) &&
+           desc.dataSize == oni_getDataSize(ref) &&
+           desc.width == oni_getWidth(ref) &&
+           desc.height == oni_getHeight(ref) &&
+           desc.strideInBytes == oni_getStrideInBytes(ref) &&
+           desc.sensorType == oni_getSensorType_VideoFrameRef(ref) &&
+           desc.frameIndex == oni_getFrameIndex(ref) &&
+           desc.timestamp == oni_getTimestamp(ref) &&
+           desc.croppingEnabled == oni_getCroppingEnabled(ref),
+           "frame descriptor: matches the getters");
+    mode = oni_getVideoModeInfo_VideoFrameRef(ref);
+    expect(mode.sensorType == oni_SENSOR_DEPTH &&
+           mode.pixelFormat == desc.pixelFormat,
+           "video mode info: matches the frame");
+    oni_release_VideoFrameRef(ref);
+    expect(oni_getFrameDescriptor(ref, &desc) == oni_STATUS_BAD_PARAMETER,
+           "frame descriptor: refused for an empty frame");
+    oni_delete_VideoFrameRef(ref);
+
+    oni_enablePropertyCache_VideoStream(stream, true);
+    if (oni_getProperty_VideoStream(stream, MIRRORING_PROPERTY, &mirroring,
+                                    &size) != oni_STATUS_OK)
+    {
+        printf("No mirroring property; skipping stream cache checks\n");
+    } else {
+        flipped = !mirroring;
+        oni_setProperty_VideoStream(stream, MIRRORING_PROPERTY, &flipped,
+                                    sizeof(flipped));
+        size = sizeof(value);
+        oni_getProperty_VideoStream(stream, MIRRORING_PROPERTY, &value, &size);
+        expect(value == flipped, "stream cache: emptied by a set");
+        oni_setProperty_VideoStream(stream, MIRRORING_PROPERTY, &mirroring,
+                                    sizeof(mirroring));
+    }
+    oni_enablePropertyCache_VideoStream(stream, false);
+}
+
+// depthDescriptor: Describe packed pixels as a DEPTH_1_MM frame.
+oni_FrameDescriptor depthDescriptor(const oni_DepthPixel * pixels, int width,
+                                    int height) {
+    oni_FrameDescriptor desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.data = pixels;
+    desc.dataSize = width * height * (int) sizeof(oni_DepthPixel);
+    desc.width = width;
+    desc.height = height;
+    desc.strideInBytes = width * (int) sizeof(oni_DepthPixel);
+    desc.sensorType = oni_SENSOR_DEPTH;
+    desc.pixelFormat = PIXEL_FORMAT_DEPTH_1_MM;
+    return desc;
+}
+
+// checkChangeDetector: Only tiles with a pixel changed by more than the
+// threshold are flagged, including the partial tiles at the edges, and a new
+// size or a reset counts as changed everywhere.
+void checkChangeDetector() {
+    int i;
+    oni_DepthPixel pixels[12 * 20];
+    oni_FrameDescriptor desc;
+    oni_ChangeResult result;
+    oni_ChangeDetector * detector = oni_new_ChangeDetector(8, 10, 0);
+
+    for (i = 0; i < 12 * 20; ++i) {
+        pixels[i] = 1000;
+    }
+    desc = depthDescriptor(pixels, 20, 12);
+    oni_updateDescriptor_ChangeDetector(detector, &desc, &result);
+    expect(result.tilesX == 3 && result.tilesY == 2 &&
+           result.changedTiles == 6 && result.bitmap[0] == 0x3f,
+           "change detection: first frame changed everywhere");
+    oni_updateDescriptor_ChangeDetector(detector, &desc, &result);
+    expect(result.changedTiles == 0 && result.bitmap[0] == 0 &&
+           result.score == 0, "change detection: same frame unchanged");
+
+    pixels[10 * 20 + 18] = 1011;
+    pixels[2 * 20 + 3] = 1010;
+    oni_updateDescriptor_ChangeDetector(detector, &desc, &result);
+    expect(result.changedTiles == 1 && result.bitmap[0] == 0x20 &&
+           result.changedPixels == 1 && fabs(result.score - 1.0 / 240) < 1e-6,
+           "change detection: one tile over the threshold");
+
+    desc.width = 10;
+    desc.strideInBytes = 20 * sizeof(oni_DepthPixel);
+    oni_updateDescriptor_ChangeDetector(detector, &desc, &result);
+    expect(result.tilesX == 2 && result.changedTiles == 4,
+           "change detection: new size changed everywhere");
+    oni_updateDescriptor_ChangeDetector(detector, &desc, &result);
+    expect(result.changedTiles == 0, "change detection: strided rows");
+    oni_reset_ChangeDetector(detector);
+    oni_updateDescriptor_ChangeDetector(detector, &desc, &result);
+    expect(result.changedTiles == 4, "change detection: reset");
+    oni_delete_ChangeDetector(detector);
+}
+
+// allPixels: Whether all 'count' pixels equal 'value'.
+bool allPixels(const oni_DepthPixel * pixels, int count, int value) {
+    int i;
+    for (i = 0; i < count; ++i) {
+        if (pixels[i] != value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// checkDepthFilter: Each filter against hand-worked results, and the same
+// output whatever the number of threads.
+void checkDepthFilter() {
+    int i, frame;
+    unsigned seed = 1;
+    static const int inputs[6] = { 1000, 1040, 0, 0, 0, 1500 };
+    static const int outputs[6] = { 1000, 1020, 1020, 1020, 0, 1500 };
+    static oni_DepthPixel noisy[48 * 64], serial[48 * 64];
+    oni_DepthPixel pixels[8 * 20];
+    const oni_DepthPixel * out;
+    oni_FrameDescriptor desc;
+    oni_DepthFilter * filter = oni_new_DepthFilter();
+
+    expect(oni_addMedian_DepthFilter(filter, 3) == -1 &&
+           oni_addTemporal_DepthFilter(filter, 0.0f, 10, 1) == -1 &&
+           oni_addHoleFill_DepthFilter(filter, 0) == -1,
+           "depth filter: bad parameters refused");
+    oni_addMedian_DepthFilter(filter, 1);
+    for (i = 0; i < 8 * 20; ++i) {
+        pixels[i] = 1000;
+    }
+    pixels[4 * 20 + 10] = 5000;
+    pixels[2 * 20 + 5] = 0;
+    desc = depthDescriptor(pixels, 20, 8);
+    out = oni_applyDescriptor_DepthFilter(filter, &desc);
+    expect(out != NULL && out[4 * 20 + 10] == 1000 && out[2 * 20 + 5] == 1000,
+           "median: spike and hole removed");
+    oni_delete_DepthFilter(filter);
+
+    filter = oni_new_DepthFilter();
+    oni_addHoleFill_DepthFilter(filter, 2);
+    for (i = 0; i < 8 * 20; ++i) {
+        pixels[i] = 1000;
+    }
+    pixels[7] = 1200;
+    pixels[5] = pixels[6] = 0;
+    pixels[20 + 5] = pixels[20 + 6] = pixels[20 + 7] = 0;
+    pixels[2 * 20] = 0;
+    out = oni_applyDescriptor_DepthFilter(filter, &desc);
+    expect(out != NULL && out[5] == 1200 && out[6] == 1200,
+           "hole fill: gap takes the farther side");
+    expect(out != NULL && out[20 + 6] == 0 && out[2 * 20] == 0,
+           "hole fill: wide and open gaps kept");
+    oni_delete_DepthFilter(filter);
+
+    filter = oni_new_DepthFilter();
+    oni_addTemporal_DepthFilter(filter, 0.5f, 100, 2);
+    for (frame = 0; frame < 6; ++frame) {
+        for (i = 0; i < 8 * 20; ++i) {
+            pixels[i] = (oni_DepthPixel) inputs[frame];
+        }
+        out = oni_applyDescriptor_DepthFilter(filter, &desc);
+        expect(out != NULL && allPixels(out, 8 * 20, outputs[frame]),
+               "temporal: smoothing, hold and restart");
+    }
+    oni_delete_DepthFilter(filter);
+
+    filter = oni_new_DepthFilter();
+    oni_addBilateral_DepthFilter(filter, 2, 1.5f, 30.0f);
+    for (i = 0; i < 48 * 64; ++i) {
+        seed = seed * 1103515245 + 12345;
+        noisy[i] = (seed >> 16) % 8 == 0 ? 0 :
+            (oni_DepthPixel) (1000 + (i % 64) * 4 + (seed >> 16) % 40);
+    }
+    desc = depthDescriptor(noisy, 64, 48);
+    oni_setParallelism(1);
+    memcpy(serial, oni_applyDescriptor_DepthFilter(filter, &desc),
+           sizeof(serial));
+    oni_setParallelism(4);
+    expect(oni_getParallelism() == 4, "parallelism: set");
+    out = oni_applyDescriptor_DepthFilter(filter, &desc);
+    expect(memcmp(out, serial, sizeof(serial)) == 0,
+           "bilateral: same output on four threads");
+    oni_setParallelism(0);
+
+    desc.pixelFormat = PIXEL_FORMAT_GRAY8;
+    expect(oni_applyDescriptor_DepthFilter(filter, &desc) == NULL,
+           "depth filter: not a depth frame");
+    oni_delete_DepthFilter(filter);
+}
+
+// checkDepthPyramid: Each decimation mode on blocks worked out by hand, with
+// strided input and the leftover edges dropped, and the levels of eager and
+// lazy pyramids.
+void checkDepthPyramid() {
+    int i, lazy, width, height;
+    oni_DepthPixel in[5 * 10], out[2 * 4], flat[8 * 16];
+    const oni_DepthPixel * level;
+    oni_FrameDescriptor desc;
+    oni_DepthPyramid * pyramid;
+
+    // 9 x 5 pixels in rows of 10; the 10th column is not part of the image.
+    for (i = 0; i < 5 * 10; ++i) {
+        in[i] = i % 10 == 9 ? 9999 : 500;
+    }
+    in[0] = 1000;
+    in[1] = 0;
+    in[10] = 1003;
+    in[11] = 1010;
+    in[2] = in[3] = in[12] = in[13] = 0;
+    in[4] = 10;
+    in[5] = 20;
+    in[14] = 30;
+    in[15] = 40;
+    expect(oni_decimateDepth(in, 9, 5, 10 * sizeof(oni_DepthPixel), 2,
+                             oni_DECIMATE_MIN, out) == oni_STATUS_OK &&
+           out[0] == 1000 && out[1] == 0 && out[2] == 10 && out[3] == 500 &&
+           out[4] == 500 && out[7] == 500, "decimation: min");
+    oni_decimateDepth(in, 9, 5, 10 * sizeof(oni_DepthPixel), 2,
+                      oni_DECIMATE_MEDIAN, out);
+    expect(out[0] == 1003 && out[1] == 0 && out[2] == 30,
+           "decimation: median");
+    oni_decimateDepth(in, 9, 5, 10 * sizeof(oni_DepthPixel), 2,
+                      oni_DECIMATE_MEAN, out);
+    expect(out[0] == 1004 && out[1] == 0 && out[2] == 25, "decimation: mean");
+    expect(oni_decimateDepth(in, 9, 5, 10 * sizeof(oni_DepthPixel), 3,
+                             oni_DECIMATE_MIN, out) ==
+           oni_STATUS_BAD_PARAMETER, "decimation: bad factor");
+
+    for (i = 0; i < 8 * 16; ++i) {
+        flat[i] = 700;
+    }
+    desc = depthDescriptor(flat, 16, 8);
+    for (lazy = 0; lazy < 2; ++lazy) {
+        pyramid = oni_new_DepthPyramid(3, 2, oni_DECIMATE_MEDIAN, lazy);
+        expect(oni_getLevel_DepthPyramid(pyramid, 0, NULL, NULL) == NULL,
+               "pyramid: empty before a frame");
+        oni_setDescriptor_DepthPyramid(pyramid, &desc);
+        expect(oni_getLevelCount_DepthPyramid(pyramid) == 3,
+               "pyramid: level count");
+        for (i = 0; i < 3; ++i) {
+            level = oni_getLevel_DepthPyramid(pyramid, i, &width, &height);
+            expect(level != NULL && width == 16 >> i && height == 8 >> i &&
+                   allPixels(level, width * height, 700), "pyramid: levels");
+        }
+        expect(oni_getLevel_DepthPyramid(pyramid, 3, NULL, NULL) == NULL,
+               "pyramid: level out of range");
+        oni_delete_DepthPyramid(pyramid);
+    }
+    expect(oni_new_DepthPyramid(3, 2, 99, false) == NULL,
+           "pyramid: bad mode refused");
+}
+
+// checkFrameStats: Statistics, histogram and validity mask of a small frame
+// worked out by hand, and of a taller one split across threads.
+void checkFrameStats() {
+    int i;
+    static const oni_DepthPixel small[2 * 5] = {
+        0, 100, 199, 200, 399,
+        400, 401, 0, 50, 1000
+    };
+    oni_DepthPixel tall[40 * 10];
+    uint32_t histogram[4];
+    uint8_t mask[50];
+    oni_FrameStats stats;
+    oni_FrameDescriptor desc = depthDescriptor(small, 5, 2);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.histogram = histogram;
+    stats.histogramBins = 4;
+    stats.histogramMin = 0;
+    stats.histogramMax = 399;
+    stats.validMask = mask;
+    stats.validMaskSize = 2;
+    expect(oni_computeDescriptorStats(&desc, &stats) == oni_STATUS_OK &&
+           stats.validCount == 8 && stats.minValue == 50 &&
+           stats.maxValue == 1000 && stats.mean == 2749.0 / 8,
+           "frame stats: min, max and mean of valid pixels");
+    expect(histogram[0] == 1 && histogram[1] == 2 && histogram[2] == 1 &&
+           histogram[3] == 1, "frame stats: histogram");
+    expect(mask[0] == 0x7e && mask[1] == 0x03, "frame stats: validity mask");
+
+    desc.sensorType = oni_SENSOR_IR;
+    desc.pixelFormat = PIXEL_FORMAT_GRAY16;
+    oni_computeDescriptorStats(&desc, &stats);
+    expect(stats.validCount == 10 && stats.minValue == 0,
+           "frame stats: every GRAY16 pixel valid");
+    stats.validMaskSize = 1;
+    expect(oni_computeDescriptorStats(&desc, &stats) ==
+           oni_STATUS_BAD_PARAMETER, "frame stats: mask too small");
+
+    for (i = 0; i < 40 * 10; ++i) {
+        tall[i] = 123;
+    }
+    tall[37 * 10 + 1] = 0;
+    desc = depthDescriptor(tall, 10, 40);
+    stats.validMaskSize = sizeof(mask);
+    oni_setParallelism(4);
+    oni_computeDescriptorStats(&desc, &stats);
+    oni_setParallelism(0);
+    expect(stats.validCount == 399 && stats.mean == 123 &&
+           histogram[1] == 399, "frame stats: split across threads");
+    expect(mask[371 / 8] == (uint8_t) ~(1 << (371 % 8)) && mask[0] == 0xff &&
+           mask[49] == 0xff, "frame stats: mask split across threads");
+}
+
+// testIntrinsics: A 60-pixel focal length centered on the image, so that a
+// 32 x 24 image sees about 30 degrees by 22.
+oni_CameraIntrinsics testIntrinsics(int width, int height) {
+    oni_CameraIntrinsics intrinsics;
+    intrinsics.width = width;
+    intrinsics.height = height;
+    intrinsics.fx = 60.0f;
+    intrinsics.fy = 60.0f;
+    intrinsics.cx = (width - 1) / 2.0f;
+    intrinsics.cy = (height - 1) / 2.0f;
+    return intrinsics;
+}
+
+// checkNormals: Normals of a plane tilted about the vertical axis, by both
+// methods, face the camera with no curvature, and pixels without a normal
+// are NaN.
+void checkNormals() {
+    int x, y, method;
+    static oni_DepthPixel depth[24 * 32];
+    static float normals[3 * 24 * 32], curvature[24 * 32];
+    const float * n = normals + 3 * (12 * 32 + 16);
+    oni_CameraIntrinsics intrinsics = testIntrinsics(32, 24);
+    oni_FrameDescriptor desc = depthDescriptor(depth, 32, 24);
+
+    // The plane Z = 3000 + X / 2, whose normal towards the camera is
+    // (1, 0, -2) / sqrt(5).
+    for (y = 0; y < 24; ++y) {
+        for (x = 0; x < 32; ++x) {
+            float rx = (x - intrinsics.cx) / intrinsics.fx;
+            depth[y * 32 + x] = (oni_DepthPixel) lrintf(3000 / (1 - rx / 2));
+        }
+    }
+    depth[5 * 32 + 5] = 0;
+    for (method = 0; method < 2; ++method) {
+        oni_Status rc = oni_computeDescriptorNormals(
+            &desc, &intrinsics, method == 0 ? oni_NORMALS_CROSS_PRODUCT :
+            oni_NORMALS_INTEGRAL_IMAGE, 2, 0.05f, normals, curvature);
+        expect(rc == oni_STATUS_OK &&
+               (n[0] - 2 * n[2]) / sqrtf(5.0f) > 0.999f &&
+               fabsf(n[1]) < 0.01f, "normals: tilted plane");
+        expect(curvature[12 * 32 + 16] < 0.001f, "normals: plane is flat");
+        expect(isnan(normals[0]) && isnan(normals[3 * (5 * 32 + 5)]) &&
+               isnan(curvature[5 * 32 + 5]), "normals: border and hole");
+    }
+}
+
+// near: Whether 'value' is within a thousandth (relative, for large values)
+// of 'expected'.
+bool near(float value, float expected) {
+    return fabsf(value - expected) <= 1e-3f * (1.0f + fabsf(expected));
+}
+
+// checkPointCloud: Points of a 4 x 2 frame worked out by hand, with colors
+// from a registered color frame of the same or twice the size, a depth range,
+// and voxel centroids.
+void checkPointCloud() {
+    int i, count, x, y;
+    bool found = false;
+    oni_DepthPixel depth[2 * 4] = { 1000, 1000, 1000, 1000,
+                                    1000, 0, 1000, 2000 };
+    oni_RGB888Pixel rgb[4 * 8];
+    const oni_PointXYZRGB * points;
+    oni_CameraIntrinsics intrinsics;
+    oni_FrameDescriptor desc = depthDescriptor(depth, 4, 2);
+    oni_FrameDescriptor color = desc;
+    oni_PointCloud * cloud = oni_new_PointCloud(0);
+
+    intrinsics.width = 4;
+    intrinsics.height = 2;
+    intrinsics.fx = intrinsics.fy = 100.0f;
+    intrinsics.cx = 1.5f;
+    intrinsics.cy = 0.5f;
+    for (y = 0; y < 4; ++y) {
+        for (x = 0; x < 8; ++x) {
+            rgb[y * 8 + x].r = (uint8_t) (10 * x);
+            rgb[y * 8 + x].g = (uint8_t) (100 * y);
+            rgb[y * 8 + x].b = 7;
+        }
+    }
+    color.data = rgb;
+    color.strideInBytes = 8 * sizeof(oni_RGB888Pixel);
+    color.sensorType = oni_SENSOR_COLOR;
+    color.pixelFormat = PIXEL_FORMAT_RGB888;
+
+    oni_buildDescriptor_PointCloud(cloud, &desc, &color, &intrinsics);
+    points = oni_getPoints_PointCloud(cloud, &count);
+    expect(count == 7 && near(points[0].x, -15) && near(points[0].y, 5) &&
+           near(points[0].z, 1000) && near(points[5].x, 5) &&
+           near(points[5].y, -5) && near(points[6].z, 2000),
+           "point cloud: points in row order");
+    expect(points[1].r == 10 && points[1].g == 0 && points[5].r == 20 &&
+           points[5].g == 100 && points[5].b == 7 && points[5].a == 255,
+           "point cloud: registered colors");
+
+    color.width = 8;
+    color.height = 4;
+    oni_buildDescriptor_PointCloud(cloud, &desc, &color, &intrinsics);
+    points = oni_getPoints_PointCloud(cloud, &count);
+    expect(count == 7 && points[5].r == 40 && points[5].g == 200,
+           "point cloud: larger color frame scaled");
+
+    oni_setDepthRange_PointCloud(cloud, 0, 1500);
+    oni_buildDescriptor_PointCloud(cloud, &desc, NULL, &intrinsics);
+    points = oni_getPoints_PointCloud(cloud, &count);
+    expect(count == 6 && points[0].r == 0 && points[0].a == 255,
+           "point cloud: depth range, no color");
+    oni_delete_PointCloud(cloud);
+
+    // Ten-meter voxels split the points only by the signs of X and Y.
+    cloud = oni_new_PointCloud(10000);
+    color.width = 4;
+    color.height = 2;
+    oni_buildDescriptor_PointCloud(cloud, &desc, &color, &intrinsics);
+    points = oni_getPoints_PointCloud(cloud, &count);
+    expect(count == 4, "voxels: one point per voxel");
+    for (i = 0; i < count; ++i) {
+        if (points[i].x < 0 && points[i].y > 0) {
+            found = near(points[i].x, -10) && near(points[i].y, 5) &&
+                near(points[i].z, 1000) && points[i].r == 5 &&
+                points[i].g == 0 && points[i].b == 7;
+        }
+    }
+    expect(found, "voxels: centroid and mean color");
+    oni_delete_PointCloud(cloud);
+}
+
+// checkPlanes: A wall facing the camera and a smaller plane tilted away from
+// it are found, largest first, and labeled.
+void checkPlanes() {
+    int x, y, count = 0, width, height;
+    static oni_DepthPixel depth[48 * 64];
+    const uint8_t * labels;
+    oni_Plane planes[4];
+    oni_CameraIntrinsics intrinsics = testIntrinsics(64, 48);
+    oni_FrameDescriptor desc = depthDescriptor(depth, 64, 48);
+    oni_PlaneDetector * detector = oni_new_PlaneDetector(4, 10.0f, 100);
+
+    // Columns 0-39: Z = 2000.  Columns 40-63: Z = 1200 + X / 2, whose normal
+    // towards the camera is (1, 0, -2) / sqrt(5).
+    for (y = 0; y < 48; ++y) {
+        for (x = 0; x < 64; ++x) {
+            float rx = (x - intrinsics.cx) / intrinsics.fx;
+            depth[y * 64 + x] = (oni_DepthPixel) (x < 40 ? 2000 :
+                                                  lrintf(1200 / (1 - rx / 2)));
+        }
+    }
+    oni_setSubsample_PlaneDetector(detector, 2);
+    expect(oni_detectDescriptor_PlaneDetector(detector, &desc, &intrinsics,
+                                              planes, &count) ==
+           oni_STATUS_OK && count == 2, "planes: both found");
+    expect(count >= 1 && planes[0].nz < -0.999f && near(planes[0].d, 2000) &&
+           near(planes[0].centroidZ, 2000), "planes: wall");
+    expect(count >= 2 && planes[1].inliers < planes[0].inliers &&
+           (planes[1].nx - 2 * planes[1].nz) / sqrtf(5.0f) > 0.99f,
+           "planes: tilted plane");
+    labels = oni_getLabels_PlaneDetector(detector, &width, &height);
+    expect(width == 64 && height == 48 && labels[10 * 64 + 10] == 1 &&
+           labels[10 * 64 + 55] == 2, "planes: labels");
+
+    // Starting from the last frame's planes must find the same ones.
+    oni_detectDescriptor_PlaneDetector(detector, &desc, &intrinsics, planes,
+                                       &count);
+    expect(count == 2 && near(planes[0].d, 2000), "planes: refined");
+    oni_delete_PlaneDetector(detector);
+}
+
+// translation: A pose that only moves the camera.
+oni_SensorPose translation(float x, float y, float z) {
+    oni_SensorPose pose;
+    memset(&pose, 0, sizeof(pose));
+    pose.rotation[0] = pose.rotation[4] = pose.rotation[8] = 1.0f;
+    pose.translation[0] = x;
+    pose.translation[1] = y;
+    pose.translation[2] = z;
+    return pose;
+}
+
+// checkOccupancyGrid: From a camera one meter up, a wall two meters ahead
+// fills its cells as occupied and a stretch of floor farther on as free.
+void checkOccupancyGrid() {
+    int x, y, columns, rows;
+    static oni_DepthPixel depth[24 * 32];
+    const uint8_t * cells;
+    const float * heights;
+    oni_CameraIntrinsics intrinsics = testIntrinsics(32, 24);
+    oni_FrameDescriptor desc = depthDescriptor(depth, 32, 24);
+    oni_SensorPose pose = translation(0, 1000, 0);
+    oni_OccupancyGrid * grid = oni_new_OccupancyGrid(20, 50, 200.0f,
+                                                     -2000.0f, 0.0f);
+
+    // The upper half sees the wall at Z = 2000, the lower half the floor at
+    // a height of 0, i.e. 1000 below the camera.
+    for (y = 0; y < 24; ++y) {
+        for (x = 0; x < 32; ++x) {
+            depth[y * 32 + x] = (oni_DepthPixel) (y < 12 ? 2000 :
+                lrintf(1000 * intrinsics.fy / (y - intrinsics.cy)));
+        }
+    }
+    oni_integrateDescriptor_OccupancyGrid(grid, &desc, &intrinsics, &pose);
+    cells = oni_getOccupancy_OccupancyGrid(grid, &columns, &rows);
+    heights = oni_getHeightMap_OccupancyGrid(grid, NULL, NULL);
+    expect(columns == 20 && rows == 50, "occupancy: grid size");
+    expect(cells[10 * 20 + 10] == oni_OCCUPANCY_OCCUPIED &&
+           cells[10 * 20 + 7] == oni_OCCUPANCY_OCCUPIED,
+           "occupancy: wall occupied");
+    expect(near(heights[10 * 20 + 10], 1000 + 11.5f * 2000 / 60),
+           "occupancy: wall height");
+    // Image row 21 sees the floor 6316 ahead, in grid row 31.
+    expect(cells[31 * 20 + 10] == oni_OCCUPANCY_FREE,
+           "occupancy: floor free");
+    expect(cells[3 * 20 + 10] == oni_OCCUPANCY_UNKNOWN &&
+           cells[10 * 20 + 1] == oni_OCCUPANCY_UNKNOWN &&
+           isnan(heights[3 * 20 + 10]), "occupancy: unseen cells unknown");
+
+    oni_clear_OccupancyGrid(grid);
+    cells = oni_getOccupancy_OccupancyGrid(grid, NULL, NULL);
+    expect(cells[10 * 20 + 10] == oni_OCCUPANCY_UNKNOWN, "occupancy: clear");
+    oni_setHeightBand_OccupancyGrid(grid, 50, 1200);
+    oni_integrateDescriptor_OccupancyGrid(grid, &desc, &intrinsics, &pose);
+    heights = oni_getHeightMap_OccupancyGrid(grid, NULL, NULL);
+    expect(heights[10 * 20 + 10] <= 1200, "occupancy: height band");
+    oni_delete_OccupancyGrid(grid);
+}
+
+// checkTsdf: A fused wall raycasts back at its depth, facing the camera, from
+// where it was seen and from half a meter farther back.
+void checkTsdf() {
+    int i;
+    static oni_DepthPixel depth[24 * 32], rendered[24 * 32];
+    static float normals[3 * 24 * 32];
+    const int center = 12 * 32 + 16;
+    oni_CameraIntrinsics intrinsics = testIntrinsics(32, 24);
+    oni_FrameDescriptor desc = depthDescriptor(depth, 32, 24);
+    oni_SensorPose back = translation(0, 0, -500);
+    oni_TsdfVolume * volume = oni_new_TsdfVolume(10.0f, 40.0f);
+
+    for (i = 0; i < 24 * 32; ++i) {
+        depth[i] = 1500;
+    }
+    for (i = 0; i < 3; ++i) {
+        oni_integrateDescriptor_TsdfVolume(volume, &desc, &intrinsics, NULL);
+    }
+    expect(oni_getBlockCount_TsdfVolume(volume) > 0, "tsdf: blocks allocated");
+    oni_raycast_TsdfVolume(volume, &intrinsics, NULL, rendered, normals);
+    expect(abs(rendered[center] - 1500) <= 5 &&
+           near(normals[3 * center + 2], -1), "tsdf: raycast in place");
+    oni_raycast_TsdfVolume(volume, &intrinsics, &back, rendered, NULL);
+    expect(abs(rendered[center] - 2000) <= 5, "tsdf: raycast from behind");
+
+    oni_reset_TsdfVolume(volume);
+    oni_raycast_TsdfVolume(volume, &intrinsics, NULL, rendered, normals);
+    expect(oni_getBlockCount_TsdfVolume(volume) == 0 &&
+           allPixels(rendered, 24 * 32, 0) && isnan(normals[3 * center]),
+           "tsdf: reset");
+    oni_delete_TsdfVolume(volume);
+}
+
+// renderPit: What a camera 'z' mm along its axis sees of a pyramid-shaped
+// pit, Z = 2000 + |X| / 2 + |Y| / 4, whose four faces pin down all six
+// degrees of freedom for ICP.
+void renderPit(oni_DepthPixel * depth, oni_CameraIntrinsics intrinsics,
+               float z) {
+    int x, y;
+    for (y = 0; y < intrinsics.height; ++y) {
+        for (x = 0; x < intrinsics.width; ++x) {
+            float u = (x - intrinsics.cx) / intrinsics.fx;
+            float v = (y - intrinsics.cy) / intrinsics.fy;
+            float t = (2000 - z) / (1 - fabsf(u) / 2 - fabsf(v) / 4);
+            depth[y * intrinsics.width + x] = (oni_DepthPixel)(t + 0.5f);
+        }
+    }
+}
+
+// checkOdometry: A repeated frame stays put, and stepping 30 mm into the
+// pit is recovered as that translation.
+void checkOdometry() {
+    static oni_DepthPixel depth[48 * 64];
+    oni_CameraIntrinsics intrinsics = testIntrinsics(64, 48);
+    oni_FrameDescriptor desc = depthDescriptor(depth, 64, 48);
+    oni_SensorPose pose;
+    oni_OdometryStats stats;
+    oni_Odometry * odometry = oni_new_Odometry(3);
+
+    renderPit(depth, intrinsics, 0);
+    oni_trackDescriptor_Odometry(odometry, &desc, &intrinsics, &pose, &stats);
+    oni_trackDescriptor_Odometry(odometry, &desc, &intrinsics, &pose, &stats);
+    expect(stats.tracked && stats.inliers > 64 * 48 / 2 &&
+           fabsf(pose.translation[0]) < 1 && fabsf(pose.translation[1]) < 1 &&
+           fabsf(pose.translation[2]) < 1 && near(pose.rotation[0], 1) &&
+           near(pose.rotation[4], 1) && near(pose.rotation[8], 1),
+           "odometry: still");
+
+    renderPit(depth, intrinsics, 30);
+    oni_trackDescriptor_Odometry(odometry, &desc, &intrinsics, &pose, &stats);
+    expect(stats.tracked && fabsf(pose.translation[0]) < 2 &&
+           fabsf(pose.translation[1]) < 2 &&
+           fabsf(pose.translation[2] - 30) < 2, "odometry: forward");
+
+    oni_reset_Odometry(odometry, NULL);
+    oni_trackDescriptor_Odometry(odometry, &desc, &intrinsics, &pose, &stats);
+    expect(fabsf(pose.translation[2]) < 1e-3f, "odometry: reset");
+    oni_delete_Odometry(odometry);
+}
+
+// fillBox: Set the inclusive box (x0, y0)-(x1, y1) of a depth image.
+void fillBox(oni_DepthPixel * depth, int width, int x0, int y0, int x1,
+             int y1, int value) {
+    int x, y;
+    for (y = y0; y <= y1; ++y) {
+        for (x = x0; x <= x1; ++x) {
+            depth[y * width + x] = (oni_DepthPixel)value;
+        }
+    }
+}
+
+// checkBlobs: Boxes in front of a wall become blobs, largest first, keep
+// their ids as they move, and speckles stay foreground without being blobs.
+void checkBlobs() {
+    static oni_DepthPixel depth[24 * 32];
+    oni_CameraIntrinsics intrinsics = testIntrinsics(32, 24);
+    oni_FrameDescriptor desc = depthDescriptor(depth, 32, 24);
+    oni_Blob blobs[4];
+    int count = -1, width = 0, height = 0, id;
+    const uint8_t * labels;
+    const uint8_t * foreground;
+    oni_BlobTracker * tracker = oni_new_BlobTracker(4, 100.0f, 5);
+
+    fillBox(depth, 32, 0, 0, 31, 23, 3000);
+    oni_updateDescriptor_BlobTracker(tracker, &desc, &intrinsics, blobs,
+                                     &count);
+    expect(count == 0, "blobs: background frame");
+
+    fillBox(depth, 32, 4, 3, 9, 8, 1500);
+    fillBox(depth, 32, 20, 4, 22, 6, 2000);
+    fillBox(depth, 32, 25, 20, 26, 20, 1500);
+    oni_updateDescriptor_BlobTracker(tracker, &desc, &intrinsics, blobs,
+                                     &count);
+    expect(count == 2 && blobs[0].pixels == 36 && blobs[0].age == 1 &&
+           blobs[0].minX == 4 && blobs[0].minY == 3 && blobs[0].maxX == 9 &&
+           blobs[0].maxY == 8 && near(blobs[0].centroidX, 6.5f) &&
+           near(blobs[0].center[2], 1500) && blobs[1].pixels == 9 &&
+           near(blobs[1].center[2], 2000) && blobs[0].id != blobs[1].id,
+           "blobs: found");
+    labels = oni_getLabels_BlobTracker(tracker, &width, &height);
+    foreground = oni_getForeground_BlobTracker(tracker, &width, &height);
+    expect(width == 32 && height == 24 && labels[5 * 32 + 6] == 1 &&
+           labels[5 * 32 + 21] == 2 && labels[0] == 0 &&
+           labels[20 * 32 + 25] == 0 && foreground[20 * 32 + 25] == 1 &&
+           foreground[0] == 0, "blobs: labels");
+
+    id = blobs[0].id;
+    fillBox(depth, 32, 0, 0, 31, 23, 3000);
+    fillBox(depth, 32, 5, 3, 10, 8, 1500);
+    oni_updateDescriptor_BlobTracker(tracker, &desc, &intrinsics, blobs,
+                                     &count);
+    expect(count == 1 && blobs[0].id == id && blobs[0].age == 2 &&
+           blobs[0].minX == 5, "blobs: tracked");
+    oni_delete_BlobTracker(tracker);
+}
+
+// checkToneMapper: A ramp of depths 1 to 100 stretches over the whole 8-bit
+// range in order, percentiles cut off missing pixels and outliers, gamma
+// brightens it and a reused histogram lags a frame behind.
+void checkToneMapper() {
+    int i;
+    static oni_DepthPixel depth[10 * 10];
+    uint8_t out[10 * 10], linear[10 * 10];
+    int low = -1, high = -1;
+    bool ordered = true;
+    oni_FrameDescriptor desc = depthDescriptor(depth, 10, 10);
+    oni_ToneMapper * mapper = oni_new_ToneMapper(4095);
+
+    for (i = 0; i < 100; ++i) {
+        depth[i] = (oni_DepthPixel)(i + 1);
+    }
+    oni_setPercentiles_ToneMapper(mapper, 0, 100);
+    oni_mapDescriptor_ToneMapper(mapper, &desc, out);
+    oni_getRange_ToneMapper(mapper, &low, &high);
+    for (i = 1; i < 100; ++i) {
+        ordered = ordered && out[i] >= out[i - 1];
+    }
+    expect(low == 1 && high == 100 && out[0] == 0 && out[99] == 255 &&
+           ordered && abs(out[50] - 129) <= 1, "tone map: stretch");
+
+    depth[0] = 0;
+    depth[99] = 4095;
+    oni_setPercentiles_ToneMapper(mapper, 2, 98);
+    oni_mapDescriptor_ToneMapper(mapper, &desc, linear);
+    oni_getRange_ToneMapper(mapper, &low, &high);
+    expect(low == 3 && high == 99 && linear[0] == 0 && linear[1] == 0 &&
+           linear[98] == 255 && linear[99] == 255, "tone map: percentiles");
+
+    oni_setGamma_ToneMapper(mapper, 2);
+    oni_mapDescriptor_ToneMapper(mapper, &desc, out);
+    expect(out[0] == 0 && out[50] > linear[50] + 40, "tone map: gamma");
+    oni_setGamma_ToneMapper(mapper, 1);
+
+    oni_setReuseHistogram_ToneMapper(mapper, true);
+    oni_mapDescriptor_ToneMapper(mapper, &desc, out);
+    expect(memcmp(out, linear, sizeof(out)) == 0, "tone map: first reuse");
+    for (i = 0; i < 100; ++i) {
+        depth[i] = (oni_DepthPixel)(1000 + i);
+    }
+    oni_mapDescriptor_ToneMapper(mapper, &desc, out);
+    expect(out[0] == 255, "tone map: reused histogram");
+    oni_mapDescriptor_ToneMapper(mapper, &desc, out);
+    oni_getRange_ToneMapper(mapper, &low, &high);
+    expect(low == 1002 && high == 1097 && out[0] == 0 && out[99] == 255,
+           "tone map: caught up");
+    oni_delete_ToneMapper(mapper);
+}
+
+// nearByte: Whether a decoded 8-bit sample is within JPEG's rounding of
+// 'expected'.
+bool nearByte(int value, int expected) {
+    return abs(value - expected) <= 3;
+}
+
+// checkJpegDecoder: Frames come back in the order submitted, a corrupt one
+// with its error, at most 'maxPending' at a time, and scaled to gray.
+void checkJpegDecoder() {
+    int i;
+    uint8_t corrupt[sizeof(testJpeg)];
+    const uint8_t * pixels;
+    oni_DecodedFrame frames[3];
+    uint64_t sequence = 99;
+    oni_FrameDescriptor desc;
+    oni_FrameDescriptor bad;
+    oni_JpegDecoder * decoder = oni_new_JpegDecoder(2, 3);
+
+    if (decoder == NULL) {
+        printf("No libjpeg; skipping decoder checks\n");
+        return;
+    }
+    memset(&desc, 0, sizeof(desc));
+    desc.data = testJpeg;
+    desc.dataSize = (int) sizeof(testJpeg);
+    desc.width = 16;
+    desc.height = 8;
+    desc.sensorType = oni_SENSOR_COLOR;
+    desc.pixelFormat = PIXEL_FORMAT_JPEG;
+    bad = desc;
+    bad.pixelFormat = PIXEL_FORMAT_GRAY8;
+    memcpy(corrupt, testJpeg, sizeof(testJpeg));
+    memset(corrupt, 0, 16);
+
+    expect(oni_submitDescriptor_JpegDecoder(decoder, &bad, NULL) ==
+           oni_STATUS_BAD_PARAMETER, "jpeg: not a jpeg");
+    for (i = 0; i < 3; ++i) {
+        desc.frameIndex = i + 1;
+        desc.data = i == 1 ? corrupt : testJpeg;
+        oni_submitDescriptor_JpegDecoder(decoder, &desc, &sequence);
+    }
+    expect(sequence == 2 && oni_getPending_JpegDecoder(decoder) == 3 &&
+           oni_submitDescriptor_JpegDecoder(decoder, &desc, NULL) ==
+           oni_STATUS_OUT_OF_FLOW, "jpeg: pending limit");
+    for (i = 0; i < 3; ++i) {
+        oni_receive_JpegDecoder(decoder, &frames[i], 1000);
+    }
+    pixels = (const uint8_t *) frames[0].desc.data;
+    expect(frames[0].sequence == 0 && frames[1].sequence == 1 &&
+           frames[2].sequence == 2 && frames[0].desc.frameIndex == 1 &&
+           frames[2].desc.frameIndex == 3, "jpeg: order");
+    expect(frames[0].status == oni_STATUS_OK && frames[0].desc.width == 16 &&
+           frames[0].desc.height == 8 && frames[0].desc.strideInBytes == 48 &&
+           frames[0].desc.pixelFormat == PIXEL_FORMAT_RGB888 &&
+           nearByte(pixels[0], 40) && nearByte(pixels[2], 40) &&
+           nearByte(pixels[7 * 48 + 15 * 3], 200), "jpeg: decoded");
+    expect(frames[1].status != oni_STATUS_OK && frames[1].desc.data == NULL &&
+           frames[2].status == oni_STATUS_OK, "jpeg: corrupt frame");
+    for (i = 0; i < 3; ++i) {
+        oni_release_DecodedFrame(decoder, &frames[i]);
+    }
+    expect(oni_getPending_JpegDecoder(decoder) == 0 &&
+           oni_receive_JpegDecoder(decoder, &frames[0], 0) ==
+           oni_STATUS_TIME_OUT, "jpeg: drained");
+
+    oni_setOutput_JpegDecoder(decoder, PIXEL_FORMAT_GRAY8, 2);
+    desc.data = testJpeg;
+    oni_submitDescriptor_JpegDecoder(decoder, &desc, NULL);
+    oni_receive_JpegDecoder(decoder, &frames[0], 1000);
+    pixels = (const uint8_t *) frames[0].desc.data;
+    expect(frames[0].status == oni_STATUS_OK && frames[0].desc.width == 8 &&
+           frames[0].desc.height == 4 && frames[0].desc.strideInBytes == 8 &&
+           nearByte(pixels[0], 40) && nearByte(pixels[3 * 8 + 7], 200),
+           "jpeg: scaled gray");
+    oni_release_DecodedFrame(decoder, &frames[0]);
+    oni_delete_JpegDecoder(decoder);
+}
+
+// readFile: Read up to 'size' bytes of a file into 'buffer', returning how
+// many were read, or -1 if it could not be opened.
+int readFile(const char * path, uint8_t * buffer, int size) {
+    int length;
+    FILE * file = fopen(path, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+    length = (int) fread(buffer, 1, size, file);
+    fclose(file);
+    return length;
+}
+
+// checkFrameExporter: A stored (uncompressed) PNG unfilters back to the
+// depth frame, clouds get the headers and records their readers expect,
+// and the stats count what was written, refused and failed.
+void checkFrameExporter() {
+    int i;
+    oni_Status rc;
+    static oni_DepthPixel depth[2 * 4] = { 1000, 1010, 1030, 1000,
+                                           2000, 0, 2000, 500 };
+    static uint8_t file[1024];
+    char png[] = "/tmp/oni_c_test_XXXXXX";
+    char ply[] = "/tmp/oni_c_test_XXXXXX";
+    char pcd[] = "/tmp/oni_c_test_XXXXXX";
+    int pngLength = 0, plyLength, pcdLength, header, pngs;
+    bool same = true;
+    float z;
+    uint32_t rgb;
+    uint8_t * rows;
+    oni_PointXYZRGB points[2] = { { 1, 2, 3, 10, 20, 30, 255 },
+                                  { 4, 5, 6, 40, 50, 60, 255 } };
+    oni_CameraIntrinsics intrinsics;
+    oni_FrameDescriptor desc = depthDescriptor(depth, 4, 2);
+    oni_ExportStats stats;
+    oni_FrameExporter * exporter = oni_new_FrameExporter(2, 1 << 20);
+
+    intrinsics.width = 4;
+    intrinsics.height = 2;
+    intrinsics.fx = intrinsics.fy = 100.0f;
+    intrinsics.cx = 1.5f;
+    intrinsics.cy = 0.5f;
+    close(mkstemp(png));
+    close(mkstemp(ply));
+    close(mkstemp(pcd));
+
+    oni_setCompression_FrameExporter(exporter, 0);
+    rc = oni_exportPngDescriptor_FrameExporter(exporter, &desc, png);
+    oni_exportCloudDescriptor_FrameExporter(exporter, &desc, &intrinsics,
+                                            oni_CLOUD_PLY, ply);
+    oni_exportPoints_FrameExporter(exporter, points, 2, oni_CLOUD_PCD, pcd);
+    oni_exportPngDescriptor_FrameExporter(exporter, &desc,
+                                          "/nonexistent/oni_c_test.png");
+    expect(oni_flush_FrameExporter(exporter, 5000) == oni_STATUS_OK,
+           "export: flush");
+
+    if (rc == oni_STATUS_NOT_SUPPORTED) {
+        printf("No zlib; skipping PNG checks\n");
+    } else {
+        // Signature, IHDR, then IDAT's length and type, the zlib header and
+        // a stored block's header ahead of the filtered rows.
+        pngLength = readFile(png, file, sizeof(file));
+        rows = file + 8 + 25 + 8 + 2 + 5;
+        expect(pngLength > 0 && memcmp(file, "\x89PNG\r\n\x1a\n", 8) == 0 &&
+               memcmp(file + 12, "IHDR", 4) == 0 && file[19] == 4 &&
+               file[23] == 2 && file[24] == 16 && file[25] == 0 &&
+               memcmp(file + pngLength - 8, "IEND", 4) == 0,
+               "export: png header");
+        for (i = 0; i < 2 * 9; ++i) {
+            if (i % 9 == 0) {
+                same = same && rows[i] == 1;
+            } else if (i % 9 > 2) {
+                rows[i] = (uint8_t) (rows[i] + rows[i - 2]);
+            }
+        }
+        for (i = 0; i < 2 * 4; ++i) {
+            same = same && ((rows[i / 4 * 9 + 1 + i % 4 * 2] << 8) |
+                            rows[i / 4 * 9 + 2 + i % 4 * 2]) == depth[i];
+        }
+        expect(same, "export: png pixels");
+    }
+
+    plyLength = readFile(ply, file, sizeof(file));
+    header = (int) (strstr((char *) file, "end_header\n") + 11 -
+                    (char *) file);
+    memcpy(&z, file + header + 6 * 12 + 8, 4);
+    expect(memcmp(file, "ply\nformat binary_little_endian 1.0\n"
+                  "element vertex 7\n", 46) == 0 &&
+           plyLength == header + 7 * 12 && near(z, 500), "export: ply");
+
+    pcdLength = readFile(pcd, file, sizeof(file));
+    file[pcdLength] = 0;
+    header = (int) (strstr((char *) file, "DATA binary\n") + 12 -
+                    (char *) file);
+    memcpy(&z, file + header + 16 + 8, 4);
+    memcpy(&rgb, file + header + 16 + 12, 4);
+    expect(strstr((char *) file, "FIELDS x y z rgb\n") != NULL &&
+           strstr((char *) file, "POINTS 2\n") != NULL &&
+           pcdLength == header + 2 * 16 && near(z, 6) && rgb == 0x28323c,
+           "export: pcd");
+
+    // Without zlib neither PNG was submitted.
+    pngs = rc == oni_STATUS_OK ? 1 : 0;
+    oni_getStats_FrameExporter(exporter, &stats);
+    expect(stats.submitted == 2 + 2 * pngs && stats.written == 2 + pngs &&
+           stats.failed == pngs && stats.rejected == 0 && stats.pending == 0 &&
+           stats.queuedBytes == 0 &&
+           stats.bytesWritten == (uint64_t) (pngLength + plyLength + pcdLength),
+           "export: stats");
+    oni_delete_FrameExporter(exporter);
+
+    exporter = oni_new_FrameExporter(1, 16);
+    expect(oni_exportPoints_FrameExporter(exporter, points, 2, oni_CLOUD_PCD,
+                                          pcd) == oni_STATUS_OUT_OF_FLOW,
+           "export: over budget");
+    oni_getStats_FrameExporter(exporter, &stats);
+    expect(stats.rejected == 1 && stats.submitted == 0, "export: refused");
+    oni_delete_FrameExporter(exporter);
+    unlink(png);
+    unlink(ply);
+    unlink(pcd);
+}
+
+// checkFrameHistory: Six frames into a history of four keep the newest four,
+// found by frame index and timestamp, and a spilled frame unpacks to the
+// pixels it had.
+void checkFrameHistory(oni_VideoStream * stream) {
+    int i, y, rowBytes = 0;
+    int indices[6];
+    uint64_t timestamps[6], first = 0, end = 0, sequence = 99;
+    static uint8_t original[1 << 22], copy[1 << 22];
+    bool same = true;
+    oni_FrameDescriptor desc;
+    oni_HistoryStats stats;
+    oni_VideoFrameRef * ref = oni_new_VideoFrameRef(NULL);
+    oni_FrameHistory * history = oni_new_FrameHistory(4, 0);
+
+    for (i = 0; i < 6; ++i) {
+        oni_readFrame(stream, ref);
+        oni_getFrameDescriptor(ref, &desc);
+        indices[i] = desc.frameIndex;
+        timestamps[i] = desc.timestamp;
+        if (i == 4) {
+            rowBytes = desc.width * 2;
+            for (y = 0; y < desc.height; ++y) {
+                memcpy(original + y * rowBytes, (const uint8_t *) desc.data +
+                       y * desc.strideInBytes, rowBytes);
+            }
+        }
+        oni_push_FrameHistory(history, ref);
+    }
+    oni_getRange_FrameHistory(history, &first, &end);
+    oni_getStats_FrameHistory(history, &stats);
+    expect(first == 2 && end == 6 && stats.frames == 4 && stats.pushed == 6 &&
+           stats.evicted == 2 && stats.hotFrames == 4, "history: capacity");
+
+    expect(oni_findFrameIndex_FrameHistory(history, indices[3], &sequence) ==
+           oni_STATUS_OK && sequence == 3 &&
+           oni_findFrameIndex_FrameHistory(history, indices[0], &sequence) ==
+           oni_STATUS_NO_DEVICE, "history: frame index");
+    expect(oni_findTimestamp_FrameHistory(history, timestamps[4] + 1,
+                                          &sequence) == oni_STATUS_OK &&
+           sequence == 4 &&
+           oni_findTimestamp_FrameHistory(history, 0, &sequence) ==
+           oni_STATUS_OK && sequence == 2, "history: timestamp");
+    expect(oni_getDescriptor_FrameHistory(history, 1, &desc) ==
+           oni_STATUS_NO_DEVICE &&
+           oni_getDescriptor_FrameHistory(history, 5, &desc) ==
+           oni_STATUS_OK && desc.frameIndex == indices[5] &&
+           desc.data == NULL, "history: descriptors");
+
+    oni_setSpill_FrameHistory(history, 1, 0);
+    for (i = 0; i < 200 && stats.hotFrames != 1; ++i) {
+        usleep(10000);
+        oni_getStats_FrameHistory(history, &stats);
+    }
+    expect(stats.hotFrames == 1 && stats.spillBytes > 0 &&
+           oni_getFrame_FrameHistory(history, 4, ref) ==
+           oni_STATUS_NOT_SUPPORTED &&
+           oni_getFrame_FrameHistory(history, 5, ref) == oni_STATUS_OK,
+           "history: spilled");
+    expect(oni_copyFrame_FrameHistory(history, 4, copy, sizeof(copy), &desc) ==
+           oni_STATUS_OK && desc.frameIndex == indices[4] &&
+           desc.strideInBytes == rowBytes, "history: copy spilled");
+    for (y = 0; y < desc.height; ++y) {
+        same = same && memcmp(copy + y * rowBytes, original + y * rowBytes,
+                              rowBytes) == 0;
+    }
+    expect(same, "history: spill round trip");
+
+    // Over the spill budget, everything but the hot frames goes.
+    oni_setSpill_FrameHistory(history, 1, 1);
+    oni_readFrame(stream, ref);
+    oni_push_FrameHistory(history, ref);
+    oni_getRange_FrameHistory(history, &first, &end);
+    expect(first == 5 && end == 7, "history: spill budget");
+
+    oni_setSpill_FrameHistory(history, 0, 0);
+    oni_release_VideoFrameRef(ref);
+    oni_delete_VideoFrameRef(ref);
+    oni_delete_FrameHistory(history);
+}
+
+// checkClockAligner: A minute of frames from a device clock running 100 ppm
+// fast, arriving 2 to 4 ms late, locks onto that skew and the 2 ms minimum
+// latency despite a late burst; a device clock going backwards starts over.
+void checkClockAligner() {
+    int i;
+    uint64_t device = 0, host, mapped;
+    uint64_t latencies[4] = { 2000, 2700, 3400, 4100 };
+    oni_ClockStats stats;
+    oni_ClockAligner * aligner = oni_new_ClockAligner();
+
+    expect(oni_toHost_ClockAligner(aligner, 5000000) == 0,
+           "clock: no samples");
+    for (i = 0; i < 1800; ++i) {
+        device = 5000000 + (uint64_t) (i * 33333 * 1.0001);
+        host = 1000000000 + (uint64_t) i * 33333 + latencies[i % 4];
+        if (i >= 900 && i < 916) {
+            host += 20000;
+        }
+        oni_addSample_ClockAligner(aligner, device, host);
+    }
+    oni_getStats_ClockAligner(aligner, &stats);
+    expect(stats.samples == 1800 && stats.locked && stats.resets == 0 &&
+           stats.rejected >= 1 && fabsf(stats.skewPpm - 100) < 1 &&
+           stats.jitterUs < 50, "clock: locked on the skew");
+    mapped = oni_toHost_ClockAligner(aligner, device);
+    expect(mapped > 1000000000 + 1799 * 33333 + 1900 &&
+           mapped < 1000000000 + 1799 * 33333 + 2100 &&
+           llabs((long long) oni_toDevice_ClockAligner(aligner, mapped) -
+                 (long long) device) <= 2,
+           "clock: mapping");
+
+    oni_addSample_ClockAligner(aligner, 1000, oni_getHostTime());
+    oni_getStats_ClockAligner(aligner, &stats);
+    expect(stats.resets == 1 && stats.buckets == 0 && !stats.locked,
+           "clock: device clock went backwards");
+    oni_reset_ClockAligner(aligner);
+    expect(oni_toDevice_ClockAligner(aligner, oni_getHostTime()) == 0,
+           "clock: reset");
+    oni_delete_ClockAligner(aligner);
+}
+
+// checkResilientDevice: While the device stays plugged in, settings go
+// straight through (refusals included), and listeners get frames until
+// removed.  Replaying on a reconnect needs the device actually unplugged.
+void checkResilientDevice(const char * uri) {
+    int i, seen, bogus = 1, mirroring = 1, size = sizeof(mirroring);
+    oni_NewFrameListener listener;
+    oni_RecoveryStats stats;
+    oni_ResilientDevice * device = oni_new_ResilientDevice();
+
+    expect(oni_addStream_ResilientDevice(device, oni_SENSOR_DEPTH) ==
+           oni_STATUS_BAD_PARAMETER, "resilient device: stream before open");
+    expect(oni_open_ResilientDevice(device, uri) == oni_STATUS_OK &&
+           oni_open_ResilientDevice(device, uri) == oni_STATUS_ERROR,
+           "resilient device: open");
+    expect(oni_getStreamProperty_ResilientDevice(device, oni_SENSOR_DEPTH,
+                                                 MIRRORING_PROPERTY,
+                                                 &mirroring, &size) ==
+           oni_STATUS_BAD_PARAMETER, "resilient device: no stream yet");
+    if (oni_addStream_ResilientDevice(device, oni_SENSOR_DEPTH) !=
+        oni_STATUS_OK)
+    {
+        printf("No depth stream; skipping resilient device checks\n");
+        oni_delete_ResilientDevice(device);
+        return;
+    }
+    expect(oni_getStream_ResilientDevice(device, oni_SENSOR_DEPTH) != NULL,
+           "resilient device: stream");
+
+    if (oni_setStreamProperty_ResilientDevice(device, oni_SENSOR_DEPTH,
+                                              MIRRORING_PROPERTY, &mirroring,
+                                              sizeof(mirroring)) ==
+        oni_STATUS_OK)
+    {
+        mirroring = 0;
+        oni_getStreamProperty_ResilientDevice(device, oni_SENSOR_DEPTH,
+                                              MIRRORING_PROPERTY, &mirroring,
+                                              &size);
+        expect(mirroring == 1, "resilient device: stream property");
+    } else {
+        printf("No mirroring property; skipping its resilient check\n");
+    }
+    expect(oni_setProperty_ResilientDevice(device, BOGUS_PROPERTY, &bogus,
+                                           sizeof(bogus)) != oni_STATUS_OK,
+           "resilient device: refusal passed through");
+
+    listenerFrame = oni_new_VideoFrameRef(NULL);
+    framesSeen = 0;
+    listener.fnPtr = &countFrame;
+    oni_addNewFrameListener_ResilientDevice(device, oni_SENSOR_DEPTH,
+                                            &listener);
+    expect(oni_start_ResilientDevice(device, oni_SENSOR_DEPTH) ==
+           oni_STATUS_OK, "resilient device: start");
+    for (i = 0; i < 200 && framesSeen < 3; ++i) {
+        usleep(10000);
+    }
+    oni_removeNewFrameListener_ResilientDevice(device, oni_SENSOR_DEPTH,
+                                               &listener);
+    seen = framesSeen;
+    expect(seen >= 3, "resilient device: frames delivered");
+    usleep(100000);
+    expect(framesSeen == seen, "resilient device: none after removal");
+    oni_stop_ResilientDevice(device, oni_SENSOR_DEPTH);
+
+    oni_getStats_ResilientDevice(device, &stats);
+    expect(stats.connected && stats.disconnects == 0 &&
+           stats.reconnects == 0 && stats.droppedSettings == 0,
+           "resilient device: stats");
+    oni_delete_ResilientDevice(device);
+    oni_delete_VideoFrameRef(listenerFrame);
+    listenerFrame = NULL;
+}
@@ -0,0 +1,407 @@
+// ============================================================================
+// openni2_capabilities.cxx: Capability snapshots, video mode selection and the
+// on-disk capability cache
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_internal.h"
+
+// The first line of every capability cache file; bump it if the format changes.
+static const char * _capabilityCacheHeader = "# OpenNI2_Wrapper capabilities v1";
+
+// ==========================
+// Internal utility functions
+// ==========================
+static void _clearCapabilities(oni_Capabilities * caps)
+{
+    caps->usbVendorId = 0;
+    caps->usbProductId = 0;
+    caps->firmwareVersion[0] = '\0';
+    caps->modeCount = 0;
+    caps->modes = NULL;
+}
+
+static void _setCapabilityModes(oni_Capabilities * caps,
+                                const std::vector<oni_VideoModeInfo> & modes)
+{
+    delete[] caps->modes;
+    caps->modes = NULL;
+    caps->modeCount = (int) modes.size();
+    if (!modes.empty()) {
+        caps->modes = new oni_VideoModeInfo[modes.size()];
+        memcpy(caps->modes, &modes[0], modes.size() * sizeof(oni_VideoModeInfo));
+    }
+}
+
+static void _appendSensorModes(const openni::SensorInfo * info,
+                               std::vector<oni_VideoModeInfo> & out)
+{
+    const openni::Array<openni::VideoMode> & modes =
+        info->getSupportedVideoModes();
+    for (int i = 0; i < modes.getSize(); ++i) {
+        oni_VideoModeInfo mode;
+        mode.sensorType = info->getSensorType();
+        mode.pixelFormat = modes[i].getPixelFormat();
+        mode.resolutionX = modes[i].getResolutionX();
+        mode.resolutionY = modes[i].getResolutionY();
+        mode.fps = modes[i].getFps();
+        out.push_back(mode);
+    }
+}
+
+// _cacheKey: The firmware version as it is written in the cache file, i.e.
+// with whitespace replaced so that it stays a single token.
+static std::string _cacheKey(const char * firmwareVersion)
+{
+    std::string key = firmwareVersion == NULL || firmwareVersion[0] == '\0' ?
+        "-" : firmwareVersion;
+    for (size_t i = 0; i < key.size(); ++i) {
+        if (isspace((unsigned char) key[i])) {
+            key[i] = '_';
+        }
+    }
+    return key;
+}
+
+// _selectMode: Implements the choice described at oni_VideoModeConstraints.
+// Returns the index of the best mode in 'modes', or -1 if none qualify.
+static int _selectMode(const oni_VideoModeInfo * modes, int count,
+                       const oni_VideoModeConstraints * c)
+{
+    int best = -1;
+    int bestRank = 0;
+    long bestResDist = 0;
+    int bestFpsDist = 0;
+
+    for (int i = 0; i < count; ++i) {
+        const oni_VideoModeInfo & m = modes[i];
+        if (m.resolutionX < c->minResolutionX ||
+            m.resolutionY < c->minResolutionY || m.fps < c->minFps)
+        {
+            continue;
+        }
+
+        int rank = 0;
+        if (c->pixelFormats != NULL && c->pixelFormatCount > 0) {
+            rank = -1;
+            for (int f = 0; f < c->pixelFormatCount; ++f) {
+                if (c->pixelFormats[f] == m.pixelFormat) {
+                    rank = f;
+                    break;
+                }
+            }
+            if (rank < 0) {
+                continue;
+            }
+        }
+
+        long resDist = 0;
+        if (c->resolutionX > 0) {
+            resDist += labs((long) m.resolutionX - c->resolutionX);
+        }
+        if (c->resolutionY > 0) {
+            resDist += labs((long) m.resolutionY - c->resolutionY);
+        }
+        int fpsDist = c->fps > 0 ? abs(m.fps - c->fps) : 0;
+
+        if (best < 0 || rank < bestRank ||
+            (rank == bestRank && (resDist < bestResDist ||
+                                  (resDist == bestResDist &&
+                                   fpsDist < bestFpsDist))))
+        {
+            best = i;
+            bestRank = rank;
+            bestResDist = resDist;
+            bestFpsDist = fpsDist;
+        }
+    }
+    return best;
+}
+
+// =============================================
+// Capability snapshots and video mode selection
+// =============================================
+oni_Status oni_getCapabilities(oni_Device * device, oni_Capabilities * caps) {
+    _clearCapabilities(caps);
+    EXC_CHECK({
+        const openni::DeviceInfo & info = device->getDeviceInfo();
+        caps->usbVendorId = info.getUsbVendorId();
+        caps->usbProductId = info.getUsbProductId();
+
+        // Recordings have no firmware; leave the version empty for them.
+        int size = sizeof(caps->firmwareVersion) - 1;
+        if (oni_getProperty_Device(device,
+                                   openni::DEVICE_PROPERTY_FIRMWARE_VERSION,
+                                   caps->firmwareVersion, &size) ==
+            openni::STATUS_OK)
+        {
+            caps->firmwareVersion[size] = '\0';
+        } else {
+            caps->firmwareVersion[0] = '\0';
+        }
+
+        std::vector<oni_VideoModeInfo> modes;
+        const openni::SensorType types[] = {
+            openni::SENSOR_IR, openni::SENSOR_COLOR, openni::SENSOR_DEPTH
+        };
+        for (int i = 0; i < 3; ++i) {
+            const openni::SensorInfo * sensor = device->hasSensor(types[i]) ?
+                device->getSensorInfo(types[i]) : NULL;
+            if (sensor != NULL) {
+                _appendSensorModes(sensor, modes);
+            }
+        }
+        _setCapabilityModes(caps, modes);
+        return openni::STATUS_OK;
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_getCapabilitiesCached(oni_Device * device, const char * path,
+                                     oni_Capabilities * caps) {
+    _clearCapabilities(caps);
+    EXC_CHECK({
+        // The firmware version is part of the key, so read it first (this is
+        // one driver round trip; the property cache saves even that once it
+        // is enabled for the device).
+        char firmware[sizeof(caps->firmwareVersion)];
+        int size = sizeof(firmware) - 1;
+        if (oni_getProperty_Device(device,
+                                   openni::DEVICE_PROPERTY_FIRMWARE_VERSION,
+                                   firmware, &size) == openni::STATUS_OK)
+        {
+            firmware[size] = '\0';
+        } else {
+            firmware[0] = '\0';
+        }
+
+        const openni::DeviceInfo & info = device->getDeviceInfo();
+        if (oni_loadCapabilities(path, info.getUsbVendorId(),
+                                 info.getUsbProductId(), firmware, caps) ==
+            openni::STATUS_OK)
+        {
+            return openni::STATUS_OK;
+        }
+
+        oni_Status rc = oni_getCapabilities(device, caps);
+        if (rc == openni::STATUS_OK) {
+            // Failing to write the cache only costs the next start its speed.
+            oni_saveCapabilities(path, caps);
+        }
+        return rc;
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_loadCapabilities(const char * path, uint16_t usbVendorId,
+                                uint16_t usbProductId,
+                                const char * firmwareVersion,
+                                oni_Capabilities * caps) {
+    _clearCapabilities(caps);
+    EXC_CHECK({
+        std::ifstream in(path);
+        std::string line;
+        if (!in || !std::getline(in, line) || line != _capabilityCacheHeader) {
+            return openni::STATUS_NO_DEVICE;
+        }
+
+        std::string wantKey = _cacheKey(firmwareVersion);
+        while (std::getline(in, line)) {
+            // Each entry: "device <vendor> <product> <firmware> <modeCount>"
+            // followed by one "<sensor> <format> <x> <y> <fps>" line per mode.
+            std::istringstream header(line);
+            std::string tag, key;
+            unsigned vendor, product;
+            int count;
+            if (!(header >> tag >> std::hex >> vendor >> product >> std::dec
+                  >> key >> count) || tag != "device" || count < 0)
+            {
+                return openni::STATUS_ERROR;
+            }
+
+            bool match = vendor == usbVendorId && product == usbProductId &&
+                key == wantKey;
+            std::vector<oni_VideoModeInfo> modes;
+            for (int i = 0; i < count; ++i) {
+                int sensor, format;
+                oni_VideoModeInfo mode;
+                if (!std::getline(in, line)) {
+                    return openni::STATUS_ERROR;
+                }
+                std::istringstream fields(line);
+                if (!(fields >> sensor >> format >> mode.resolutionX
+                      >> mode.resolutionY >> mode.fps))
+                {
+                    return openni::STATUS_ERROR;
+                }
+                mode.sensorType = (oni_SensorType) sensor;
+                mode.pixelFormat = (oni_PixelFormat) format;
+                modes.push_back(mode);
+            }
+
+            if (match) {
+                caps->usbVendorId = usbVendorId;
+                caps->usbProductId = usbProductId;
+                strncpy(caps->firmwareVersion,
+                        firmwareVersion == NULL ? "" : firmwareVersion,
+                        sizeof(caps->firmwareVersion) - 1);
+                caps->firmwareVersion[sizeof(caps->firmwareVersion) - 1] = '\0';
+                _setCapabilityModes(caps, modes);
+                return openni::STATUS_OK;
+            }
+        }
+        return openni::STATUS_NO_DEVICE;
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_saveCapabilities(const char * path, const oni_Capabilities * caps) {
+    EXC_CHECK({
+        // Keep every other device's entry, then replace the whole file at once
+        // so that a concurrent reader never sees half of it.
+        std::string ownKey = _cacheKey(caps->firmwareVersion);
+        std::ostringstream out;
+        out << _capabilityCacheHeader << "\n";
+
+        // Whatever can't be parsed (from a newer version, say) is kept too,
+        // after this device's entry so that loading still reaches it.
+        std::string unparsed;
+        std::ifstream in(path);
+        std::string line;
+        if (in && std::getline(in, line) && line == _capabilityCacheHeader) {
+            while (std::getline(in, line)) {
+                std::istringstream header(line);
+                std::string tag, key;
+                unsigned vendor, product;
+                int count;
+                if (!(header >> tag >> std::hex >> vendor >> product
+                      >> std::dec >> key >> count) || tag != "device")
+                {
+                    unparsed = line + "\n";
+                    while (std::getline(in, line)) {
+                        unparsed += line + "\n";
+                    }
+                    break;
+                }
+                bool own = vendor == caps->usbVendorId &&
+                    product == caps->usbProductId && key == ownKey;
+                std::string entry = line + "\n";
+                for (int i = 0; i < count && std::getline(in, line); ++i) {
+                    entry += line + "\n";
+                }
+                if (!own) {
+                    out << entry;
+                }
+            }
+        }
+        in.close();
+
+        char vendor[8], product[8];
+        snprintf(vendor, sizeof(vendor), "%04x", caps->usbVendorId);
+        snprintf(product, sizeof(product), "%04x", caps->usbProductId);
+        out << "device " << vendor << " " << product << " " << ownKey << " "
+            << caps->modeCount << "\n";
+        for (int i = 0; i < caps->modeCount; ++i) {
+            const oni_VideoModeInfo & m = caps->modes[i];
+            out << (int) m.sensorType << " " << (int) m.pixelFormat << " "
+                << m.resolutionX << " " << m.resolutionY << " " << m.fps << "\n";
+        }
+        out << unparsed;
+
+        // A temporary file of its own, so that concurrent savers can't write
+        // into each other's before the rename.
+        std::string tmpPath = std::string(path) + ".XXXXXX";
+        int fd = mkstemp(&tmpPath[0]);
+        if (fd < 0) {
+            return openni::STATUS_ERROR;
+        }
+        fchmod(fd, 0644);
+        std::string contents = out.str();
+        size_t written = 0;
+        while (written < contents.size()) {
+            ssize_t n = write(fd, contents.data() + written,
+                              contents.size() - written);
+            if (n <= 0) {
+                break;
+            }
+            written += (size_t) n;
+        }
+        if (close(fd) != 0 || written < contents.size()) {
+            remove(tmpPath.c_str());
+            return openni::STATUS_ERROR;
+        }
+        if (rename(tmpPath.c_str(), path) != 0) {
+            remove(tmpPath.c_str());
+            return openni::STATUS_ERROR;
+        }
+        return openni::STATUS_OK;
+    });
+    return openni::STATUS_ERROR;
+}
+
+void oni_release_Capabilities(oni_Capabilities * caps) {
+    EXC_CHECK({
+        delete[] caps->modes;
+        _clearCapabilities(caps);
+    });
+}
+
+oni_Status oni_selectVideoMode(const oni_SensorInfo * info,
+                               const oni_VideoModeConstraints * constraints,
+                               oni_VideoModeInfo * best) {
+    EXC_CHECK({
+        std::vector<oni_VideoModeInfo> modes;
+        _appendSensorModes(info, modes);
+        int idx = modes.empty() ? -1 :
+            _selectMode(&modes[0], (int) modes.size(), constraints);
+        if (idx < 0) {
+            return openni::STATUS_NOT_SUPPORTED;
+        }
+        *best = modes[idx];
+        return openni::STATUS_OK;
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_selectVideoMode_Capabilities(
+    const oni_Capabilities * caps, oni_SensorType sensorType,
+    const oni_VideoModeConstraints * constraints, oni_VideoModeInfo * best) {
+    EXC_CHECK({
+        // Modes are grouped by sensor, so find this sensor's run of them.
+        int first = 0;
+        while (first < caps->modeCount &&
+               caps->modes[first].sensorType != sensorType)
+        {
+            ++first;
+        }
+        int last = first;
+        while (last < caps->modeCount &&
+               caps->modes[last].sensorType == sensorType)
+        {
+            ++last;
+        }
+
+        int idx = _selectMode(caps->modes + first, last - first, constraints);
+        if (idx < 0) {
+            return openni::STATUS_NOT_SUPPORTED;
+        }
+        *best = caps->modes[first + idx];
+        return openni::STATUS_OK;
+    });
+    return openni::STATUS_ERROR;
+}
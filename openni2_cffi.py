@@ -1,6 +1,7 @@
 from cffi import FFI
 from cffi import cparser
 from cffi.cparser import pycparser
+import asyncio
 import re
 
 class OpenNI2:
@@ -206,6 +207,69 @@ class WalkAST(object):
                     #setattr(newClass, newName, 
                     print("Found function %s for %s" % (newName, target[0]))
 
+class AsyncFrameEvents(object):
+    """Wait for frames from an asyncio event loop, without any callback from
+    OpenNI's threads into the interpreter. This wraps an oni_FrameEvent: the
+    C library queues the frames of the given streams itself and makes a file
+    descriptor readable, which the event loop watches.
+    streams -- List of oni_VideoStream* (already started) to take frames from
+    queueDepth -- Frames queued per stream before the oldest is dropped
+    batchSize -- Most frames returned by one step of batches()
+    Do not call oni_readFrame on the streams while they are attached."""
+    def __init__(self, streams, queueDepth=4, batchSize=16):
+        OpenNI2.check_cffi()
+        lib, ffi = OpenNI2.lib, OpenNI2.ffi
+        self.event = lib.oni_new_FrameEvent(queueDepth)
+        if self.event == ffi.NULL:
+            raise Exception("Unable to create frame event!")
+        self.streams = list(streams)
+        for stream in self.streams:
+            rc = lib.oni_attach_FrameEvent(self.event, stream)
+            if rc != lib.oni_STATUS_OK:
+                self.close()
+                raise Exception("Unable to attach stream: %s" %
+                                ffi.string(lib.oni_getString_Status(rc)))
+        self.fd = lib.oni_getFd_FrameEvent(self.event)
+        self.refs = [lib.oni_new_VideoFrameRef(ffi.NULL)
+                     for i in range(batchSize)]
+        self.refArray = ffi.new("oni_VideoFrameRef*[]", self.refs)
+        self.streamArray = ffi.new("oni_VideoStream*[]", batchSize)
+    def take(self):
+        """Return a list of (stream, frame) tuples for whatever frames are
+        queued right now, without waiting. The frames are only valid until the
+        next call to take() or batches()."""
+        lib = OpenNI2.lib
+        count = lib.oni_takeFrames_FrameEvent(self.event, self.refArray,
+                                              self.streamArray,
+                                              len(self.refs))
+        return [(self.streamArray[i], self.refArray[i]) for i in range(count)]
+    async def batches(self):
+        """Asynchronous generator yielding non-empty lists of (stream, frame)
+        tuples (see take()) as frames arrive."""
+        loop = asyncio.get_running_loop()
+        while True:
+            batch = self.take()
+            if len(batch) > 0:
+                yield batch
+                continue
+            ready = loop.create_future()
+            def wake():
+                if not ready.done():
+                    ready.set_result(None)
+            loop.add_reader(self.fd, wake)
+            try:
+                await ready
+            finally:
+                loop.remove_reader(self.fd)
+    def close(self):
+        lib, ffi = OpenNI2.lib, OpenNI2.ffi
+        if self.event != ffi.NULL:
+            lib.oni_delete_FrameEvent(self.event)
+            self.event = ffi.NULL
+        for ref in getattr(self, "refs", []):
+            lib.oni_delete_VideoFrameRef(ref)
+        self.refs = []
+
 OpenNI2.check_cffi()
 lib,ffi = OpenNI2.lib, OpenNI2.ffi
 rc = lib.oni_initialize()
@@ -0,0 +1,269 @@
+// ============================================================================
+// openni2_change_detect.cxx: Tile-based change detection between consecutive
+// frames (oni_ChangeDetector)
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_internal.h"
+
+// _countChanged16: How many of the 'n' pixels of 'a' differ from those of 'b'
+// by more than 'threshold'.
+static int _countChanged16(const uint16_t * a, const uint16_t * b, int n,
+                           uint16_t threshold)
+{
+    int count = 0;
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i t = _mm_set1_epi16((short) threshold);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *) (a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *) (b + i));
+        // |x - y| with unsigned saturation, then nonzero where it exceeds t.
+        __m128i d = _mm_or_si128(_mm_subs_epu16(x, y), _mm_subs_epu16(y, x));
+        __m128i same = _mm_cmpeq_epi16(_mm_subs_epu16(d, t), zero);
+        count += 8 - __builtin_popcount(_mm_movemask_epi8(same)) / 2;
+    }
+#endif
+    for (; i < n; ++i) {
+        int d = (int) a[i] - (int) b[i];
+        if (d > threshold || -d > threshold) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+// _countChanged8: The same for 8-bit pixels.
+static int _countChanged8(const uint8_t * a, const uint8_t * b, int n,
+                          uint16_t threshold)
+{
+    if (threshold > 255) {
+        return 0;
+    }
+    int count = 0;
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i t = _mm_set1_epi8((char) threshold);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *) (a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *) (b + i));
+        __m128i d = _mm_or_si128(_mm_subs_epu8(x, y), _mm_subs_epu8(y, x));
+        __m128i same = _mm_cmpeq_epi8(_mm_subs_epu8(d, t), zero);
+        count += 16 - __builtin_popcount(_mm_movemask_epi8(same));
+    }
+#endif
+    for (; i < n; ++i) {
+        int d = (int) a[i] - (int) b[i];
+        if (d > threshold || -d > threshold) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+// =======================
+// openni2_change_detector
+// =======================
+// openni2_change_detector: Lets consumers skip frames or tiles that only
+// differ from the last by sensor noise.  The previous frame is kept packed,
+// and each tile's changed pixels are counted row by row, 8 or 16 at a time
+// with SSE2.
+class openni2_change_detector
+{
+public:
+    openni2_change_detector(int tileSize, int threshold, int minChangedPixels)
+        : tileSize(tileSize), threshold(threshold),
+          minChangedPixels(minChangedPixels), dropUnchanged(false),
+          m_width(0), m_height(0), m_format(-1), m_hasPrevious(false) {}
+
+    oni_Status update(const oni_FrameDescriptor & desc, oni_ChangeResult * result)
+    {
+        int bpp = _bytesPerPixel(desc.pixelFormat);
+        if (desc.data == NULL || (bpp != 1 && bpp != 2)) {
+            return openni::STATUS_NOT_SUPPORTED;
+        }
+        int width = desc.width;
+        int height = desc.height;
+        int tilesX = (width + tileSize - 1) / tileSize;
+        int tilesY = (height + tileSize - 1) / tileSize;
+        int rowBytes = width * bpp;
+
+        bool comparable = m_hasPrevious && width == m_width &&
+            height == m_height && desc.pixelFormat == m_format;
+        m_counts.assign((size_t) tilesX * tilesY, 0);
+        m_bitmap.assign(((size_t) tilesX * tilesY + 7) / 8, 0);
+        m_previous.resize((size_t) rowBytes * height);
+
+        uint64_t changedPixels = 0;
+        for (int y = 0; y < height; ++y) {
+            const uint8_t * cur = (const uint8_t *) desc.data +
+                (size_t) y * desc.strideInBytes;
+            uint8_t * prev = &m_previous[(size_t) y * rowBytes];
+            if (comparable) {
+                int * counts = &m_counts[(size_t) (y / tileSize) * tilesX];
+                for (int tx = 0; tx < tilesX; ++tx) {
+                    int x0 = tx * tileSize;
+                    int n = width - x0 < tileSize ? width - x0 : tileSize;
+                    int c = bpp == 2 ?
+                        _countChanged16((const uint16_t *) cur + x0,
+                                        (const uint16_t *) prev + x0, n,
+                                        threshold) :
+                        _countChanged8(cur + x0, prev + x0, n, threshold);
+                    counts[tx] += c;
+                    changedPixels += c;
+                }
+            }
+            memcpy(prev, cur, rowBytes);
+        }
+
+        int changedTiles = 0;
+        for (int i = 0; i < tilesX * tilesY; ++i) {
+            if (!comparable || m_counts[i] > minChangedPixels) {
+                m_bitmap[i / 8] |= (uint8_t) (1 << (i % 8));
+                ++changedTiles;
+            }
+        }
+        if (!comparable) {
+            changedPixels = (uint64_t) width * height;
+        }
+
+        m_width = width;
+        m_height = height;
+        m_format = desc.pixelFormat;
+        m_hasPrevious = true;
+
+        result->tilesX = tilesX;
+        result->tilesY = tilesY;
+        result->changedTiles = changedTiles;
+        result->changedPixels = changedPixels;
+        result->score = width * height > 0 ?
+            (float) changedPixels / ((float) width * height) : 0.0f;
+        result->bitmap = m_bitmap.empty() ? NULL : &m_bitmap[0];
+        result->bitmapSize = (int) m_bitmap.size();
+        return openni::STATUS_OK;
+    }
+
+    void reset()
+    {
+        m_hasPrevious = false;
+    }
+
+    const int tileSize;
+    const uint16_t threshold;
+    const int minChangedPixels;
+    // Used only by the pipeline stage, which may be running when it is set.
+    std::atomic<bool> dropUnchanged;
+
+private:
+    int m_width;
+    int m_height;
+    int m_format;
+    bool m_hasPrevious;
+    // The previous frame with its rows packed together.
+    std::vector<uint8_t> m_previous;
+    std::vector<int> m_counts;
+    std::vector<uint8_t> m_bitmap;
+};
+
+static bool _changeDetectionStage(void * userData, oni_PipelineItem * item)
+{
+    openni2_change_detector * detector = (openni2_change_detector *) userData;
+    oni_FrameDescriptor desc;
+    oni_ChangeResult result;
+    if (oni_getFrameDescriptor(oni_getFrame_PipelineItem(item), &desc) !=
+            openni::STATUS_OK ||
+        detector->update(desc, &result) != openni::STATUS_OK)
+    {
+        return false;
+    }
+    if (detector->dropUnchanged.load(std::memory_order_relaxed) &&
+        result.changedTiles == 0)
+    {
+        return false;
+    }
+
+    // One block holding the result and, right after it, its bitmap.
+    int size = (int) sizeof(result) + result.bitmapSize;
+    char * block = (char *) malloc(size);
+    if (block == NULL) {
+        return false;
+    }
+    memcpy(block + sizeof(result), result.bitmap, result.bitmapSize);
+    result.bitmap = (const uint8_t *) (block + sizeof(result));
+    memcpy(block, &result, sizeof(result));
+    oni_setPayload_PipelineItem(item, block, size, &free);
+    return true;
+}
+
+// ==================
+// oni_ChangeDetector
+// ==================
+oni_ChangeDetector * oni_new_ChangeDetector(int tileSize, int threshold,
+                                            int minChangedPixels) {
+    if (tileSize <= 0 || threshold < 0 || threshold > 65535) {
+        return NULL;
+    }
+    EXC_CHECK({
+        return new openni2_change_detector(tileSize, threshold,
+                                           minChangedPixels);
+    });
+    return NULL;
+}
+
+void oni_delete_ChangeDetector(oni_ChangeDetector * detector) {
+    EXC_CHECK( delete detector; );
+}
+
+oni_Status oni_update_ChangeDetector(oni_ChangeDetector * detector,
+                                     oni_VideoFrameRef * frame,
+                                     oni_ChangeResult * result) {
+    EXC_CHECK({
+        oni_FrameDescriptor desc;
+        oni_Status rc = oni_getFrameDescriptor(frame, &desc);
+        if (rc != openni::STATUS_OK) {
+            return rc;
+        }
+        return detector->update(desc, result);
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_updateDescriptor_ChangeDetector(oni_ChangeDetector * detector,
+                                               const oni_FrameDescriptor * desc,
+                                               oni_ChangeResult * result) {
+    EXC_CHECK( return detector->update(*desc, result); );
+    return openni::STATUS_ERROR;
+}
+
+void oni_reset_ChangeDetector(oni_ChangeDetector * detector) {
+    EXC_CHECK( detector->reset(); );
+}
+
+int oni_addChangeDetectionStage_Pipeline(oni_Pipeline * pipeline,
+                                         const char * name,
+                                         oni_ChangeDetector * detector,
+                                         bool dropUnchanged) {
+    if (detector == NULL) {
+        return -1;
+    }
+    EXC_CHECK({
+        detector->dropUnchanged.store(dropUnchanged, std::memory_order_relaxed);
+        return oni_addStage_Pipeline(pipeline, name, &_changeDetectionStage,
+                                     detector);
+    });
+    return -1;
+}
@@ -0,0 +1,303 @@
+// ============================================================================
+// openni2_clock_align.cxx: Mapping device timestamps to the host's monotonic
+// clock by robust online regression (oni_ClockAligner)
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <mutex>
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_internal.h"
+
+// A bucket whose minimum lands further than this (in us) from the fit is an
+// outlier, and this many outliers in a row mean that a clock jumped.
+static const double _clockOutlierUs = 5000.0;
+static const int _clockMaxOutliers = 3;
+// The fit counts as locked after this many buckets.
+static const int _clockLockBuckets = 4;
+
+// _hostMicroseconds: CLOCK_MONOTONIC, in microseconds.
+static uint64_t _hostMicroseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// =====================
+// openni2_clock_aligner
+// =====================
+// openni2_clock_aligner: A frame's arrival time on the host is its device
+// time mapped to the host clock plus a transfer latency that is never below
+// some minimum and often well above it.  So samples are grouped into buckets
+// of device time and only each bucket's earliest arrival (relative to device
+// time) is kept, which throws away almost all of the latency jitter.  A line
+// is fitted through the bucket minima by least squares, weighting older
+// buckets down exponentially so that the fit follows changing drift, and
+// leaving out buckets that disagree with it; its slope is the rate of the
+// device clock against the host clock, and it maps device times to the host
+// at the minimum latency.  Adding a sample and converting a time take
+// constant time.  Times are kept relative to the first sample, and the sums
+// as weighted means and co-moments, so that doubles keep their precision
+// however long the aligner runs.
+class openni2_clock_aligner
+{
+public:
+    openni2_clock_aligner() : m_bucket(250000.0), m_halfLife(30e6)
+    {
+        memset(&m_stats, 0, sizeof(m_stats));
+        reset();
+    }
+
+    void setWindow(int bucketMs, float halfLife)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_bucket = std::max(bucketMs, 1) * 1000.0;
+        m_halfLife = std::max(halfLife, 0.001f) * 1e6;
+    }
+
+    void reset()
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        clear();
+    }
+
+    // add: O(1): keep the sample if it is the bucket's earliest so far, and
+    // fold the bucket into the fit when a sample from a later one arrives.
+    void add(uint64_t device, uint64_t host)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        ++m_stats.samples;
+        if (!m_started || device < m_lastDevice) {
+            if (m_started) {
+                ++m_stats.resets;
+            }
+            clear();
+            m_started = true;
+            m_device0 = device;
+            m_host0 = host;
+        }
+        m_lastDevice = device;
+
+        double x = (double) (device - m_device0);
+        double y = (double) host - (double) m_host0;
+        double bucket = floor(x / m_bucket);
+        if (m_hasBucket && bucket != m_bucketIndex) {
+            fold(m_bucketX, m_bucketY);
+            m_hasBucket = false;
+        }
+        if (!m_hasBucket || y - x < m_bucketY - m_bucketX) {
+            m_bucketX = x;
+            m_bucketY = y;
+            m_bucketIndex = bucket;
+            m_hasBucket = true;
+        }
+    }
+
+    uint64_t toHost(uint64_t device)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (!m_started) {
+            return 0;
+        }
+        double x = (double) device - (double) m_device0;
+        double y = predict(x);
+        return (uint64_t) std::max((double) m_host0 + y + 0.5, 0.0);
+    }
+
+    uint64_t toDevice(uint64_t host)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (!m_started) {
+            return 0;
+        }
+        double y = (double) host - (double) m_host0;
+        double x;
+        if (m_weight > 0.0) {
+            x = m_meanX + (y - m_meanY) / slope();
+        } else {
+            x = y - (m_bucketY - m_bucketX);
+        }
+        return (uint64_t) std::max((double) m_device0 + x + 0.5, 0.0);
+    }
+
+    void stats(oni_ClockStats * out)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        *out = m_stats;
+        out->locked = m_stats.buckets >= _clockLockBuckets && m_outliers == 0;
+        out->skewPpm = m_weight > 0.0 ? (float) ((1.0 / slope() - 1.0) * 1e6) : 0.0f;
+        out->jitterUs = (float) sqrt(m_residual);
+    }
+
+private:
+    void clear()
+    {
+        m_started = false;
+        m_hasBucket = false;
+        m_lastDevice = 0;
+        m_weight = 0.0;
+        m_meanX = m_meanY = 0.0;
+        m_cxx = m_cxy = 0.0;
+        m_lastFoldX = 0.0;
+        m_residual = 0.0;
+        m_outliers = 0;
+        m_stats.buckets = 0;
+    }
+
+    double slope() const
+    {
+        // Until there is a spread of points, assume the clocks run alike.
+        return m_cxx > m_bucket * m_bucket ? m_cxy / m_cxx : 1.0;
+    }
+
+    double predict(double x) const
+    {
+        if (m_weight > 0.0) {
+            return m_meanY + slope() * (x - m_meanX);
+        }
+        // Nothing folded yet: the earliest arrival so far, at a slope of 1.
+        return x + (m_bucketY - m_bucketX);
+    }
+
+    // fold: Add a bucket minimum to the fit, unless it is an outlier; too
+    // many of those in a row and the fit starts over from this point.
+    void fold(double x, double y)
+    {
+        if (m_stats.buckets >= _clockLockBuckets) {
+            double r = y - predict(x);
+            if (fabs(r) > _clockOutlierUs) {
+                ++m_stats.rejected;
+                if (++m_outliers < _clockMaxOutliers) {
+                    return;
+                }
+                ++m_stats.resets;
+                m_weight = 0.0;
+                m_meanX = m_meanY = m_cxx = m_cxy = m_residual = 0.0;
+                m_stats.buckets = 0;
+            } else {
+                m_residual = 0.9 * m_residual + 0.1 * r * r;
+            }
+        }
+        m_outliers = 0;
+
+        double decay = m_weight > 0.0 ?
+            pow(0.5, (x - m_lastFoldX) / m_halfLife) : 0.0;
+        m_weight = decay * m_weight + 1.0;
+        double dx = x - m_meanX;
+        double dy = y - m_meanY;
+        m_meanX += dx / m_weight;
+        m_meanY += dy / m_weight;
+        m_cxx = decay * m_cxx + dx * (x - m_meanX);
+        m_cxy = decay * m_cxy + dx * (y - m_meanY);
+        m_lastFoldX = x;
+        ++m_stats.buckets;
+    }
+
+    double m_bucket;
+    double m_halfLife;
+
+    bool m_started;
+    uint64_t m_device0;
+    uint64_t m_host0;
+    uint64_t m_lastDevice;
+
+    bool m_hasBucket;
+    double m_bucketIndex;
+    double m_bucketX;
+    double m_bucketY;
+
+    double m_weight;
+    double m_meanX;
+    double m_meanY;
+    double m_cxx;
+    double m_cxy;
+    double m_lastFoldX;
+    double m_residual;
+    int m_outliers;
+
+    oni_ClockStats m_stats;
+    std::mutex m_lock;
+};
+
+// ================
+// oni_ClockAligner
+// ================
+oni_ClockAligner * oni_new_ClockAligner() {
+    EXC_CHECK( return new openni2_clock_aligner(); );
+    return NULL;
+}
+
+void oni_delete_ClockAligner(oni_ClockAligner * aligner) {
+    EXC_CHECK( delete aligner; );
+}
+
+void oni_setWindow_ClockAligner(oni_ClockAligner * aligner, int bucketMs,
+                                float halfLife) {
+    EXC_CHECK( aligner->setWindow(bucketMs, halfLife); );
+}
+
+void oni_reset_ClockAligner(oni_ClockAligner * aligner) {
+    EXC_CHECK( aligner->reset(); );
+}
+
+oni_Status oni_observe_ClockAligner(oni_ClockAligner * aligner,
+                                    oni_VideoFrameRef * frame) {
+    uint64_t host = _hostMicroseconds();
+    if (!frame->isValid()) {
+        return openni::STATUS_BAD_PARAMETER;
+    }
+    EXC_CHECK({
+        aligner->add(frame->getTimestamp(), host);
+        return openni::STATUS_OK;
+    });
+    return openni::STATUS_ERROR;
+}
+
+void oni_addSample_ClockAligner(oni_ClockAligner * aligner,
+                                uint64_t deviceTimestamp,
+                                uint64_t hostTimestamp) {
+    EXC_CHECK( aligner->add(deviceTimestamp, hostTimestamp); );
+}
+
+uint64_t oni_toHost_ClockAligner(oni_ClockAligner * aligner,
+                                 uint64_t deviceTimestamp) {
+    EXC_CHECK( return aligner->toHost(deviceTimestamp); );
+    return 0;
+}
+
+uint64_t oni_toDevice_ClockAligner(oni_ClockAligner * aligner,
+                                   uint64_t hostTimestamp) {
+    EXC_CHECK( return aligner->toDevice(hostTimestamp); );
+    return 0;
+}
+
+oni_Status oni_getFrameDescriptor_ClockAligner(oni_ClockAligner * aligner,
+                                               oni_VideoFrameRef * frame,
+                                               oni_FrameDescriptor * desc) {
+    EXC_CHECK({
+        oni_Status rc = oni_getFrameDescriptor(frame, desc);
+        if (rc != openni::STATUS_OK) {
+            return rc;
+        }
+        desc->timestamp = aligner->toHost(desc->timestamp);
+        return openni::STATUS_OK;
+    });
+    return openni::STATUS_ERROR;
+}
+
+void oni_getStats_ClockAligner(oni_ClockAligner * aligner,
+                               oni_ClockStats * stats) {
+    EXC_CHECK( aligner->stats(stats); );
+}
+
+uint64_t oni_getHostTime() {
+    return _hostMicroseconds();
+}
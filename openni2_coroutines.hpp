@@ -0,0 +1,688 @@
+// ============================================================================
+// openni2_coroutines.hpp: Optional, header-only C++20 coroutine interface on
+// top of the wrapper, e.g.
+//     oni::coro::task<void> run(oni::coro::frame_stream & depth) {
+//         for (;;) {
+//             oni::coro::frame_result r = co_await depth.nextFrame();
+//             if (!r) break;
+//             ... use r.frame ...
+//         }
+//     }
+// Frames are delivered by OpenNI's new-frame listener and coroutines are
+// resumed on an executor (see frame_loop), so one thread can drive any number
+// of streams from any number of devices.
+// (c) Chris Hodapp, 2013
+// ============================================================================
+#ifndef OPENNI2_COROUTINES
+#define OPENNI2_COROUTINES
+
+#if !defined(__cplusplus) || __cplusplus < 202002L
+#error openni2_coroutines.hpp requires C++20.
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+
+namespace oni {
+namespace coro {
+
+typedef std::chrono::steady_clock clock;
+
+// =========
+// executors
+// =========
+// executor: Where coroutines resume, and where timeouts are kept.  Implement
+// this to resume coroutines on an existing event loop.
+class executor
+{
+public:
+    typedef uint64_t timer_id;
+
+    virtual ~executor() {}
+    // post: Run 'fn' soon; callable from any thread.
+    virtual void post(std::function<void()> fn) = 0;
+    // schedule: Run 'fn' at 'when' unless cancelTimer(id) is called first.
+    virtual timer_id schedule(clock::time_point when,
+                              std::function<void()> fn) = 0;
+    virtual void cancelTimer(timer_id id) = 0;
+};
+
+// frame_loop: An executor whose work runs on whichever thread calls run().
+class frame_loop : public executor
+{
+public:
+    frame_loop() : m_nextTimer(1), m_stopped(false) {}
+
+    void post(std::function<void()> fn) override
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_work.push_back(std::move(fn));
+        m_wake.notify_one();
+    }
+
+    timer_id schedule(clock::time_point when, std::function<void()> fn) override
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        timer_id id = m_nextTimer++;
+        m_timers.emplace(std::make_pair(when, id), std::move(fn));
+        m_wake.notify_one();
+        return id;
+    }
+
+    void cancelTimer(timer_id id) override
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        for (auto it = m_timers.begin(); it != m_timers.end(); ++it) {
+            if (it->first.second == id) {
+                m_timers.erase(it);
+                return;
+            }
+        }
+    }
+
+    // run: Run work until stop() is called.
+    void run() { runUntil(clock::time_point::max()); }
+
+    // runUntil: Run work until 'deadline' or until stop() is called.  Returns
+    // false if it stopped because of stop().
+    bool runUntil(clock::time_point deadline)
+    {
+        std::unique_lock<std::mutex> guard(m_lock);
+        while (!m_stopped) {
+            clock::time_point now = clock::now();
+            if (!m_timers.empty() && m_timers.begin()->first.first <= now) {
+                std::function<void()> fn = std::move(m_timers.begin()->second);
+                m_timers.erase(m_timers.begin());
+                guard.unlock();
+                fn();
+                guard.lock();
+            } else if (!m_work.empty()) {
+                std::function<void()> fn = std::move(m_work.front());
+                m_work.pop_front();
+                guard.unlock();
+                fn();
+                guard.lock();
+            } else if (now >= deadline) {
+                return true;
+            } else {
+                clock::time_point until = deadline;
+                if (!m_timers.empty() && m_timers.begin()->first.first < until) {
+                    until = m_timers.begin()->first.first;
+                }
+                if (until == clock::time_point::max()) {
+                    m_wake.wait(guard);
+                } else {
+                    m_wake.wait_until(guard, until);
+                }
+            }
+        }
+        m_stopped = false;
+        return false;
+    }
+
+    // stop: Make run() (or runUntil()) return; callable from any thread.
+    void stop()
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_stopped = true;
+        m_wake.notify_one();
+    }
+
+private:
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::deque<std::function<void()> > m_work;
+    std::map<std::pair<clock::time_point, timer_id>, std::function<void()> > m_timers;
+    timer_id m_nextTimer;
+    bool m_stopped;
+};
+
+// ============
+// cancellation
+// ============
+namespace detail {
+struct cancel_state
+{
+    std::mutex lock;
+    bool cancelled = false;
+    uint64_t nextId = 1;
+    std::map<uint64_t, std::function<void()> > callbacks;
+};
+} // namespace detail
+
+// cancel_token: Handed to operations that may be cancelled.  A default
+// constructed token is never cancelled.
+class cancel_token
+{
+public:
+    cancel_token() {}
+    explicit cancel_token(std::shared_ptr<detail::cancel_state> state)
+        : m_state(std::move(state)) {}
+
+    bool isCancelled() const
+    {
+        if (!m_state) {
+            return false;
+        }
+        std::lock_guard<std::mutex> guard(m_state->lock);
+        return m_state->cancelled;
+    }
+
+    // subscribe: Call 'fn' (once) upon cancellation; immediately if already
+    // cancelled.  Returns an ID for unsubscribe(), or 0 if 'fn' already ran.
+    uint64_t subscribe(std::function<void()> fn) const
+    {
+        if (!m_state) {
+            return 0;
+        }
+        {
+            std::lock_guard<std::mutex> guard(m_state->lock);
+            if (!m_state->cancelled) {
+                uint64_t id = m_state->nextId++;
+                m_state->callbacks[id] = std::move(fn);
+                return id;
+            }
+        }
+        fn();
+        return 0;
+    }
+
+    void unsubscribe(uint64_t id) const
+    {
+        if (m_state && id != 0) {
+            std::lock_guard<std::mutex> guard(m_state->lock);
+            m_state->callbacks.erase(id);
+        }
+    }
+
+private:
+    std::shared_ptr<detail::cancel_state> m_state;
+};
+
+class cancel_source
+{
+public:
+    cancel_source() : m_state(std::make_shared<detail::cancel_state>()) {}
+
+    cancel_token token() const { return cancel_token(m_state); }
+
+    void cancel()
+    {
+        std::map<uint64_t, std::function<void()> > callbacks;
+        {
+            std::lock_guard<std::mutex> guard(m_state->lock);
+            if (m_state->cancelled) {
+                return;
+            }
+            m_state->cancelled = true;
+            callbacks.swap(m_state->callbacks);
+        }
+        for (auto & cb : callbacks) {
+            cb.second();
+        }
+    }
+
+private:
+    std::shared_ptr<detail::cancel_state> m_state;
+};
+
+// ====
+// task
+// ====
+// task<T>: A lazily started coroutine that can be co_awaited by another
+// coroutine, or started on an executor with spawn().
+template <class T> class task;
+
+namespace detail {
+template <class T>
+struct task_promise_base
+{
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct final_awaiter
+    {
+        bool await_ready() noexcept { return false; }
+        template <class P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+        {
+            std::coroutine_handle<> next = h.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    final_awaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+template <class T>
+struct task_promise : task_promise_base<T>
+{
+    std::optional<T> value;
+    task<T> get_return_object();
+    template <class U> void return_value(U && v) { value.emplace(std::forward<U>(v)); }
+    T result()
+    {
+        if (this->error) {
+            std::rethrow_exception(this->error);
+        }
+        return std::move(*value);
+    }
+};
+
+template <>
+struct task_promise<void> : task_promise_base<void>
+{
+    task<void> get_return_object();
+    void return_void() {}
+    void result()
+    {
+        if (this->error) {
+            std::rethrow_exception(this->error);
+        }
+    }
+};
+} // namespace detail
+
+template <class T>
+class task
+{
+public:
+    typedef detail::task_promise<T> promise_type;
+
+    explicit task(std::coroutine_handle<promise_type> h) : m_handle(h) {}
+    task(task && other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+    task & operator=(task && other) noexcept
+    {
+        if (this != &other) {
+            if (m_handle) {
+                m_handle.destroy();
+            }
+            m_handle = std::exchange(other.m_handle, {});
+        }
+        return *this;
+    }
+    task(const task &) = delete;
+    task & operator=(const task &) = delete;
+    ~task()
+    {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return !m_handle || m_handle.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        m_handle.promise().continuation = awaiting;
+        return m_handle;
+    }
+    T await_resume() { return m_handle.promise().result(); }
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+namespace detail {
+template <class T>
+task<T> task_promise<T>::get_return_object()
+{
+    return task<T>(std::coroutine_handle<task_promise<T> >::from_promise(*this));
+}
+
+inline task<void> task_promise<void>::get_return_object()
+{
+    return task<void>(std::coroutine_handle<task_promise<void> >::from_promise(*this));
+}
+
+// detached: A coroutine that starts at once and cleans up after itself.
+struct detached
+{
+    struct promise_type
+    {
+        detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+inline detached runDetached(task<void> t)
+{
+    co_await t;
+}
+} // namespace detail
+
+// spawn: Start 't' on 'ex' and let it run to completion on its own.  An
+// exception escaping 't' terminates the program.
+inline void spawn(executor & ex, task<void> t)
+{
+    std::shared_ptr<task<void> > held = std::make_shared<task<void> >(std::move(t));
+    ex.post([held]() { detail::runDetached(std::move(*held)); });
+}
+
+// ===============
+// frame awaiting
+// ===============
+// frame_result: What awaiting a frame produces.  Converts to true only when
+// 'frame' holds a frame.
+struct frame_result
+{
+    enum outcome { OK, TIMED_OUT, CANCELLED, FAILED };
+
+    outcome result = FAILED;
+    // On FAILED, what oni_readFrame (or the stream) reported.
+    oni_Status status = openni::STATUS_ERROR;
+    oni_VideoFrameRef frame;
+
+    explicit operator bool() const { return result == OK; }
+};
+
+namespace detail {
+// frame_wait: One pending nextFrame().  Shared between the awaiter, the frame
+// listener, the timer and the cancellation callback; whichever of them gets
+// to complete() first decides the outcome and resumes the coroutine.
+struct frame_wait
+{
+    std::atomic<bool> done{false};
+    std::coroutine_handle<> handle;
+    frame_result result;
+    executor * ex = nullptr;
+    std::atomic<executor::timer_id> timer{0};
+    cancel_token token;
+    std::atomic<uint64_t> cancelId{0};
+
+    bool claim() { return !done.exchange(true); }
+
+    // complete: Call only after claim() returned true.
+    void complete(std::shared_ptr<frame_wait> self)
+    {
+        if (timer != 0) {
+            ex->cancelTimer(timer);
+        }
+        token.unsubscribe(cancelId);
+        ex->post([self]() { self->handle.resume(); });
+    }
+};
+} // namespace detail
+
+// frame_stream: Awaitable frames from one started oni_VideoStream.  Only one
+// nextFrame() may be outstanding at a time, the stream must outlive this
+// object, and nothing else may call oni_readFrame on the stream meanwhile.
+class frame_stream : public oni_NewFrameListener_cxx
+{
+public:
+    frame_stream(oni_VideoStream * stream, executor & ex)
+        : m_stream(stream), m_ex(ex), m_pending(false)
+    {
+        m_status = m_stream->addNewFrameListener(this);
+    }
+
+    ~frame_stream()
+    {
+        if (m_status == openni::STATUS_OK) {
+            m_stream->removeNewFrameListener(this);
+        }
+    }
+
+    frame_stream(const frame_stream &) = delete;
+    frame_stream & operator=(const frame_stream &) = delete;
+
+    // isValid: False if the frame listener could not be added.
+    bool isValid() const { return m_status == openni::STATUS_OK; }
+    oni_VideoStream * stream() const { return m_stream; }
+
+    class frame_awaiter
+    {
+    public:
+        frame_awaiter(frame_stream & owner, clock::duration timeout,
+                      cancel_token token)
+            : m_owner(owner), m_timeout(timeout), m_token(std::move(token)) {}
+
+        bool await_ready()
+        {
+            // A frame that arrived since the last await is taken at once.
+            std::lock_guard<std::mutex> guard(m_owner.m_lock);
+            if (!m_owner.m_pending) {
+                return false;
+            }
+            m_owner.m_pending = false;
+            m_ready = m_owner.read();
+            return true;
+        }
+
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            // Once the wait can be completed (by the timer, the token or a
+            // frame), the coroutine may be resumed on another thread and this
+            // awaiter freed with its frame, so everything needed afterwards
+            // is copied out first, and the wait is offered to the listener
+            // last.
+            frame_stream * owner = &m_owner;
+            executor & ex = m_owner.m_ex;
+            clock::duration timeout = m_timeout;
+            cancel_token token = m_token;
+            std::shared_ptr<detail::frame_wait> wait =
+                std::make_shared<detail::frame_wait>();
+            wait->handle = h;
+            wait->ex = &ex;
+            wait->token = token;
+            m_wait = wait;
+            std::weak_ptr<detail::frame_wait> weak = wait;
+
+            if (timeout != clock::duration::max()) {
+                wait->timer = ex.schedule(
+                    clock::now() + timeout, [weak, owner]() {
+                        std::shared_ptr<detail::frame_wait> w = weak.lock();
+                        if (w && w->claim()) {
+                            owner->drop(w);
+                            w->result.result = frame_result::TIMED_OUT;
+                            w->timer = 0;
+                            w->complete(w);
+                        }
+                    });
+            }
+            wait->cancelId = token.subscribe([weak, owner]() {
+                std::shared_ptr<detail::frame_wait> w = weak.lock();
+                if (w && w->claim()) {
+                    owner->drop(w);
+                    w->result.result = frame_result::CANCELLED;
+                    w->cancelId = 0;
+                    w->complete(w);
+                }
+            });
+            if (wait->done) {
+                // Completed before the IDs above were stored, so complete()
+                // may have missed them; both calls are harmless if not.
+                ex.cancelTimer(wait->timer);
+                token.unsubscribe(wait->cancelId);
+                return;
+            }
+
+            std::lock_guard<std::mutex> guard(owner->m_lock);
+            if (wait->done) {
+                return;
+            }
+            if (owner->m_waiter) {
+                // Someone else is already waiting on this stream.
+                if (wait->claim()) {
+                    wait->result.status = openni::STATUS_BAD_PARAMETER;
+                    wait->complete(wait);
+                }
+                return;
+            }
+            // A timer or token that claims the wait from here on clears this
+            // again in drop(), which takes the same lock.
+            owner->m_waiter = wait;
+        }
+
+        frame_result await_resume()
+        {
+            return m_wait ? std::move(m_wait->result) : std::move(m_ready);
+        }
+
+    private:
+        frame_stream & m_owner;
+        clock::duration m_timeout;
+        cancel_token m_token;
+        std::shared_ptr<detail::frame_wait> m_wait;
+        frame_result m_ready;
+    };
+
+    // nextFrame: Await the next frame of the stream, for at most 'timeout'.
+    frame_awaiter nextFrame(clock::duration timeout = clock::duration::max(),
+                            cancel_token token = cancel_token())
+    {
+        return frame_awaiter(*this, timeout, std::move(token));
+    }
+
+    // Overrides function in openni::VideoStream::NewFrameListener
+    void onNewFrame(openni::VideoStream &) override
+    {
+        std::shared_ptr<detail::frame_wait> wait;
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            wait = std::move(m_waiter);
+            m_waiter.reset();
+            if (!wait || !wait->claim()) {
+                m_pending = true;
+                return;
+            }
+        }
+        wait->result = read();
+        wait->complete(wait);
+    }
+
+private:
+    frame_result read()
+    {
+        frame_result r;
+        r.status = oni_readFrame(m_stream, &r.frame);
+        r.result = r.status == openni::STATUS_OK ?
+            frame_result::OK : frame_result::FAILED;
+        return r;
+    }
+
+    void drop(const std::shared_ptr<detail::frame_wait> & wait)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (m_waiter == wait) {
+            m_waiter.reset();
+        }
+    }
+
+    oni_VideoStream * m_stream;
+    executor & m_ex;
+    oni_Status m_status;
+    std::mutex m_lock;
+    std::shared_ptr<detail::frame_wait> m_waiter;
+    // A frame arrived while nobody was waiting.
+    bool m_pending;
+};
+
+// pair_result: What frame_sync::nextPair() produces.
+struct pair_result
+{
+    frame_result::outcome result = frame_result::FAILED;
+    oni_Status status = openni::STATUS_ERROR;
+    oni_VideoFrameRef first;
+    oni_VideoFrameRef second;
+
+    explicit operator bool() const { return result == frame_result::OK; }
+};
+
+// frame_sync: Pairs frames of two streams (e.g. depth and color) whose
+// timestamps are at most 'toleranceUs' microseconds apart.  The timestamps
+// must be comparable, i.e. come from one device's clock.
+class frame_sync
+{
+public:
+    frame_sync(frame_stream & first, frame_stream & second, uint64_t toleranceUs)
+        : m_first(first), m_second(second), m_tolerance(toleranceUs) {}
+
+    task<pair_result> nextPair(clock::duration timeout = clock::duration::max(),
+                               cancel_token token = cancel_token())
+    {
+        clock::time_point deadline = timeout == clock::duration::max() ?
+            clock::time_point::max() : clock::now() + timeout;
+        pair_result out;
+
+        frame_result a = co_await m_first.nextFrame(remaining(deadline), token);
+        if (!a) {
+            co_return fail(out, a);
+        }
+        frame_result b = co_await m_second.nextFrame(remaining(deadline), token);
+        if (!b) {
+            co_return fail(out, b);
+        }
+
+        for (;;) {
+            uint64_t ta = oni_getTimestamp(&a.frame);
+            uint64_t tb = oni_getTimestamp(&b.frame);
+            uint64_t diff = ta > tb ? ta - tb : tb - ta;
+            if (diff <= m_tolerance) {
+                out.result = frame_result::OK;
+                out.status = openni::STATUS_OK;
+                out.first = a.frame;
+                out.second = b.frame;
+                co_return out;
+            }
+            // Replace whichever frame is older; it can never be matched.
+            if (ta < tb) {
+                a = co_await m_first.nextFrame(remaining(deadline), token);
+                if (!a) {
+                    co_return fail(out, a);
+                }
+            } else {
+                b = co_await m_second.nextFrame(remaining(deadline), token);
+                if (!b) {
+                    co_return fail(out, b);
+                }
+            }
+        }
+    }
+
+private:
+    static clock::duration remaining(clock::time_point deadline)
+    {
+        if (deadline == clock::time_point::max()) {
+            return clock::duration::max();
+        }
+        clock::time_point now = clock::now();
+        return deadline > now ? deadline - now : clock::duration::zero();
+    }
+
+    static pair_result fail(pair_result & out, const frame_result & r)
+    {
+        out.result = r.result;
+        out.status = r.status;
+        return out;
+    }
+
+    frame_stream & m_first;
+    frame_stream & m_second;
+    uint64_t m_tolerance;
+};
+
+} // namespace coro
+} // namespace oni
+
+#endif // OPENNI2_COROUTINES
@@ -0,0 +1,673 @@
+// ============================================================================
+// openni2_depth_filter.cxx: Chainable depth filters (oni_DepthFilter)
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#include <utility>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_parallel.h"
+#include "openni2_internal.h"
+
+// Rows per _parallelFor range; enough to amortize the hand-off.
+static const int _rowGrain = 16;
+
+// ======
+// Median
+// ======
+// The 19-exchange median-of-9 network (Paeth, via Devillard).  'Ops' supplies
+// min and max, so the same network runs on single pixels and SSE2 vectors.
+template <class Ops, class T>
+static inline T _median9(T p0, T p1, T p2, T p3, T p4, T p5, T p6, T p7, T p8)
+{
+#define SORT2(a, b) { T t = Ops::min(a, b); b = Ops::max(a, b); a = t; }
+    SORT2(p1, p2); SORT2(p4, p5); SORT2(p7, p8);
+    SORT2(p0, p1); SORT2(p3, p4); SORT2(p6, p7);
+    SORT2(p1, p2); SORT2(p4, p5); SORT2(p7, p8);
+    SORT2(p0, p3); SORT2(p5, p8); SORT2(p4, p7);
+    SORT2(p3, p6); SORT2(p1, p4); SORT2(p2, p5);
+    SORT2(p4, p7); SORT2(p4, p2); SORT2(p6, p4);
+    SORT2(p4, p2);
+#undef SORT2
+    return p4;
+}
+
+struct _scalarOps {
+    static inline uint16_t min(uint16_t a, uint16_t b) { return a < b ? a : b; }
+    static inline uint16_t max(uint16_t a, uint16_t b) { return a < b ? b : a; }
+};
+
+#ifdef __SSE2__
+// SSE2 only has signed 16-bit min/max; the caller flips the top bit of every
+// pixel so that these order unsigned values correctly.
+struct _sse2Ops {
+    static inline __m128i min(__m128i a, __m128i b) { return _mm_min_epi16(a, b); }
+    static inline __m128i max(__m128i a, __m128i b) { return _mm_max_epi16(a, b); }
+};
+#endif
+
+static inline int _clamp(int v, int lo, int hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+// _medianPixel: Median of the (2r+1)^2 window around (x, y), with the edges
+// of the image repeated outward.
+static uint16_t _medianPixel(const uint16_t * in, int stride, int w, int h,
+                             int x, int y, int r)
+{
+    uint16_t window[25];
+    int n = 0;
+    for (int dy = -r; dy <= r; ++dy) {
+        const uint16_t * row = in + _clamp(y + dy, 0, h - 1) * stride;
+        for (int dx = -r; dx <= r; ++dx) {
+            window[n++] = row[_clamp(x + dx, 0, w - 1)];
+        }
+    }
+    std::nth_element(window, window + n / 2, window + n);
+    return window[n / 2];
+}
+
+// _median25Network: The exchanges of Batcher's odd-even merge sort of 32
+// values, cut down to those that decide the median of the first 25.  The
+// other 7 would be +infinity, which never moves, so exchanges touching them
+// are dropped; so is every exchange that the final middle value does not
+// depend on.
+static const std::vector<std::pair<int, int> > & _median25Network()
+{
+    static std::vector<std::pair<int, int> > network;
+    static std::once_flag once;
+    std::call_once(once, []() {
+        const int n = 32;
+        std::vector<std::pair<int, int> > all;
+        for (int p = 1; p < n; p <<= 1) {
+            for (int k = p; k >= 1; k >>= 1) {
+                for (int j = k % p; j + k < n; j += 2 * k) {
+                    for (int i = 0; i < k && i + j + k < n; ++i) {
+                        if ((i + j) / (2 * p) == (i + j + k) / (2 * p) &&
+                            i + j + k < 25)
+                        {
+                            all.push_back(std::make_pair(i + j, i + j + k));
+                        }
+                    }
+                }
+            }
+        }
+        bool needed[n] = { false };
+        needed[12] = true;
+        for (size_t i = all.size(); i-- > 0; ) {
+            if (needed[all[i].first] || needed[all[i].second]) {
+                needed[all[i].first] = needed[all[i].second] = true;
+                network.push_back(all[i]);
+            }
+        }
+        std::reverse(network.begin(), network.end());
+    });
+    return network;
+}
+
+template <class Ops, class T>
+static inline T _median25(T * v, const std::vector<std::pair<int, int> > & network)
+{
+    for (size_t i = 0; i < network.size(); ++i) {
+        T & a = v[network[i].first];
+        T & b = v[network[i].second];
+        T t = Ops::min(a, b);
+        b = Ops::max(a, b);
+        a = t;
+    }
+    return v[12];
+}
+
+static void _medianRows(const uint16_t * in, int stride, uint16_t * out,
+                        int w, int h, int r, int y0, int y1)
+{
+    const std::vector<std::pair<int, int> > & network = _median25Network();
+    for (int y = y0; y < y1; ++y) {
+        uint16_t * o = out + y * w;
+        int x = 0;
+        if (r == 2 && y > 1 && y < h - 2) {
+            for (; x < 2; ++x) {
+                o[x] = _medianPixel(in, stride, w, h, x, y, r);
+            }
+#ifdef __SSE2__
+            const __m128i flip = _mm_set1_epi16((short) 0x8000);
+            for (; x + 10 <= w; x += 8) {
+                __m128i v[25];
+                for (int dy = -2, n = 0; dy <= 2; ++dy) {
+                    const uint16_t * row = in + (y + dy) * stride + x;
+                    for (int dx = -2; dx <= 2; ++dx) {
+                        v[n++] = _mm_xor_si128(_mm_loadu_si128(
+                            (const __m128i *) (row + dx)), flip);
+                    }
+                }
+                _mm_storeu_si128((__m128i *) (o + x), _mm_xor_si128(
+                    _median25<_sse2Ops>(v, network), flip));
+            }
+#endif
+            for (; x < w - 2; ++x) {
+                uint16_t v[25];
+                for (int dy = -2, n = 0; dy <= 2; ++dy) {
+                    const uint16_t * row = in + (y + dy) * stride + x;
+                    for (int dx = -2; dx <= 2; ++dx) {
+                        v[n++] = row[dx];
+                    }
+                }
+                o[x] = _median25<_scalarOps>(v, network);
+            }
+        } else if (r == 1 && y > 0 && y < h - 1) {
+            const uint16_t * a = in + (y - 1) * stride;
+            const uint16_t * b = in + y * stride;
+            const uint16_t * c = in + (y + 1) * stride;
+            o[0] = _medianPixel(in, stride, w, h, 0, y, r);
+            x = 1;
+#ifdef __SSE2__
+            const __m128i flip = _mm_set1_epi16((short) 0x8000);
+#define LOAD(p) _mm_xor_si128(_mm_loadu_si128((const __m128i *) (p)), flip)
+            for (; x + 8 < w; x += 8) {
+                __m128i m = _median9<_sse2Ops>(
+                    LOAD(a + x - 1), LOAD(a + x), LOAD(a + x + 1),
+                    LOAD(b + x - 1), LOAD(b + x), LOAD(b + x + 1),
+                    LOAD(c + x - 1), LOAD(c + x), LOAD(c + x + 1));
+                _mm_storeu_si128((__m128i *) (o + x), _mm_xor_si128(m, flip));
+            }
+#undef LOAD
+#endif
+            for (; x < w - 1; ++x) {
+                o[x] = _median9<_scalarOps>(a[x - 1], a[x], a[x + 1],
+                                            b[x - 1], b[x], b[x + 1],
+                                            c[x - 1], c[x], c[x + 1]);
+            }
+        }
+        for (; x < w; ++x) {
+            o[x] = _medianPixel(in, stride, w, h, x, y, r);
+        }
+    }
+}
+
+// =========
+// Bilateral
+// =========
+// Weights are a Gaussian of the distance in pixels times a Gaussian of the
+// depth difference, cut off at 3 sigma.  Missing pixels neither get nor give
+// weight.
+struct _bilateralParams {
+    int radius;
+    // Per window position, row by row: the spatial weight and its base-2
+    // logarithm.
+    std::vector<float> spatial;
+    std::vector<float> spatialLog2;
+    // Weight per depth difference, up to the cutoff.
+    std::vector<float> range;
+    // Minus the base-2 logarithm of the range weight, per squared difference.
+    float rangeScale2;
+};
+
+#ifdef __SSE2__
+// _exp2: 2^x for x <= 0 to within about 1e-5 relative: the integer part goes
+// into the exponent bits and a polynomial handles the fraction.
+static inline __m128 _exp2(__m128 x)
+{
+    // Shifted to be positive, so that truncation is floor.
+    __m128 t = _mm_add_ps(_mm_max_ps(x, _mm_set1_ps(-126.0f)),
+                          _mm_set1_ps(127.0f));
+    __m128i i = _mm_cvttps_epi32(t);
+    __m128 f = _mm_sub_ps(t, _mm_cvtepi32_ps(i));
+    __m128 p = _mm_set1_ps(1.3333558e-3f);
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(9.6181291e-3f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(5.5504109e-2f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(2.4022651e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(6.9314718e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+    return _mm_mul_ps(p, _mm_castsi128_ps(_mm_slli_epi32(i, 23)));
+}
+
+// _bilateral4: Four pixels starting at 'x' of row 'y', whose windows lie
+// wholly inside the image.
+static inline void _bilateral4(const uint16_t * in, int stride, uint16_t * o,
+                               int x, int y, const _bilateralParams & p)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const int r = p.radius;
+    const int side = 2 * r + 1;
+    const __m128 rangeScale = _mm_set1_ps(p.rangeScale2);
+    const float limit = (float) (p.range.size() - 1);
+    const __m128 limit2 = _mm_set1_ps(limit * limit);
+
+    __m128 c = _mm_cvtepi32_ps(_mm_unpacklo_epi16(
+        _mm_loadl_epi64((const __m128i *) (in + y * stride + x)), zero));
+    __m128 sum = _mm_setzero_ps();
+    __m128 weight = _mm_setzero_ps();
+    for (int dy = -r; dy <= r; ++dy) {
+        const uint16_t * row = in + (y + dy) * stride + x;
+        const float * sl = &p.spatialLog2[(dy + r) * side + r];
+        for (int dx = -r; dx <= r; ++dx) {
+            __m128i v16 = _mm_loadl_epi64((const __m128i *) (row + dx));
+            __m128 v = _mm_cvtepi32_ps(_mm_unpacklo_epi16(v16, zero));
+            __m128 d = _mm_sub_ps(v, c);
+            __m128 d2 = _mm_mul_ps(d, d);
+            __m128 wt = _exp2(_mm_sub_ps(_mm_set1_ps(sl[dx]),
+                                        _mm_mul_ps(d2, rangeScale)));
+            __m128 use = _mm_andnot_ps(_mm_cmpeq_ps(v, _mm_setzero_ps()),
+                                       _mm_cmple_ps(d2, limit2));
+            wt = _mm_and_ps(wt, use);
+            sum = _mm_add_ps(sum, _mm_mul_ps(wt, v));
+            weight = _mm_add_ps(weight, wt);
+        }
+    }
+    // A missing center gets no weight from itself; leave it missing (and
+    // avoid 0 / 0) by forcing the result to 0.
+    __m128 present = _mm_cmpneq_ps(c, _mm_setzero_ps());
+    __m128 safe = _mm_or_ps(weight, _mm_andnot_ps(present, _mm_set1_ps(1.0f)));
+    __m128 result = _mm_and_ps(present, _mm_add_ps(_mm_div_ps(sum, safe),
+                                                   _mm_set1_ps(0.5f)));
+    __m128i r32 = _mm_cvttps_epi32(result);
+    __m128i r16 = _mm_xor_si128(_mm_packs_epi32(
+        _mm_sub_epi32(r32, _mm_set1_epi32(32768)), zero), _mm_set1_epi16((short) 0x8000));
+    _mm_storel_epi64((__m128i *) (o + x), r16);
+}
+#endif
+
+static void _bilateralRows(const uint16_t * in, int stride, uint16_t * out,
+                           int w, int h, const _bilateralParams & p,
+                           int y0, int y1)
+{
+    const int r = p.radius;
+    const int side = 2 * r + 1;
+    const int rangeSize = (int) p.range.size();
+    for (int y = y0; y < y1; ++y) {
+        const uint16_t * row = in + y * stride;
+        uint16_t * o = out + y * w;
+        int x = 0;
+        while (x < w) {
+#ifdef __SSE2__
+            if (y >= r && y < h - r && x >= r && x + 4 + r <= w) {
+                _bilateral4(in, stride, o, x, y, p);
+                x += 4;
+                continue;
+            }
+#endif
+            int c = row[x];
+            if (c == 0) {
+                o[x++] = 0;
+                continue;
+            }
+            float sum = 0.0f;
+            float weight = 0.0f;
+            for (int dy = -r; dy <= r; ++dy) {
+                int yy = y + dy;
+                if (yy < 0 || yy >= h) {
+                    continue;
+                }
+                const uint16_t * n = in + yy * stride;
+                const float * s = &p.spatial[(dy + r) * side + r];
+                int xa = x - r < 0 ? -x : -r;
+                int xb = x + r >= w ? w - 1 - x : r;
+                for (int dx = xa; dx <= xb; ++dx) {
+                    int v = n[x + dx];
+                    int d = v > c ? v - c : c - v;
+                    if (v == 0 || d >= rangeSize) {
+                        continue;
+                    }
+                    float wt = s[dx] * p.range[d];
+                    sum += wt * v;
+                    weight += wt;
+                }
+            }
+            o[x++] = (uint16_t) (sum / weight + 0.5f);
+        }
+    }
+}
+
+// ========
+// Temporal
+// ========
+// Per pixel: while the new value is within 'threshold' of the history, the
+// history moves toward it by 'alpha'; otherwise (motion, or no history) the
+// history restarts at the new value.  A missing pixel repeats the history for
+// up to 'hold' frames.  'age' counts consecutive missing frames, stopping at
+// 32767 so that it compares correctly as a signed 16-bit value.
+static void _temporalRows(const uint16_t * in, int stride, uint16_t * out,
+                          int w, float * history, uint16_t * age, float alpha,
+                          float threshold, int hold, int y0, int y1)
+{
+    for (int y = y0; y < y1; ++y) {
+        const uint16_t * c = in + y * stride;
+        uint16_t * o = out + y * w;
+        float * hist = history + y * w;
+        uint16_t * a = age + y * w;
+        int x = 0;
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one = _mm_set1_epi16(1);
+        const __m128i holdv = _mm_set1_epi16((short) hold);
+        const __m128i bias = _mm_set1_epi32(32768);
+        const __m128i flip = _mm_set1_epi16((short) 0x8000);
+        const __m128 zerof = _mm_setzero_ps();
+        const __m128 alphav = _mm_set1_ps(alpha);
+        const __m128 thresholdv = _mm_set1_ps(threshold);
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        for (; x + 8 <= w; x += 8) {
+            __m128i c16 = _mm_loadu_si128((const __m128i *) (c + x));
+            __m128i a16 = _mm_loadu_si128((const __m128i *) (a + x));
+            __m128i missing16 = _mm_cmpeq_epi16(c16, zero);
+            __m128i keep16 = _mm_cmplt_epi16(a16, holdv);
+            _mm_storeu_si128((__m128i *) (a + x),
+                             _mm_and_si128(missing16, _mm_adds_epi16(a16, one)));
+
+            __m128i rounded[2];
+            for (int half = 0; half < 2; ++half) {
+                __m128i c32 = half ? _mm_unpackhi_epi16(c16, zero) :
+                    _mm_unpacklo_epi16(c16, zero);
+                __m128 missing = _mm_castsi128_ps(half ?
+                    _mm_unpackhi_epi16(missing16, missing16) :
+                    _mm_unpacklo_epi16(missing16, missing16));
+                __m128 keep = _mm_castsi128_ps(half ?
+                    _mm_unpackhi_epi16(keep16, keep16) :
+                    _mm_unpacklo_epi16(keep16, keep16));
+                __m128 cf = _mm_cvtepi32_ps(c32);
+                __m128 hf = _mm_loadu_ps(hist + x + 4 * half);
+                __m128 noHistory = _mm_cmpeq_ps(hf, zerof);
+                __m128 diff = _mm_sub_ps(cf, hf);
+                __m128 restart = _mm_or_ps(noHistory,
+                    _mm_cmpgt_ps(_mm_and_ps(diff, absMask), thresholdv));
+                __m128 smoothed = _mm_add_ps(hf, _mm_mul_ps(alphav, diff));
+                __m128 present = _mm_or_ps(_mm_and_ps(restart, cf),
+                                           _mm_andnot_ps(restart, smoothed));
+                __m128 held = _mm_andnot_ps(noHistory, _mm_and_ps(keep, hf));
+                __m128 next = _mm_or_ps(_mm_and_ps(missing, held),
+                                        _mm_andnot_ps(missing, present));
+                _mm_storeu_ps(hist + x + 4 * half, next);
+                rounded[half] = _mm_sub_epi32(_mm_cvtps_epi32(next), bias);
+            }
+            // Pack the unsigned 32-bit values via signed saturation.
+            _mm_storeu_si128((__m128i *) (o + x), _mm_xor_si128(
+                _mm_packs_epi32(rounded[0], rounded[1]), flip));
+        }
+#endif
+        for (; x < w; ++x) {
+            float h = hist[x];
+            if (c[x] == 0) {
+                if (a[x] >= hold) {
+                    h = 0.0f;
+                }
+                a[x] = a[x] == 0x7fff ? a[x] : a[x] + 1;
+            } else {
+                float diff = c[x] - h;
+                h = h == 0.0f || fabsf(diff) > threshold ? c[x] : h + alpha * diff;
+                a[x] = 0;
+            }
+            hist[x] = h;
+            o[x] = (uint16_t) lrintf(h);
+        }
+    }
+}
+
+// =========
+// Hole fill
+// =========
+// Gaps of up to 'maxHole' missing pixels along a row, with valid pixels on
+// both sides, take the farther of those two values so that foreground objects
+// don't grow into the background.
+static void _holeFillRows(const uint16_t * in, int stride, uint16_t * out,
+                          int w, int maxHole, int y0, int y1)
+{
+    for (int y = y0; y < y1; ++y) {
+        const uint16_t * row = in + y * stride;
+        uint16_t * o = out + y * w;
+        memcpy(o, row, w * sizeof(uint16_t));
+        int x = 0;
+        while (x < w) {
+            if (row[x] != 0) {
+                ++x;
+                continue;
+            }
+            int start = x;
+            while (x < w && row[x] == 0) {
+                ++x;
+            }
+            if (start > 0 && x < w && x - start <= maxHole) {
+                uint16_t fill = std::max(row[start - 1], row[x]);
+                for (int i = start; i < x; ++i) {
+                    o[i] = fill;
+                }
+            }
+        }
+    }
+}
+
+// ====================
+// openni2_depth_filter
+// ====================
+// openni2_depth_filter: Each step splits the rows of the frame across threads
+// (see oni_setParallelism), ping-ponging between two buffers that are kept,
+// like the temporal history, from frame to frame.  Missing pixels (0) stay
+// missing except where a step fills them.
+class openni2_depth_filter
+{
+public:
+    enum kind { MEDIAN, BILATERAL, TEMPORAL, HOLE_FILL };
+
+    struct step {
+        kind type;
+        int radius;
+        _bilateralParams bilateral;
+        float alpha;
+        float threshold;
+        int hold;
+        int maxHole;
+        // Temporal state, sized to the frame.
+        std::vector<float> history;
+        std::vector<uint16_t> age;
+    };
+
+    openni2_depth_filter() : m_width(0), m_height(0) {}
+
+    int add(const step & s)
+    {
+        m_steps.push_back(s);
+        return (int) m_steps.size() - 1;
+    }
+
+    const uint16_t * apply(const oni_FrameDescriptor & desc)
+    {
+        if (desc.data == NULL || desc.width <= 0 || desc.height <= 0 ||
+            _bytesPerPixel(desc.pixelFormat) != 2 ||
+            desc.sensorType != openni::SENSOR_DEPTH)
+        {
+            return NULL;
+        }
+        int w = desc.width;
+        int h = desc.height;
+        if (w != m_width || h != m_height) {
+            m_width = w;
+            m_height = h;
+            m_buffers[0].assign((size_t) w * h, 0);
+            m_buffers[1].assign((size_t) w * h, 0);
+            reset();
+        }
+
+        const uint16_t * in = (const uint16_t *) desc.data;
+        int stride = desc.strideInBytes / sizeof(uint16_t);
+        if (m_steps.empty()) {
+            uint16_t * out = &m_buffers[0][0];
+            for (int y = 0; y < h; ++y) {
+                memcpy(out + y * w, in + y * stride, w * sizeof(uint16_t));
+            }
+            return out;
+        }
+        // Each step reads the output of the one before, alternating between
+        // the two buffers.
+        for (size_t i = 0; i < m_steps.size(); ++i) {
+            uint16_t * out = &m_buffers[i % 2][0];
+            run(m_steps[i], in, stride, out);
+            in = out;
+            stride = w;
+        }
+        return in;
+    }
+
+    void reset()
+    {
+        for (size_t i = 0; i < m_steps.size(); ++i) {
+            if (m_steps[i].type == TEMPORAL) {
+                m_steps[i].history.assign((size_t) m_width * m_height, 0.0f);
+                m_steps[i].age.assign((size_t) m_width * m_height, 0);
+            }
+        }
+    }
+
+private:
+    void run(step & s, const uint16_t * in, int stride, uint16_t * out)
+    {
+        int w = m_width;
+        int h = m_height;
+        switch (s.type) {
+        case MEDIAN:
+            _parallelFor(h, _rowGrain, [&](int y0, int y1) {
+                _medianRows(in, stride, out, w, h, s.radius, y0, y1);
+            });
+            break;
+        case BILATERAL:
+            _parallelFor(h, _rowGrain, [&](int y0, int y1) {
+                _bilateralRows(in, stride, out, w, h, s.bilateral, y0, y1);
+            });
+            break;
+        case TEMPORAL:
+            if (s.history.size() != (size_t) w * h) {
+                s.history.assign((size_t) w * h, 0.0f);
+                s.age.assign((size_t) w * h, 0);
+            }
+            _parallelFor(h, _rowGrain, [&](int y0, int y1) {
+                _temporalRows(in, stride, out, w, &s.history[0], &s.age[0],
+                              s.alpha, s.threshold, s.hold, y0, y1);
+            });
+            break;
+        case HOLE_FILL:
+            _parallelFor(h, _rowGrain, [&](int y0, int y1) {
+                _holeFillRows(in, stride, out, w, s.maxHole, y0, y1);
+            });
+            break;
+        }
+    }
+
+    int m_width;
+    int m_height;
+    std::vector<step> m_steps;
+    std::vector<uint16_t> m_buffers[2];
+};
+
+// ===============
+// oni_DepthFilter
+// ===============
+oni_DepthFilter * oni_new_DepthFilter() {
+    EXC_CHECK( return new openni2_depth_filter(); );
+    return NULL;
+}
+
+void oni_delete_DepthFilter(oni_DepthFilter * filter) {
+    EXC_CHECK( delete filter; );
+}
+
+int oni_addMedian_DepthFilter(oni_DepthFilter * filter, int radius) {
+    if (radius < 1 || radius > 2) {
+        return -1;
+    }
+    EXC_CHECK({
+        openni2_depth_filter::step s = openni2_depth_filter::step();
+        s.type = openni2_depth_filter::MEDIAN;
+        s.radius = radius;
+        return filter->add(s);
+    });
+    return -1;
+}
+
+int oni_addBilateral_DepthFilter(oni_DepthFilter * filter, int radius,
+                                 float sigmaSpace, float sigmaDepth) {
+    if (radius < 1 || sigmaSpace <= 0.0f || sigmaDepth <= 0.0f) {
+        return -1;
+    }
+    EXC_CHECK({
+        openni2_depth_filter::step s = openni2_depth_filter::step();
+        s.type = openni2_depth_filter::BILATERAL;
+        _bilateralParams & p = s.bilateral;
+        p.radius = radius;
+        for (int dy = -radius; dy <= radius; ++dy) {
+            for (int dx = -radius; dx <= radius; ++dx) {
+                float e = -(dx * dx + dy * dy) / (2.0f * sigmaSpace * sigmaSpace);
+                p.spatialLog2.push_back(e * (float) M_LOG2E);
+                p.spatial.push_back(expf(e));
+            }
+        }
+        float rangeScale = 1.0f / (2.0f * sigmaDepth * sigmaDepth);
+        p.rangeScale2 = rangeScale * (float) M_LOG2E;
+        int rangeSize = (int) ceilf(3.0f * sigmaDepth) + 1;
+        for (int d = 0; d < rangeSize; ++d) {
+            p.range.push_back(expf(-(float) (d * d) * rangeScale));
+        }
+        return filter->add(s);
+    });
+    return -1;
+}
+
+int oni_addTemporal_DepthFilter(oni_DepthFilter * filter, float alpha,
+                                int threshold, int holdFrames) {
+    if (alpha <= 0.0f || alpha > 1.0f || threshold < 0 || holdFrames < 0) {
+        return -1;
+    }
+    EXC_CHECK({
+        openni2_depth_filter::step s = openni2_depth_filter::step();
+        s.type = openni2_depth_filter::TEMPORAL;
+        s.alpha = alpha;
+        s.threshold = (float) threshold;
+        s.hold = holdFrames < 32767 ? holdFrames : 32767;
+        return filter->add(s);
+    });
+    return -1;
+}
+
+int oni_addHoleFill_DepthFilter(oni_DepthFilter * filter, int maxHoleSize) {
+    if (maxHoleSize < 1) {
+        return -1;
+    }
+    EXC_CHECK({
+        openni2_depth_filter::step s = openni2_depth_filter::step();
+        s.type = openni2_depth_filter::HOLE_FILL;
+        s.maxHole = maxHoleSize;
+        return filter->add(s);
+    });
+    return -1;
+}
+
+const oni_DepthPixel * oni_apply_DepthFilter(oni_DepthFilter * filter,
+                                             oni_VideoFrameRef * frame) {
+    EXC_CHECK({
+        oni_FrameDescriptor desc;
+        if (oni_getFrameDescriptor(frame, &desc) != openni::STATUS_OK) {
+            return NULL;
+        }
+        return filter->apply(desc);
+    });
+    return NULL;
+}
+
+const oni_DepthPixel * oni_applyDescriptor_DepthFilter(oni_DepthFilter * filter,
+                                                       const oni_FrameDescriptor * desc) {
+    EXC_CHECK( return filter->apply(*desc); );
+    return NULL;
+}
+
+void oni_reset_DepthFilter(oni_DepthFilter * filter) {
+    EXC_CHECK( filter->reset(); );
+}
@@ -0,0 +1,369 @@
+// ============================================================================
+// openni2_depth_pyramid.cxx: Decimation of depth frames that skips missing
+// pixels, and pyramids built from it (oni_DepthPyramid)
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_parallel.h"
+#include "openni2_internal.h"
+
+const int oni_DECIMATE_MIN = 0;
+const int oni_DECIMATE_MEDIAN = 1;
+const int oni_DECIMATE_MEAN = 2;
+
+// ==================
+// Decimation kernels
+// ==================
+// Decimating in the wrapper is much cheaper than switching to a smaller video
+// mode, which restarts the stream for every consumer.
+// _decimateBlock: The reduction of one factor x factor block whose top-left
+// pixel is 'p'.  Only nonzero pixels take part; a block without any gives 0.
+// The median of an even count is the upper of the two middle values.
+static uint16_t _decimateBlock(const uint16_t * p, int stride, int factor,
+                               int mode)
+{
+    uint16_t valid[16];
+    int n = 0;
+    uint32_t sum = 0;
+    for (int y = 0; y < factor; ++y) {
+        for (int x = 0; x < factor; ++x) {
+            uint16_t v = p[y * stride + x];
+            if (v != 0) {
+                valid[n++] = v;
+                sum += v;
+            }
+        }
+    }
+    if (n == 0) {
+        return 0;
+    }
+    if (mode == oni_DECIMATE_MIN) {
+        return *std::min_element(valid, valid + n);
+    }
+    if (mode == oni_DECIMATE_MEDIAN) {
+        std::nth_element(valid, valid + n / 2, valid + n);
+        return valid[n / 2];
+    }
+    return (uint16_t) ((sum + n / 2) / n);
+}
+
+#ifdef __SSE2__
+// _min2x2: Eight outputs from 16 pixels of rows 'a' and 'b'.  Subtracting 1
+// turns missing pixels into 0xffff so that they lose every min, and flipping
+// the top bit lets signed min order them as unsigned; both are undone at the
+// end, which turns a block without valid pixels back into 0.
+static inline __m128i _min2x2(const uint16_t * a, const uint16_t * b)
+{
+    const __m128i bias = _mm_set1_epi16((short) 0x7fff);
+    // v - 1 then flip the top bit == v + 0x7fff (mod 2^16).
+    __m128i a0 = _mm_add_epi16(_mm_loadu_si128((const __m128i *) a), bias);
+    __m128i a1 = _mm_add_epi16(_mm_loadu_si128((const __m128i *) (a + 8)), bias);
+    __m128i b0 = _mm_add_epi16(_mm_loadu_si128((const __m128i *) b), bias);
+    __m128i b1 = _mm_add_epi16(_mm_loadu_si128((const __m128i *) (b + 8)), bias);
+    __m128i v0 = _mm_min_epi16(a0, b0);
+    __m128i v1 = _mm_min_epi16(a1, b1);
+    // Each pair's min ends up in the low half of its 32-bit lane; sign-extend
+    // those and pack them together.
+    v0 = _mm_min_epi16(v0, _mm_srli_epi32(v0, 16));
+    v1 = _mm_min_epi16(v1, _mm_srli_epi32(v1, 16));
+    v0 = _mm_srai_epi32(_mm_slli_epi32(v0, 16), 16);
+    v1 = _mm_srai_epi32(_mm_slli_epi32(v1, 16), 16);
+    return _mm_sub_epi16(_mm_packs_epi32(v0, v1), bias);
+}
+
+// _median2x2: Eight outputs from 16 pixels of rows 'a' and 'b', with missing
+// pixels biased as in _min2x2 so that sorting moves them to the end.  With
+// 'n' valid pixels in a block, the median is then element n / 2 of the block
+// sorted.
+static inline __m128i _median2x2(const uint16_t * a, const uint16_t * b)
+{
+    const __m128i bias = _mm_set1_epi16((short) 0x7fff);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a0 = _mm_loadu_si128((const __m128i *) a);
+    __m128i a1 = _mm_loadu_si128((const __m128i *) (a + 8));
+    __m128i b0 = _mm_loadu_si128((const __m128i *) b);
+    __m128i b1 = _mm_loadu_si128((const __m128i *) (b + 8));
+    // Missing pixels are -1 in these masks; madd adds horizontal pairs.
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i m0 = _mm_madd_epi16(_mm_add_epi16(_mm_cmpeq_epi16(a0, zero),
+                                              _mm_cmpeq_epi16(b0, zero)), ones);
+    __m128i m1 = _mm_madd_epi16(_mm_add_epi16(_mm_cmpeq_epi16(a1, zero),
+                                              _mm_cmpeq_epi16(b1, zero)), ones);
+    __m128i n = _mm_add_epi16(_mm_packs_epi32(m0, m1), _mm_set1_epi16(4));
+
+    a0 = _mm_add_epi16(a0, bias);
+    a1 = _mm_add_epi16(a1, bias);
+    b0 = _mm_add_epi16(b0, bias);
+    b1 = _mm_add_epi16(b1, bias);
+    // Split even and odd columns, one block per lane.
+    __m128i v[4];
+    v[0] = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a0, 16), 16),
+                           _mm_srai_epi32(_mm_slli_epi32(a1, 16), 16));
+    v[1] = _mm_packs_epi32(_mm_srai_epi32(a0, 16), _mm_srai_epi32(a1, 16));
+    v[2] = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(b0, 16), 16),
+                           _mm_srai_epi32(_mm_slli_epi32(b1, 16), 16));
+    v[3] = _mm_packs_epi32(_mm_srai_epi32(b0, 16), _mm_srai_epi32(b1, 16));
+    static const int net[5][2] = { {0, 1}, {2, 3}, {0, 2}, {1, 3}, {1, 2} };
+    for (int i = 0; i < 5; ++i) {
+        __m128i lo = _mm_min_epi16(v[net[i][0]], v[net[i][1]]);
+        v[net[i][1]] = _mm_max_epi16(v[net[i][0]], v[net[i][1]]);
+        v[net[i][0]] = lo;
+    }
+
+    // n <= 1 takes element 0, n = 2 or 3 element 1 and n = 4 element 2.
+    __m128i use1 = _mm_cmpgt_epi16(n, ones);
+    __m128i use2 = _mm_cmpeq_epi16(n, _mm_set1_epi16(4));
+    __m128i r = _mm_or_si128(_mm_andnot_si128(use1, v[0]),
+                             _mm_and_si128(use1, v[1]));
+    r = _mm_or_si128(_mm_andnot_si128(use2, r), _mm_and_si128(use2, v[2]));
+    return _mm_sub_epi16(r, bias);
+}
+
+// _pairSums: Add the vertical pair sums in 's' (four 32-bit lanes, pixels
+// 0-3) horizontally, leaving the sums of pixels 0+1 and 2+3 in lanes 0 and 2.
+static inline __m128i _pairSums(__m128i s)
+{
+    return _mm_add_epi32(s, _mm_srli_epi64(s, 32));
+}
+
+// _mean2x2: Four outputs from 8 pixels of rows 'a' and 'b'.
+static inline __m128i _mean2x2(const uint16_t * a, const uint16_t * b)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i va = _mm_loadu_si128((const __m128i *) a);
+    __m128i vb = _mm_loadu_si128((const __m128i *) b);
+    __m128i lo = _pairSums(_mm_add_epi32(_mm_unpacklo_epi16(va, zero),
+                                         _mm_unpacklo_epi16(vb, zero)));
+    __m128i hi = _pairSums(_mm_add_epi32(_mm_unpackhi_epi16(va, zero),
+                                         _mm_unpackhi_epi16(vb, zero)));
+    __m128 sum = _mm_cvtepi32_ps(_mm_castps_si128(_mm_shuffle_ps(
+        _mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0))));
+
+    // Missing pixels are -1 in these masks; madd adds horizontal pairs.
+    __m128i missing = _mm_add_epi16(_mm_cmpeq_epi16(va, zero),
+                                    _mm_cmpeq_epi16(vb, zero));
+    __m128i count = _mm_add_epi32(_mm_set1_epi32(4),
+                                  _mm_madd_epi16(missing, _mm_set1_epi16(1)));
+    __m128 countf = _mm_cvtepi32_ps(count);
+    __m128 any = _mm_cmpgt_ps(countf, _mm_setzero_ps());
+    __m128 safe = _mm_or_ps(countf, _mm_andnot_ps(any, _mm_set1_ps(1.0f)));
+    __m128 mean = _mm_and_ps(any, _mm_add_ps(_mm_div_ps(sum, safe),
+                                             _mm_set1_ps(0.5f)));
+    return _mm_cvttps_epi32(mean);
+}
+#endif
+
+// _decimateRows: Output rows [y0, y1) of 'in' (w x h, 'stride' pixels per
+// row) reduced by 'factor' into 'out' (w / factor pixels per row).
+static void _decimateRows(const uint16_t * in, int stride, uint16_t * out,
+                          int w, int factor, int mode, int y0, int y1)
+{
+    int ow = w / factor;
+    for (int y = y0; y < y1; ++y) {
+        const uint16_t * a = in + (size_t) y * factor * stride;
+        uint16_t * o = out + (size_t) y * ow;
+        int x = 0;
+#ifdef __SSE2__
+        if (factor == 2 && mode == oni_DECIMATE_MIN) {
+            for (; x + 8 <= ow; x += 8) {
+                _mm_storeu_si128((__m128i *) (o + x),
+                                 _min2x2(a + 2 * x, a + stride + 2 * x));
+            }
+        } else if (factor == 2 && mode == oni_DECIMATE_MEDIAN) {
+            for (; x + 8 <= ow; x += 8) {
+                _mm_storeu_si128((__m128i *) (o + x),
+                                 _median2x2(a + 2 * x, a + stride + 2 * x));
+            }
+        } else if (factor == 2 && mode == oni_DECIMATE_MEAN) {
+            const __m128i bias = _mm_set1_epi32(32768);
+            const __m128i flip = _mm_set1_epi16((short) 0x8000);
+            for (; x + 8 <= ow; x += 8) {
+                __m128i m0 = _mean2x2(a + 2 * x, a + stride + 2 * x);
+                __m128i m1 = _mean2x2(a + 2 * x + 8, a + stride + 2 * x + 8);
+                _mm_storeu_si128((__m128i *) (o + x), _mm_xor_si128(
+                    _mm_packs_epi32(_mm_sub_epi32(m0, bias),
+                                    _mm_sub_epi32(m1, bias)), flip));
+            }
+        }
+#endif
+        for (; x < ow; ++x) {
+            o[x] = _decimateBlock(a + x * factor, stride, factor, mode);
+        }
+    }
+}
+
+static void _decimate(const uint16_t * in, int stride, uint16_t * out,
+                      int w, int h, int factor, int mode)
+{
+    _parallelFor(h / factor, 16, [&](int y0, int y1) {
+        _decimateRows(in, stride, out, w, factor, mode, y0, y1);
+    });
+}
+
+// =====================
+// openni2_depth_pyramid
+// =====================
+// openni2_depth_pyramid: The level buffers are kept from frame to frame.
+// Unless lazy, every level is built as soon as the frame is set.
+class openni2_depth_pyramid
+{
+public:
+    openni2_depth_pyramid(int levels, int factor, int mode, bool lazy)
+        : factor(factor), mode(mode), lazy(lazy), m_levels(levels),
+          m_built(0) {}
+
+    oni_Status setFrame(const oni_FrameDescriptor & desc)
+    {
+        if (desc.data == NULL || _bytesPerPixel(desc.pixelFormat) != 2 ||
+            desc.sensorType != openni::SENSOR_DEPTH)
+        {
+            return openni::STATUS_NOT_SUPPORTED;
+        }
+        int w = desc.width;
+        int h = desc.height;
+        if (w != m_levels[0].width || h != m_levels[0].height) {
+            for (size_t i = 0; i < m_levels.size(); ++i) {
+                m_levels[i].width = w;
+                m_levels[i].height = h;
+                m_levels[i].pixels.resize((size_t) w * h);
+                w /= factor;
+                h /= factor;
+            }
+        }
+        level & base = m_levels[0];
+        const char * src = (const char *) desc.data;
+        for (int y = 0; y < base.height; ++y) {
+            memcpy(&base.pixels[(size_t) y * base.width],
+                   src + (size_t) y * desc.strideInBytes,
+                   base.width * sizeof(uint16_t));
+        }
+        m_built = 1;
+        if (!lazy) {
+            build((int) m_levels.size() - 1);
+        }
+        return openni::STATUS_OK;
+    }
+
+    const uint16_t * get(int index, int * width, int * height)
+    {
+        if (index < 0 || index >= (int) m_levels.size() || m_built == 0) {
+            return NULL;
+        }
+        build(index);
+        const level & l = m_levels[index];
+        if (width != NULL) {
+            *width = l.width;
+        }
+        if (height != NULL) {
+            *height = l.height;
+        }
+        return l.pixels.empty() ? NULL : &l.pixels[0];
+    }
+
+    int levelCount() const { return (int) m_levels.size(); }
+
+    const int factor;
+    const int mode;
+    const bool lazy;
+
+private:
+    struct level {
+        level() : width(0), height(0) {}
+        int width;
+        int height;
+        std::vector<uint16_t> pixels;
+    };
+
+    // build: Make sure levels up to 'index' are built.
+    void build(int index)
+    {
+        for (; m_built <= index; ++m_built) {
+            level & src = m_levels[m_built - 1];
+            level & dst = m_levels[m_built];
+            if (!dst.pixels.empty()) {
+                _decimate(&src.pixels[0], src.width, &dst.pixels[0],
+                          src.width, src.height, factor, mode);
+            }
+        }
+    }
+
+    std::vector<level> m_levels;
+    // Levels [0, m_built) hold the current frame.
+    int m_built;
+};
+
+// ================
+// oni_DepthPyramid
+// ================
+oni_Status oni_decimateDepth(const oni_DepthPixel * in, int width, int height,
+                             int strideInBytes, int factor, int mode,
+                             oni_DepthPixel * out) {
+    if ((factor != 2 && factor != 4) || mode < oni_DECIMATE_MIN ||
+        mode > oni_DECIMATE_MEAN || strideInBytes % sizeof(oni_DepthPixel) != 0)
+    {
+        return openni::STATUS_BAD_PARAMETER;
+    }
+    EXC_CHECK({
+        _decimate(in, strideInBytes / sizeof(oni_DepthPixel), out, width, height,
+                  factor, mode);
+        return openni::STATUS_OK;
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_DepthPyramid * oni_new_DepthPyramid(int levels, int factor, int mode,
+                                        bool lazy) {
+    if (levels < 1 || (factor != 2 && factor != 4) || mode < oni_DECIMATE_MIN ||
+        mode > oni_DECIMATE_MEAN)
+    {
+        return NULL;
+    }
+    EXC_CHECK( return new openni2_depth_pyramid(levels, factor, mode, lazy); );
+    return NULL;
+}
+
+void oni_delete_DepthPyramid(oni_DepthPyramid * pyramid) {
+    EXC_CHECK( delete pyramid; );
+}
+
+oni_Status oni_setFrame_DepthPyramid(oni_DepthPyramid * pyramid,
+                                     oni_VideoFrameRef * frame) {
+    EXC_CHECK({
+        oni_FrameDescriptor desc;
+        oni_Status rc = oni_getFrameDescriptor(frame, &desc);
+        if (rc != openni::STATUS_OK) {
+            return rc;
+        }
+        return pyramid->setFrame(desc);
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_setDescriptor_DepthPyramid(oni_DepthPyramid * pyramid,
+                                          const oni_FrameDescriptor * desc) {
+    EXC_CHECK( return pyramid->setFrame(*desc); );
+    return openni::STATUS_ERROR;
+}
+
+const oni_DepthPixel * oni_getLevel_DepthPyramid(oni_DepthPyramid * pyramid,
+                                                 int level, int * width,
+                                                 int * height) {
+    EXC_CHECK( return pyramid->get(level, width, height); );
+    return NULL;
+}
+
+int oni_getLevelCount_DepthPyramid(oni_DepthPyramid * pyramid) {
+    EXC_CHECK( return pyramid->levelCount(); );
+    return -1;
+}
@@ -0,0 +1,852 @@
+// ============================================================================
+// openni2_export.cxx: Writing frames as PNG and point clouds as PLY or PCD
+// off the capture thread, within a memory budget (oni_FrameExporter)
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_geometry.h"
+#include "openni2_internal.h"
+
+const int oni_CLOUD_PLY = 0;
+const int oni_CLOUD_PCD = 1;
+
+// What a job turns into.
+enum _exportKind { _EXPORT_PNG, _EXPORT_DEPTH_CLOUD, _EXPORT_POINTS };
+
+// _exportJob: One file to write.  The source is either a frame the job holds
+// a reference to, a copy of a frame's pixels, or a copy of points.  'charge'
+// is what the job counts against the memory budget from submission until
+// its file is written: the source plus the most its encoding can take.
+struct _exportJob
+{
+    _exportKind kind;
+    std::string path;
+    openni::VideoFrameRef frame;
+    std::vector<uint8_t> copy;
+    oni_FrameDescriptor desc;
+    oni_CameraIntrinsics intrinsics;
+    std::vector<oni_PointXYZRGB> points;
+    oni_CloudFormat format;
+    int level;
+    size_t charge;
+    uint64_t sequence;
+    std::chrono::steady_clock::time_point submitted;
+
+    std::vector<uint8_t> encoded;
+    bool ok;
+};
+
+// _pngLayout: The PNG bit depth, color type and bytes per pixel for frames
+// of 'format', or false if PNG can't hold them.  16-bit samples are written
+// big-endian, as PNG wants.
+static bool _pngLayout(oni_PixelFormat format, int * depth, int * colorType,
+                       int * bytesPerPixel)
+{
+    switch (format) {
+    case openni::PIXEL_FORMAT_DEPTH_1_MM:
+    case openni::PIXEL_FORMAT_DEPTH_100_UM:
+    case openni::PIXEL_FORMAT_GRAY16:
+        *depth = 16; *colorType = 0; *bytesPerPixel = 2;
+        return true;
+    case openni::PIXEL_FORMAT_GRAY8:
+        *depth = 8; *colorType = 0; *bytesPerPixel = 1;
+        return true;
+    case openni::PIXEL_FORMAT_RGB888:
+        *depth = 8; *colorType = 2; *bytesPerPixel = 3;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void _putBigEndian(std::vector<uint8_t> & out, uint32_t v)
+{
+    out.push_back((uint8_t) (v >> 24));
+    out.push_back((uint8_t) (v >> 16));
+    out.push_back((uint8_t) (v >> 8));
+    out.push_back((uint8_t) v);
+}
+
+static void _putText(std::vector<uint8_t> & out, const char * text)
+{
+    out.insert(out.end(), text, text + strlen(text));
+}
+
+// _writeCloud: Encode 'count' points as binary PLY or PCD, with colors if
+// 'color'.  Both are written little-endian, as on the host.
+static void _writeCloud(const oni_PointXYZRGB * points, int count, bool color,
+                        oni_CloudFormat format, std::vector<uint8_t> & out)
+{
+    char header[512];
+    if (format == oni_CLOUD_PLY) {
+        snprintf(header, sizeof(header),
+                 "ply\nformat binary_little_endian 1.0\n"
+                 "element vertex %d\n"
+                 "property float x\nproperty float y\nproperty float z\n%s"
+                 "end_header\n", count,
+                 color ? "property uchar red\nproperty uchar green\n"
+                 "property uchar blue\n" : "");
+    } else {
+        snprintf(header, sizeof(header),
+                 "# .PCD v0.7 - Point Cloud Data file format\nVERSION 0.7\n"
+                 "FIELDS x y z%s\nSIZE 4 4 4%s\nTYPE F F F%s\n"
+                 "COUNT 1 1 1%s\nWIDTH %d\nHEIGHT 1\n"
+                 "VIEWPOINT 0 0 0 1 0 0 0\nPOINTS %d\nDATA binary\n",
+                 color ? " rgb" : "", color ? " 4" : "", color ? " U" : "",
+                 color ? " 1" : "", count, count);
+    }
+    int record = 12 + (color ? (format == oni_CLOUD_PLY ? 3 : 4) : 0);
+    out.clear();
+    _putText(out, header);
+    size_t start = out.size();
+    out.resize(start + (size_t) count * record);
+    uint8_t * p = &out[start];
+    for (int i = 0; i < count; ++i, p += record) {
+        memcpy(p, &points[i].x, 12);
+        if (!color) {
+            continue;
+        }
+        if (format == oni_CLOUD_PLY) {
+            p[12] = points[i].r;
+            p[13] = points[i].g;
+            p[14] = points[i].b;
+        } else {
+            uint32_t rgb = ((uint32_t) points[i].r << 16) |
+                ((uint32_t) points[i].g << 8) | points[i].b;
+            memcpy(p + 12, &rgb, 4);
+        }
+    }
+}
+
+// _cloudBound: The most bytes _writeCloud can produce for 'count' points.
+static size_t _cloudBound(size_t count)
+{
+    return 512 + count * 16;
+}
+
+// ==============
+// _exportEncoder
+// ==============
+// _exportEncoder: What a worker keeps from job to job: a deflate stream
+// (reset rather than set up again for every PNG), filtered rows and
+// converted points.
+class _exportEncoder
+{
+public:
+    _exportEncoder() : m_level(-1)
+    {
+#ifdef HAVE_ZLIB
+        memset(&m_stream, 0, sizeof(m_stream));
+#endif
+    }
+
+    ~_exportEncoder()
+    {
+#ifdef HAVE_ZLIB
+        if (m_level >= 0) {
+            deflateEnd(&m_stream);
+        }
+#endif
+    }
+
+    bool encode(_exportJob * job, int level)
+    {
+        if (job->kind == _EXPORT_PNG) {
+            return png(job->desc, level, job->encoded);
+        }
+        if (job->kind == _EXPORT_POINTS) {
+            _writeCloud(job->points.empty() ? NULL : &job->points[0],
+                        (int) job->points.size(), true, job->format,
+                        job->encoded);
+            return true;
+        }
+
+        _depthGeometry g;
+        if (!_makeDepthGeometry(job->desc, job->intrinsics, &g)) {
+            return false;
+        }
+        m_points.clear();
+        for (int y = 0; y < job->desc.height; ++y) {
+            const uint16_t * row = _depthRow(job->desc, y);
+            for (int x = 0; x < job->desc.width; ++x) {
+                if (row[x] == 0) {
+                    continue;
+                }
+                float z = row[x] * g.scale;
+                oni_PointXYZRGB p = { g.ax[x] * z, g.ay[y] * z, z,
+                                      255, 255, 255, 255 };
+                m_points.push_back(p);
+            }
+        }
+        _writeCloud(m_points.empty() ? NULL : &m_points[0],
+                    (int) m_points.size(), false, job->format, job->encoded);
+        return true;
+    }
+
+    // pngBound: The most bytes png() can produce for the frame.
+    static size_t pngBound(const oni_FrameDescriptor & desc, int bytesPerPixel)
+    {
+        size_t raw = (size_t) desc.height * (desc.width * bytesPerPixel + 1);
+        return 128 + raw + raw / 1000 + 64;
+    }
+
+private:
+    // png: Encode the frame as a PNG with a single IDAT chunk.  Every row
+    // uses the Sub filter, which suits smooth depth and IR well and costs
+    // one subtraction per byte.
+    bool png(const oni_FrameDescriptor & desc, int level,
+             std::vector<uint8_t> & out)
+    {
+#ifdef HAVE_ZLIB
+        int depth, colorType, bpp;
+        if (!_pngLayout(desc.pixelFormat, &depth, &colorType, &bpp)) {
+            return false;
+        }
+        if (m_level != level) {
+            if (m_level >= 0) {
+                deflateEnd(&m_stream);
+            }
+            m_level = -1;
+            if (deflateInit(&m_stream, level) != Z_OK) {
+                return false;
+            }
+            m_level = level;
+        } else {
+            deflateReset(&m_stream);
+        }
+
+        size_t rowBytes = (size_t) desc.width * bpp;
+        m_rows.resize(desc.height * (rowBytes + 1));
+        for (int y = 0; y < desc.height; ++y) {
+            const uint8_t * src = (const uint8_t *) desc.data +
+                (size_t) y * desc.strideInBytes;
+            uint8_t * dst = &m_rows[y * (rowBytes + 1)];
+            *dst++ = 1;
+            if (depth == 16) {
+                // The filter works on bytes, so the high and low bytes are
+                // differenced separately, without borrowing.
+                const uint16_t * s = (const uint16_t *) src;
+                uint16_t prev = 0;
+                for (int x = 0; x < desc.width; ++x) {
+                    dst[2 * x] = (uint8_t) ((s[x] >> 8) - (prev >> 8));
+                    dst[2 * x + 1] = (uint8_t) (s[x] - prev);
+                    prev = s[x];
+                }
+            } else {
+                for (int i = 0; i < bpp; ++i) {
+                    dst[i] = src[i];
+                }
+                for (size_t i = bpp; i < rowBytes; ++i) {
+                    dst[i] = (uint8_t) (src[i] - src[i - bpp]);
+                }
+            }
+        }
+
+        out.clear();
+        static const uint8_t signature[8] =
+            { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        out.insert(out.end(), signature, signature + 8);
+        uint8_t ihdr[13];
+        for (int i = 0; i < 4; ++i) {
+            ihdr[i] = (uint8_t) (desc.width >> (24 - 8 * i));
+            ihdr[4 + i] = (uint8_t) (desc.height >> (24 - 8 * i));
+        }
+        ihdr[8] = (uint8_t) depth;
+        ihdr[9] = (uint8_t) colorType;
+        ihdr[10] = ihdr[11] = ihdr[12] = 0;
+        chunk(out, "IHDR", ihdr, sizeof(ihdr));
+
+        // Deflate straight into the IDAT chunk, then fill in its length.
+        size_t start = out.size();
+        out.resize(start + 8 + deflateBound(&m_stream, m_rows.size()));
+        m_stream.next_in = &m_rows[0];
+        m_stream.avail_in = (uInt) m_rows.size();
+        m_stream.next_out = &out[start + 8];
+        m_stream.avail_out = (uInt) (out.size() - start - 8);
+        if (deflate(&m_stream, Z_FINISH) != Z_STREAM_END) {
+            return false;
+        }
+        uint32_t length = (uint32_t) m_stream.total_out;
+        out.resize(start + 8 + length);
+        std::vector<uint8_t> head;
+        _putBigEndian(head, length);
+        _putText(head, "IDAT");
+        memcpy(&out[start], &head[0], 8);
+        _putBigEndian(out, (uint32_t) crc32(0, &out[start + 4], length + 4));
+        chunk(out, "IEND", NULL, 0);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+#ifdef HAVE_ZLIB
+    static void chunk(std::vector<uint8_t> & out, const char * type,
+                      const uint8_t * data, size_t size)
+    {
+        _putBigEndian(out, (uint32_t) size);
+        size_t start = out.size();
+        _putText(out, type);
+        if (size > 0) {
+            out.insert(out.end(), data, data + size);
+        }
+        _putBigEndian(out, (uint32_t) crc32(0, &out[start], size + 4));
+    }
+
+    z_stream m_stream;
+#endif
+    int m_level;
+    std::vector<uint8_t> m_rows;
+    std::vector<oni_PointXYZRGB> m_points;
+};
+
+// ======================
+// openni2_frame_exporter
+// ======================
+// openni2_frame_exporter: Capture should never wait on encoding or on the
+// disk.  Jobs go from 'm_encode' to the encoder threads, then from 'm_write'
+// to the single I/O thread, which writes each file whole.  With a sync
+// interval, the I/O thread keeps written files open and fsyncs them together
+// once that many have piled up, when flushed, or when the exporter is
+// deleted.  Each job is charged its source plus the most its encoding can
+// take; one that would take the queued bytes over the budget is refused
+// rather than waited for.
+class openni2_frame_exporter
+{
+public:
+    openni2_frame_exporter(int threadCount, uint64_t maxBytes)
+        : m_maxBytes(maxBytes), m_level(1), m_syncInterval(0),
+          m_running(true), m_flushing(0), m_syncing(false), m_queuedBytes(0),
+          m_encoding(0), m_flushTarget(0), m_syncedThrough(0)
+    {
+        memset(&m_stats, 0, sizeof(m_stats));
+        if (threadCount <= 0) {
+            threadCount = std::max(1, (int) std::thread::hardware_concurrency());
+        }
+        for (int i = 0; i < threadCount; ++i) {
+            m_encoders.push_back(
+                std::thread(&openni2_frame_exporter::encodeWork, this));
+        }
+        m_writer = std::thread(&openni2_frame_exporter::writeWork, this);
+    }
+
+    // ~openni2_frame_exporter: Finish everything already submitted.
+    ~openni2_frame_exporter()
+    {
+        flush(-1);
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_running = false;
+            m_wake.notify_all();
+            m_writeWake.notify_all();
+        }
+        for (size_t i = 0; i < m_encoders.size(); ++i) {
+            m_encoders[i].join();
+        }
+        m_writer.join();
+        syncAll();
+    }
+
+    void setCompression(int level)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_level = std::max(0, std::min(level, 9));
+    }
+
+    void setSyncInterval(int files)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_syncInterval = std::max(files, 0);
+    }
+
+    // submitFrame: Queue a PNG of the frame, or a cloud of it if 'intrinsics'
+    // is not NULL, referencing 'frame' if it is not NULL and copying the
+    // pixels otherwise.
+    oni_Status submitFrame(const openni::VideoFrameRef * frame,
+                           const oni_FrameDescriptor & desc,
+                           const oni_CameraIntrinsics * intrinsics,
+                           oni_CloudFormat format, const char * path)
+    {
+        if (desc.data == NULL || desc.width <= 0 || desc.height <= 0 ||
+            path == NULL)
+        {
+            return openni::STATUS_BAD_PARAMETER;
+        }
+        size_t bound;
+        if (intrinsics != NULL) {
+            if ((format != oni_CLOUD_PLY && format != oni_CLOUD_PCD) ||
+                (desc.pixelFormat != openni::PIXEL_FORMAT_DEPTH_1_MM &&
+                 desc.pixelFormat != openni::PIXEL_FORMAT_DEPTH_100_UM))
+            {
+                return openni::STATUS_BAD_PARAMETER;
+            }
+            bound = _cloudBound((size_t) desc.width * desc.height);
+        } else {
+            int depth, colorType, bpp;
+            if (!_pngLayout(desc.pixelFormat, &depth, &colorType, &bpp)) {
+                return openni::STATUS_BAD_PARAMETER;
+            }
+#ifndef HAVE_ZLIB
+            return openni::STATUS_NOT_SUPPORTED;
+#endif
+            bound = _exportEncoder::pngBound(desc, bpp);
+        }
+        size_t source = (size_t) desc.strideInBytes * desc.height;
+
+        _exportJob * job = reserve(source + bound);
+        if (job == NULL) {
+            return openni::STATUS_OUT_OF_FLOW;
+        }
+        try {
+            job->kind = intrinsics != NULL ? _EXPORT_DEPTH_CLOUD : _EXPORT_PNG;
+            job->path = path;
+            job->desc = desc;
+            job->format = format;
+            if (intrinsics != NULL) {
+                job->intrinsics = *intrinsics;
+            }
+            if (frame != NULL) {
+                job->frame = *frame;
+            } else {
+                const uint8_t * data = (const uint8_t *) desc.data;
+                job->copy.assign(data, data + source);
+                job->desc.data = &job->copy[0];
+            }
+            enqueue(job);
+        } catch (...) {
+            unreserve(job);
+            throw;
+        }
+        return openni::STATUS_OK;
+    }
+
+    oni_Status submitPoints(const oni_PointXYZRGB * points, int count,
+                            oni_CloudFormat format, const char * path)
+    {
+        if ((points == NULL && count > 0) || count < 0 || path == NULL ||
+            (format != oni_CLOUD_PLY && format != oni_CLOUD_PCD))
+        {
+            return openni::STATUS_BAD_PARAMETER;
+        }
+        _exportJob * job =
+            reserve(count * sizeof(oni_PointXYZRGB) + _cloudBound(count));
+        if (job == NULL) {
+            return openni::STATUS_OUT_OF_FLOW;
+        }
+        try {
+            job->kind = _EXPORT_POINTS;
+            job->path = path;
+            job->format = format;
+            job->points.assign(points, points + count);
+            enqueue(job);
+        } catch (...) {
+            unreserve(job);
+            throw;
+        }
+        return openni::STATUS_OK;
+    }
+
+    // flush: Wait for everything submitted so far to be written, and synced
+    // if there is a sync interval.  Jobs submitted meanwhile are not waited
+    // for.
+    oni_Status flush(int timeoutMs)
+    {
+        std::unique_lock<std::mutex> guard(m_lock);
+        std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(std::max(timeoutMs, 0));
+        uint64_t target = m_stats.submitted;
+        m_flushTarget = std::max(m_flushTarget, target);
+        ++m_flushing;
+        m_writeWake.notify_all();
+        while (!flushed(target)) {
+            if (timeoutMs < 0) {
+                m_idle.wait(guard);
+            } else if (m_idle.wait_until(guard, deadline) ==
+                       std::cv_status::timeout)
+            {
+                break;
+            }
+        }
+        --m_flushing;
+        return flushed(target) ? openni::STATUS_OK : openni::STATUS_TIME_OUT;
+    }
+
+    void stats(oni_ExportStats * out)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        *out = m_stats;
+        out->queuedBytes = m_queuedBytes;
+    }
+
+private:
+    // completedThrough: Every job numbered below this has been written (or
+    // has failed).  Encoders finish out of order, so this can lag the count.
+    uint64_t completedThrough() const
+    {
+        return m_outstanding.empty() ? m_stats.submitted : *m_outstanding.begin();
+    }
+
+    // flushed: Whether every job numbered below 'target' is written and its
+    // file synced.
+    bool flushed(uint64_t target) const
+    {
+        return completedThrough() >= target &&
+            (m_syncedThrough >= target || (m_unsynced.empty() && !m_syncing));
+    }
+
+    // reserve: Charge 'bytes' to the budget and hand out a job, or NULL if
+    // they don't fit.
+    _exportJob * reserve(size_t bytes)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (m_queuedBytes + bytes > m_maxBytes) {
+            ++m_stats.rejected;
+            return NULL;
+        }
+        m_queuedBytes += bytes;
+        ++m_stats.pending;
+        _exportJob * job;
+        if (m_spareJobs.empty()) {
+            job = new _exportJob();
+        } else {
+            job = m_spareJobs.back();
+            m_spareJobs.pop_back();
+        }
+        job->charge = bytes;
+        job->level = m_level;
+        job->submitted = std::chrono::steady_clock::now();
+        job->ok = false;
+        return job;
+    }
+
+    // unreserve: Give back a job from reserve() that could not be queued.
+    void unreserve(_exportJob * job)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        --m_stats.pending;
+        m_queuedBytes -= job->charge;
+        delete job;
+    }
+
+    // enqueue: Number the job and hand it to the encoders.
+    void enqueue(_exportJob * job)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        job->sequence = m_stats.submitted;
+        m_outstanding.insert(job->sequence);
+        try {
+            m_encode.push_back(job);
+        } catch (...) {
+            m_outstanding.erase(job->sequence);
+            throw;
+        }
+        ++m_stats.submitted;
+        m_wake.notify_one();
+    }
+
+    // recycle: Drop the job's source, keeping its buffers for the next one.
+    void recycle(_exportJob * job)
+    {
+        job->frame.release();
+        job->copy.clear();
+        job->points.clear();
+        job->encoded.clear();
+        m_spareJobs.push_back(job);
+    }
+
+    void encodeWork()
+    {
+        _exportEncoder encoder;
+        std::unique_lock<std::mutex> guard(m_lock);
+        for (;;) {
+            if (m_encode.empty()) {
+                if (!m_running) {
+                    return;
+                }
+                m_wake.wait(guard);
+                continue;
+            }
+            _exportJob * job = m_encode.front();
+            m_encode.pop_front();
+            ++m_encoding;
+            guard.unlock();
+
+            try {
+                job->ok = encoder.encode(job, job->level);
+            } catch (std::exception &) {
+                job->ok = false;
+            }
+            // The source is not needed any more.
+            job->frame.release();
+            job->copy.clear();
+            job->points.clear();
+
+            guard.lock();
+            --m_encoding;
+            m_write.push_back(job);
+            m_writeWake.notify_one();
+        }
+    }
+
+    void writeWork()
+    {
+        std::unique_lock<std::mutex> guard(m_lock);
+        for (;;) {
+            // A flush waits for its files to be synced, but only once all of
+            // them are written, so they go in one batch.
+            if (m_flushing > 0 && !m_unsynced.empty() &&
+                m_syncedThrough < m_flushTarget &&
+                completedThrough() >= m_flushTarget)
+            {
+                guard.unlock();
+                syncAll();
+                guard.lock();
+                continue;
+            }
+            if (m_write.empty()) {
+                if (!m_running && m_encode.empty() && m_encoding == 0) {
+                    return;
+                }
+                m_writeWake.wait(guard);
+                continue;
+            }
+            _exportJob * job = m_write.front();
+            m_write.pop_front();
+            int interval = m_syncInterval;
+            guard.unlock();
+
+            bool ok = job->ok && writeFile(job, interval > 0);
+            uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - job->submitted).count();
+
+            guard.lock();
+            if (ok) {
+                ++m_stats.written;
+                m_stats.bytesWritten += job->encoded.size();
+            } else {
+                ++m_stats.failed;
+            }
+            m_stats.totalLatencyNs += ns;
+            m_stats.maxLatencyNs = std::max(m_stats.maxLatencyNs, ns);
+            --m_stats.pending;
+            m_queuedBytes -= job->charge;
+            m_outstanding.erase(job->sequence);
+            recycle(job);
+            if (interval > 0 && (int) m_unsynced.size() >= interval) {
+                guard.unlock();
+                syncAll();
+                guard.lock();
+            }
+            if (m_flushing > 0) {
+                m_idle.notify_all();
+            }
+        }
+    }
+
+    // writeFile: Write the job's file, keeping it open for syncing later if
+    // 'keep'.  Only the I/O thread adds to 'm_unsynced', so it may read its
+    // size without the lock.
+    bool writeFile(_exportJob * job, bool keep)
+    {
+        int fd = open(job->path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        const uint8_t * p = job->encoded.empty() ? NULL : &job->encoded[0];
+        size_t left = job->encoded.size();
+        while (left > 0) {
+            ssize_t n = ::write(fd, p, left);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                close(fd);
+                return false;
+            }
+            p += n;
+            left -= n;
+        }
+        if (keep) {
+            std::lock_guard<std::mutex> guard(m_lock);
+            try {
+                m_unsynced.push_back(fd);
+                return true;
+            } catch (std::exception &) {
+                // No room to keep it for the batch; sync it on its own.
+                fdatasync(fd);
+            }
+        }
+        close(fd);
+        return true;
+    }
+
+    // syncAll: fdatasync and close every file written since the last sync.
+    // Only the I/O thread (or the destructor, after it) calls this, so every
+    // job completed so far has its file among 'fds' or an earlier batch.
+    void syncAll()
+    {
+        std::vector<int> fds;
+        uint64_t through;
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            fds.swap(m_unsynced);
+            m_syncing = !fds.empty();
+            through = completedThrough();
+        }
+        if (fds.empty()) {
+            return;
+        }
+        for (size_t i = 0; i < fds.size(); ++i) {
+            fdatasync(fds[i]);
+            close(fds[i]);
+        }
+        std::lock_guard<std::mutex> guard(m_lock);
+        ++m_stats.syncs;
+        m_syncing = false;
+        m_syncedThrough = std::max(m_syncedThrough, through);
+        m_idle.notify_all();
+    }
+
+    const uint64_t m_maxBytes;
+    int m_level;
+    int m_syncInterval;
+    bool m_running;
+    int m_flushing;
+    bool m_syncing;
+    uint64_t m_queuedBytes;
+    int m_encoding;
+    // Jobs are numbered by m_stats.submitted; the ones not yet written are
+    // in 'm_outstanding'.
+    uint64_t m_flushTarget;
+    uint64_t m_syncedThrough;
+    std::set<uint64_t> m_outstanding;
+    oni_ExportStats m_stats;
+
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::condition_variable m_writeWake;
+    std::condition_variable m_idle;
+    std::vector<std::thread> m_encoders;
+    std::thread m_writer;
+    std::deque<_exportJob *> m_encode;
+    std::deque<_exportJob *> m_write;
+    std::vector<_exportJob *> m_spareJobs;
+    std::vector<int> m_unsynced;
+};
+
+// =================
+// oni_FrameExporter
+// =================
+oni_FrameExporter * oni_new_FrameExporter(int threadCount, uint64_t maxBytes) {
+    if (maxBytes == 0) {
+        return NULL;
+    }
+    EXC_CHECK( return new openni2_frame_exporter(threadCount, maxBytes); );
+    return NULL;
+}
+
+void oni_delete_FrameExporter(oni_FrameExporter * exporter) {
+    EXC_CHECK( delete exporter; );
+}
+
+void oni_setCompression_FrameExporter(oni_FrameExporter * exporter,
+                                      int level) {
+    EXC_CHECK( exporter->setCompression(level); );
+}
+
+void oni_setSyncInterval_FrameExporter(oni_FrameExporter * exporter,
+                                       int files) {
+    EXC_CHECK( exporter->setSyncInterval(files); );
+}
+
+oni_Status oni_exportPng_FrameExporter(oni_FrameExporter * exporter,
+                                       oni_VideoFrameRef * frame,
+                                       const char * path) {
+    EXC_CHECK({
+        oni_FrameDescriptor desc;
+        oni_Status rc = oni_getFrameDescriptor(frame, &desc);
+        if (rc != openni::STATUS_OK) {
+            return rc;
+        }
+        return exporter->submitFrame(frame, desc, NULL, oni_CLOUD_PLY, path);
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_exportPngDescriptor_FrameExporter(oni_FrameExporter * exporter,
+                                                 const oni_FrameDescriptor * desc,
+                                                 const char * path) {
+    EXC_CHECK(
+        return exporter->submitFrame(NULL, *desc, NULL, oni_CLOUD_PLY, path);
+    );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_exportCloud_FrameExporter(oni_FrameExporter * exporter,
+                                         oni_VideoFrameRef * frame,
+                                         const oni_CameraIntrinsics * intrinsics,
+                                         oni_CloudFormat format,
+                                         const char * path) {
+    EXC_CHECK({
+        oni_FrameDescriptor desc;
+        oni_Status rc = oni_getFrameDescriptor(frame, &desc);
+        if (rc != openni::STATUS_OK) {
+            return rc;
+        }
+        return exporter->submitFrame(frame, desc, intrinsics, format, path);
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_exportCloudDescriptor_FrameExporter(
+    oni_FrameExporter * exporter, const oni_FrameDescriptor * desc,
+    const oni_CameraIntrinsics * intrinsics, oni_CloudFormat format,
+    const char * path) {
+    EXC_CHECK(
+        return exporter->submitFrame(NULL, *desc, intrinsics, format, path);
+    );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_exportPoints_FrameExporter(oni_FrameExporter * exporter,
+                                          const oni_PointXYZRGB * points,
+                                          int count, oni_CloudFormat format,
+                                          const char * path) {
+    EXC_CHECK( return exporter->submitPoints(points, count, format, path); );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_flush_FrameExporter(oni_FrameExporter * exporter,
+                                   int timeoutMs) {
+    EXC_CHECK( return exporter->flush(timeoutMs); );
+    return openni::STATUS_ERROR;
+}
+
+void oni_getStats_FrameExporter(oni_FrameExporter * exporter,
+                                oni_ExportStats * stats) {
+    EXC_CHECK( exporter->stats(stats); );
+}
@@ -0,0 +1,236 @@
+// ============================================================================
+// openni2_frame_event.cxx: Frame queues that signal readiness via eventfd
+// (oni_FrameEvent)
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_internal.h"
+
+class openni2_frame_event;
+
+// openni2_frame_event_listener: One per attached stream, so that the event can
+// tell which stream a frame came from and remove just that listener later.
+class openni2_frame_event_listener : public openni::VideoStream::NewFrameListener
+{
+public:
+    openni2_frame_event_listener(openni2_frame_event * event,
+                                 openni::VideoStream * stream)
+        : m_event(event), m_stream(stream), m_queued(0) {}
+
+    // Overrides function in openni::VideoStream::NewFrameListener
+    void onNewFrame(openni::VideoStream & stream);
+
+    openni2_frame_event * m_event;
+    openni::VideoStream * m_stream;
+    // Frames of this stream currently in the event's queue.
+    int m_queued;
+};
+
+// openni2_frame_event: Lets an event loop (select, poll, epoll, Python's
+// asyncio) wait for frames without any callback into the application.  A
+// frame listener per stream reads each new frame into one queue and signals
+// an eventfd, which take() resets before draining the queue.
+class openni2_frame_event
+{
+public:
+    struct entry {
+        openni2_frame_event_listener * source;
+        openni::VideoFrameRef frame;
+    };
+
+    openni2_frame_event(int fd, int queueDepth)
+        : m_fd(fd), m_queueDepth(queueDepth), m_dropped(0) {}
+
+    ~openni2_frame_event()
+    {
+        while (!m_listeners.empty()) {
+            detach(m_listeners.back()->m_stream);
+        }
+        close(m_fd);
+    }
+
+    void push(openni2_frame_event_listener * source,
+              const openni::VideoFrameRef & frame)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (source->m_queued >= m_queueDepth) {
+            for (std::deque<entry>::iterator it = m_queue.begin();
+                 it != m_queue.end(); ++it)
+            {
+                if (it->source == source) {
+                    m_queue.erase(it);
+                    --source->m_queued;
+                    ++m_dropped;
+                    break;
+                }
+            }
+        }
+        entry e;
+        e.source = source;
+        e.frame = frame;
+        m_queue.push_back(e);
+        ++source->m_queued;
+        signal();
+    }
+
+    int take(openni::VideoFrameRef ** refs, openni::VideoStream ** streams,
+             int maxFrames)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        uint64_t count;
+        // Reset the descriptor before draining; a frame that arrives after
+        // this point signals it again.
+        if (read(m_fd, &count, sizeof(count)) < 0) {
+            // EAGAIN: nothing was signaled.  Frames may still be queued if the
+            // last take stopped at maxFrames, so carry on regardless.
+        }
+
+        int n = 0;
+        while (n < maxFrames && !m_queue.empty()) {
+            entry & e = m_queue.front();
+            *refs[n] = e.frame;
+            if (streams != NULL) {
+                streams[n] = e.source->m_stream;
+            }
+            --e.source->m_queued;
+            m_queue.pop_front();
+            ++n;
+        }
+        if (!m_queue.empty()) {
+            signal();
+        }
+        return n;
+    }
+
+    oni_Status attach(openni::VideoStream * stream)
+    {
+        std::lock_guard<std::mutex> attaching(m_attachLock);
+        openni2_frame_event_listener * listener =
+            new openni2_frame_event_listener(this, stream);
+        oni_Status rc = stream->addNewFrameListener(listener);
+        if (rc != openni::STATUS_OK) {
+            delete listener;
+            return rc;
+        }
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_listeners.push_back(listener);
+        return rc;
+    }
+
+    void detach(openni::VideoStream * stream)
+    {
+        std::lock_guard<std::mutex> attaching(m_attachLock);
+        openni2_frame_event_listener * listener = NULL;
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            for (size_t i = 0; i < m_listeners.size(); ++i) {
+                if (m_listeners[i]->m_stream == stream) {
+                    listener = m_listeners[i];
+                    m_listeners.erase(m_listeners.begin() + i);
+                    break;
+                }
+            }
+        }
+        if (listener == NULL) {
+            return;
+        }
+        // Not under the lock: OpenNI waits out a callback that is running,
+        // and that callback may be waiting on the lock in push().
+        stream->removeNewFrameListener(listener);
+
+        std::lock_guard<std::mutex> guard(m_lock);
+        for (std::deque<entry>::iterator it = m_queue.begin();
+             it != m_queue.end(); )
+        {
+            it = it->source == listener ? m_queue.erase(it) : it + 1;
+        }
+        delete listener;
+    }
+
+    int m_fd;
+    int m_queueDepth;
+    // Counted under m_lock, but read without it.
+    std::atomic<uint64_t> m_dropped;
+
+private:
+    void signal()
+    {
+        uint64_t one = 1;
+        if (write(m_fd, &one, sizeof(one)) < 0) {
+            // EAGAIN only happens if the counter is about to overflow, and then
+            // the descriptor is readable already.
+        }
+    }
+
+    std::mutex m_lock;
+    // Held across attach() and detach() as a whole, so that the list of
+    // listeners always matches what is added to the streams.  Callbacks never
+    // take it, so it may be held while OpenNI waits one out.
+    std::mutex m_attachLock;
+    std::deque<entry> m_queue;
+    std::vector<openni2_frame_event_listener *> m_listeners;
+};
+
+void openni2_frame_event_listener::onNewFrame(openni::VideoStream & stream)
+{
+    openni::VideoFrameRef frame;
+    if (stream.readFrame(&frame) == openni::STATUS_OK) {
+        m_event->push(this, frame);
+    }
+}
+
+// ==============
+// oni_FrameEvent
+// ==============
+oni_FrameEvent * oni_new_FrameEvent(int queueDepth) {
+    if (queueDepth <= 0) {
+        return NULL;
+    }
+    EXC_CHECK({
+        int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0) {
+            return NULL;
+        }
+        return new openni2_frame_event(fd, queueDepth);
+    });
+    return NULL;
+}
+
+void oni_delete_FrameEvent(oni_FrameEvent * event) {
+    EXC_CHECK( delete event; );
+}
+
+int oni_getFd_FrameEvent(oni_FrameEvent * event) {
+    return event->m_fd;
+}
+
+oni_Status oni_attach_FrameEvent(oni_FrameEvent * event,
+                                 oni_VideoStream * stream) {
+    EXC_CHECK( return event->attach(stream); );
+    return openni::STATUS_ERROR;
+}
+
+void oni_detach_FrameEvent(oni_FrameEvent * event, oni_VideoStream * stream) {
+    EXC_CHECK( event->detach(stream); );
+}
+
+int oni_takeFrames_FrameEvent(oni_FrameEvent * event, oni_VideoFrameRef ** refs,
+                              oni_VideoStream ** streams, int maxFrames) {
+    EXC_CHECK( return event->take(refs, streams, maxFrames); );
+    return 0;
+}
+
+uint64_t oni_getDroppedCount_FrameEvent(oni_FrameEvent * event) {
+    return event->m_dropped.load();
+}
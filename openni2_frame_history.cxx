@@ -0,0 +1,722 @@
+// ============================================================================
+// openni2_frame_history.cxx: A ring of recent frames indexed by timestamp and
+// frame index, with older frames optionally compressed (oni_FrameHistory)
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_internal.h"
+
+// _historyEntry: One frame in the ring.  An entry never changes once it is
+// in the ring; spilling a frame puts a new, packed entry in its place.  While
+// 'hot', the entry holds a reference to the frame and 'desc.data' points
+// into it; once packed, 'packed' holds the pixels (deflated if 'deflated')
+// and 'desc.data' is NULL.
+struct _historyEntry
+{
+    uint64_t sequence;
+    oni_FrameDescriptor desc;
+    openni::VideoFrameRef frame;
+    bool hot;
+    bool deflated;
+    std::vector<uint8_t> packed;
+
+    _historyEntry * nextRetired;
+    uint64_t retiredEpoch;
+};
+
+// _packDeltas: Turn 16-bit rows into the differences between neighbouring
+// pixels, with all the low bytes first and then all the high bytes, which
+// deflates far better than the pixels themselves.  'out' holds 2 * w * h.
+static void _packDeltas(const oni_FrameDescriptor & desc, uint8_t * out)
+{
+    size_t n = (size_t) desc.width * desc.height;
+    uint8_t * lo = out;
+    uint8_t * hi = out + n;
+    for (int y = 0; y < desc.height; ++y) {
+        const uint16_t * row = (const uint16_t *) ((const char *) desc.data +
+                                                   (size_t) y * desc.strideInBytes);
+        uint16_t prev = 0;
+        for (int x = 0; x < desc.width; ++x) {
+            uint16_t d = (uint16_t) (row[x] - prev);
+            prev = row[x];
+            *lo++ = (uint8_t) d;
+            *hi++ = (uint8_t) (d >> 8);
+        }
+    }
+}
+
+// _unpackDeltas: The reverse of _packDeltas, into packed rows at 'out'.
+static void _unpackDeltas(const uint8_t * in, int width, int height,
+                          uint16_t * out)
+{
+    size_t n = (size_t) width * height;
+    const uint8_t * lo = in;
+    const uint8_t * hi = in + n;
+    for (int y = 0; y < height; ++y) {
+        uint16_t prev = 0;
+        for (int x = 0; x < width; ++x) {
+            prev = (uint16_t) (prev + (*lo++ | (*hi++ << 8)));
+            *out++ = prev;
+        }
+    }
+}
+
+// _usesDeltas: Whether frames like 'desc' are packed with _packDeltas.
+static bool _usesDeltas(const oni_FrameDescriptor & desc)
+{
+    oni_PixelFormat f = desc.pixelFormat;
+    return (f == openni::PIXEL_FORMAT_DEPTH_1_MM ||
+            f == openni::PIXEL_FORMAT_DEPTH_100_UM ||
+            f == openni::PIXEL_FORMAT_GRAY16 ||
+            f == openni::PIXEL_FORMAT_SHIFT_9_2 ||
+            f == openni::PIXEL_FORMAT_SHIFT_9_3) &&
+        desc.strideInBytes >= 2 * desc.width;
+}
+
+// =====================
+// openni2_frame_history
+// =====================
+// openni2_frame_history: Frame 'sequence' lives in slot sequence % capacity
+// while m_head <= sequence < m_tail.  Only one thread (the writer: the frame
+// listener, or whoever calls push) adds and evicts frames, and readers never
+// take a lock.  Evicted and replaced entries are retired rather than freed,
+// and freed by the writer once no reader can still see them: readers pin the
+// epoch they start in, and entries retired in an epoch are freed once the
+// writer has advanced two epochs past it with no reader left in between
+// (epoch-based reclamation).  Lookups by timestamp or frame index are binary
+// searches over the slots.  The spill thread packs entries older than the
+// newest 'm_hotFrames' (16-bit frames as row differences, deflated if built
+// with zlib) and swaps them into their slots, so that a long history fits in
+// little memory.
+class openni2_frame_history : public openni::VideoStream::NewFrameListener
+{
+public:
+    openni2_frame_history(int capacity, uint64_t duration)
+        : m_stream(NULL), m_slots(capacity), m_timestamps(capacity),
+          m_frameIndices(capacity), m_duration(duration), m_head(0), m_tail(0),
+          m_epoch(2), m_retiredStack(NULL), m_hotFrames(0), m_maxSpillBytes(0),
+          m_spillBytes(0), m_packedFrames(0), m_pushed(0), m_evicted(0), m_spilling(false),
+          m_spillNext(0)
+    {
+        m_active[0] = 0;
+        m_active[1] = 0;
+        for (size_t i = 0; i < m_slots.size(); ++i) {
+            m_slots[i] = NULL;
+        }
+    }
+
+    ~openni2_frame_history()
+    {
+        stopSpilling();
+        for (size_t i = 0; i < m_slots.size(); ++i) {
+            delete m_slots[i].load();
+        }
+        collect();
+        for (size_t i = 0; i < m_retired.size(); ++i) {
+            delete m_retired[i];
+        }
+    }
+
+    // Overrides function in openni::VideoStream::NewFrameListener
+    void onNewFrame(openni::VideoStream & stream)
+    {
+        _historyEntry * entry = new _historyEntry();
+        if (stream.readFrame(&entry->frame) != openni::STATUS_OK) {
+            delete entry;
+            return;
+        }
+        add(entry);
+    }
+
+    void push(const openni::VideoFrameRef & frame)
+    {
+        _historyEntry * entry = new _historyEntry();
+        entry->frame = frame;
+        add(entry);
+    }
+
+    // setSpill: Start (or stop, if 'hotFrames' is 0) packing frames.
+    void setSpill(int hotFrames, uint64_t maxBytes)
+    {
+        stopSpilling();
+        m_hotFrames = hotFrames;
+        m_maxSpillBytes = maxBytes;
+        if (hotFrames > 0) {
+            m_spilling = true;
+            m_spiller = std::thread(&openni2_frame_history::spillWork, this);
+        }
+    }
+
+    void range(uint64_t * first, uint64_t * end)
+    {
+        // m_tail first, so that the range is never backwards.
+        uint64_t t = m_tail.load();
+        uint64_t h = m_head.load();
+        *first = std::min(h, t);
+        *end = t;
+    }
+
+    // find: The sequence number of the frame whose timestamp is nearest to
+    // 'key', or (if 'byIndex') whose frame index is exactly 'key'.
+    oni_Status find(uint64_t key, bool byIndex, uint64_t * sequence)
+    {
+        _historyGuard guard(this);
+        for (int attempt = 0; attempt < 8; ++attempt) {
+            // m_head first: it never passes m_tail, so h == t means the ring
+            // really was empty (when m_tail was read).
+            uint64_t h = m_head.load();
+            uint64_t t = m_tail.load();
+            if (h > t) {
+                continue;
+            }
+            if (h == t) {
+                return openni::STATUS_NO_DEVICE;
+            }
+            // Lower bound: the first frame at or after 'key'.
+            uint64_t lo = h, hi = t;
+            bool evicted = false;
+            while (lo < hi && !evicted) {
+                uint64_t mid = lo + (hi - lo) / 2;
+                _historyEntry * e = entry(mid);
+                if (e == NULL) {
+                    evicted = true;
+                } else if (keyOf(e, byIndex) < key) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            if (evicted) {
+                continue;
+            }
+
+            _historyEntry * after = lo < t ? entry(lo) : NULL;
+            _historyEntry * before = lo > h ? entry(lo - 1) : NULL;
+            if ((lo < t && after == NULL) || (lo > h && before == NULL)) {
+                continue;
+            }
+            if (byIndex) {
+                if (after == NULL || keyOf(after, true) != key) {
+                    return openni::STATUS_NO_DEVICE;
+                }
+                *sequence = lo;
+            } else if (after == NULL) {
+                *sequence = lo - 1;
+            } else if (before == NULL) {
+                *sequence = lo;
+            } else {
+                *sequence = keyOf(after, false) - key <
+                    key - keyOf(before, false) ? lo : lo - 1;
+            }
+            return openni::STATUS_OK;
+        }
+        return openni::STATUS_TIME_OUT;
+    }
+
+    oni_Status descriptor(uint64_t sequence, oni_FrameDescriptor * desc)
+    {
+        _historyGuard guard(this);
+        _historyEntry * e = entry(sequence);
+        if (e == NULL) {
+            return openni::STATUS_NO_DEVICE;
+        }
+        *desc = e->desc;
+        desc->data = NULL;
+        return openni::STATUS_OK;
+    }
+
+    oni_Status frame(uint64_t sequence, openni::VideoFrameRef * out)
+    {
+        _historyGuard guard(this);
+        _historyEntry * e = entry(sequence);
+        if (e == NULL) {
+            return openni::STATUS_NO_DEVICE;
+        }
+        if (!e->hot) {
+            return openni::STATUS_NOT_SUPPORTED;
+        }
+        *out = e->frame;
+        return openni::STATUS_OK;
+    }
+
+    oni_Status copy(uint64_t sequence, void * buffer, int size,
+                    oni_FrameDescriptor * desc)
+    {
+        _historyGuard guard(this);
+        _historyEntry * e = entry(sequence);
+        if (e == NULL) {
+            return openni::STATUS_NO_DEVICE;
+        }
+        const oni_FrameDescriptor & src = e->desc;
+        if (size < src.dataSize) {
+            return openni::STATUS_BAD_PARAMETER;
+        }
+        *desc = src;
+        desc->data = buffer;
+        if (e->hot) {
+            memcpy(buffer, src.data, src.dataSize);
+            return openni::STATUS_OK;
+        }
+        return unpack(e, (uint8_t *) buffer) ?
+            openni::STATUS_OK : openni::STATUS_ERROR;
+    }
+
+    void stats(oni_HistoryStats * out)
+    {
+        uint64_t first, end;
+        range(&first, &end);
+        out->frames = (int) (end - first);
+        // Packed frames are counted as the spiller swaps them in, so this is
+        // right even while it lags behind m_hotFrames.
+        int64_t packed = std::max<int64_t>(m_packedFrames.load(), 0);
+        out->hotFrames = (int) std::max<int64_t>(out->frames - packed, 0);
+        out->spillBytes = (uint64_t) std::max<int64_t>(m_spillBytes.load(), 0);
+        out->pushed = m_pushed.load();
+        out->evicted = m_evicted.load();
+    }
+
+    openni::VideoStream * m_stream;
+
+private:
+    // _historyGuard: Pins the current epoch for a reader.
+    class _historyGuard
+    {
+    public:
+        explicit _historyGuard(openni2_frame_history * history)
+            : m_history(history)
+        {
+            for (;;) {
+                m_epoch = history->m_epoch.load();
+                ++history->m_active[m_epoch & 1];
+                if (history->m_epoch.load() == m_epoch) {
+                    break;
+                }
+                --history->m_active[m_epoch & 1];
+            }
+        }
+
+        ~_historyGuard() { --m_history->m_active[m_epoch & 1]; }
+
+    private:
+        openni2_frame_history * m_history;
+        uint64_t m_epoch;
+    };
+
+    // entry: The entry for 'sequence', or NULL if it is not in the ring.
+    // Only valid under a guard (or on the writer).
+    _historyEntry * entry(uint64_t sequence)
+    {
+        _historyEntry * e = m_slots[sequence % m_slots.size()].load();
+        return e != NULL && e->sequence == sequence ? e : NULL;
+    }
+
+    static uint64_t keyOf(const _historyEntry * e, bool byIndex)
+    {
+        return byIndex ? (uint64_t) (uint32_t) e->desc.frameIndex :
+            e->desc.timestamp;
+    }
+
+    void add(_historyEntry * entry)
+    {
+        oni_getFrameDescriptor(&entry->frame, &entry->desc);
+        entry->hot = true;
+        entry->deflated = false;
+
+        uint64_t t = m_tail.load();
+        uint64_t h = m_head.load();
+        // Frames going backwards (e.g. a recording that looped) start over.
+        if (t > h) {
+            size_t last = (t - 1) % m_slots.size();
+            if (entry->desc.timestamp <= m_timestamps[last] ||
+                (uint32_t) entry->desc.frameIndex <= m_frameIndices[last])
+            {
+                while (h < t) {
+                    evict(h++);
+                }
+            }
+        }
+        while (t - h >= m_slots.size() ||
+               (t > h && m_duration > 0 &&
+                entry->desc.timestamp - m_timestamps[h % m_slots.size()] >
+                m_duration) ||
+               (t - h > (uint64_t) m_hotFrames && m_maxSpillBytes > 0 &&
+                m_spillBytes.load() > (int64_t) m_maxSpillBytes))
+        {
+            evict(h++);
+        }
+
+        entry->sequence = t;
+        size_t slot = t % m_slots.size();
+        m_timestamps[slot] = entry->desc.timestamp;
+        m_frameIndices[slot] = (uint32_t) entry->desc.frameIndex;
+        m_slots[slot].store(entry);
+        m_tail.store(t + 1);
+        ++m_pushed;
+        reclaim();
+        if (m_spilling) {
+            m_spillWake.notify_one();
+        }
+    }
+
+    // evict: Take frame 'sequence' out of the ring.  m_head moves past it
+    // first, so that readers stop looking for it.
+    void evict(uint64_t sequence)
+    {
+        m_head.store(sequence + 1);
+        _historyEntry * e = m_slots[sequence % m_slots.size()].exchange(NULL);
+        if (e != NULL) {
+            if (!e->hot) {
+                m_spillBytes -= (int64_t) e->packed.size();
+                --m_packedFrames;
+            }
+            retire(e);
+        }
+        ++m_evicted;
+    }
+
+    // retire: Hand 'e' over to be freed once no reader can see it.  Called by
+    // the writer and the spill thread.
+    void retire(_historyEntry * e)
+    {
+        e->retiredEpoch = m_epoch.load();
+        e->nextRetired = m_retiredStack.load();
+        while (!m_retiredStack.compare_exchange_weak(e->nextRetired, e)) {}
+    }
+
+    void collect()
+    {
+        _historyEntry * e = m_retiredStack.exchange(NULL);
+        while (e != NULL) {
+            m_retired.push_back(e);
+            e = e->nextRetired;
+        }
+    }
+
+    // reclaim: On the writer.  Advance the epoch if nobody is still reading
+    // in the one before, and free what was retired two epochs ago.
+    void reclaim()
+    {
+        collect();
+        if (m_retired.empty()) {
+            return;
+        }
+        uint64_t epoch = m_epoch.load();
+        if (m_active[(epoch + 1) & 1].load() != 0) {
+            return;
+        }
+        m_epoch.store(epoch + 1);
+        size_t kept = 0;
+        for (size_t i = 0; i < m_retired.size(); ++i) {
+            if (m_retired[i]->retiredEpoch + 1 <= epoch) {
+                delete m_retired[i];
+            } else {
+                m_retired[kept++] = m_retired[i];
+            }
+        }
+        m_retired.resize(kept);
+    }
+
+    void stopSpilling()
+    {
+        if (m_spiller.joinable()) {
+            {
+                std::lock_guard<std::mutex> guard(m_spillLock);
+                m_spilling = false;
+            }
+            m_spillWake.notify_all();
+            m_spiller.join();
+        }
+        m_spilling = false;
+    }
+
+    // spillWork: Pack every hot frame older than the newest 'm_hotFrames'.
+    // The frame is read under a guard, packed without one, and swapped in
+    // only if its slot still holds the same entry.
+    void spillWork()
+    {
+        _historyPacker packer;
+        std::unique_lock<std::mutex> lock(m_spillLock);
+        while (m_spilling) {
+            uint64_t t = m_tail.load();
+            uint64_t next = std::max(m_spillNext, m_head.load());
+            if (t < (uint64_t) m_hotFrames || next >= t - m_hotFrames) {
+                m_spillWake.wait_for(lock, std::chrono::milliseconds(10));
+                continue;
+            }
+            lock.unlock();
+
+            openni::VideoFrameRef frame;
+            {
+                _historyGuard guard(this);
+                _historyEntry * e = entry(next);
+                if (e != NULL && e->hot) {
+                    frame = e->frame;
+                }
+            }
+            if (frame.isValid()) {
+                _historyEntry * packed = new _historyEntry();
+                oni_getFrameDescriptor(&frame, &packed->desc);
+                packed->sequence = next;
+                packed->hot = false;
+                packed->deflated = packer.pack(packed->desc, packed->packed);
+                packed->desc.data = NULL;
+                // 16-bit frames come back with packed rows.
+                if (_usesDeltas(packed->desc)) {
+                    packed->desc.strideInBytes = 2 * packed->desc.width;
+                    packed->desc.dataSize =
+                        packed->desc.strideInBytes * packed->desc.height;
+                }
+                frame.release();
+
+                _historyGuard guard(this);
+                std::atomic<_historyEntry *> & slot =
+                    m_slots[next % m_slots.size()];
+                _historyEntry * e = slot.load();
+                if (e != NULL && e->sequence == next && e->hot &&
+                    slot.compare_exchange_strong(e, packed))
+                {
+                    m_spillBytes += (int64_t) packed->packed.size();
+                    ++m_packedFrames;
+                    retire(e);
+                } else {
+                    delete packed;
+                }
+            }
+            m_spillNext = next + 1;
+            lock.lock();
+        }
+    }
+
+    // _historyPacker: The spill thread's deflate stream, kept from frame to
+    // frame, and its scratch buffer.
+    class _historyPacker
+    {
+    public:
+        _historyPacker() : m_ready(false)
+        {
+#ifdef HAVE_ZLIB
+            memset(&m_stream, 0, sizeof(m_stream));
+            m_ready = deflateInit(&m_stream, 1) == Z_OK;
+#endif
+        }
+
+        ~_historyPacker()
+        {
+#ifdef HAVE_ZLIB
+            if (m_ready) {
+                deflateEnd(&m_stream);
+            }
+#endif
+        }
+
+        // pack: Store the frame's pixels (packed rows) in 'out'; returns true
+        // if they were deflated, false if stored as they are.
+        bool pack(const oni_FrameDescriptor & desc, std::vector<uint8_t> & out)
+        {
+            size_t n = (size_t) desc.width * desc.height;
+            const uint8_t * raw = (const uint8_t *) desc.data;
+            size_t rawSize = desc.dataSize;
+            if (_usesDeltas(desc)) {
+                m_scratch.resize(2 * n);
+                _packDeltas(desc, &m_scratch[0]);
+                raw = &m_scratch[0];
+                rawSize = 2 * n;
+            }
+#ifdef HAVE_ZLIB
+            if (m_ready && deflateReset(&m_stream) == Z_OK) {
+                out.resize(deflateBound(&m_stream, rawSize));
+                m_stream.next_in = (Bytef *) raw;
+                m_stream.avail_in = (uInt) rawSize;
+                m_stream.next_out = &out[0];
+                m_stream.avail_out = (uInt) out.size();
+                if (deflate(&m_stream, Z_FINISH) == Z_STREAM_END) {
+                    out.resize(m_stream.total_out);
+                    out.shrink_to_fit();
+                    return true;
+                }
+            }
+#endif
+            out.assign(raw, raw + rawSize);
+            return false;
+        }
+
+    private:
+#ifdef HAVE_ZLIB
+        z_stream m_stream;
+#endif
+        bool m_ready;
+        std::vector<uint8_t> m_scratch;
+    };
+
+    // unpack: Restore a packed entry's pixels into 'out' (desc.dataSize
+    // bytes).
+    static bool unpack(const _historyEntry * e, uint8_t * out)
+    {
+        const oni_FrameDescriptor & desc = e->desc;
+        bool deltas = _usesDeltas(desc);
+        size_t rawSize = desc.dataSize;
+        std::vector<uint8_t> scratch;
+        const uint8_t * raw = &e->packed[0];
+        if (e->deflated) {
+#ifdef HAVE_ZLIB
+            scratch.resize(rawSize);
+            uLongf size = (uLongf) rawSize;
+            if (uncompress(&scratch[0], &size, &e->packed[0],
+                           e->packed.size()) != Z_OK || size != rawSize)
+            {
+                return false;
+            }
+            raw = &scratch[0];
+#else
+            return false;
+#endif
+        }
+        if (deltas) {
+            _unpackDeltas(raw, desc.width, desc.height, (uint16_t *) out);
+        } else {
+            memcpy(out, raw, rawSize);
+        }
+        return true;
+    }
+
+    std::vector<std::atomic<_historyEntry *> > m_slots;
+    // The writer's copies of each slot's keys, for eviction.
+    std::vector<uint64_t> m_timestamps;
+    std::vector<uint32_t> m_frameIndices;
+    const uint64_t m_duration;
+    std::atomic<uint64_t> m_head;
+    std::atomic<uint64_t> m_tail;
+
+    std::atomic<uint64_t> m_epoch;
+    std::atomic<int> m_active[2];
+    std::atomic<_historyEntry *> m_retiredStack;
+    // Only the writer touches this.
+    std::vector<_historyEntry *> m_retired;
+
+    std::atomic<int> m_hotFrames;
+    std::atomic<uint64_t> m_maxSpillBytes;
+    std::atomic<int64_t> m_spillBytes;
+    std::atomic<int64_t> m_packedFrames;
+    std::atomic<uint64_t> m_pushed;
+    std::atomic<uint64_t> m_evicted;
+    std::atomic<bool> m_spilling;
+    uint64_t m_spillNext;
+    std::mutex m_spillLock;
+    std::condition_variable m_spillWake;
+    std::thread m_spiller;
+};
+
+// ================
+// oni_FrameHistory
+// ================
+oni_FrameHistory * oni_new_FrameHistory(int capacity, uint64_t duration) {
+    if (capacity < 1) {
+        return NULL;
+    }
+    EXC_CHECK( return new openni2_frame_history(capacity, duration); );
+    return NULL;
+}
+
+void oni_delete_FrameHistory(oni_FrameHistory * history) {
+    EXC_CHECK({
+        oni_detach_FrameHistory(history);
+        delete history;
+    });
+}
+
+oni_Status oni_attach_FrameHistory(oni_FrameHistory * history,
+                                   oni_VideoStream * stream) {
+    EXC_CHECK({
+        oni_detach_FrameHistory(history);
+        oni_Status rc = stream->addNewFrameListener(history);
+        if (rc == openni::STATUS_OK) {
+            history->m_stream = stream;
+        }
+        return rc;
+    });
+    return openni::STATUS_ERROR;
+}
+
+void oni_detach_FrameHistory(oni_FrameHistory * history) {
+    EXC_CHECK({
+        if (history->m_stream != NULL) {
+            history->m_stream->removeNewFrameListener(history);
+            history->m_stream = NULL;
+        }
+    });
+}
+
+oni_Status oni_push_FrameHistory(oni_FrameHistory * history,
+                                 oni_VideoFrameRef * frame) {
+    if (!frame->isValid()) {
+        return openni::STATUS_BAD_PARAMETER;
+    }
+    EXC_CHECK({
+        history->push(*frame);
+        return openni::STATUS_OK;
+    });
+    return openni::STATUS_ERROR;
+}
+
+void oni_setSpill_FrameHistory(oni_FrameHistory * history, int hotFrames,
+                               uint64_t maxBytes) {
+    EXC_CHECK( history->setSpill(hotFrames, maxBytes); );
+}
+
+void oni_getRange_FrameHistory(oni_FrameHistory * history, uint64_t * first,
+                               uint64_t * end) {
+    history->range(first, end);
+}
+
+oni_Status oni_findTimestamp_FrameHistory(oni_FrameHistory * history,
+                                          uint64_t timestamp,
+                                          uint64_t * sequence) {
+    return history->find(timestamp, false, sequence);
+}
+
+oni_Status oni_findFrameIndex_FrameHistory(oni_FrameHistory * history,
+                                           int frameIndex,
+                                           uint64_t * sequence) {
+    return history->find((uint32_t) frameIndex, true, sequence);
+}
+
+oni_Status oni_getDescriptor_FrameHistory(oni_FrameHistory * history,
+                                          uint64_t sequence,
+                                          oni_FrameDescriptor * desc) {
+    return history->descriptor(sequence, desc);
+}
+
+oni_Status oni_getFrame_FrameHistory(oni_FrameHistory * history,
+                                     uint64_t sequence,
+                                     oni_VideoFrameRef * frame) {
+    EXC_CHECK( return history->frame(sequence, frame); );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_copyFrame_FrameHistory(oni_FrameHistory * history,
+                                      uint64_t sequence, void * buffer,
+                                      int size, oni_FrameDescriptor * desc) {
+    EXC_CHECK( return history->copy(sequence, buffer, size, desc); );
+    return openni::STATUS_ERROR;
+}
+
+void oni_getStats_FrameHistory(oni_FrameHistory * history,
+                               oni_HistoryStats * stats) {
+    history->stats(stats);
+}
@@ -0,0 +1,211 @@
+// ============================================================================
+// openni2_frame_stats.cxx: Per-frame statistics, histograms and validity
+// masks, computed in one pass
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <string.h>
+#include <mutex>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_parallel.h"
+#include "openni2_internal.h"
+
+// _frameStats: Totals over some of the rows.
+struct _frameStats {
+    _frameStats() : sum(0), valid(0), min(0xffff), max(0) {}
+    uint64_t sum;
+    int valid;
+    uint16_t min;
+    uint16_t max;
+};
+
+// _putBits: OR the low 'count' bits of 'bits' into 'mask' at bit 'bit'.
+static inline void _putBits(uint8_t * mask, size_t bit, unsigned bits, int count)
+{
+    int shift = (int) (bit & 7);
+    mask[bit >> 3] |= (uint8_t) (bits << shift);
+    if (shift + count > 8) {
+        mask[(bit >> 3) + 1] |= (uint8_t) (bits >> (8 - shift));
+    }
+}
+
+// _statsRow: Add the 'n' pixels at 'p' to 'stats', and their validity to
+// 'mask' (if not NULL) starting at bit 'bit'.
+static void _statsRow(const uint16_t * p, int n, bool depth, _frameStats & stats,
+                      uint8_t * mask, size_t bit)
+{
+    int x = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i flip = _mm_set1_epi16((short) 0x8000);
+    // For depth, v + 0x7fff is (v - 1) with its top bit flipped: missing
+    // pixels become the largest value and never win the min.
+    const __m128i minBias = _mm_set1_epi16((short) (depth ? 0x7fff : 0x8000));
+    __m128i minv = _mm_set1_epi16(0x7fff);
+    __m128i maxv = _mm_set1_epi16((short) 0x8000);
+    __m128i sum = zero;
+    int valid = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (p + x));
+        __m128i missing = depth ? _mm_cmpeq_epi16(v, zero) : zero;
+        unsigned bits = ~_mm_movemask_epi8(_mm_packs_epi16(missing, missing)) & 0xff;
+        valid += __builtin_popcount(bits);
+        if (mask != NULL) {
+            _putBits(mask, bit + x, bits, 8);
+        }
+        minv = _mm_min_epi16(minv, _mm_add_epi16(v, minBias));
+        maxv = _mm_max_epi16(maxv, _mm_xor_si128(v, flip));
+        // Missing pixels are zero, so they add nothing.
+        sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_unpacklo_epi16(v, zero),
+                                               _mm_unpackhi_epi16(v, zero)));
+    }
+    if (x > 0) {
+        uint16_t lanes[8];
+        _mm_storeu_si128((__m128i *) lanes, _mm_sub_epi16(minv, minBias));
+        for (int i = 0; i < 8; ++i) {
+            // In depth frames, lanes that only saw missing pixels come back
+            // as 0.
+            if ((lanes[i] != 0 || !depth) && lanes[i] < stats.min) {
+                stats.min = lanes[i];
+            }
+        }
+        _mm_storeu_si128((__m128i *) lanes, _mm_xor_si128(maxv, flip));
+        for (int i = 0; i < 8; ++i) {
+            if (lanes[i] > stats.max) {
+                stats.max = lanes[i];
+            }
+        }
+        uint32_t sums[4];
+        _mm_storeu_si128((__m128i *) sums, sum);
+        stats.sum += (uint64_t) sums[0] + sums[1] + sums[2] + sums[3];
+        stats.valid += valid;
+    }
+#endif
+    for (; x < n; ++x) {
+        uint16_t v = p[x];
+        if (depth && v == 0) {
+            continue;
+        }
+        if (mask != NULL) {
+            _putBits(mask, bit + x, 1, 1);
+        }
+        stats.min = v < stats.min ? v : stats.min;
+        stats.max = v > stats.max ? v : stats.max;
+        stats.sum += v;
+        ++stats.valid;
+    }
+}
+
+// _histogramRow: Count the valid pixels of one row into 'bins'.  'scale' maps
+// (value - lo) to a bin in 32.32 fixed point.
+static void _histogramRow(const uint16_t * p, int n, bool depth, uint32_t * bins,
+                          int binCount, int lo, int hi, uint64_t scale)
+{
+    for (int x = 0; x < n; ++x) {
+        int v = p[x];
+        if ((depth && v == 0) || v < lo || v > hi) {
+            continue;
+        }
+        uint64_t bin = ((uint64_t) (v - lo) * scale) >> 32;
+        ++bins[bin < (uint64_t) binCount ? bin : binCount - 1];
+    }
+}
+
+static oni_Status _computeStats(const oni_FrameDescriptor & desc,
+                                oni_FrameStats * stats)
+{
+    if (desc.data == NULL || _bytesPerPixel(desc.pixelFormat) != 2) {
+        return openni::STATUS_NOT_SUPPORTED;
+    }
+    int width = desc.width;
+    int height = desc.height;
+    size_t maskSize = ((size_t) width * height + 7) / 8;
+    uint8_t * mask = stats->validMask;
+    if (mask != NULL && (size_t) stats->validMaskSize < maskSize) {
+        return openni::STATUS_BAD_PARAMETER;
+    }
+    uint32_t * histogram = stats->histogramBins > 0 ? stats->histogram : NULL;
+    int binCount = stats->histogramBins;
+    int lo = stats->histogramMin;
+    int hi = stats->histogramMax;
+    if (histogram != NULL && hi < lo) {
+        return openni::STATUS_BAD_PARAMETER;
+    }
+    // Rounded up, so that truncating never puts a value one bin too low.
+    uint64_t range = (uint64_t) (hi - lo) + 1;
+    uint64_t scale = (((uint64_t) binCount << 32) + range - 1) / range;
+    bool depth = desc.sensorType == openni::SENSOR_DEPTH;
+
+    _frameStats total;
+    std::vector<uint32_t> bins(histogram != NULL ? binCount : 0, 0);
+    std::mutex lock;
+    // Chunks start on a multiple of 16 rows, hence on a whole byte of the
+    // mask, so no two threads write the same byte.
+    _parallelFor(height, 16, [&](int y0, int y1) {
+        _frameStats part;
+        std::vector<uint32_t> partBins(bins.size(), 0);
+        if (mask != NULL) {
+            size_t begin = (size_t) y0 * width / 8;
+            size_t end = ((size_t) y1 * width + 7) / 8;
+            memset(mask + begin, 0, end - begin);
+        }
+        for (int y = y0; y < y1; ++y) {
+            const uint16_t * row = (const uint16_t *)
+                ((const char *) desc.data + (size_t) y * desc.strideInBytes);
+            _statsRow(row, width, depth, part, mask, (size_t) y * width);
+            if (histogram != NULL) {
+                _histogramRow(row, width, depth, &partBins[0], binCount, lo, hi,
+                              scale);
+            }
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        total.sum += part.sum;
+        total.valid += part.valid;
+        total.min = part.min < total.min ? part.min : total.min;
+        total.max = part.max > total.max ? part.max : total.max;
+        for (size_t i = 0; i < partBins.size(); ++i) {
+            bins[i] += partBins[i];
+        }
+    });
+
+    stats->width = width;
+    stats->height = height;
+    stats->validCount = total.valid;
+    stats->minValue = total.valid > 0 ? total.min : 0;
+    stats->maxValue = total.valid > 0 ? total.max : 0;
+    stats->mean = total.valid > 0 ? (double) total.sum / total.valid : 0.0;
+    if (histogram != NULL) {
+        memcpy(histogram, &bins[0], binCount * sizeof(uint32_t));
+    }
+    return openni::STATUS_OK;
+}
+
+// ================
+// Frame statistics
+// ================
+oni_Status oni_computeFrameStats(oni_VideoFrameRef * frame,
+                                 oni_FrameStats * stats) {
+    EXC_CHECK({
+        oni_FrameDescriptor desc;
+        oni_Status rc = oni_getFrameDescriptor(frame, &desc);
+        if (rc != openni::STATUS_OK) {
+            return rc;
+        }
+        return _computeStats(desc, stats);
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_computeDescriptorStats(const oni_FrameDescriptor * desc,
+                                      oni_FrameStats * stats) {
+    EXC_CHECK( return _computeStats(*desc, stats); );
+    return openni::STATUS_ERROR;
+}
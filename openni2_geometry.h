@@ -0,0 +1,79 @@
+// ============================================================================
+// openni2_geometry.h: Turning depth pixels into points, shared by the kernels
+// that work on organized point clouds.  Internal to the C++ code for the
+// wrapper.
+// (c) Chris Hodapp, 2013
+// ============================================================================
+#ifndef OPENNI2_GEOMETRY
+#define OPENNI2_GEOMETRY
+
+#include <OpenNI.h>
+#include <vector>
+
+#include "openni2_types.h"
+
+// _depthGeometry: Pixel (x, y) with raw depth d is the point
+// (ax[x] * z, ay[y] * z, z) with z = d * scale, in mm.  The other way
+// round, point (X, Y, Z) lands on pixel (cx + fx * X / Z, cy - fy * Y / Z).
+struct _depthGeometry {
+    float scale;
+    std::vector<float> ax;
+    std::vector<float> ay;
+    float fx;
+    float fy;
+    float cx;
+    float cy;
+};
+
+// _makeDepthGeometry: Fill in 'geometry' for a frame described by 'desc' and
+// taken with 'intrinsics'.  A cropped frame is placed at its crop origin; an
+// uncropped frame of another size than the intrinsics (e.g. a pyramid level)
+// is scaled to them.  Returns false if 'desc' is not a depth frame in mm or
+// 100 um.
+inline bool _makeDepthGeometry(const oni_FrameDescriptor & desc,
+                               const oni_CameraIntrinsics & intrinsics,
+                               _depthGeometry * geometry)
+{
+    if (desc.data == NULL || desc.width <= 0 || desc.height <= 0 ||
+        intrinsics.fx <= 0.0f || intrinsics.fy <= 0.0f)
+    {
+        return false;
+    }
+    if (desc.pixelFormat == openni::PIXEL_FORMAT_DEPTH_1_MM) {
+        geometry->scale = 1.0f;
+    } else if (desc.pixelFormat == openni::PIXEL_FORMAT_DEPTH_100_UM) {
+        geometry->scale = 0.1f;
+    } else {
+        return false;
+    }
+    float originX = 0.0f, originY = 0.0f, stepX = 1.0f, stepY = 1.0f;
+    if (desc.croppingEnabled) {
+        originX = (float) desc.cropOriginX;
+        originY = (float) desc.cropOriginY;
+    } else if (intrinsics.width > 0 && intrinsics.height > 0) {
+        stepX = (float) intrinsics.width / desc.width;
+        stepY = (float) intrinsics.height / desc.height;
+    }
+    geometry->ax.resize(desc.width);
+    geometry->ay.resize(desc.height);
+    for (int x = 0; x < desc.width; ++x) {
+        geometry->ax[x] = (originX + x * stepX - intrinsics.cx) / intrinsics.fx;
+    }
+    for (int y = 0; y < desc.height; ++y) {
+        geometry->ay[y] = (intrinsics.cy - originY - y * stepY) / intrinsics.fy;
+    }
+    geometry->fx = intrinsics.fx / stepX;
+    geometry->fy = intrinsics.fy / stepY;
+    geometry->cx = (intrinsics.cx - originX) / stepX;
+    geometry->cy = (intrinsics.cy - originY) / stepY;
+    return true;
+}
+
+// _depthRow: Row 'y' of the frame described by 'desc'.
+inline const uint16_t * _depthRow(const oni_FrameDescriptor & desc, int y)
+{
+    return (const uint16_t *) ((const char *) desc.data +
+                               (size_t) y * desc.strideInBytes);
+}
+
+#endif // OPENNI2_GEOMETRY
@@ -0,0 +1,44 @@
+// ============================================================================
+// openni2_internal.h: Definitions shared by the wrapper's C++ source files but
+// not part of its interface.
+// (c) Chris Hodapp, 2013
+// ============================================================================
+#ifndef OPENNI2_INTERNAL
+#define OPENNI2_INTERNAL
+
+#include <OpenNI.h>
+#include <iostream>
+
+// EXC_CHECK(block): Wrap the block or statement in an exception check, e.g.
+//     EXC_CHECK( delete ptr; )
+// This being a C wrapper, none of the functions may throw exceptions, so it is
+// wise to use this anyplace an exception could conceivably occur.  The block
+// is taken as variadic so that it may contain commas outside of parentheses.
+#define EXC_CHECK(...) \
+    try { \
+        __VA_ARGS__ \
+    } catch (std::exception & e) { \
+        std::cout << "Error: " << e.what() << std::endl; \
+    }
+
+// _bytesPerPixel: Size of one pixel of 'format', or 0 for formats without a
+// fixed pixel size (YUV422 pairs, JPEG).
+inline int _bytesPerPixel(int format)
+{
+    switch (format) {
+    case openni::PIXEL_FORMAT_DEPTH_1_MM:
+    case openni::PIXEL_FORMAT_DEPTH_100_UM:
+    case openni::PIXEL_FORMAT_SHIFT_9_2:
+    case openni::PIXEL_FORMAT_SHIFT_9_3:
+    case openni::PIXEL_FORMAT_GRAY16:
+        return 2;
+    case openni::PIXEL_FORMAT_GRAY8:
+        return 1;
+    case openni::PIXEL_FORMAT_RGB888:
+        return 3;
+    default:
+        return 0;
+    }
+}
+
+#endif // OPENNI2_INTERNAL
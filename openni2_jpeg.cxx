@@ -0,0 +1,540 @@
+// ============================================================================
+// openni2_jpeg.cxx: Decoding JPEG color frames on a pool of threads, in order,
+// into pooled buffers (oni_JpegDecoder)
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef HAVE_LIBJPEG
+#include <setjmp.h>
+extern "C" {
+#include <jpeglib.h>
+}
+#endif
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_internal.h"
+
+// _jpegJob: One submitted frame.  The compressed data is either that of
+// 'frame' (which the job holds a reference to) or a copy in 'copy'; jobs are
+// recycled along with their copy buffers.
+struct _jpegJob
+{
+    uint64_t sequence;
+    openni::VideoFrameRef frame;
+    std::vector<uint8_t> copy;
+    const uint8_t * data;
+    int size;
+    oni_FrameDescriptor source;
+    oni_PixelFormat format;
+    int scale;
+
+    bool taken;
+    bool done;
+    oni_Status status;
+    int buffer;
+    int width;
+    int height;
+    int stride;
+};
+
+#ifdef HAVE_LIBJPEG
+// =================
+// libjpeg callbacks
+// =================
+// libjpeg's error and source managers for decoding from memory.  Errors
+// longjmp back to the decode call instead of exiting, warnings about corrupt
+// data are not printed, and data that ends early (some cameras leave out the
+// EOI marker) is padded with an EOI so that what was there still decodes.
+struct _jpegError
+{
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+};
+
+static void _jpegErrorExit(j_common_ptr cinfo)
+{
+    longjmp(((_jpegError *) cinfo->err)->jump, 1);
+}
+
+static void _jpegQuiet(j_common_ptr) {}
+
+static void _jpegSourceInit(j_decompress_ptr) {}
+
+static boolean _jpegSourceFill(j_decompress_ptr cinfo)
+{
+    static const JOCTET eoi[2] = { 0xFF, JPEG_EOI };
+    cinfo->src->next_input_byte = eoi;
+    cinfo->src->bytes_in_buffer = 2;
+    return TRUE;
+}
+
+static void _jpegSourceSkip(j_decompress_ptr cinfo, long count)
+{
+    if (count <= 0) {
+        return;
+    }
+    if ((size_t) count > cinfo->src->bytes_in_buffer) {
+        _jpegSourceFill(cinfo);
+    } else {
+        cinfo->src->next_input_byte += count;
+        cinfo->src->bytes_in_buffer -= count;
+    }
+}
+
+static void _jpegSourceTerm(j_decompress_ptr) {}
+
+// _packYuv422: Pack a row of 'n' interleaved Y, Cb, Cr pixels as UYVY (which
+// is what OpenNI means by YUV422), averaging the chroma of each pair.  An odd
+// last pixel is paired with itself.
+static void _packYuv422(const uint8_t * ycc, int n, uint8_t * out)
+{
+    int x = 0;
+    for (; x + 2 <= n; x += 2, ycc += 6, out += 4) {
+        out[0] = (uint8_t) ((ycc[1] + ycc[4] + 1) >> 1);
+        out[1] = ycc[0];
+        out[2] = (uint8_t) ((ycc[2] + ycc[5] + 1) >> 1);
+        out[3] = ycc[3];
+    }
+    if (x < n) {
+        out[0] = ycc[1];
+        out[1] = ycc[0];
+        out[2] = ycc[2];
+        out[3] = ycc[0];
+    }
+}
+
+// =================
+// _jpegDecompressor
+// =================
+// _jpegDecompressor: A libjpeg decompressor that a worker thread keeps for
+// its lifetime, so that its tables and buffers are set up once per thread
+// rather than once per frame.
+class _jpegDecompressor
+{
+public:
+    _jpegDecompressor()
+    {
+        m_cinfo.err = jpeg_std_error(&m_error.pub);
+        m_error.pub.error_exit = _jpegErrorExit;
+        m_error.pub.output_message = _jpegQuiet;
+        jpeg_create_decompress(&m_cinfo);
+        m_source.init_source = _jpegSourceInit;
+        m_source.fill_input_buffer = _jpegSourceFill;
+        m_source.skip_input_data = _jpegSourceSkip;
+        m_source.resync_to_restart = jpeg_resync_to_restart;
+        m_source.term_source = _jpegSourceTerm;
+        m_cinfo.src = &m_source;
+    }
+
+    ~_jpegDecompressor() { jpeg_destroy_decompress(&m_cinfo); }
+
+    // decode: Decode 'job', getting its output buffer from 'acquire' once the
+    // size is known.  Nothing with a destructor may live across the setjmp.
+    template <typename Acquire>
+    oni_Status decode(_jpegJob * job, Acquire acquire)
+    {
+        if (setjmp(m_error.jump)) {
+            jpeg_abort_decompress(&m_cinfo);
+            return openni::STATUS_ERROR;
+        }
+        m_source.next_input_byte = job->data;
+        m_source.bytes_in_buffer = job->size;
+        if (jpeg_read_header(&m_cinfo, TRUE) != JPEG_HEADER_OK) {
+            jpeg_abort_decompress(&m_cinfo);
+            return openni::STATUS_ERROR;
+        }
+
+        bool yuv = job->format == openni::PIXEL_FORMAT_YUV422;
+        m_cinfo.scale_num = 1;
+        m_cinfo.scale_denom = job->scale;
+        m_cinfo.out_color_space =
+            job->format == openni::PIXEL_FORMAT_GRAY8 ? JCS_GRAYSCALE :
+            yuv ? JCS_YCbCr : JCS_RGB;
+        jpeg_start_decompress(&m_cinfo);
+
+        int w = (int) m_cinfo.output_width;
+        int h = (int) m_cinfo.output_height;
+        int channels = m_cinfo.output_components;
+        job->width = w;
+        job->height = h;
+        job->stride = yuv ? (w + 1) / 2 * 4 : w * channels;
+        uint8_t * out = acquire(job->stride * h);
+
+        if (yuv) {
+            m_scratch.resize((size_t) m_cinfo.rec_outbuf_height * w * 3);
+        }
+        JSAMPROW rows[16];
+        int batch = std::min((int) m_cinfo.rec_outbuf_height, 16);
+        while ((int) m_cinfo.output_scanline < h) {
+            int y = (int) m_cinfo.output_scanline;
+            int n = std::min(batch, h - y);
+            for (int i = 0; i < n; ++i) {
+                rows[i] = yuv ? &m_scratch[(size_t) i * w * 3] :
+                    out + (size_t) (y + i) * job->stride;
+            }
+            n = (int) jpeg_read_scanlines(&m_cinfo, rows, n);
+            if (yuv) {
+                for (int i = 0; i < n; ++i) {
+                    _packYuv422(rows[i], w,
+                                out + (size_t) (y + i) * job->stride);
+                }
+            }
+        }
+        jpeg_finish_decompress(&m_cinfo);
+        return openni::STATUS_OK;
+    }
+
+    // abort: Get ready for the next decode after one that threw.
+    void abort() { jpeg_abort_decompress(&m_cinfo); }
+
+private:
+    struct jpeg_decompress_struct m_cinfo;
+    _jpegError m_error;
+    struct jpeg_source_mgr m_source;
+    std::vector<uint8_t> m_scratch;
+};
+#endif
+
+// ====================
+// openni2_jpeg_decoder
+// ====================
+// openni2_jpeg_decoder: Jobs are queued in the order they were submitted and
+// stay there until received, so the front of 'm_jobs' is always the next
+// frame out.  Workers take the oldest job nobody has taken yet, each keeping
+// one decompressor for its lifetime.  Output buffers come from a pool that
+// grows to however many frames are decoding or held by the caller at once,
+// so a steady stream allocates nothing.  Scaling down on the way skips most
+// of the work for consumers that only want thumbnails.
+class openni2_jpeg_decoder
+{
+public:
+    openni2_jpeg_decoder(int threadCount, int maxPending)
+        : m_maxPending(maxPending), m_format(openni::PIXEL_FORMAT_RGB888),
+          m_scale(1), m_sequence(0), m_reserved(0), m_running(true)
+    {
+        if (threadCount <= 0) {
+            threadCount = std::max(1, (int) std::thread::hardware_concurrency());
+        }
+        for (int i = 0; i < threadCount; ++i) {
+            m_workers.push_back(std::thread(&openni2_jpeg_decoder::work, this));
+        }
+    }
+
+    ~openni2_jpeg_decoder()
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_running = false;
+            m_wake.notify_all();
+        }
+        for (size_t i = 0; i < m_workers.size(); ++i) {
+            m_workers[i].join();
+        }
+        for (size_t i = 0; i < m_jobs.size(); ++i) {
+            delete m_jobs[i];
+        }
+        for (size_t i = 0; i < m_spareJobs.size(); ++i) {
+            delete m_spareJobs[i];
+        }
+    }
+
+    oni_Status setOutput(oni_PixelFormat format, int scale)
+    {
+        if ((format != openni::PIXEL_FORMAT_RGB888 &&
+             format != openni::PIXEL_FORMAT_YUV422 &&
+             format != openni::PIXEL_FORMAT_GRAY8) ||
+            (scale != 1 && scale != 2 && scale != 4 && scale != 8))
+        {
+            return openni::STATUS_BAD_PARAMETER;
+        }
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_format = format;
+        m_scale = scale;
+        return openni::STATUS_OK;
+    }
+
+    // submit: Queue a frame, referencing 'frame' if it is not NULL and
+    // copying 'desc.data' otherwise.
+    oni_Status submit(const openni::VideoFrameRef * frame,
+                      const oni_FrameDescriptor & desc, uint64_t * sequence)
+    {
+        if (desc.pixelFormat != openni::PIXEL_FORMAT_JPEG ||
+            desc.data == NULL || desc.dataSize <= 0)
+        {
+            return openni::STATUS_BAD_PARAMETER;
+        }
+
+        // The job's place in the queue is reserved along with the check, so
+        // that concurrent submitters can't take it past 'm_maxPending' while
+        // each fills in its job.
+        _jpegJob * job;
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            if ((int) m_jobs.size() + m_reserved >= m_maxPending) {
+                return openni::STATUS_OUT_OF_FLOW;
+            }
+            if (m_spareJobs.empty()) {
+                job = new _jpegJob();
+            } else {
+                job = m_spareJobs.back();
+                m_spareJobs.pop_back();
+            }
+            ++m_reserved;
+        }
+
+        try {
+            if (frame != NULL) {
+                job->frame = *frame;
+                job->data = (const uint8_t *) desc.data;
+            } else {
+                job->copy.assign((const uint8_t *) desc.data,
+                                 (const uint8_t *) desc.data + desc.dataSize);
+                job->data = &job->copy[0];
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(m_lock);
+            --m_reserved;
+            delete job;
+            throw;
+        }
+        job->size = desc.dataSize;
+        job->source = desc;
+        job->taken = false;
+        job->done = false;
+        job->status = openni::STATUS_ERROR;
+        job->buffer = -1;
+        job->width = job->height = job->stride = 0;
+
+        std::lock_guard<std::mutex> guard(m_lock);
+        --m_reserved;
+        try {
+            m_jobs.push_back(job);
+        } catch (...) {
+            delete job;
+            throw;
+        }
+        job->sequence = m_sequence++;
+        job->format = m_format;
+        job->scale = m_scale;
+        m_wake.notify_one();
+        if (sequence != NULL) {
+            *sequence = job->sequence;
+        }
+        return openni::STATUS_OK;
+    }
+
+    oni_Status receive(oni_DecodedFrame * out, int timeoutMs)
+    {
+        std::unique_lock<std::mutex> guard(m_lock);
+        std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(std::max(timeoutMs, 0));
+        while (m_jobs.empty() || !m_jobs.front()->done) {
+            if (timeoutMs < 0) {
+                m_done.wait(guard);
+            } else if (m_done.wait_until(guard, deadline) ==
+                       std::cv_status::timeout)
+            {
+                if (m_jobs.empty() || !m_jobs.front()->done) {
+                    return openni::STATUS_TIME_OUT;
+                }
+            }
+        }
+
+        _jpegJob * job = m_jobs.front();
+        m_jobs.pop_front();
+        out->sequence = job->sequence;
+        out->status = job->status;
+        out->_buffer = job->buffer;
+        out->desc = job->source;
+        out->desc.pixelFormat = job->format;
+        out->desc.width = job->width;
+        out->desc.height = job->height;
+        out->desc.strideInBytes = job->stride;
+        out->desc.dataSize = job->stride * job->height;
+        out->desc.data = job->buffer < 0 ? NULL : &m_buffers[job->buffer][0];
+        out->desc.cropOriginX /= job->scale;
+        out->desc.cropOriginY /= job->scale;
+
+        job->frame.release();
+        m_spareJobs.push_back(job);
+        return openni::STATUS_OK;
+    }
+
+    void release(oni_DecodedFrame * frame)
+    {
+        if (frame->_buffer < 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_freeBuffers.push_back(frame->_buffer);
+        frame->_buffer = -1;
+        frame->desc.data = NULL;
+    }
+
+    int pending()
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        return (int) m_jobs.size();
+    }
+
+private:
+    // acquire: Give 'job' a buffer of at least 'bytes' from the pool.  Only
+    // the worker decoding the job touches the buffer until it is received.
+    uint8_t * acquire(_jpegJob * job, int bytes)
+    {
+        std::vector<uint8_t> * pooled;
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            if (m_freeBuffers.empty()) {
+                m_buffers.push_back(std::vector<uint8_t>());
+                job->buffer = (int) m_buffers.size() - 1;
+            } else {
+                job->buffer = m_freeBuffers.back();
+                m_freeBuffers.pop_back();
+            }
+            pooled = &m_buffers[job->buffer];
+        }
+        std::vector<uint8_t> & buffer = *pooled;
+        if ((int) buffer.size() < bytes) {
+            buffer.resize(bytes);
+        }
+        return &buffer[0];
+    }
+
+    void work()
+    {
+#ifdef HAVE_LIBJPEG
+        _jpegDecompressor decompressor;
+#endif
+        std::unique_lock<std::mutex> guard(m_lock);
+        while (m_running) {
+            _jpegJob * job = NULL;
+            for (size_t i = 0; i < m_jobs.size() && job == NULL; ++i) {
+                if (!m_jobs[i]->taken) {
+                    job = m_jobs[i];
+                }
+            }
+            if (job == NULL) {
+                m_wake.wait(guard);
+                continue;
+            }
+            job->taken = true;
+            guard.unlock();
+
+            oni_Status rc = openni::STATUS_NOT_SUPPORTED;
+#ifdef HAVE_LIBJPEG
+            try {
+                rc = decompressor.decode(job, [this, job] (int bytes) {
+                    return acquire(job, bytes);
+                });
+            } catch (std::exception &) {
+                decompressor.abort();
+                rc = openni::STATUS_ERROR;
+            }
+#endif
+
+            guard.lock();
+            if (rc != openni::STATUS_OK && job->buffer >= 0) {
+                m_freeBuffers.push_back(job->buffer);
+                job->buffer = -1;
+            }
+            job->status = rc;
+            job->done = true;
+            if (job == m_jobs.front()) {
+                m_done.notify_all();
+            }
+        }
+    }
+
+    const int m_maxPending;
+    oni_PixelFormat m_format;
+    int m_scale;
+    uint64_t m_sequence;
+    // Jobs that passed the m_maxPending check but are not queued yet.
+    int m_reserved;
+    bool m_running;
+
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::vector<std::thread> m_workers;
+    std::deque<_jpegJob *> m_jobs;
+    std::vector<_jpegJob *> m_spareJobs;
+    // A deque, so that growing the pool leaves buffers being decoded into
+    // where they are.
+    std::deque<std::vector<uint8_t> > m_buffers;
+    std::vector<int> m_freeBuffers;
+};
+
+// ===============
+// oni_JpegDecoder
+// ===============
+oni_JpegDecoder * oni_new_JpegDecoder(int threadCount, int maxPending) {
+#ifdef HAVE_LIBJPEG
+    if (maxPending < 1) {
+        return NULL;
+    }
+    EXC_CHECK( return new openni2_jpeg_decoder(threadCount, maxPending); );
+#endif
+    return NULL;
+}
+
+void oni_delete_JpegDecoder(oni_JpegDecoder * decoder) {
+    EXC_CHECK( delete decoder; );
+}
+
+oni_Status oni_setOutput_JpegDecoder(oni_JpegDecoder * decoder,
+                                     oni_PixelFormat format, int scale) {
+    EXC_CHECK( return decoder->setOutput(format, scale); );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_submit_JpegDecoder(oni_JpegDecoder * decoder,
+                                  oni_VideoFrameRef * frame,
+                                  uint64_t * sequence) {
+    EXC_CHECK({
+        oni_FrameDescriptor desc;
+        oni_Status rc = oni_getFrameDescriptor(frame, &desc);
+        if (rc != openni::STATUS_OK) {
+            return rc;
+        }
+        return decoder->submit(frame, desc, sequence);
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_submitDescriptor_JpegDecoder(oni_JpegDecoder * decoder,
+                                            const oni_FrameDescriptor * desc,
+                                            uint64_t * sequence) {
+    EXC_CHECK( return decoder->submit(NULL, *desc, sequence); );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_receive_JpegDecoder(oni_JpegDecoder * decoder,
+                                   oni_DecodedFrame * frame, int timeoutMs) {
+    EXC_CHECK( return decoder->receive(frame, timeoutMs); );
+    return openni::STATUS_ERROR;
+}
+
+void oni_release_DecodedFrame(oni_JpegDecoder * decoder,
+                              oni_DecodedFrame * frame) {
+    EXC_CHECK( decoder->release(frame); );
+}
+
+int oni_getPending_JpegDecoder(oni_JpegDecoder * decoder) {
+    EXC_CHECK( return decoder->pending(); );
+    return -1;
+}
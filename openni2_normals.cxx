@@ -0,0 +1,609 @@
+// ============================================================================
+// openni2_normals.cxx: Surface normals and curvature from depth frames
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <math.h>
+#include <string.h>
+#include <limits>
+#include <memory>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_geometry.h"
+#include "openni2_parallel.h"
+#include "openni2_internal.h"
+
+const int oni_NORMALS_CROSS_PRODUCT = 0;
+const int oni_NORMALS_INTEGRAL_IMAGE = 1;
+
+static const float _nan = std::numeric_limits<float>::quiet_NaN();
+
+// _normalsParams: Everything the row kernels need about one call.
+struct _normalsParams {
+    const oni_FrameDescriptor * desc;
+    _depthGeometry geometry;
+    int radius;
+    float maxDepthChange;
+    float * normals;
+    float * curvature;
+};
+
+// _closeEnough: Whether neighbor depth 'z' may share a surface with depth 'zc'.
+static inline bool _closeEnough(float z, float zc, float maxDepthChange)
+{
+    return z > 0.0f && (maxDepthChange <= 0.0f ||
+                        fabsf(z - zc) <= maxDepthChange * zc);
+}
+
+// _storeNormal: Orient (nx, ny, nz) towards the camera, which is at the
+// origin, from point 'p', normalize it and store it at 'out'.
+static inline void _storeNormal(float nx, float ny, float nz, const float * p,
+                                float * out)
+{
+    float len = sqrtf(nx * nx + ny * ny + nz * nz);
+    if (!(len > 0.0f)) {
+        out[0] = out[1] = out[2] = _nan;
+        return;
+    }
+    if (nx * p[0] + ny * p[1] + nz * p[2] > 0.0f) {
+        len = -len;
+    }
+    out[0] = nx / len;
+    out[1] = ny / len;
+    out[2] = nz / len;
+}
+
+static inline void _storeNaN(float * out, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        out[i] = _nan;
+    }
+}
+
+// ==============
+// Cross products
+// ==============
+// The normal at a pixel is the cross product of the vectors between its
+// neighbors 'radius' pixels to the left and right and those above and below.
+
+static void _crossProductPixel(const _normalsParams & p, int x, int y,
+                               float * out)
+{
+    int r = p.radius;
+    const _depthGeometry & g = p.geometry;
+    float s = g.scale;
+    float zc = _depthRow(*p.desc, y)[x] * s;
+    float zl = _depthRow(*p.desc, y)[x - r] * s;
+    float zr = _depthRow(*p.desc, y)[x + r] * s;
+    float zu = _depthRow(*p.desc, y - r)[x] * s;
+    float zd = _depthRow(*p.desc, y + r)[x] * s;
+    float md = p.maxDepthChange;
+    if (zc <= 0.0f || !_closeEnough(zl, zc, md) || !_closeEnough(zr, zc, md) ||
+        !_closeEnough(zu, zc, md) || !_closeEnough(zd, zc, md))
+    {
+        _storeNaN(out, 3);
+        return;
+    }
+    float tx[3] = { zr * g.ax[x + r] - zl * g.ax[x - r], (zr - zl) * g.ay[y],
+                    zr - zl };
+    float ty[3] = { (zu - zd) * g.ax[x], zu * g.ay[y - r] - zd * g.ay[y + r],
+                    zu - zd };
+    float pc[3] = { g.ax[x] * zc, g.ay[y] * zc, zc };
+    _storeNormal(tx[1] * ty[2] - tx[2] * ty[1], tx[2] * ty[0] - tx[0] * ty[2],
+                 tx[0] * ty[1] - tx[1] * ty[0], pc, out);
+}
+
+#ifdef __SSE2__
+static inline __m128 _loadDepth4(const uint16_t * p, __m128 scale)
+{
+    __m128i v = _mm_loadl_epi64((const __m128i *) p);
+    return _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128())),
+                      scale);
+}
+
+// _neighborOk4: The vector form of _closeEnough.
+static inline __m128 _neighborOk4(__m128 z, __m128 zc, __m128 md)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 abs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 near = _mm_cmple_ps(_mm_and_ps(_mm_sub_ps(z, zc), abs),
+                               _mm_mul_ps(md, zc));
+    return _mm_and_ps(_mm_cmpgt_ps(z, zero),
+                      _mm_or_ps(near, _mm_cmple_ps(md, zero)));
+}
+
+// _crossProduct4: Normals of pixels x .. x + 3 of row y.
+static void _crossProduct4(const _normalsParams & p, int x, int y, float * out)
+{
+    int r = p.radius;
+    const _depthGeometry & g = p.geometry;
+    const __m128 s = _mm_set1_ps(g.scale);
+    const __m128 md = _mm_set1_ps(p.maxDepthChange);
+    const uint16_t * row = _depthRow(*p.desc, y);
+    __m128 zc = _loadDepth4(row + x, s);
+    __m128 zl = _loadDepth4(row + x - r, s);
+    __m128 zr = _loadDepth4(row + x + r, s);
+    __m128 zu = _loadDepth4(_depthRow(*p.desc, y - r) + x, s);
+    __m128 zd = _loadDepth4(_depthRow(*p.desc, y + r) + x, s);
+    __m128 valid = _mm_and_ps(_mm_cmpgt_ps(zc, _mm_setzero_ps()),
+        _mm_and_ps(_mm_and_ps(_neighborOk4(zl, zc, md), _neighborOk4(zr, zc, md)),
+                   _mm_and_ps(_neighborOk4(zu, zc, md), _neighborOk4(zd, zc, md))));
+
+    __m128 axc = _mm_loadu_ps(&g.ax[x]);
+    __m128 ayc = _mm_set1_ps(g.ay[y]);
+    __m128 txx = _mm_sub_ps(_mm_mul_ps(zr, _mm_loadu_ps(&g.ax[x + r])),
+                            _mm_mul_ps(zl, _mm_loadu_ps(&g.ax[x - r])));
+    __m128 txz = _mm_sub_ps(zr, zl);
+    __m128 txy = _mm_mul_ps(txz, ayc);
+    __m128 tyz = _mm_sub_ps(zu, zd);
+    __m128 tyx = _mm_mul_ps(tyz, axc);
+    __m128 tyy = _mm_sub_ps(_mm_mul_ps(zu, _mm_set1_ps(g.ay[y - r])),
+                            _mm_mul_ps(zd, _mm_set1_ps(g.ay[y + r])));
+    __m128 nx = _mm_sub_ps(_mm_mul_ps(txy, tyz), _mm_mul_ps(txz, tyy));
+    __m128 ny = _mm_sub_ps(_mm_mul_ps(txz, tyx), _mm_mul_ps(txx, tyz));
+    __m128 nz = _mm_sub_ps(_mm_mul_ps(txx, tyy), _mm_mul_ps(txy, tyx));
+
+    // Flip the normals facing away from the camera: the point is
+    // (axc * zc, ayc * zc, zc), and zc > 0 for every valid pixel.
+    __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, axc), _mm_mul_ps(ny, ayc)), nz);
+    __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)),
+                             _mm_mul_ps(nz, nz));
+    valid = _mm_and_ps(valid, _mm_cmpgt_ps(len2, _mm_setzero_ps()));
+    __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(len2));
+    inv = _mm_xor_ps(inv, _mm_and_ps(_mm_cmpgt_ps(dot, _mm_setzero_ps()),
+                                     _mm_set1_ps(-0.0f)));
+    const __m128 nan = _mm_set1_ps(_nan);
+    float n[3][4];
+    __m128 * lanes[3] = { &nx, &ny, &nz };
+    for (int c = 0; c < 3; ++c) {
+        __m128 v = _mm_mul_ps(*lanes[c], inv);
+        _mm_storeu_ps(n[c], _mm_or_ps(_mm_and_ps(valid, v),
+                                      _mm_andnot_ps(valid, nan)));
+    }
+    for (int i = 0; i < 4; ++i) {
+        out[3 * i] = n[0][i];
+        out[3 * i + 1] = n[1][i];
+        out[3 * i + 2] = n[2][i];
+    }
+}
+#endif
+
+static void _crossProductRows(const _normalsParams & p, int y0, int y1)
+{
+    int w = p.desc->width;
+    int h = p.desc->height;
+    int r = p.radius;
+    for (int y = y0; y < y1; ++y) {
+        float * out = p.normals + (size_t) y * w * 3;
+        if (y < r || y >= h - r) {
+            _storeNaN(out, w * 3);
+            continue;
+        }
+        int x0 = r < w ? r : w;
+        int x1 = w - r > x0 ? w - r : x0;
+        _storeNaN(out, x0 * 3);
+        _storeNaN(out + x1 * 3, (w - x1) * 3);
+        int x = x0;
+#ifdef __SSE2__
+        for (; x + 4 <= x1; x += 4) {
+            _crossProduct4(p, x, y, out + x * 3);
+        }
+#endif
+        for (; x < x1; ++x) {
+            _crossProductPixel(p, x, y, out + x * 3);
+        }
+    }
+}
+
+// ===============
+// Integral images
+// ===============
+// The tangents at a pixel are the differences between the mean points of two
+// (2 * radius + 1)-pixel square windows, one pixel to either side of it, so
+// the normals are smoothed over the window at the same cost for any radius.
+// Sums are kept in double: in float, the sums over a whole frame lose
+// millimeters.
+
+struct _moments {
+    double x;
+    double y;
+    double z;
+    double n;
+};
+
+// _integralImage: (w + 1) x (h + 1) sums of the valid points above and to
+// the left of each entry.  Each band of 16 rows is summed on its own, and
+// then offset by the last row of the bands above it.
+static void _integralImage(const _normalsParams & p, _moments * sums)
+{
+    const oni_FrameDescriptor & desc = *p.desc;
+    const _depthGeometry & g = p.geometry;
+    int w = desc.width;
+    int h = desc.height;
+    size_t stride = w + 1;
+    const int band = 16;
+    memset(sums, 0, stride * sizeof(_moments));
+    _parallelFor(h, band, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            const uint16_t * row = _depthRow(desc, y);
+            _moments * out = &sums[(y + 1) * stride];
+            const _moments * above = y > y0 ? out - stride : sums;
+            _moments acc = _moments();
+            out[0] = acc;
+            for (int x = 0; x < w; ++x) {
+                if (row[x] != 0) {
+                    double z = row[x] * g.scale;
+                    acc.x += g.ax[x] * z;
+                    acc.y += g.ay[y] * z;
+                    acc.z += z;
+                    acc.n += 1.0;
+                }
+                out[x + 1].x = above[x + 1].x + acc.x;
+                out[x + 1].y = above[x + 1].y + acc.y;
+                out[x + 1].z = above[x + 1].z + acc.z;
+                out[x + 1].n = above[x + 1].n + acc.n;
+            }
+        }
+    });
+    // The last row of each band becomes final, top to bottom; then every
+    // other row takes the offset from the band above.
+    for (int y = 2 * band; y <= h; y += band) {
+        _moments * out = &sums[y * stride];
+        const _moments * above = out - band * stride;
+        for (size_t x = 1; x < stride; ++x) {
+            out[x].x += above[x].x;
+            out[x].y += above[x].y;
+            out[x].z += above[x].z;
+            out[x].n += above[x].n;
+        }
+    }
+    _parallelFor(h, band, [&](int y0, int y1) {
+        if (y0 == 0) {
+            return;
+        }
+        const _moments * offset = &sums[y0 * stride];
+        for (int y = y0 + 1; y < y1; ++y) {
+            _moments * out = &sums[y * stride];
+            for (size_t x = 1; x < stride; ++x) {
+                out[x].x += offset[x].x;
+                out[x].y += offset[x].y;
+                out[x].z += offset[x].z;
+                out[x].n += offset[x].n;
+            }
+        }
+        // The band's last row was made final above, unless the band is cut
+        // short by the bottom of the frame.
+        if (y1 - y0 < band) {
+            _moments * out = &sums[y1 * stride];
+            for (size_t x = 1; x < stride; ++x) {
+                out[x].x += offset[x].x;
+                out[x].y += offset[x].y;
+                out[x].z += offset[x].z;
+                out[x].n += offset[x].n;
+            }
+        }
+    });
+}
+
+// _boxMean: Mean of the valid points in [x0, x1) x [y0, y1); false if none.
+static inline bool _boxMean(const _moments * sums, size_t stride,
+                            int x0, int y0, int x1, int y1, double * mean)
+{
+    const _moments & a = sums[y0 * stride + x0];
+    const _moments & b = sums[y0 * stride + x1];
+    const _moments & c = sums[y1 * stride + x0];
+    const _moments & d = sums[y1 * stride + x1];
+    double n = d.n - b.n - c.n + a.n;
+    if (n < 0.5) {
+        return false;
+    }
+    mean[0] = (d.x - b.x - c.x + a.x) / n;
+    mean[1] = (d.y - b.y - c.y + a.y) / n;
+    mean[2] = (d.z - b.z - c.z + a.z) / n;
+    return true;
+}
+
+static void _integralRows(const _normalsParams & p,
+                          const _moments * sums, int y0, int y1)
+{
+    const oni_FrameDescriptor & desc = *p.desc;
+    const _depthGeometry & g = p.geometry;
+    int w = desc.width;
+    int h = desc.height;
+    int r = p.radius;
+    size_t stride = w + 1;
+    for (int y = y0; y < y1; ++y) {
+        float * out = p.normals + (size_t) y * w * 3;
+        const uint16_t * row = _depthRow(desc, y);
+        for (int x = 0; x < w; ++x, out += 3) {
+            // The shifted windows must fit, and so must the neighbors used
+            // to find depth edges.
+            if (x < r + 1 || x >= w - r - 1 || y < r + 1 || y >= h - r - 1 ||
+                row[x] == 0)
+            {
+                _storeNaN(out, 3);
+                continue;
+            }
+            float zc = row[x] * g.scale;
+            float md = p.maxDepthChange;
+            if (!_closeEnough(row[x - r] * g.scale, zc, md) ||
+                !_closeEnough(row[x + r] * g.scale, zc, md) ||
+                !_closeEnough(_depthRow(desc, y - r)[x] * g.scale, zc, md) ||
+                !_closeEnough(_depthRow(desc, y + r)[x] * g.scale, zc, md))
+            {
+                _storeNaN(out, 3);
+                continue;
+            }
+            double left[3], right[3], up[3], down[3];
+            if (!_boxMean(sums, stride, x - r - 1, y - r, x + r, y + r + 1, left) ||
+                !_boxMean(sums, stride, x - r + 1, y - r, x + r + 2, y + r + 1, right) ||
+                !_boxMean(sums, stride, x - r, y - r - 1, x + r + 1, y + r, up) ||
+                !_boxMean(sums, stride, x - r, y - r + 1, x + r + 1, y + r + 2, down))
+            {
+                _storeNaN(out, 3);
+                continue;
+            }
+            float tx[3], ty[3];
+            for (int c = 0; c < 3; ++c) {
+                tx[c] = (float) (right[c] - left[c]);
+                ty[c] = (float) (up[c] - down[c]);
+            }
+            float pc[3] = { g.ax[x] * zc, g.ay[y] * zc, zc };
+            _storeNormal(tx[1] * ty[2] - tx[2] * ty[1],
+                         tx[2] * ty[0] - tx[0] * ty[2],
+                         tx[0] * ty[1] - tx[1] * ty[0], pc, out);
+        }
+    }
+}
+
+// =========
+// Curvature
+// =========
+// The surface variation lambda0 / (lambda0 + lambda1 + lambda2), lambda0
+// being the smallest eigenvalue of the covariance of the points in the
+// window: 0 on a plane, up to 1/3 where points scatter evenly.
+
+// _smallestEigenvalue: Of the symmetric matrix with diagonal (a, b, c) and
+// off-diagonal entries d = (0, 1), e = (0, 2), f = (1, 2), which must be
+// positive semidefinite.  Its characteristic polynomial is increasing and
+// concave between 0 and its smallest root, so Newton's method from 0 creeps
+// up on that root without overshooting.
+static double _smallestEigenvalue(double a, double b, double c, double d,
+                                  double e, double f)
+{
+    double c2 = a + b + c;
+    double c1 = a * b + a * c + b * c - d * d - e * e - f * f;
+    double c0 = a * (b * c - f * f) - d * (d * c - f * e) + e * (d * f - b * e);
+    double lambda = 0.0;
+    for (int i = 0; i < 16; ++i) {
+        double value = ((lambda - c2) * lambda + c1) * lambda - c0;
+        double slope = (3.0 * lambda - 2.0 * c2) * lambda + c1;
+        if (!(slope > 0.0)) {
+            break;
+        }
+        double step = value / slope;
+        lambda -= step;
+        if (-step <= 1e-6 * c2) {
+            break;
+        }
+    }
+    return lambda;
+}
+
+// _curvatureFromMoments: The surface variation from 'n' points' sums 's' and
+// sums of products 'ss' (xx, yy, zz, xy, xz, yz).
+static float _curvatureFromMoments(int n, const float * s, const float * ss)
+{
+    if (n < 3) {
+        return _nan;
+    }
+    double m[3] = { s[0] / n, s[1] / n, s[2] / n };
+    double a = ss[0] / n - m[0] * m[0];
+    double b = ss[1] / n - m[1] * m[1];
+    double c = ss[2] / n - m[2] * m[2];
+    double trace = a + b + c;
+    if (!(trace > 0.0)) {
+        return 0.0f;
+    }
+    double lambda = _smallestEigenvalue(a, b, c, ss[3] / n - m[0] * m[1],
+                                        ss[4] / n - m[0] * m[2],
+                                        ss[5] / n - m[1] * m[2]);
+    return (float) (lambda > 0.0 ? lambda / trace : 0.0);
+}
+
+static float _curvaturePixel(const _normalsParams & p, int x, int y)
+{
+    const oni_FrameDescriptor & desc = *p.desc;
+    const _depthGeometry & g = p.geometry;
+    int r = p.radius;
+    float zc = _depthRow(desc, y)[x] * g.scale;
+    if (zc <= 0.0f) {
+        return _nan;
+    }
+    float pc[3] = { g.ax[x] * zc, g.ay[y] * zc, zc };
+    int wx0 = x - r > 0 ? x - r : 0;
+    int wx1 = x + r < desc.width - 1 ? x + r : desc.width - 1;
+    int wy0 = y - r > 0 ? y - r : 0;
+    int wy1 = y + r < desc.height - 1 ? y + r : desc.height - 1;
+    // Moments about the center point, which keeps them small enough for
+    // float.
+    float s[3] = { 0, 0, 0 };
+    float ss[6] = { 0, 0, 0, 0, 0, 0 };
+    int n = 0;
+    for (int wy = wy0; wy <= wy1; ++wy) {
+        const uint16_t * wrow = _depthRow(desc, wy);
+        for (int wx = wx0; wx <= wx1; ++wx) {
+            float z = wrow[wx] * g.scale;
+            if (!_closeEnough(z, zc, p.maxDepthChange)) {
+                continue;
+            }
+            float dx = g.ax[wx] * z - pc[0];
+            float dy = g.ay[wy] * z - pc[1];
+            float dz = z - pc[2];
+            s[0] += dx; s[1] += dy; s[2] += dz;
+            ss[0] += dx * dx; ss[1] += dy * dy; ss[2] += dz * dz;
+            ss[3] += dx * dy; ss[4] += dx * dz; ss[5] += dy * dz;
+            ++n;
+        }
+    }
+    return _curvatureFromMoments(n, s, ss);
+}
+
+#ifdef __SSE2__
+// _curvature4: Curvature of pixels x .. x + 3 of row y, whose windows must
+// lie inside the frame.  Neighbors across an edge are masked out rather than
+// skipped.
+static void _curvature4(const _normalsParams & p, int x, int y, float * out)
+{
+    const oni_FrameDescriptor & desc = *p.desc;
+    const _depthGeometry & g = p.geometry;
+    int r = p.radius;
+    const __m128 scale = _mm_set1_ps(g.scale);
+    const __m128 md = _mm_set1_ps(p.maxDepthChange);
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 zc = _loadDepth4(_depthRow(desc, y) + x, scale);
+    __m128 pcx = _mm_mul_ps(_mm_loadu_ps(&g.ax[x]), zc);
+    __m128 pcy = _mm_mul_ps(_mm_set1_ps(g.ay[y]), zc);
+    __m128 n = _mm_setzero_ps();
+    __m128 sx = n, sy = n, sz = n;
+    __m128 sxx = n, syy = n, szz = n, sxy = n, sxz = n, syz = n;
+    for (int wy = y - r; wy <= y + r; ++wy) {
+        const uint16_t * wrow = _depthRow(desc, wy);
+        __m128 ay = _mm_set1_ps(g.ay[wy]);
+        for (int wx = x - r; wx <= x + r; ++wx) {
+            __m128 z = _loadDepth4(wrow + wx, scale);
+            __m128 ok = _neighborOk4(z, zc, md);
+            __m128 dx = _mm_and_ps(ok, _mm_sub_ps(
+                _mm_mul_ps(_mm_loadu_ps(&g.ax[wx]), z), pcx));
+            __m128 dy = _mm_and_ps(ok, _mm_sub_ps(_mm_mul_ps(ay, z), pcy));
+            __m128 dz = _mm_and_ps(ok, _mm_sub_ps(z, zc));
+            n = _mm_add_ps(n, _mm_and_ps(ok, one));
+            sx = _mm_add_ps(sx, dx);
+            sy = _mm_add_ps(sy, dy);
+            sz = _mm_add_ps(sz, dz);
+            sxx = _mm_add_ps(sxx, _mm_mul_ps(dx, dx));
+            syy = _mm_add_ps(syy, _mm_mul_ps(dy, dy));
+            szz = _mm_add_ps(szz, _mm_mul_ps(dz, dz));
+            sxy = _mm_add_ps(sxy, _mm_mul_ps(dx, dy));
+            sxz = _mm_add_ps(sxz, _mm_mul_ps(dx, dz));
+            syz = _mm_add_ps(syz, _mm_mul_ps(dy, dz));
+        }
+    }
+    float lanes[10][4];
+    __m128 sums[10] = { n, sx, sy, sz, sxx, syy, szz, sxy, sxz, syz };
+    for (int i = 0; i < 10; ++i) {
+        _mm_storeu_ps(lanes[i], sums[i]);
+    }
+    float centers[4];
+    _mm_storeu_ps(centers, zc);
+    for (int i = 0; i < 4; ++i) {
+        float s[3] = { lanes[1][i], lanes[2][i], lanes[3][i] };
+        float ss[6] = { lanes[4][i], lanes[5][i], lanes[6][i],
+                        lanes[7][i], lanes[8][i], lanes[9][i] };
+        out[i] = centers[i] > 0.0f ?
+            _curvatureFromMoments((int) lanes[0][i], s, ss) : _nan;
+    }
+}
+#endif
+
+static void _curvatureRows(const _normalsParams & p, int y0, int y1)
+{
+    int w = p.desc->width;
+    int h = p.desc->height;
+    int r = p.radius;
+    for (int y = y0; y < y1; ++y) {
+        float * out = p.curvature + (size_t) y * w;
+        int x = 0;
+#ifdef __SSE2__
+        if (y >= r && y < h - r) {
+            for (; x < r && x < w; ++x) {
+                out[x] = _curvaturePixel(p, x, y);
+            }
+            for (; x + 4 <= w - r; x += 4) {
+                _curvature4(p, x, y, out + x);
+            }
+        }
+#endif
+        for (; x < w; ++x) {
+            out[x] = _curvaturePixel(p, x, y);
+        }
+    }
+}
+
+static oni_Status _computeNormals(const oni_FrameDescriptor & desc,
+                                  const oni_CameraIntrinsics & intrinsics,
+                                  int method, int radius, float maxDepthChange,
+                                  float * normals, float * curvature)
+{
+    if (radius < 1 || (method != oni_NORMALS_CROSS_PRODUCT &&
+                       method != oni_NORMALS_INTEGRAL_IMAGE) || normals == NULL)
+    {
+        return openni::STATUS_BAD_PARAMETER;
+    }
+    _normalsParams p;
+    if (!_makeDepthGeometry(desc, intrinsics, &p.geometry)) {
+        return openni::STATUS_NOT_SUPPORTED;
+    }
+    p.desc = &desc;
+    p.radius = radius;
+    p.maxDepthChange = maxDepthChange;
+    p.normals = normals;
+    p.curvature = curvature;
+
+    if (method == oni_NORMALS_CROSS_PRODUCT) {
+        _parallelFor(desc.height, 16, [&](int y0, int y1) {
+            _crossProductRows(p, y0, y1);
+        });
+    } else {
+        std::unique_ptr<_moments[]> sums(
+            new _moments[(size_t) (desc.width + 1) * (desc.height + 1)]);
+        _integralImage(p, sums.get());
+        _parallelFor(desc.height, 16, [&](int y0, int y1) {
+            _integralRows(p, sums.get(), y0, y1);
+        });
+    }
+    if (curvature != NULL) {
+        _parallelFor(desc.height, 16, [&](int y0, int y1) {
+            _curvatureRows(p, y0, y1);
+        });
+    }
+    return openni::STATUS_OK;
+}
+
+// ===============
+// Surface normals
+// ===============
+oni_Status oni_computeNormals(oni_VideoFrameRef * frame,
+                              const oni_CameraIntrinsics * intrinsics,
+                              int method, int radius, float maxDepthChange,
+                              float * normals, float * curvature) {
+    EXC_CHECK({
+        oni_FrameDescriptor desc;
+        oni_Status rc = oni_getFrameDescriptor(frame, &desc);
+        if (rc != openni::STATUS_OK) {
+            return rc;
+        }
+        return _computeNormals(desc, *intrinsics, method, radius,
+                               maxDepthChange, normals, curvature);
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_computeDescriptorNormals(const oni_FrameDescriptor * desc,
+                                        const oni_CameraIntrinsics * intrinsics,
+                                        int method, int radius,
+                                        float maxDepthChange, float * normals,
+                                        float * curvature) {
+    EXC_CHECK({
+        return _computeNormals(*desc, *intrinsics, method, radius,
+                               maxDepthChange, normals, curvature);
+    });
+    return openni::STATUS_ERROR;
+}
@@ -0,0 +1,372 @@
+// ============================================================================
+// openni2_occupancy_grid.cxx: 2.5D occupancy grids and height maps projected
+// straight from depth frames (oni_OccupancyGrid)
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <math.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_geometry.h"
+#include "openni2_parallel.h"
+#include "openni2_internal.h"
+
+const int oni_OCCUPANCY_UNKNOWN = 0;
+const int oni_OCCUPANCY_FREE = 1;
+const int oni_OCCUPANCY_OCCUPIED = 2;
+
+// _gridPartial: What one strip of rows of one frame added to the grid.  Only
+// the cells in 'touched' are nonzero, so merging and resetting only visit
+// those.
+struct _gridPartial {
+    explicit _gridPartial(size_t cells)
+        : hits(cells, 0), ground(cells, 0), height(cells, 0.0f) {}
+    std::vector<uint32_t> hits;
+    std::vector<uint32_t> ground;
+    std::vector<float> height;
+    std::vector<int> touched;
+    // Per-row scratch: cell coordinates and height of each pixel.
+    std::vector<float> cellX;
+    std::vector<float> cellZ;
+    std::vector<float> rowHeight;
+};
+
+// _projection: The pose folded together with the grid's placement, so that
+// a camera point maps to fractional cell coordinates and a height with one
+// multiply-add per term.
+struct _projection {
+    float x[4];
+    float z[4];
+    float h[4];
+};
+
+// _projectRow: Cell coordinates and height of the 'n' pixels of one row.
+// Missing pixels come out as NaN, which fails every range test.
+static void _projectRow(const uint16_t * row, const float * ax, float ay,
+                        float scale, int n, const _projection & p,
+                        float * cellX, float * cellZ, float * height)
+{
+    int x = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 nan = _mm_set1_ps(NAN);
+    const __m128 vay = _mm_set1_ps(ay);
+    for (; x + 4 <= n; x += 4) {
+        __m128i raw = _mm_unpacklo_epi16(
+            _mm_loadl_epi64((const __m128i *) (row + x)), zero);
+        __m128 missing = _mm_castsi128_ps(_mm_cmpeq_epi32(raw, zero));
+        __m128 z = _mm_mul_ps(_mm_cvtepi32_ps(raw), _mm_set1_ps(scale));
+        __m128 px = _mm_mul_ps(_mm_loadu_ps(ax + x), z);
+        __m128 py = _mm_mul_ps(vay, z);
+        const float * rows[3] = { p.x, p.z, p.h };
+        float * outs[3] = { cellX, cellZ, height };
+        for (int i = 0; i < 3; ++i) {
+            const float * m = rows[i];
+            __m128 v = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(_mm_set1_ps(m[0]), px),
+                _mm_mul_ps(_mm_set1_ps(m[1]), py)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[2]), z), _mm_set1_ps(m[3])));
+            v = _mm_or_ps(_mm_and_ps(missing, nan), _mm_andnot_ps(missing, v));
+            _mm_storeu_ps(outs[i] + x, v);
+        }
+    }
+#endif
+    for (; x < n; ++x) {
+        if (row[x] == 0) {
+            cellX[x] = cellZ[x] = height[x] = NAN;
+            continue;
+        }
+        float z = row[x] * scale;
+        float px = ax[x] * z, py = ay * z;
+        cellX[x] = p.x[0] * px + p.x[1] * py + p.x[2] * z + p.x[3];
+        cellZ[x] = p.z[0] * px + p.z[1] * py + p.z[2] * z + p.z[3];
+        height[x] = p.h[0] * px + p.h[1] * py + p.h[2] * z + p.h[3];
+    }
+}
+
+// ======================
+// openni2_occupancy_grid
+// ======================
+// openni2_occupancy_grid: Pixels go straight to cells, for navigation,
+// without going through oni_convertDepthToWorld.  Each frame is split into
+// strips of rows across threads (see oni_setParallelism), each strip filling
+// a partial grid that is merged into the grid at the end.
+class openni2_occupancy_grid
+{
+public:
+    openni2_occupancy_grid(int columns, int rows, float cellSize,
+                           float originX, float originZ)
+        : m_columns(columns), m_rows(rows), m_cellSize(cellSize),
+          m_originX(originX), m_originZ(originZ), m_minHeight(50.0f),
+          m_maxHeight(2000.0f), m_minHits(2),
+          m_hits((size_t) columns * rows, 0), m_ground((size_t) columns * rows, 0),
+          m_height((size_t) columns * rows, NAN),
+          m_occupancy((size_t) columns * rows, 0) {}
+
+    void setHeightBand(float minHeight, float maxHeight)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_minHeight = minHeight;
+        m_maxHeight = maxHeight;
+    }
+
+    void setMinHits(int hits)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_minHits = hits > 1 ? hits : 1;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        std::fill(m_hits.begin(), m_hits.end(), 0);
+        std::fill(m_ground.begin(), m_ground.end(), 0);
+        std::fill(m_height.begin(), m_height.end(), NAN);
+    }
+
+    oni_Status integrate(const oni_FrameDescriptor & desc,
+                         const oni_CameraIntrinsics & intrinsics,
+                         const oni_SensorPose * pose)
+    {
+        _depthGeometry g;
+        if (!_makeDepthGeometry(desc, intrinsics, &g)) {
+            return openni::STATUS_NOT_SUPPORTED;
+        }
+        _projection p;
+        float minHeight, maxHeight;
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            makeProjection(pose, p);
+            minHeight = m_minHeight;
+            maxHeight = m_maxHeight;
+        }
+
+        // One partial grid per strip, and one strip per thread.
+        int strips = _parallelism();
+        strips = strips < desc.height ? strips : desc.height;
+        std::vector<std::unique_ptr<_gridPartial> > partials(strips);
+        takePartials(partials);
+        _parallelFor(strips, 1, [&](int s0, int s1) {
+            for (int s = s0; s < s1; ++s) {
+                project(desc, g, p, minHeight, maxHeight,
+                        desc.height * s / strips, desc.height * (s + 1) / strips,
+                        *partials[s]);
+            }
+        });
+
+        std::lock_guard<std::mutex> guard(m_lock);
+        for (int s = 0; s < strips; ++s) {
+            merge(*partials[s]);
+            m_spare.push_back(std::move(partials[s]));
+        }
+        return openni::STATUS_OK;
+    }
+
+    const uint8_t * occupancy(int * columns, int * rows)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        for (size_t i = 0; i < m_occupancy.size(); ++i) {
+            m_occupancy[i] = (uint8_t) (m_hits[i] >= (uint32_t) m_minHits ?
+                                        oni_OCCUPANCY_OCCUPIED :
+                                        m_ground[i] > 0 ? oni_OCCUPANCY_FREE :
+                                        oni_OCCUPANCY_UNKNOWN);
+        }
+        size(columns, rows);
+        return &m_occupancy[0];
+    }
+
+    const float * heightMap(int * columns, int * rows)
+    {
+        size(columns, rows);
+        return &m_height[0];
+    }
+
+private:
+    void size(int * columns, int * rows) const
+    {
+        if (columns != NULL) {
+            *columns = m_columns;
+        }
+        if (rows != NULL) {
+            *rows = m_rows;
+        }
+    }
+
+    // makeProjection: Rows of the pose (identity if NULL), offset and scaled
+    // so that X and Z come out in cells.
+    void makeProjection(const oni_SensorPose * pose, _projection & p) const
+    {
+        static const oni_SensorPose identity = {
+            { 1, 0, 0, 0, 1, 0, 0, 0, 1 }, { 0, 0, 0 } };
+        const oni_SensorPose & pp = pose != NULL ? *pose : identity;
+        float inv = 1.0f / m_cellSize;
+        for (int c = 0; c < 3; ++c) {
+            p.x[c] = pp.rotation[c] * inv;
+            p.h[c] = pp.rotation[3 + c];
+            p.z[c] = pp.rotation[6 + c] * inv;
+        }
+        p.x[3] = (pp.translation[0] - m_originX) * inv;
+        p.h[3] = pp.translation[1];
+        p.z[3] = (pp.translation[2] - m_originZ) * inv;
+    }
+
+    void takePartials(std::vector<std::unique_ptr<_gridPartial> > & partials)
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            for (size_t i = 0; i < partials.size() && !m_spare.empty(); ++i) {
+                partials[i] = std::move(m_spare.back());
+                m_spare.pop_back();
+            }
+        }
+        for (size_t i = 0; i < partials.size(); ++i) {
+            if (!partials[i]) {
+                partials[i].reset(new _gridPartial(m_hits.size()));
+            }
+        }
+    }
+
+    void project(const oni_FrameDescriptor & desc, const _depthGeometry & g,
+                 const _projection & p, float minHeight, float maxHeight,
+                 int y0, int y1, _gridPartial & part) const
+    {
+        int width = desc.width;
+        part.cellX.resize(width);
+        part.cellZ.resize(width);
+        part.rowHeight.resize(width);
+        float columns = (float) m_columns, rows = (float) m_rows;
+        for (int y = y0; y < y1; ++y) {
+            _projectRow(_depthRow(desc, y), &g.ax[0], g.ay[y], g.scale, width, p,
+                        &part.cellX[0], &part.cellZ[0], &part.rowHeight[0]);
+            for (int x = 0; x < width; ++x) {
+                float cx = part.cellX[x], cz = part.cellZ[x];
+                float h = part.rowHeight[x];
+                // Written so that NaN (missing) fails too.
+                if (!(cx >= 0.0f && cx < columns && cz >= 0.0f && cz < rows &&
+                      h <= maxHeight))
+                {
+                    continue;
+                }
+                int cell = (int) cz * m_columns + (int) cx;
+                if (part.hits[cell] == 0 && part.ground[cell] == 0) {
+                    part.touched.push_back(cell);
+                    part.height[cell] = h;
+                } else if (h > part.height[cell]) {
+                    part.height[cell] = h;
+                }
+                if (h < minHeight) {
+                    ++part.ground[cell];
+                } else {
+                    ++part.hits[cell];
+                }
+            }
+        }
+    }
+
+    // merge: Add 'part' to the grid and reset it.  Called with the lock held.
+    void merge(_gridPartial & part)
+    {
+        for (size_t i = 0; i < part.touched.size(); ++i) {
+            int cell = part.touched[i];
+            m_hits[cell] += part.hits[cell];
+            m_ground[cell] += part.ground[cell];
+            if (!(m_height[cell] >= part.height[cell])) {
+                m_height[cell] = part.height[cell];
+            }
+            part.hits[cell] = 0;
+            part.ground[cell] = 0;
+        }
+        part.touched.clear();
+    }
+
+    const int m_columns;
+    const int m_rows;
+    const float m_cellSize;
+    const float m_originX;
+    const float m_originZ;
+    // Everything below is guarded by m_lock.
+    std::mutex m_lock;
+    float m_minHeight;
+    float m_maxHeight;
+    int m_minHits;
+    std::vector<uint32_t> m_hits;
+    std::vector<uint32_t> m_ground;
+    std::vector<float> m_height;
+    std::vector<uint8_t> m_occupancy;
+    std::vector<std::unique_ptr<_gridPartial> > m_spare;
+};
+
+// =================
+// oni_OccupancyGrid
+// =================
+oni_OccupancyGrid * oni_new_OccupancyGrid(int columns, int rows, float cellSize,
+                                          float originX, float originZ) {
+    if (columns < 1 || rows < 1 || cellSize <= 0.0f) {
+        return NULL;
+    }
+    EXC_CHECK( return new openni2_occupancy_grid(columns, rows, cellSize,
+                                                 originX, originZ); );
+    return NULL;
+}
+
+void oni_delete_OccupancyGrid(oni_OccupancyGrid * grid) {
+    EXC_CHECK( delete grid; );
+}
+
+void oni_setHeightBand_OccupancyGrid(oni_OccupancyGrid * grid,
+                                     float minHeight, float maxHeight) {
+    EXC_CHECK( grid->setHeightBand(minHeight, maxHeight); );
+}
+
+void oni_setMinHits_OccupancyGrid(oni_OccupancyGrid * grid, int hits) {
+    EXC_CHECK( grid->setMinHits(hits); );
+}
+
+void oni_clear_OccupancyGrid(oni_OccupancyGrid * grid) {
+    EXC_CHECK( grid->clear(); );
+}
+
+oni_Status oni_integrate_OccupancyGrid(oni_OccupancyGrid * grid,
+                                       oni_VideoFrameRef * frame,
+                                       const oni_CameraIntrinsics * intrinsics,
+                                       const oni_SensorPose * pose) {
+    EXC_CHECK({
+        oni_FrameDescriptor desc;
+        oni_Status rc = oni_getFrameDescriptor(frame, &desc);
+        if (rc != openni::STATUS_OK) {
+            return rc;
+        }
+        return grid->integrate(desc, *intrinsics, pose);
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_integrateDescriptor_OccupancyGrid(oni_OccupancyGrid * grid,
+                                                 const oni_FrameDescriptor * desc,
+                                                 const oni_CameraIntrinsics * intrinsics,
+                                                 const oni_SensorPose * pose) {
+    EXC_CHECK( return grid->integrate(*desc, *intrinsics, pose); );
+    return openni::STATUS_ERROR;
+}
+
+const uint8_t * oni_getOccupancy_OccupancyGrid(oni_OccupancyGrid * grid,
+                                               int * columns, int * rows) {
+    EXC_CHECK( return grid->occupancy(columns, rows); );
+    return NULL;
+}
+
+const float * oni_getHeightMap_OccupancyGrid(oni_OccupancyGrid * grid,
+                                             int * columns, int * rows) {
+    EXC_CHECK( return grid->heightMap(columns, rows); );
+    return NULL;
+}
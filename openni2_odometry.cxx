@@ -0,0 +1,618 @@
+// ============================================================================
+// openni2_odometry.cxx: Camera motion between consecutive depth frames by
+// point-to-plane ICP over depth pyramids (oni_Odometry)
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_geometry.h"
+#include "openni2_parallel.h"
+#include "openni2_internal.h"
+
+// Rows are summed in bands of this many, each into its own partial sums,
+// which are then added up in order so that the result does not depend on
+// how many threads ran.
+static const int _icpBand = 16;
+// The normal equations: the upper triangle of J^T J (21), J^T r (6), the
+// sum of squared residuals and the number of matches.
+static const int _icpSums = 29;
+// Fewer matches than this at any level means the frame was not tracked.
+static const int _icpMinInliers = 100;
+// Levels smaller than this in either direction are skipped.
+static const int _icpMinLevelSize = 8;
+static const double _radiansPerDegree = 3.14159265358979323846 / 180.0;
+
+// _icpLevel: One pyramid level of a frame.  'points' holds
+// (x, y, z, 0, nx, ny, nz, 0) for each pixel, row after row, so that a pixel
+// the data association lands on is two aligned loads; pixels without a point
+// or normal are all NaN.  One more all-NaN entry at the end stands in for
+// pixels that land off the frame.
+struct _icpLevel {
+    int width;
+    int height;
+    _depthGeometry geometry;
+    std::vector<float> points;
+};
+
+// _icpMotion: p -> r * p + t, kept in double so that chaining thousands of
+// frames does not drift from numerical error alone.
+struct _icpMotion {
+    double r[9];
+    double t[3];
+};
+
+static void _identity(_icpMotion & m)
+{
+    static const double identity[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+    memcpy(m.r, identity, sizeof(m.r));
+    m.t[0] = m.t[1] = m.t[2] = 0.0;
+}
+
+// _compose: 'out' = a(b(p)); 'out' may be either argument.
+static void _compose(const _icpMotion & a, const _icpMotion & b, _icpMotion & out)
+{
+    _icpMotion m;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            m.r[3 * i + j] = a.r[3 * i] * b.r[j] + a.r[3 * i + 1] * b.r[3 + j] +
+                a.r[3 * i + 2] * b.r[6 + j];
+        }
+        m.t[i] = a.r[3 * i] * b.t[0] + a.r[3 * i + 1] * b.t[1] +
+            a.r[3 * i + 2] * b.t[2] + a.t[i];
+    }
+    out = m;
+}
+
+// _twist: The motion for a solution x = (rotation vector, translation).
+static void _twist(const double * x, _icpMotion & m)
+{
+    double theta = sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+    _identity(m);
+    if (theta > 0.0) {
+        double k[3] = { x[0] / theta, x[1] / theta, x[2] / theta };
+        double s = sin(theta), c = 1.0 - cos(theta);
+        m.r[0] = 1.0 - c * (k[1] * k[1] + k[2] * k[2]);
+        m.r[1] = -s * k[2] + c * k[0] * k[1];
+        m.r[2] = s * k[1] + c * k[0] * k[2];
+        m.r[3] = s * k[2] + c * k[0] * k[1];
+        m.r[4] = 1.0 - c * (k[0] * k[0] + k[2] * k[2]);
+        m.r[5] = -s * k[0] + c * k[1] * k[2];
+        m.r[6] = -s * k[1] + c * k[0] * k[2];
+        m.r[7] = s * k[0] + c * k[1] * k[2];
+        m.r[8] = 1.0 - c * (k[0] * k[0] + k[1] * k[1]);
+    }
+    m.t[0] = x[3];
+    m.t[1] = x[4];
+    m.t[2] = x[5];
+}
+
+// _solve: Solve J^T J x = -J^T r from 'sums' by Cholesky decomposition.
+// Returns false if the system is (close to) singular, i.e. the geometry
+// does not pin down all six degrees of freedom.
+static bool _solve(const double * sums, double * x)
+{
+    double a[6][6];
+    for (int i = 0, k = 0; i < 6; ++i) {
+        for (int j = i; j < 6; ++j, ++k) {
+            a[i][j] = a[j][i] = sums[k];
+        }
+    }
+    double l[6][6] = { { 0 } };
+    for (int j = 0; j < 6; ++j) {
+        double d = a[j][j];
+        for (int k = 0; k < j; ++k) {
+            d -= l[j][k] * l[j][k];
+        }
+        if (!(d > 1e-9 * a[j][j])) {
+            return false;
+        }
+        l[j][j] = sqrt(d);
+        for (int i = j + 1; i < 6; ++i) {
+            double v = a[i][j];
+            for (int k = 0; k < j; ++k) {
+                v -= l[i][k] * l[j][k];
+            }
+            l[i][j] = v / l[j][j];
+        }
+    }
+    double y[6];
+    for (int i = 0; i < 6; ++i) {
+        double v = -sums[21 + i];
+        for (int k = 0; k < i; ++k) {
+            v -= l[i][k] * y[k];
+        }
+        y[i] = v / l[i][i];
+    }
+    for (int i = 5; i >= 0; --i) {
+        double v = y[i];
+        for (int k = i + 1; k < 6; ++k) {
+            v -= l[k][i] * x[k];
+        }
+        x[i] = v / l[i][i];
+    }
+    return true;
+}
+
+// _icpParams: Everything associating one level of the current frame with
+// the previous one needs.  'r' and 't' take current camera coordinates to
+// previous ones.
+struct _icpParams {
+    const _icpLevel * current;
+    const _icpLevel * previous;
+    float r[9];
+    float t[3];
+    float maxDistance2;
+    float minCos;
+};
+
+// _addScalar: Add one match, with 'p' the moved current point and 'q' the
+// previous point and normal, to 'sums' if it is close enough.
+static inline void _addScalar(const float * p, const float * q,
+                              float maxDistance2, double * sums)
+{
+    float d[3] = { p[0] - q[0], p[1] - q[1], p[2] - q[2] };
+    if (!(d[0] * d[0] + d[1] * d[1] + d[2] * d[2] <= maxDistance2)) {
+        return;
+    }
+    const float * n = q + 4;
+    double r = n[0] * d[0] + n[1] * d[1] + n[2] * d[2];
+    double jac[6] = { p[1] * n[2] - p[2] * n[1], p[2] * n[0] - p[0] * n[2],
+                      p[0] * n[1] - p[1] * n[0], n[0], n[1], n[2] };
+    for (int i = 0, k = 0; i < 6; ++i) {
+        for (int j = i; j < 6; ++j, ++k) {
+            sums[k] += jac[i] * jac[j];
+        }
+        sums[21 + i] += jac[i] * r;
+    }
+    sums[27] += r * r;
+    sums[28] += 1.0;
+}
+
+// _accumulateRow: Add the matches of row 'y' of the current level to
+// 'sums'.  Each current point is moved into the previous camera and paired
+// with the previous point on the pixel it projects to (projective data
+// association), if the two are close enough and their normals agree.  The
+// residual of a match is n . (p - q) for the moved current point p, and its
+// Jacobian with respect to a small motion (rotation vector w, translation u)
+// taking p to p + w x p + u is (p x n, n).
+static void _accumulateRow(const _icpParams & p, int y, double * sums)
+{
+    const _icpLevel & cur = *p.current;
+    const _icpLevel & prev = *p.previous;
+    const _depthGeometry & g = prev.geometry;
+    const float * row = &cur.points[(size_t) 8 * y * cur.width];
+    const float * target = &prev.points[0];
+    const size_t missing = (size_t) prev.width * prev.height;
+    int w = cur.width;
+    int x = 0;
+#ifdef __SSE2__
+    __m128 acc[_icpSums];
+    for (int i = 0; i < _icpSums; ++i) {
+        acc[i] = _mm_setzero_ps();
+    }
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (; x + 4 <= w; x += 4) {
+        const float * c = row + 8 * x;
+        __m128 cx = _mm_loadu_ps(c), cy = _mm_loadu_ps(c + 8);
+        __m128 cz = _mm_loadu_ps(c + 16), cw = _mm_loadu_ps(c + 24);
+        _MM_TRANSPOSE4_PS(cx, cy, cz, cw);
+        __m128 nx = _mm_loadu_ps(c + 4), ny = _mm_loadu_ps(c + 12);
+        __m128 nz = _mm_loadu_ps(c + 20), nw = _mm_loadu_ps(c + 28);
+        _MM_TRANSPOSE4_PS(nx, ny, nz, nw);
+        // The moved point and the rotated normal.
+        __m128 m[3], rn[3];
+        for (int i = 0; i < 3; ++i) {
+            __m128 r0 = _mm_set1_ps(p.r[3 * i]);
+            __m128 r1 = _mm_set1_ps(p.r[3 * i + 1]);
+            __m128 r2 = _mm_set1_ps(p.r[3 * i + 2]);
+            m[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r0, cx), _mm_mul_ps(r1, cy)),
+                              _mm_add_ps(_mm_mul_ps(r2, cz), _mm_set1_ps(p.t[i])));
+            rn[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r0, nx), _mm_mul_ps(r1, ny)),
+                               _mm_mul_ps(r2, nz));
+        }
+        // Missing points and points far off the frame convert to INT_MIN,
+        // which fails the bounds test.  Points behind the camera would
+        // project mirrored, so they are masked out as in the scalar code.
+        int front = _mm_movemask_ps(_mm_cmpgt_ps(m[2], _mm_setzero_ps()));
+        __m128 inv = _mm_div_ps(one, m[2]);
+        __m128 u = _mm_add_ps(_mm_set1_ps(g.cx),
+                              _mm_mul_ps(_mm_set1_ps(g.fx), _mm_mul_ps(m[0], inv)));
+        __m128 v = _mm_sub_ps(_mm_set1_ps(g.cy),
+                              _mm_mul_ps(_mm_set1_ps(g.fy), _mm_mul_ps(m[1], inv)));
+        int iu[4], iv[4];
+        _mm_storeu_si128((__m128i *) iu, _mm_cvtps_epi32(u));
+        _mm_storeu_si128((__m128i *) iv, _mm_cvtps_epi32(v));
+        const float * q[4];
+        for (int k = 0; k < 4; ++k) {
+            bool inside = (front >> k & 1) &&
+                (unsigned) iu[k] < (unsigned) prev.width &&
+                (unsigned) iv[k] < (unsigned) prev.height;
+            q[k] = target + 8 * (inside ? (size_t) iv[k] * prev.width + iu[k] : missing);
+        }
+        __m128 qx = _mm_loadu_ps(q[0]), qy = _mm_loadu_ps(q[1]);
+        __m128 qz = _mm_loadu_ps(q[2]), qw = _mm_loadu_ps(q[3]);
+        _MM_TRANSPOSE4_PS(qx, qy, qz, qw);
+        __m128 px = _mm_loadu_ps(q[0] + 4), py = _mm_loadu_ps(q[1] + 4);
+        __m128 pz = _mm_loadu_ps(q[2] + 4), pw = _mm_loadu_ps(q[3] + 4);
+        _MM_TRANSPOSE4_PS(px, py, pz, pw);
+        __m128 dx = _mm_sub_ps(m[0], qx);
+        __m128 dy = _mm_sub_ps(m[1], qy);
+        __m128 dz = _mm_sub_ps(m[2], qz);
+        __m128 dist2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                                  _mm_mul_ps(dz, dz));
+        __m128 cosine = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rn[0], px),
+                                              _mm_mul_ps(rn[1], py)),
+                                   _mm_mul_ps(rn[2], pz));
+        // NaN on either side compares false.
+        __m128 mask = _mm_and_ps(_mm_cmple_ps(dist2, _mm_set1_ps(p.maxDistance2)),
+                                 _mm_cmpge_ps(cosine, _mm_set1_ps(p.minCos)));
+        if (_mm_movemask_ps(mask) == 0) {
+            continue;
+        }
+        __m128 r = _mm_and_ps(mask, _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(px, dx), _mm_mul_ps(py, dy)), _mm_mul_ps(pz, dz)));
+        __m128 jac[6] = {
+            _mm_sub_ps(_mm_mul_ps(m[1], pz), _mm_mul_ps(m[2], py)),
+            _mm_sub_ps(_mm_mul_ps(m[2], px), _mm_mul_ps(m[0], pz)),
+            _mm_sub_ps(_mm_mul_ps(m[0], py), _mm_mul_ps(m[1], px)),
+            px, py, pz };
+        for (int i = 0; i < 6; ++i) {
+            jac[i] = _mm_and_ps(mask, jac[i]);
+        }
+        for (int i = 0, k = 0; i < 6; ++i) {
+            for (int j = i; j < 6; ++j, ++k) {
+                acc[k] = _mm_add_ps(acc[k], _mm_mul_ps(jac[i], jac[j]));
+            }
+            acc[21 + i] = _mm_add_ps(acc[21 + i], _mm_mul_ps(jac[i], r));
+        }
+        acc[27] = _mm_add_ps(acc[27], _mm_mul_ps(r, r));
+        acc[28] = _mm_add_ps(acc[28], _mm_and_ps(mask, one));
+    }
+    // Float sums over one row are exact enough; across rows they go to
+    // double.
+    for (int i = 0; i < _icpSums; ++i) {
+        float lanes[4];
+        _mm_storeu_ps(lanes, acc[i]);
+        sums[i] += (double) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+    for (; x < w; ++x) {
+        const float * c = row + 8 * x;
+        float m[3], rn[3];
+        for (int i = 0; i < 3; ++i) {
+            m[i] = p.r[3 * i] * c[0] + p.r[3 * i + 1] * c[1] +
+                p.r[3 * i + 2] * c[2] + p.t[i];
+            rn[i] = p.r[3 * i] * c[4] + p.r[3 * i + 1] * c[5] +
+                p.r[3 * i + 2] * c[6];
+        }
+        if (!(m[2] > 0.0f)) {
+            continue;
+        }
+        int u = (int) floorf(g.cx + g.fx * m[0] / m[2] + 0.5f);
+        int v = (int) floorf(g.cy - g.fy * m[1] / m[2] + 0.5f);
+        if ((unsigned) u >= (unsigned) prev.width ||
+            (unsigned) v >= (unsigned) prev.height)
+        {
+            continue;
+        }
+        const float * q = target + 8 * ((size_t) v * prev.width + u);
+        if (rn[0] * q[4] + rn[1] * q[5] + rn[2] * q[6] >= p.minCos) {
+            _addScalar(m, q, p.maxDistance2, sums);
+        }
+    }
+}
+
+// ================
+// openni2_odometry
+// ================
+// openni2_odometry: ICP with projective data association, run coarse to fine
+// over a median depth pyramid.  Each iteration builds the 6 x 6 normal
+// equations from bands of rows in parallel (see oni_setParallelism), with
+// SSE2 where available.
+class openni2_odometry
+{
+public:
+    explicit openni2_odometry(int levels)
+        : m_levels(levels), m_maxDistance(100.0f),
+          m_minCos((float) cos(30.0 * _radiansPerDegree)), m_iterations(levels, 10),
+          m_pyramid(NULL), m_hasPrevious(false)
+    {
+        m_iterations[0] = 4;
+        if (levels > 1) {
+            m_iterations[1] = 5;
+        }
+        m_pyramid = oni_new_DepthPyramid(levels, 2, oni_DECIMATE_MEDIAN, false);
+        if (m_pyramid == NULL) {
+            throw std::bad_alloc();
+        }
+        _identity(m_pose);
+    }
+
+    ~openni2_odometry()
+    {
+        oni_delete_DepthPyramid(m_pyramid);
+    }
+
+    void setIterations(int level, int iterations)
+    {
+        if (level >= 0 && level < m_levels) {
+            m_iterations[level] = std::max(iterations, 0);
+        }
+    }
+
+    void setThresholds(float maxDistance, float maxAngle)
+    {
+        m_maxDistance = maxDistance;
+        m_minCos = (float) cos(maxAngle * _radiansPerDegree);
+    }
+
+    void reset(const oni_SensorPose * pose)
+    {
+        m_hasPrevious = false;
+        _identity(m_pose);
+        if (pose != NULL) {
+            for (int i = 0; i < 9; ++i) {
+                m_pose.r[i] = pose->rotation[i];
+            }
+            for (int i = 0; i < 3; ++i) {
+                m_pose.t[i] = pose->translation[i];
+            }
+        }
+    }
+
+    oni_Status track(const oni_FrameDescriptor & desc,
+                     const oni_CameraIntrinsics & intrinsics,
+                     oni_SensorPose * pose, oni_OdometryStats * stats)
+    {
+        _depthGeometry g;
+        if (!_makeDepthGeometry(desc, intrinsics, &g)) {
+            return openni::STATUS_NOT_SUPPORTED;
+        }
+        oni_Status rc = oni_setDescriptor_DepthPyramid(m_pyramid, &desc);
+        if (rc != openni::STATUS_OK) {
+            return rc;
+        }
+        // The intrinsics of this very frame, so that crops and frames of
+        // another size than the intrinsics carry through to every level.
+        oni_CameraIntrinsics frame = { desc.width, desc.height, g.fx, g.fy,
+                                       g.cx, g.cy };
+        m_current.resize(m_levels);
+        for (int l = 0; l < m_levels; ++l) {
+            rc = prepare(l, desc.pixelFormat, frame, m_current[l]);
+            if (rc != openni::STATUS_OK) {
+                return rc;
+            }
+        }
+
+        oni_OdometryStats s = { 1, 0, 0, 0.0f };
+        if (m_hasPrevious) {
+            _icpMotion motion;
+            _identity(motion);
+            if (m_previous[0].width == m_current[0].width &&
+                m_previous[0].height == m_current[0].height &&
+                align(motion, s))
+            {
+                _compose(m_pose, motion, m_pose);
+            } else {
+                s.tracked = 0;
+            }
+        }
+        std::swap(m_previous, m_current);
+        m_hasPrevious = true;
+
+        if (pose != NULL) {
+            for (int i = 0; i < 9; ++i) {
+                pose->rotation[i] = (float) m_pose.r[i];
+            }
+            for (int i = 0; i < 3; ++i) {
+                pose->translation[i] = (float) m_pose.t[i];
+            }
+        }
+        if (stats != NULL) {
+            *stats = s;
+        }
+        return openni::STATUS_OK;
+    }
+
+private:
+    // prepare: Vertices and normals of pyramid level 'l' of the frame just
+    // given to the pyramid.
+    oni_Status prepare(int l, openni::PixelFormat format,
+                       const oni_CameraIntrinsics & intrinsics, _icpLevel & level)
+    {
+        int w = 0, h = 0;
+        const oni_DepthPixel * pixels =
+            oni_getLevel_DepthPyramid(m_pyramid, l, &w, &h);
+        level.width = w;
+        level.height = h;
+        if (pixels == NULL || w < _icpMinLevelSize || h < _icpMinLevelSize) {
+            return openni::STATUS_OK;
+        }
+        oni_FrameDescriptor desc;
+        memset(&desc, 0, sizeof(desc));
+        desc.data = pixels;
+        desc.width = w;
+        desc.height = h;
+        desc.strideInBytes = w * (int) sizeof(oni_DepthPixel);
+        desc.sensorType = openni::SENSOR_DEPTH;
+        desc.pixelFormat = format;
+        _makeDepthGeometry(desc, intrinsics, &level.geometry);
+        size_t count = (size_t) w * h;
+        m_normals.resize(3 * count);
+        oni_Status rc = oni_computeDescriptorNormals(
+            &desc, &intrinsics, oni_NORMALS_CROSS_PRODUCT, 1, 0.05f,
+            &m_normals[0], NULL);
+        if (rc != openni::STATUS_OK) {
+            return rc;
+        }
+        level.points.resize(8 * (count + 1));
+        std::fill(level.points.end() - 8, level.points.end(), NAN);
+        const _depthGeometry & g = level.geometry;
+        _parallelFor(h, _icpBand, [&](int y0, int y1) {
+            for (int y = y0; y < y1; ++y) {
+                size_t row = (size_t) y * w;
+                for (int x = 0; x < w; ++x) {
+                    const float * n = &m_normals[3 * (row + x)];
+                    float * out = &level.points[8 * (row + x)];
+                    oni_DepthPixel d = pixels[row + x];
+                    float z = d != 0 && n[0] == n[0] ? d * g.scale : NAN;
+                    out[0] = g.ax[x] * z;
+                    out[1] = g.ay[y] * z;
+                    out[2] = z;
+                    out[3] = 0.0f;
+                    out[4] = n[0];
+                    out[5] = n[1];
+                    out[6] = n[2];
+                    out[7] = 0.0f;
+                }
+            }
+        });
+        return openni::STATUS_OK;
+    }
+
+    // align: Refine 'motion' (current camera to previous camera) coarse to
+    // fine.  Returns false if tracking failed at some level.
+    bool align(_icpMotion & motion, oni_OdometryStats & stats)
+    {
+        for (int l = m_levels - 1; l >= 0; --l) {
+            const _icpLevel & cur = m_current[l];
+            const _icpLevel & prev = m_previous[l];
+            if (cur.width < _icpMinLevelSize || cur.height < _icpMinLevelSize) {
+                continue;
+            }
+            for (int i = 0; i < m_iterations[l]; ++i) {
+                double sums[_icpSums];
+                accumulate(cur, prev, motion, sums);
+                ++stats.iterations;
+                stats.inliers = (int) sums[28];
+                stats.rmsError = stats.inliers > 0 ?
+                    (float) sqrt(sums[27] / sums[28]) : 0.0f;
+                double x[6];
+                if (stats.inliers < _icpMinInliers || !_solve(sums, x)) {
+                    return false;
+                }
+                _icpMotion step;
+                _twist(x, step);
+                _compose(step, motion, motion);
+                if (x[0] * x[0] + x[1] * x[1] + x[2] * x[2] < 1e-10 &&
+                    x[3] * x[3] + x[4] * x[4] + x[5] * x[5] < 1e-3)
+                {
+                    break;
+                }
+            }
+        }
+        return true;
+    }
+
+    // accumulate: The normal equations for 'motion' at one level, summed
+    // over bands of rows in parallel.
+    void accumulate(const _icpLevel & cur, const _icpLevel & prev,
+                    const _icpMotion & motion, double * sums)
+    {
+        _icpParams p;
+        p.current = &cur;
+        p.previous = &prev;
+        for (int i = 0; i < 9; ++i) {
+            p.r[i] = (float) motion.r[i];
+        }
+        for (int i = 0; i < 3; ++i) {
+            p.t[i] = (float) motion.t[i];
+        }
+        p.maxDistance2 = m_maxDistance * m_maxDistance;
+        p.minCos = m_minCos;
+        int bands = (cur.height + _icpBand - 1) / _icpBand;
+        m_partials.assign((size_t) bands * _icpSums, 0.0);
+        _parallelFor(bands, 1, [&](int b0, int b1) {
+            for (int b = b0; b < b1; ++b) {
+                int y1 = std::min((b + 1) * _icpBand, cur.height);
+                for (int y = b * _icpBand; y < y1; ++y) {
+                    _accumulateRow(p, y, &m_partials[(size_t) b * _icpSums]);
+                }
+            }
+        });
+        for (int i = 0; i < _icpSums; ++i) {
+            sums[i] = 0.0;
+        }
+        for (int b = 0; b < bands; ++b) {
+            for (int i = 0; i < _icpSums; ++i) {
+                sums[i] += m_partials[(size_t) b * _icpSums + i];
+            }
+        }
+    }
+
+    int m_levels;
+    float m_maxDistance;
+    float m_minCos;
+    std::vector<int> m_iterations;
+    oni_DepthPyramid * m_pyramid;
+    std::vector<_icpLevel> m_previous;
+    std::vector<_icpLevel> m_current;
+    bool m_hasPrevious;
+    _icpMotion m_pose;
+    std::vector<double> m_partials;
+    std::vector<float> m_normals;
+};
+
+// ============
+// oni_Odometry
+// ============
+oni_Odometry * oni_new_Odometry(int levels) {
+    if (levels < 1) {
+        return NULL;
+    }
+    EXC_CHECK( return new openni2_odometry(levels); );
+    return NULL;
+}
+
+void oni_delete_Odometry(oni_Odometry * odometry) {
+    EXC_CHECK( delete odometry; );
+}
+
+void oni_setIterations_Odometry(oni_Odometry * odometry, int level,
+                                int iterations) {
+    EXC_CHECK( odometry->setIterations(level, iterations); );
+}
+
+void oni_setThresholds_Odometry(oni_Odometry * odometry, float maxDistance,
+                                float maxAngle) {
+    EXC_CHECK( odometry->setThresholds(maxDistance, maxAngle); );
+}
+
+void oni_reset_Odometry(oni_Odometry * odometry, const oni_SensorPose * pose) {
+    EXC_CHECK( odometry->reset(pose); );
+}
+
+oni_Status oni_track_Odometry(oni_Odometry * odometry, oni_VideoFrameRef * frame,
+                              const oni_CameraIntrinsics * intrinsics,
+                              oni_SensorPose * pose, oni_OdometryStats * stats) {
+    EXC_CHECK({
+        oni_FrameDescriptor desc;
+        oni_Status rc = oni_getFrameDescriptor(frame, &desc);
+        if (rc != openni::STATUS_OK) {
+            return rc;
+        }
+        return odometry->track(desc, *intrinsics, pose, stats);
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_trackDescriptor_Odometry(oni_Odometry * odometry,
+                                        const oni_FrameDescriptor * desc,
+                                        const oni_CameraIntrinsics * intrinsics,
+                                        oni_SensorPose * pose,
+                                        oni_OdometryStats * stats) {
+    EXC_CHECK( return odometry->track(*desc, *intrinsics, pose, stats); );
+    return openni::STATUS_ERROR;
+}
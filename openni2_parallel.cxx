@@ -0,0 +1,210 @@
+// ============================================================================
+// openni2_parallel.cxx: Worker pool for row-parallel image kernels
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_parallel.h"
+#include "openni2_internal.h"
+
+// _parallel_job: One _parallelFor call.  It lives on the caller's stack, so
+// the caller waits until no worker refers to it any longer ('users').  Every
+// chunk is taken by someone counted in 'users', so that is also when all of
+// them are done.
+struct _parallel_job {
+    const std::function<void (int, int)> * fn;
+    int count;
+    int grain;
+    int chunks;
+    std::atomic<int> next;
+    // Guarded by the pool's lock.
+    int users;
+    // The first exception 'fn' threw; no more chunks are started after it.
+    std::exception_ptr error;
+};
+
+class openni2_parallel_pool
+{
+public:
+    openni2_parallel_pool() : m_target(0), m_stopping(false) {}
+
+    ~openni2_parallel_pool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_stopping = true;
+            m_wake.notify_all();
+        }
+        for (size_t i = 0; i < m_workers.size(); ++i) {
+            m_workers[i].join();
+        }
+    }
+
+    void setThreadCount(int threads)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_target = threads;
+        // Workers beyond the new count go idle (see work()).
+        m_wake.notify_all();
+    }
+
+    int threadCount()
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        return helpers() + 1;
+    }
+
+    void run(_parallel_job & job)
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            // Workers are started lazily, and never stopped before exit.
+            while ((int) m_workers.size() < helpers()) {
+                m_workers.push_back(std::thread(&openni2_parallel_pool::work,
+                                                this, (int) m_workers.size()));
+            }
+            job.users = 1;
+            m_jobs.push_back(&job);
+            m_wake.notify_all();
+        }
+
+        std::exception_ptr error = runChunks(job);
+
+        std::unique_lock<std::mutex> guard(m_lock);
+        if (error && !job.error) {
+            job.error = error;
+        }
+        --job.users;
+        removeJob(&job);
+        while (job.users > 0) {
+            m_done.wait(guard);
+        }
+        if (job.error) {
+            std::rethrow_exception(job.error);
+        }
+    }
+
+private:
+    int helpers() const
+    {
+        int n = m_target > 0 ? m_target : (int) std::thread::hardware_concurrency();
+        return n > 1 ? n - 1 : 0;
+    }
+
+    // runChunks: Run chunks until none are left, or one throws; then stop
+    // everyone else taking more, and return the exception.
+    std::exception_ptr runChunks(_parallel_job & job)
+    {
+        for (;;) {
+            int chunk = job.next++;
+            if (chunk >= job.chunks) {
+                return std::exception_ptr();
+            }
+            int begin = chunk * job.grain;
+            int end = begin + job.grain < job.count ? begin + job.grain : job.count;
+            try {
+                (*job.fn)(begin, end);
+            } catch (...) {
+                job.next = job.chunks;
+                return std::current_exception();
+            }
+        }
+    }
+
+    void removeJob(_parallel_job * job)
+    {
+        for (std::deque<_parallel_job *>::iterator it = m_jobs.begin();
+             it != m_jobs.end(); ++it)
+        {
+            if (*it == job) {
+                m_jobs.erase(it);
+                return;
+            }
+        }
+    }
+
+    // work: Worker 'index' only takes jobs while it is within the current
+    // thread count, so lowering it idles the workers above it.
+    void work(int index)
+    {
+        std::unique_lock<std::mutex> guard(m_lock);
+        while (!m_stopping) {
+            if (m_jobs.empty() || index >= helpers()) {
+                m_wake.wait(guard);
+                continue;
+            }
+            _parallel_job * job = m_jobs.front();
+            ++job->users;
+            guard.unlock();
+            std::exception_ptr error = runChunks(*job);
+            guard.lock();
+            if (error && !job->error) {
+                job->error = error;
+            }
+            // Every chunk is taken, so nobody else needs to find this job.
+            removeJob(job);
+            --job->users;
+            m_done.notify_all();
+        }
+    }
+
+    int m_target;
+    bool m_stopping;
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::deque<_parallel_job *> m_jobs;
+    std::vector<std::thread> m_workers;
+};
+
+static openni2_parallel_pool _pool;
+
+void _parallelFor(int count, int grain, const std::function<void (int, int)> & fn)
+{
+    if (count <= 0) {
+        return;
+    }
+    if (grain <= 0) {
+        grain = 1;
+    }
+    _parallel_job job;
+    job.fn = &fn;
+    job.count = count;
+    job.grain = grain;
+    job.chunks = (count + grain - 1) / grain;
+    job.next = 0;
+    job.users = 0;
+    if (job.chunks == 1) {
+        fn(0, count);
+        return;
+    }
+    _pool.run(job);
+}
+
+int _parallelism()
+{
+    return _pool.threadCount();
+}
+
+// ==================
+// Parallel execution
+// ==================
+void oni_setParallelism(int threadCount) {
+    EXC_CHECK( _pool.setThreadCount(threadCount); );
+}
+
+int oni_getParallelism() {
+    EXC_CHECK( return _pool.threadCount(); );
+    return 1;
+}
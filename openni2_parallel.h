@@ -0,0 +1,21 @@
+// ============================================================================
+// openni2_parallel.h: Declaration of the worker pool that the wrapper's image
+// kernels split their rows across.  Internal to the C++ code for the wrapper.
+// (c) Chris Hodapp, 2013
+// ============================================================================
+#ifndef OPENNI2_PARALLEL
+#define OPENNI2_PARALLEL
+
+#include <functional>
+
+// _parallelFor: Call fn(begin, end) on ranges that together cover [0, count),
+// each at most 'grain' long, spread over the pool and the calling thread.
+// Returns once every range is done.  If fn throws, no more ranges are
+// started, and the first exception is rethrown once none is running.  Calls
+// may be nested and may come from several threads at once.
+void _parallelFor(int count, int grain, const std::function<void (int, int)> & fn);
+
+// _parallelism: How many threads _parallelFor uses, counting the caller.
+int _parallelism();
+
+#endif // OPENNI2_PARALLEL
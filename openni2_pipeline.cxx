@@ -0,0 +1,706 @@
+// ============================================================================
+// openni2_pipeline.cxx: Staged processing pipelines with bounded queues and
+// backpressure (oni_Pipeline)
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_internal.h"
+#include "openni2_geometry.h"
+
+const int oni_BACKPRESSURE_BLOCK = 0;
+const int oni_BACKPRESSURE_DROP_OLDEST = 1;
+const int oni_BACKPRESSURE_KEEP_LATEST = 2;
+
+// =====================
+// openni2_pipeline_item
+// =====================
+class openni2_pipeline_item
+{
+public:
+    openni2_pipeline_item() : payloadSize(0), sequence(0) {}
+
+    openni::VideoFrameRef frame;
+    std::shared_ptr<void> payload;
+    int payloadSize;
+    uint64_t sequence;
+};
+
+// =====================
+// openni2_pipeline_edge
+// =====================
+// openni2_pipeline_edge: A bounded queue of item pointers.  Only the stage at
+// its tail ever pushes, but both that stage (when dropping) and the stage at
+// its head may pop, so popping claims a slot with a compare-and-swap on
+// 'm_head'.  A slot can't be reused while 'm_head' still points at it, which
+// is what makes reading the slot before the swap safe.  A producer blocked
+// on a full queue sleeps on 'm_space' until a pop makes room.
+class openni2_pipeline_edge
+{
+public:
+    openni2_pipeline_edge(int from, int to, int capacity,
+                          oni_BackpressurePolicy policy)
+        : from(from), to(to), policy(policy), m_slots(capacity),
+          m_head(0), m_tail(0), m_highWater(0), m_pushed(0), m_dropped(0),
+          m_waiters(0) {}
+
+    ~openni2_pipeline_edge() { clear(); }
+
+    bool tryPush(openni2_pipeline_item * item)
+    {
+        uint64_t t = m_tail.load(std::memory_order_relaxed);
+        uint64_t h = m_head.load(std::memory_order_acquire);
+        if (t - h >= m_slots.size()) {
+            return false;
+        }
+        m_slots[t % m_slots.size()].store(item, std::memory_order_relaxed);
+        m_tail.store(t + 1, std::memory_order_release);
+
+        int occupancy = (int) (t + 1 - h);
+        if (occupancy > m_highWater.load(std::memory_order_relaxed)) {
+            m_highWater.store(occupancy, std::memory_order_relaxed);
+        }
+        ++m_pushed;
+        return true;
+    }
+
+    openni2_pipeline_item * pop()
+    {
+        uint64_t h = m_head.load(std::memory_order_acquire);
+        for (;;) {
+            uint64_t t = m_tail.load(std::memory_order_acquire);
+            if (h >= t) {
+                return NULL;
+            }
+            openni2_pipeline_item * item =
+                m_slots[h % m_slots.size()].load(std::memory_order_relaxed);
+            if (m_head.compare_exchange_weak(h, h + 1,
+                                             std::memory_order_acq_rel))
+            {
+                // Pairs with the fence in pushWait: either the producer sees
+                // the room, or this sees the producer waiting.
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (m_waiters.load(std::memory_order_relaxed) > 0) {
+                    std::lock_guard<std::mutex> guard(m_waitLock);
+                    m_space.notify_all();
+                }
+                return item;
+            }
+        }
+    }
+
+    // pushWait: Push 'item', waiting for room while 'running' is true.
+    // Returns false, without pushing, once it is not.
+    bool pushWait(openni2_pipeline_item * item,
+                  const std::atomic<bool> & running)
+    {
+        if (tryPush(item)) {
+            return true;
+        }
+        std::unique_lock<std::mutex> guard(m_waitLock);
+        ++m_waiters;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool pushed;
+        while (!(pushed = tryPush(item)) && running) {
+            m_space.wait(guard);
+        }
+        --m_waiters;
+        return pushed;
+    }
+
+    // wake: Let producers blocked in pushWait look at 'running' again.
+    void wake()
+    {
+        std::lock_guard<std::mutex> guard(m_waitLock);
+        m_space.notify_all();
+    }
+
+    void drop()
+    {
+        openni2_pipeline_item * item = pop();
+        if (item != NULL) {
+            ++m_dropped;
+            delete item;
+        }
+    }
+
+    void clear()
+    {
+        openni2_pipeline_item * item;
+        while ((item = pop()) != NULL) {
+            delete item;
+        }
+    }
+
+    bool empty() const
+    {
+        return m_head.load(std::memory_order_acquire) >=
+            m_tail.load(std::memory_order_acquire);
+    }
+
+    void stats(oni_PipelineEdgeStats * out) const
+    {
+        uint64_t h = m_head.load(std::memory_order_acquire);
+        uint64_t t = m_tail.load(std::memory_order_acquire);
+        out->occupancy = t > h ? (int) (t - h) : 0;
+        out->capacity = (int) m_slots.size();
+        out->highWater = m_highWater.load(std::memory_order_relaxed);
+        out->itemsPushed = m_pushed.load(std::memory_order_relaxed);
+        out->itemsDropped = m_dropped.load(std::memory_order_relaxed);
+    }
+
+    const int from;
+    const int to;
+    const oni_BackpressurePolicy policy;
+
+private:
+    std::vector<std::atomic<openni2_pipeline_item *> > m_slots;
+    std::atomic<uint64_t> m_head;
+    std::atomic<uint64_t> m_tail;
+    std::atomic<int> m_highWater;
+    std::atomic<uint64_t> m_pushed;
+    std::atomic<uint64_t> m_dropped;
+    std::mutex m_waitLock;
+    std::condition_variable m_space;
+    std::atomic<int> m_waiters;
+};
+
+// ======================
+// openni2_pipeline_stage
+// ======================
+class openni2_pipeline;
+
+class openni2_pipeline_stage : public openni::VideoStream::NewFrameListener
+{
+public:
+    openni2_pipeline_stage(openni2_pipeline * owner, int id, const char * name)
+        : owner(owner), id(id), name(name == NULL ? "" : name), fn(NULL),
+          userData(NULL), stream(NULL), listening(false), scheduled(false),
+          nextInput(0), sequence(0), processed(0), discarded(0), totalNs(0),
+          maxNs(0) {}
+
+    // Overrides function in openni::VideoStream::NewFrameListener
+    void onNewFrame(openni::VideoStream & stream);
+
+    openni2_pipeline * owner;
+    const int id;
+    std::string name;
+    // NULL for sources.
+    oni_PipelineStageFn fn;
+    void * userData;
+    // For sources fed by a stream.
+    openni::VideoStream * stream;
+    bool listening;
+    // Only the built-in depth-to-world stage uses these.
+    openni::VideoStream * depthStream;
+    _depthGeometry geometry;
+    // Held by a source's producer while it emits, so that there is only ever
+    // one, and so that stop() can wait for it.
+    std::mutex producing;
+
+    std::vector<openni2_pipeline_edge *> inputs;
+    std::vector<openni2_pipeline_edge *> outputs;
+    // True while the stage is in the ready queue or running.
+    std::atomic<bool> scheduled;
+    size_t nextInput;
+    std::atomic<uint64_t> sequence;
+
+    std::atomic<uint64_t> processed;
+    std::atomic<uint64_t> discarded;
+    std::atomic<uint64_t> totalNs;
+    std::atomic<uint64_t> maxNs;
+};
+
+// ================
+// openni2_pipeline
+// ================
+// openni2_pipeline: Stages (e.g. source stream, unit conversion, filtering,
+// registration, sink) run on the pool one item at a time, while different
+// stages run in parallel.  Every edge has its own capacity and
+// oni_BackpressurePolicy.  Items carry a frame and an optional payload; a
+// stage with several outgoing edges sends each of them a copy of the item,
+// sharing the payload.
+class openni2_pipeline
+{
+public:
+    openni2_pipeline() : m_running(false) {}
+
+    ~openni2_pipeline()
+    {
+        stop();
+        for (size_t i = 0; i < m_edges.size(); ++i) {
+            delete m_edges[i];
+        }
+        for (size_t i = 0; i < m_stages.size(); ++i) {
+            delete m_stages[i];
+        }
+    }
+
+    int addStage(const char * name, oni_PipelineStageFn fn, void * userData,
+                 openni::VideoStream * stream, bool source)
+    {
+        if (m_running) {
+            return -1;
+        }
+        openni2_pipeline_stage * stage =
+            new openni2_pipeline_stage(this, (int) m_stages.size(), name);
+        stage->fn = source ? NULL : fn;
+        stage->userData = userData;
+        stage->stream = source ? stream : NULL;
+        stage->depthStream = source ? NULL : stream;
+        m_stages.push_back(stage);
+        return stage->id;
+    }
+
+    int connect(int from, int to, int capacity, oni_BackpressurePolicy policy)
+    {
+        if (m_running || from < 0 || to < 0 || from >= (int) m_stages.size() ||
+            to >= (int) m_stages.size() || capacity <= 0 ||
+            m_stages[to]->fn == NULL || reaches(to, from))
+        {
+            return -1;
+        }
+        openni2_pipeline_edge * edge =
+            new openni2_pipeline_edge(from, to, capacity, policy);
+        m_edges.push_back(edge);
+        m_stages[from]->outputs.push_back(edge);
+        m_stages[to]->inputs.push_back(edge);
+        return (int) m_edges.size() - 1;
+    }
+
+    oni_Status start(int threadCount)
+    {
+        if (m_running) {
+            return openni::STATUS_OUT_OF_FLOW;
+        }
+
+        // A worker blocked on a full BLOCK edge is stuck until the stage
+        // downstream runs, so there must always be a worker left over.
+        int blocking = 0;
+        for (size_t i = 0; i < m_stages.size(); ++i) {
+            if (m_stages[i]->fn == NULL) {
+                continue;
+            }
+            for (size_t j = 0; j < m_stages[i]->outputs.size(); ++j) {
+                if (m_stages[i]->outputs[j]->policy == oni_BACKPRESSURE_BLOCK) {
+                    ++blocking;
+                    break;
+                }
+            }
+        }
+        if (threadCount <= 0) {
+            threadCount = (int) m_stages.size();
+        }
+        if (threadCount < blocking + 1) {
+            threadCount = blocking + 1;
+        }
+
+        m_running = true;
+        for (int i = 0; i < threadCount; ++i) {
+            m_workers.push_back(std::thread(&openni2_pipeline::work, this));
+        }
+
+        for (size_t i = 0; i < m_stages.size(); ++i) {
+            openni2_pipeline_stage * stage = m_stages[i];
+            if (stage->stream != NULL) {
+                oni_Status rc = stage->stream->addNewFrameListener(stage);
+                if (rc != openni::STATUS_OK) {
+                    stop();
+                    return rc;
+                }
+                stage->listening = true;
+            }
+        }
+        return openni::STATUS_OK;
+    }
+
+    void stop()
+    {
+        for (size_t i = 0; i < m_stages.size(); ++i) {
+            if (m_stages[i]->listening) {
+                m_stages[i]->stream->removeNewFrameListener(m_stages[i]);
+                m_stages[i]->listening = false;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_running = false;
+            m_wake.notify_all();
+        }
+        for (size_t i = 0; i < m_edges.size(); ++i) {
+            m_edges[i]->wake();
+        }
+        // Wait out any source still emitting, so nothing is pushed after the
+        // edges are cleared below.
+        for (size_t i = 0; i < m_stages.size(); ++i) {
+            if (m_stages[i]->fn == NULL) {
+                std::lock_guard<std::mutex> guard(m_stages[i]->producing);
+            }
+        }
+        for (size_t i = 0; i < m_workers.size(); ++i) {
+            m_workers[i].join();
+        }
+        m_workers.clear();
+        m_ready.clear();
+        for (size_t i = 0; i < m_edges.size(); ++i) {
+            m_edges[i]->clear();
+        }
+        for (size_t i = 0; i < m_stages.size(); ++i) {
+            m_stages[i]->scheduled = false;
+        }
+    }
+
+    // produce: Emit 'item' (which this takes ownership of) from the source
+    // 'stage', unless the pipeline has stopped.
+    oni_Status produce(openni2_pipeline_stage * stage,
+                       openni2_pipeline_item * item)
+    {
+        std::lock_guard<std::mutex> guard(stage->producing);
+        if (!m_running) {
+            delete item;
+            return openni::STATUS_OUT_OF_FLOW;
+        }
+        item->sequence = stage->sequence++;
+        emit(stage, item);
+        return openni::STATUS_OK;
+    }
+
+    // emit: Send 'item' (which this takes ownership of) along every outgoing
+    // edge of 'stage'.
+    void emit(openni2_pipeline_stage * stage, openni2_pipeline_item * item)
+    {
+        size_t count = stage->outputs.size();
+        for (size_t i = 0; i < count; ++i) {
+            openni2_pipeline_item * copy = i + 1 == count ?
+                item : new openni2_pipeline_item(*item);
+            push(stage->outputs[i], copy);
+        }
+        if (count == 0) {
+            delete item;
+        }
+    }
+
+    bool isRunning() const { return m_running; }
+
+    std::vector<openni2_pipeline_stage *> m_stages;
+    std::vector<openni2_pipeline_edge *> m_edges;
+
+private:
+    bool reaches(int from, int to) const
+    {
+        if (from == to) {
+            return true;
+        }
+        const std::vector<openni2_pipeline_edge *> & out = m_stages[from]->outputs;
+        for (size_t i = 0; i < out.size(); ++i) {
+            if (reaches(out[i]->to, to)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void push(openni2_pipeline_edge * edge, openni2_pipeline_item * item)
+    {
+        if (edge->policy == oni_BACKPRESSURE_KEEP_LATEST) {
+            while (!edge->empty()) {
+                edge->drop();
+            }
+        }
+        if (edge->policy == oni_BACKPRESSURE_BLOCK) {
+            if (!edge->pushWait(item, m_running)) {
+                delete item;
+                return;
+            }
+        } else {
+            while (!edge->tryPush(item)) {
+                edge->drop();
+            }
+        }
+        schedule(m_stages[edge->to]);
+    }
+
+    void schedule(openni2_pipeline_stage * stage)
+    {
+        bool expected = false;
+        if (stage->scheduled.compare_exchange_strong(expected, true)) {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_ready.push_back(stage);
+            m_wake.notify_one();
+        }
+    }
+
+    // runStage: Process a bounded number of items, taking the inputs in turn
+    // so that one busy edge can't starve the others.
+    void runStage(openni2_pipeline_stage * stage)
+    {
+        const int batch = 16;
+        for (int n = 0; n < batch && m_running; ++n) {
+            openni2_pipeline_item * item = NULL;
+            for (size_t i = 0; i < stage->inputs.size() && item == NULL; ++i) {
+                size_t idx = (stage->nextInput + i) % stage->inputs.size();
+                item = stage->inputs[idx]->pop();
+                if (item != NULL) {
+                    stage->nextInput = idx + 1;
+                }
+            }
+            if (item == NULL) {
+                break;
+            }
+
+            std::chrono::steady_clock::time_point t0 =
+                std::chrono::steady_clock::now();
+            bool keep = false;
+            try {
+                keep = stage->fn(stage->userData, item);
+            } catch (std::exception & e) {
+                std::cout << "Error: " << e.what() << std::endl;
+            }
+            uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - t0).count();
+
+            ++stage->processed;
+            stage->totalNs += ns;
+            if (ns > stage->maxNs.load(std::memory_order_relaxed)) {
+                stage->maxNs.store(ns, std::memory_order_relaxed);
+            }
+            if (keep) {
+                emit(stage, item);
+            } else {
+                ++stage->discarded;
+                delete item;
+            }
+        }
+
+        stage->scheduled = false;
+        for (size_t i = 0; i < stage->inputs.size(); ++i) {
+            if (!stage->inputs[i]->empty()) {
+                schedule(stage);
+                break;
+            }
+        }
+    }
+
+    void work()
+    {
+        std::unique_lock<std::mutex> guard(m_lock);
+        while (m_running) {
+            if (m_ready.empty()) {
+                m_wake.wait(guard);
+                continue;
+            }
+            openni2_pipeline_stage * stage = m_ready.front();
+            m_ready.pop_front();
+            guard.unlock();
+            runStage(stage);
+            guard.lock();
+        }
+    }
+
+    std::atomic<bool> m_running;
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::deque<openni2_pipeline_stage *> m_ready;
+    std::vector<std::thread> m_workers;
+};
+
+void openni2_pipeline_stage::onNewFrame(openni::VideoStream & s)
+{
+    openni2_pipeline_item * item = new openni2_pipeline_item();
+    if (s.readFrame(&item->frame) != openni::STATUS_OK) {
+        delete item;
+        return;
+    }
+    owner->produce(this, item);
+}
+
+// ===============
+// Built-in stages
+// ===============
+static void _freeFloats(void * data)
+{
+    delete[] (float *) data;
+}
+
+static bool _depthToWorldStage(void * userData, oni_PipelineItem * item)
+{
+    // A stage never runs on two workers at once, so its geometry is safe to
+    // reuse from item to item.
+    openni2_pipeline_stage * stage = (openni2_pipeline_stage *) userData;
+    oni_FrameDescriptor desc;
+    oni_CameraIntrinsics intrinsics;
+    if (!item->frame.isValid() ||
+        oni_getFrameDescriptor(&item->frame, &desc) != openni::STATUS_OK ||
+        oni_getCameraIntrinsics(stage->depthStream, &intrinsics) !=
+            openni::STATUS_OK ||
+        !_makeDepthGeometry(desc, intrinsics, &stage->geometry))
+    {
+        return false;
+    }
+
+    const _depthGeometry & g = stage->geometry;
+    int width = desc.width;
+    int height = desc.height;
+    float * out = new float[(size_t) width * height * 3];
+    float * p = out;
+    for (int y = 0; y < height; ++y) {
+        const uint16_t * row = _depthRow(desc, y);
+        for (int x = 0; x < width; ++x, p += 3) {
+            float z = row[x] * g.scale;
+            p[0] = g.ax[x] * z;
+            p[1] = g.ay[y] * z;
+            p[2] = z;
+        }
+    }
+    oni_setPayload_PipelineItem(item, out, width * height * 3 * sizeof(float),
+                                &_freeFloats);
+    return true;
+}
+
+// ============
+// oni_Pipeline
+// ============
+oni_Pipeline * oni_new_Pipeline() {
+    EXC_CHECK( return new openni2_pipeline(); );
+    return NULL;
+}
+
+void oni_delete_Pipeline(oni_Pipeline * pipeline) {
+    EXC_CHECK( delete pipeline; );
+}
+
+int oni_addSource_Pipeline(oni_Pipeline * pipeline, const char * name,
+                           oni_VideoStream * stream) {
+    EXC_CHECK( return pipeline->addStage(name, NULL, NULL, stream, true); );
+    return -1;
+}
+
+int oni_addStage_Pipeline(oni_Pipeline * pipeline, const char * name,
+                          oni_PipelineStageFn fn, void * userData) {
+    if (fn == NULL) {
+        return -1;
+    }
+    EXC_CHECK( return pipeline->addStage(name, fn, userData, NULL, false); );
+    return -1;
+}
+
+int oni_addDepthToWorldStage_Pipeline(oni_Pipeline * pipeline,
+                                      const char * name,
+                                      oni_VideoStream * depth) {
+    EXC_CHECK({
+        int id = pipeline->addStage(name, &_depthToWorldStage, NULL, depth,
+                                    false);
+        if (id >= 0) {
+            pipeline->m_stages[id]->userData = pipeline->m_stages[id];
+        }
+        return id;
+    });
+    return -1;
+}
+
+int oni_connect_Pipeline(oni_Pipeline * pipeline, int from, int to,
+                         int capacity, oni_BackpressurePolicy policy) {
+    EXC_CHECK( return pipeline->connect(from, to, capacity, policy); );
+    return -1;
+}
+
+oni_Status oni_start_Pipeline(oni_Pipeline * pipeline, int threadCount) {
+    EXC_CHECK( return pipeline->start(threadCount); );
+    return openni::STATUS_ERROR;
+}
+
+void oni_stop_Pipeline(oni_Pipeline * pipeline) {
+    EXC_CHECK( pipeline->stop(); );
+}
+
+oni_Status oni_push_Pipeline(oni_Pipeline * pipeline, int source,
+                             oni_VideoFrameRef * frame) {
+    EXC_CHECK({
+        if (source < 0 || source >= (int) pipeline->m_stages.size() ||
+            pipeline->m_stages[source]->fn != NULL ||
+            pipeline->m_stages[source]->stream != NULL)
+        {
+            // A stream source's listener is the only producer its queues
+            // may have.
+            return openni::STATUS_BAD_PARAMETER;
+        }
+        if (!pipeline->isRunning()) {
+            return openni::STATUS_OUT_OF_FLOW;
+        }
+        openni2_pipeline_item * item = new openni2_pipeline_item();
+        item->frame = *frame;
+        return pipeline->produce(pipeline->m_stages[source], item);
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_getStageStats_Pipeline(oni_Pipeline * pipeline, int stage,
+                                      oni_PipelineStageStats * stats) {
+    EXC_CHECK({
+        if (stage < 0 || stage >= (int) pipeline->m_stages.size()) {
+            return openni::STATUS_BAD_PARAMETER;
+        }
+        const openni2_pipeline_stage * s = pipeline->m_stages[stage];
+        stats->itemsProcessed = s->fn == NULL ? s->sequence.load() : s->processed.load();
+        stats->itemsDiscarded = s->discarded;
+        stats->totalTimeNs = s->totalNs;
+        stats->maxTimeNs = s->maxNs;
+        return openni::STATUS_OK;
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_getEdgeStats_Pipeline(oni_Pipeline * pipeline, int edge,
+                                     oni_PipelineEdgeStats * stats) {
+    EXC_CHECK({
+        if (edge < 0 || edge >= (int) pipeline->m_edges.size()) {
+            return openni::STATUS_BAD_PARAMETER;
+        }
+        pipeline->m_edges[edge]->stats(stats);
+        return openni::STATUS_OK;
+    });
+    return openni::STATUS_ERROR;
+}
+
+// ================
+// oni_PipelineItem
+// ================
+oni_VideoFrameRef * oni_getFrame_PipelineItem(oni_PipelineItem * item) {
+    return &item->frame;
+}
+
+void * oni_getPayload_PipelineItem(oni_PipelineItem * item, int * size) {
+    if (size != NULL) {
+        *size = item->payloadSize;
+    }
+    return item->payload.get();
+}
+
+static void _noRelease(void *)
+{
+}
+
+void oni_setPayload_PipelineItem(oni_PipelineItem * item, void * payload,
+                                 int size, void (*release) (void *)) {
+    EXC_CHECK({
+        item->payload.reset(payload, release != NULL ? release : &_noRelease);
+        item->payloadSize = size;
+    });
+}
+
+uint64_t oni_getSequence_PipelineItem(oni_PipelineItem * item) {
+    return item->sequence;
+}
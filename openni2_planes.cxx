@@ -0,0 +1,642 @@
+// ============================================================================
+// openni2_planes.cxx: RANSAC plane detection on depth frames
+// (oni_PlaneDetector)
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <math.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_geometry.h"
+#include "openni2_parallel.h"
+#include "openni2_internal.h"
+
+// Hypotheses are drawn and scored this many at a time; the time budget and
+// the adaptive stopping rule are checked in between.
+static const int _hypothesisBatch = 32;
+
+// _plane: n . p + d = 0, with n a unit vector.
+struct _plane {
+    float n[3];
+    float d;
+};
+
+// _points: The subsampled points still to be assigned to a plane, as
+// structure of arrays so that four can be tested at once.
+struct _points {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+
+    size_t size() const { return x.size(); }
+
+    void clear()
+    {
+        x.clear();
+        y.clear();
+        z.clear();
+    }
+
+    void push(float px, float py, float pz)
+    {
+        x.push_back(px);
+        y.push_back(py);
+        z.push_back(pz);
+    }
+};
+
+// _countInliers: How many of the points lie within 'threshold' of 'plane'.
+static int _countInliers(const _points & pts, const _plane & plane,
+                         float threshold)
+{
+    size_t n = pts.size();
+    size_t i = 0;
+    int count = 0;
+#ifdef __SSE2__
+    const __m128 a = _mm_set1_ps(plane.n[0]);
+    const __m128 b = _mm_set1_ps(plane.n[1]);
+    const __m128 c = _mm_set1_ps(plane.n[2]);
+    const __m128 d = _mm_set1_ps(plane.d);
+    const __m128 t = _mm_set1_ps(threshold);
+    const __m128 abs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    for (; i + 4 <= n; i += 4) {
+        __m128 dist = _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(a, _mm_loadu_ps(&pts.x[i])),
+            _mm_mul_ps(b, _mm_loadu_ps(&pts.y[i]))),
+            _mm_add_ps(_mm_mul_ps(c, _mm_loadu_ps(&pts.z[i])), d));
+        count += __builtin_popcount(
+            _mm_movemask_ps(_mm_cmple_ps(_mm_and_ps(dist, abs), t)));
+    }
+#endif
+    for (; i < n; ++i) {
+        float dist = plane.n[0] * pts.x[i] + plane.n[1] * pts.y[i] +
+            plane.n[2] * pts.z[i] + plane.d;
+        count += fabsf(dist) <= threshold;
+    }
+    return count;
+}
+
+// _smallestEigenvector: Of symmetric 'm', by cyclic Jacobi rotations.
+static void _smallestEigenvector(double m[3][3], double * out)
+{
+    double v[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+    for (int sweep = 0; sweep < 16; ++sweep) {
+        double off = m[0][1] * m[0][1] + m[0][2] * m[0][2] + m[1][2] * m[1][2];
+        if (off < 1e-18 * (m[0][0] * m[0][0] + m[1][1] * m[1][1] +
+                           m[2][2] * m[2][2]) || off == 0.0)
+        {
+            break;
+        }
+        for (int p = 0; p < 2; ++p) {
+            for (int q = p + 1; q < 3; ++q) {
+                if (m[p][q] == 0.0) {
+                    continue;
+                }
+                double theta = (m[q][q] - m[p][p]) / (2.0 * m[p][q]);
+                double t = (theta >= 0 ? 1.0 : -1.0) /
+                    (fabs(theta) + sqrt(theta * theta + 1.0));
+                double c = 1.0 / sqrt(t * t + 1.0);
+                double s = t * c;
+                for (int k = 0; k < 3; ++k) {
+                    double mkp = m[k][p], mkq = m[k][q];
+                    m[k][p] = c * mkp - s * mkq;
+                    m[k][q] = s * mkp + c * mkq;
+                }
+                for (int k = 0; k < 3; ++k) {
+                    double mpk = m[p][k], mqk = m[q][k];
+                    m[p][k] = c * mpk - s * mqk;
+                    m[q][k] = s * mpk + c * mqk;
+                }
+                for (int k = 0; k < 3; ++k) {
+                    double vkp = v[k][p], vkq = v[k][q];
+                    v[k][p] = c * vkp - s * vkq;
+                    v[k][q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+    int best = 0;
+    for (int i = 1; i < 3; ++i) {
+        if (m[i][i] < m[best][best]) {
+            best = i;
+        }
+    }
+    for (int k = 0; k < 3; ++k) {
+        out[k] = v[k][best];
+    }
+}
+
+// _orient: Make the normal face the camera at the origin, i.e. d > 0.
+static void _orient(_plane & plane)
+{
+    if (plane.d < 0.0f) {
+        for (int k = 0; k < 3; ++k) {
+            plane.n[k] = -plane.n[k];
+        }
+        plane.d = -plane.d;
+    }
+}
+
+// _fitPlane: Least-squares refit of 'plane' to the points within
+// 'threshold' of it.  Returns false if there are too few; otherwise sets
+// 'centroid' to their mean.
+static bool _fitPlane(const _points & pts, float threshold, _plane & plane,
+                      float * centroid)
+{
+    double sum[3] = { 0, 0, 0 };
+    double cov[3][3] = { { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 } };
+    size_t n = 0;
+    // Moments about a point on the plane keep the sums small.
+    double origin[3] = { -plane.n[0] * plane.d, -plane.n[1] * plane.d,
+                         -plane.n[2] * plane.d };
+    for (size_t i = 0; i < pts.size(); ++i) {
+        float dist = plane.n[0] * pts.x[i] + plane.n[1] * pts.y[i] +
+            plane.n[2] * pts.z[i] + plane.d;
+        if (fabsf(dist) > threshold) {
+            continue;
+        }
+        double p[3] = { pts.x[i] - origin[0], pts.y[i] - origin[1],
+                        pts.z[i] - origin[2] };
+        for (int a = 0; a < 3; ++a) {
+            sum[a] += p[a];
+            for (int b = a; b < 3; ++b) {
+                cov[a][b] += p[a] * p[b];
+            }
+        }
+        ++n;
+    }
+    if (n < 3) {
+        return false;
+    }
+    double mean[3] = { sum[0] / n, sum[1] / n, sum[2] / n };
+    for (int a = 0; a < 3; ++a) {
+        for (int b = a; b < 3; ++b) {
+            cov[a][b] = cov[a][b] / n - mean[a] * mean[b];
+            cov[b][a] = cov[a][b];
+        }
+    }
+    double normal[3];
+    _smallestEigenvector(cov, normal);
+    double len = sqrt(normal[0] * normal[0] + normal[1] * normal[1] +
+                      normal[2] * normal[2]);
+    if (!(len > 0.0)) {
+        return false;
+    }
+    double d = 0.0;
+    for (int k = 0; k < 3; ++k) {
+        centroid[k] = (float) (mean[k] + origin[k]);
+        plane.n[k] = (float) (normal[k] / len);
+        d -= plane.n[k] * centroid[k];
+    }
+    plane.d = (float) d;
+    _orient(plane);
+    return true;
+}
+
+// _planeThrough: The plane through three points; false if they are
+// (nearly) collinear.
+static bool _planeThrough(const _points & pts, size_t i, size_t j, size_t k,
+                          _plane & plane)
+{
+    float u[3] = { pts.x[j] - pts.x[i], pts.y[j] - pts.y[i], pts.z[j] - pts.z[i] };
+    float v[3] = { pts.x[k] - pts.x[i], pts.y[k] - pts.y[i], pts.z[k] - pts.z[i] };
+    float n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2],
+                   u[0] * v[1] - u[1] * v[0] };
+    float len2 = n[0] * n[0] + n[1] * n[1] + n[2] * n[2];
+    float scale = (u[0] * u[0] + u[1] * u[1] + u[2] * u[2]) *
+        (v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    // Reject sin(angle) below about 0.1.
+    if (!(len2 > 0.01f * scale)) {
+        return false;
+    }
+    float inv = 1.0f / sqrtf(len2);
+    for (int a = 0; a < 3; ++a) {
+        plane.n[a] = n[a] * inv;
+    }
+    plane.d = -(plane.n[0] * pts.x[i] + plane.n[1] * pts.y[i] +
+                plane.n[2] * pts.z[i]);
+    _orient(plane);
+    return true;
+}
+
+// _labelRow: Label the 'n' pixels of one row with the number of the first
+// of 'planes' they lie within 'threshold' of (0 for none), counting each
+// plane's pixels into 'counts'.
+static void _labelRow(const uint16_t * row, const float * ax, float ay,
+                      float scale, int n, const std::vector<_plane> & planes,
+                      float threshold, uint8_t * out, int * counts)
+{
+    int x = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 abs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 t = _mm_set1_ps(threshold);
+    for (; x + 4 <= n; x += 4) {
+        __m128i raw = _mm_unpacklo_epi16(
+            _mm_loadl_epi64((const __m128i *) (row + x)), zero);
+        __m128 z = _mm_mul_ps(_mm_cvtepi32_ps(raw), _mm_set1_ps(scale));
+        __m128 px = _mm_mul_ps(_mm_loadu_ps(ax + x), z);
+        __m128 py = _mm_mul_ps(_mm_set1_ps(ay), z);
+        // Lanes still without a plane; missing pixels never get one.
+        __m128i open = _mm_xor_si128(_mm_cmpeq_epi32(raw, zero),
+                                     _mm_set1_epi32(-1));
+        __m128i labels = zero;
+        for (size_t i = 0; i < planes.size() && _mm_movemask_epi8(open); ++i) {
+            const _plane & p = planes[i];
+            __m128 dist = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(_mm_set1_ps(p.n[0]), px),
+                _mm_mul_ps(_mm_set1_ps(p.n[1]), py)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.n[2]), z), _mm_set1_ps(p.d)));
+            __m128i hit = _mm_and_si128(open, _mm_castps_si128(
+                _mm_cmple_ps(_mm_and_ps(dist, abs), t)));
+            labels = _mm_or_si128(labels, _mm_and_si128(
+                hit, _mm_set1_epi32((int) i + 1)));
+            open = _mm_andnot_si128(hit, open);
+            counts[i] += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(hit)));
+        }
+        labels = _mm_packs_epi32(labels, labels);
+        uint32_t packed = (uint32_t) _mm_cvtsi128_si32(_mm_packus_epi16(labels, labels));
+        memcpy(out + x, &packed, 4);
+    }
+#endif
+    for (; x < n; ++x) {
+        out[x] = 0;
+        if (row[x] == 0) {
+            continue;
+        }
+        float z = row[x] * scale;
+        float px = ax[x] * z, py = ay * z;
+        for (size_t i = 0; i < planes.size(); ++i) {
+            const _plane & p = planes[i];
+            float dist = p.n[0] * px + p.n[1] * py + p.n[2] * z + p.d;
+            if (fabsf(dist) <= threshold) {
+                out[x] = (uint8_t) (i + 1);
+                ++counts[i];
+                break;
+            }
+        }
+    }
+}
+
+// ======================
+// openni2_plane_detector
+// ======================
+// openni2_plane_detector: Hypotheses through three random points are scored
+// in parallel (see oni_setParallelism) against a subsampled grid of the frame,
+// the best one is refit by least squares, its points are removed, and the
+// search repeats for the next plane.  Each frame starts from the previous
+// frame's planes, so a static scene usually needs no random sampling at all.
+class openni2_plane_detector
+{
+public:
+    openni2_plane_detector(int maxPlanes, float threshold, int minInliers)
+        : maxPlanes(maxPlanes), threshold(threshold), minInliers(minInliers),
+          iterations(200), step(4), budgetMs(0.0f), refine(true),
+          m_random(0x2545f4914f6cdd1dULL), m_width(0), m_height(0) {}
+
+    oni_Status detect(const oni_FrameDescriptor & desc,
+                      const oni_CameraIntrinsics & intrinsics,
+                      oni_Plane * planes, int * count)
+    {
+        if (!_makeDepthGeometry(desc, intrinsics, &m_geometry)) {
+            return openni::STATUS_NOT_SUPPORTED;
+        }
+        m_desc = &desc;
+        sample();
+        // The budget covers the search only.
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+
+        std::vector<_plane> & found = m_found;
+        std::vector<float> & centroids = m_centroids;
+        found.clear();
+        centroids.clear();
+        m_support.clear();
+        // Support on the subsampled grid needed to keep a plane.
+        int minSupport = minInliers / (step * step);
+        minSupport = minSupport < 3 ? 3 : minSupport;
+        while ((int) found.size() < maxPlanes && (int) m_points.size() >= minSupport) {
+            _plane best;
+            int support = 0;
+            if (!search(start, best, support) || support < minSupport) {
+                break;
+            }
+            float centroid[3];
+            // Two refits: the first may pull in points the hypothesis missed.
+            for (int i = 0; i < 2; ++i) {
+                if (!_fitPlane(m_points, threshold, best, centroid)) {
+                    break;
+                }
+            }
+            found.push_back(best);
+            m_support.push_back(_countInliers(m_points, best, threshold));
+            centroids.insert(centroids.end(), centroid, centroid + 3);
+            removeInliers(best);
+            if (overBudget(start)) {
+                break;
+            }
+        }
+
+        label(found);
+        m_previous = found;
+        m_previousSupport = m_support;
+        for (size_t i = 0; i < found.size(); ++i) {
+            oni_Plane & out = planes[i];
+            out.nx = found[i].n[0];
+            out.ny = found[i].n[1];
+            out.nz = found[i].n[2];
+            out.d = found[i].d;
+            out.centroidX = centroids[3 * i];
+            out.centroidY = centroids[3 * i + 1];
+            out.centroidZ = centroids[3 * i + 2];
+            out.inliers = m_inliers[i];
+        }
+        *count = (int) found.size();
+        return openni::STATUS_OK;
+    }
+
+    const uint8_t * labels(int * width, int * height) const
+    {
+        if (width != NULL) {
+            *width = m_width;
+        }
+        if (height != NULL) {
+            *height = m_height;
+        }
+        return m_labels.empty() ? NULL : &m_labels[0];
+    }
+
+    const int maxPlanes;
+    const float threshold;
+    const int minInliers;
+    int iterations;
+    int step;
+    float budgetMs;
+    bool refine;
+
+private:
+    bool overBudget(std::chrono::steady_clock::time_point start) const
+    {
+        if (budgetMs <= 0.0f) {
+            return false;
+        }
+        std::chrono::duration<float, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        return elapsed.count() >= budgetMs;
+    }
+
+    // sample: Collect the valid points on every step-th row and column.
+    void sample()
+    {
+        const oni_FrameDescriptor & desc = *m_desc;
+        const _depthGeometry & g = m_geometry;
+        int rows = (desc.height + step - 1) / step;
+        m_bandPoints.resize(rows);
+        _parallelFor(rows, 16, [&](int r0, int r1) {
+            for (int r = r0; r < r1; ++r) {
+                int y = r * step;
+                const uint16_t * row = _depthRow(desc, y);
+                _points & out = m_bandPoints[r];
+                out.clear();
+                for (int x = 0; x < desc.width; x += step) {
+                    if (row[x] != 0) {
+                        float z = row[x] * g.scale;
+                        out.push(g.ax[x] * z, g.ay[y] * z, z);
+                    }
+                }
+            }
+        });
+        m_points.clear();
+        for (int r = 0; r < rows; ++r) {
+            const _points & part = m_bandPoints[r];
+            m_points.x.insert(m_points.x.end(), part.x.begin(), part.x.end());
+            m_points.y.insert(m_points.y.end(), part.y.begin(), part.y.end());
+            m_points.z.insert(m_points.z.end(), part.z.begin(), part.z.end());
+        }
+    }
+
+    uint64_t random()
+    {
+        // xorshift64*
+        m_random ^= m_random >> 12;
+        m_random ^= m_random << 25;
+        m_random ^= m_random >> 27;
+        return m_random * 0x2545f4914f6cdd1dULL;
+    }
+
+    // search: Find the plane with the most support among the remaining
+    // points.  The previous frame's planes are tried first; if one of them
+    // still has four fifths of its old support, random sampling is skipped.
+    bool search(std::chrono::steady_clock::time_point start, _plane & best,
+                int & support)
+    {
+        size_t n = m_points.size();
+        support = 0;
+        if (refine) {
+            bool kept = false;
+            for (size_t i = 0; i < m_previous.size(); ++i) {
+                int s = _countInliers(m_points, m_previous[i], threshold);
+                if (s > support) {
+                    support = s;
+                    best = m_previous[i];
+                    kept = 5 * s >= 4 * m_previousSupport[i];
+                }
+            }
+            if (kept) {
+                return true;
+            }
+        }
+
+        std::vector<_plane> & hypotheses = m_hypotheses;
+        std::vector<int> & scores = m_scores;
+        hypotheses.resize(_hypothesisBatch);
+        scores.resize(_hypothesisBatch);
+        int drawn = 0;
+        int limit = iterations;
+        while (drawn < limit) {
+            int batch = limit - drawn < _hypothesisBatch ? limit - drawn : _hypothesisBatch;
+            // Drawn here, not in the workers, so that results do not depend
+            // on the thread count.
+            int made = 0;
+            for (int tries = 0; made < batch && tries < 4 * batch; ++tries) {
+                size_t i = random() % n, j = random() % n, k = random() % n;
+                if (i != j && j != k && i != k &&
+                    _planeThrough(m_points, i, j, k, hypotheses[made]))
+                {
+                    ++made;
+                }
+            }
+            if (made == 0) {
+                break;
+            }
+            _parallelFor(made, 1, [&](int h0, int h1) {
+                for (int h = h0; h < h1; ++h) {
+                    scores[h] = _countInliers(m_points, hypotheses[h], threshold);
+                }
+            });
+            for (int h = 0; h < made; ++h) {
+                if (scores[h] > support) {
+                    support = scores[h];
+                    best = hypotheses[h];
+                }
+            }
+            drawn += batch;
+            // Stop once a better plane would have been found with 99%
+            // probability: (1 - w^3)^k < 0.01 for inlier ratio w.
+            double w = (double) support / n;
+            double miss = 1.0 - w * w * w;
+            if (miss <= 0.0) {
+                break;
+            }
+            if (miss < 1.0) {
+                double needed = log(0.01) / log(miss);
+                if (needed < limit) {
+                    limit = needed < drawn ? drawn : (int) needed;
+                }
+            }
+            if (overBudget(start)) {
+                break;
+            }
+        }
+        return support > 0;
+    }
+
+    void removeInliers(const _plane & plane)
+    {
+        size_t out = 0;
+        for (size_t i = 0; i < m_points.size(); ++i) {
+            float dist = plane.n[0] * m_points.x[i] + plane.n[1] * m_points.y[i] +
+                plane.n[2] * m_points.z[i] + plane.d;
+            if (fabsf(dist) > threshold) {
+                m_points.x[out] = m_points.x[i];
+                m_points.y[out] = m_points.y[i];
+                m_points.z[out] = m_points.z[i];
+                ++out;
+            }
+        }
+        m_points.x.resize(out);
+        m_points.y.resize(out);
+        m_points.z.resize(out);
+    }
+
+    // label: Give every pixel of the full frame the number of the first
+    // plane it lies within 'threshold' of, and count them.
+    void label(const std::vector<_plane> & planes)
+    {
+        const oni_FrameDescriptor & desc = *m_desc;
+        const _depthGeometry & g = m_geometry;
+        m_width = desc.width;
+        m_height = desc.height;
+        m_labels.resize((size_t) m_width * m_height);
+        m_inliers.assign(planes.size(), 0);
+        std::vector<int> & counts = m_counts;
+        counts.assign((size_t) ((m_height + 15) / 16) * planes.size(), 0);
+        _parallelFor(m_height, 16, [&](int y0, int y1) {
+            int * bandCounts = planes.empty() ? NULL : &counts[(y0 / 16) * planes.size()];
+            for (int y = y0; y < y1; ++y) {
+                const uint16_t * row = _depthRow(desc, y);
+                uint8_t * out = &m_labels[(size_t) y * m_width];
+                _labelRow(row, &g.ax[0], g.ay[y], g.scale, m_width, planes,
+                          threshold, out, bandCounts);
+            }
+        });
+        for (size_t b = 0; b < counts.size(); ++b) {
+            m_inliers[b % planes.size()] += counts[b];
+        }
+    }
+
+    uint64_t m_random;
+    // Valid during detect() only.
+    const oni_FrameDescriptor * m_desc;
+    _depthGeometry m_geometry;
+    _points m_points;
+    std::vector<_points> m_bandPoints;
+    // Support on the subsampled grid of the planes found so far, and of
+    // the previous frame's.
+    std::vector<int> m_support;
+    std::vector<_plane> m_previous;
+    std::vector<int> m_previousSupport;
+    // Scratch for detect(), search() and label(), kept from frame to frame.
+    std::vector<_plane> m_found;
+    std::vector<float> m_centroids;
+    std::vector<_plane> m_hypotheses;
+    std::vector<int> m_scores;
+    std::vector<int> m_counts;
+    int m_width;
+    int m_height;
+    std::vector<uint8_t> m_labels;
+    std::vector<int> m_inliers;
+};
+
+// =================
+// oni_PlaneDetector
+// =================
+oni_PlaneDetector * oni_new_PlaneDetector(int maxPlanes, float threshold,
+                                          int minInliers) {
+    if (maxPlanes < 1 || maxPlanes > 255 || threshold <= 0.0f) {
+        return NULL;
+    }
+    EXC_CHECK( return new openni2_plane_detector(maxPlanes, threshold,
+                                                 minInliers); );
+    return NULL;
+}
+
+void oni_delete_PlaneDetector(oni_PlaneDetector * detector) {
+    EXC_CHECK( delete detector; );
+}
+
+void oni_setIterations_PlaneDetector(oni_PlaneDetector * detector,
+                                     int iterations) {
+    EXC_CHECK( detector->iterations = iterations > 1 ? iterations : 1; );
+}
+
+void oni_setSubsample_PlaneDetector(oni_PlaneDetector * detector, int step) {
+    EXC_CHECK( detector->step = step > 1 ? step : 1; );
+}
+
+void oni_setTimeBudget_PlaneDetector(oni_PlaneDetector * detector,
+                                     float milliseconds) {
+    EXC_CHECK( detector->budgetMs = milliseconds; );
+}
+
+void oni_setRefine_PlaneDetector(oni_PlaneDetector * detector, bool refine) {
+    EXC_CHECK( detector->refine = refine; );
+}
+
+oni_Status oni_detect_PlaneDetector(oni_PlaneDetector * detector,
+                                    oni_VideoFrameRef * frame,
+                                    const oni_CameraIntrinsics * intrinsics,
+                                    oni_Plane * planes, int * count) {
+    EXC_CHECK({
+        oni_FrameDescriptor desc;
+        oni_Status rc = oni_getFrameDescriptor(frame, &desc);
+        if (rc != openni::STATUS_OK) {
+            return rc;
+        }
+        return detector->detect(desc, *intrinsics, planes, count);
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_detectDescriptor_PlaneDetector(oni_PlaneDetector * detector,
+                                              const oni_FrameDescriptor * desc,
+                                              const oni_CameraIntrinsics * intrinsics,
+                                              oni_Plane * planes, int * count) {
+    EXC_CHECK( return detector->detect(*desc, *intrinsics, planes, count); );
+    return openni::STATUS_ERROR;
+}
+
+const uint8_t * oni_getLabels_PlaneDetector(oni_PlaneDetector * detector,
+                                            int * width, int * height) {
+    EXC_CHECK( return detector->labels(width, height); );
+    return NULL;
+}
@@ -0,0 +1,388 @@
+// ============================================================================
+// openni2_point_cloud.cxx: Colored point clouds from depth and color frames,
+// voxel-grid downsampled on the way (oni_PointCloud)
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_geometry.h"
+#include "openni2_parallel.h"
+#include "openni2_internal.h"
+
+// Voxels are spread over this many partitions by hash, so that partitions
+// can be merged in parallel without sharing anything.
+static const int _partitions = 16;
+// Each voxel index is offset by this much and kept in 21 bits.
+static const int _keyOffset = 1 << 20;
+
+// _voxel: Running sums of the points that fell into one voxel.
+struct _voxel {
+    uint64_t key;
+    float x;
+    float y;
+    float z;
+    uint32_t r;
+    uint32_t g;
+    uint32_t b;
+    uint32_t count;
+    // Where the voxel's table slot is.
+    uint32_t slot;
+};
+
+// _hashKey: MurmurHash3's finalizer, which mixes every bit of the key into
+// every bit of the hash; the three indices are packed into separate bit
+// ranges, which a plain multiplication would leave in separate ranges too.
+static inline uint32_t _hashKey(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return (uint32_t) key;
+}
+
+// _voxelTable: Voxels kept densely in the order they were added, and found
+// through open addressing with linear probing.  A slot holds the voxel's
+// hash in its upper half and its index plus one in the lower half (0 means
+// empty), so probing only touches the small slot array until the hashes
+// match.  The slot count is a power of two and at most half are used.
+class _voxelTable
+{
+public:
+    void clear()
+    {
+        for (size_t i = 0; i < m_voxels.size(); ++i) {
+            m_slots[m_voxels[i].slot] = 0;
+        }
+        m_voxels.clear();
+    }
+
+    // find: The voxel for 'key', added if need be.  The reference is only
+    // good until the next call.
+    _voxel & find(uint64_t key, uint32_t hash)
+    {
+        if (2 * (m_voxels.size() + 1) > m_slots.size()) {
+            grow();
+        }
+        size_t mask = m_slots.size() - 1;
+        // The low bits of the hash pick the partition, so probe with the
+        // others.
+        for (size_t i = (hash >> 4) & mask; ; i = (i + 1) & mask) {
+            uint64_t slot = m_slots[i];
+            if (slot == 0) {
+                _voxel v = _voxel();
+                v.key = key;
+                v.slot = (uint32_t) i;
+                m_voxels.push_back(v);
+                m_slots[i] = (uint64_t) hash << 32 | m_voxels.size();
+                return m_voxels.back();
+            }
+            if ((uint32_t) (slot >> 32) == hash) {
+                _voxel & v = m_voxels[(uint32_t) slot - 1];
+                if (v.key == key) {
+                    return v;
+                }
+            }
+        }
+    }
+
+    size_t size() const { return m_voxels.size(); }
+    const _voxel & at(size_t i) const { return m_voxels[i]; }
+
+private:
+    void grow()
+    {
+        m_slots.assign(m_slots.empty() ? 64 : m_slots.size() * 2, 0);
+        size_t mask = m_slots.size() - 1;
+        for (size_t k = 0; k < m_voxels.size(); ++k) {
+            uint32_t hash = _hashKey(m_voxels[k].key);
+            size_t i = (hash >> 4) & mask;
+            while (m_slots[i] != 0) {
+                i = (i + 1) & mask;
+            }
+            m_slots[i] = (uint64_t) hash << 32 | (k + 1);
+            m_voxels[k].slot = (uint32_t) i;
+        }
+    }
+
+    std::vector<uint64_t> m_slots;
+    std::vector<_voxel> m_voxels;
+};
+
+// ===================
+// openni2_point_cloud
+// ===================
+// openni2_point_cloud: Builds the cloud in one pass instead of calling
+// oni_convertDepthToWorld1 and oni_convertDepthToColor for every pixel.  Work
+// is split across threads (see oni_setParallelism), and buffers are reused
+// from frame to frame.
+class openni2_point_cloud
+{
+public:
+    openni2_point_cloud(float voxelSize)
+        : voxelSize(voxelSize), m_minDepth(0.0f), m_maxDepth(0.0f) {}
+
+    void setDepthRange(float minDepth, float maxDepth)
+    {
+        m_minDepth = minDepth;
+        m_maxDepth = maxDepth;
+    }
+
+    oni_Status build(const oni_FrameDescriptor & depth,
+                     const oni_FrameDescriptor * color,
+                     const oni_CameraIntrinsics & intrinsics)
+    {
+        if (!_makeDepthGeometry(depth, intrinsics, &m_geometry)) {
+            return openni::STATUS_NOT_SUPPORTED;
+        }
+        if (color != NULL && (color->data == NULL ||
+                              color->pixelFormat != openni::PIXEL_FORMAT_RGB888))
+        {
+            return openni::STATUS_NOT_SUPPORTED;
+        }
+        m_depth = &depth;
+        m_color = color;
+        if (voxelSize > 0.0f) {
+            voxelize();
+        } else {
+            collect();
+        }
+        return openni::STATUS_OK;
+    }
+
+    const oni_PointXYZRGB * points(int * count) const
+    {
+        if (count != NULL) {
+            *count = (int) m_points.size();
+        }
+        return m_points.empty() ? NULL : &m_points[0];
+    }
+
+    const float voxelSize;
+
+private:
+    static const int band = 16;
+
+    // forEachPoint: Call fn(x, y, z, rgb) for every valid pixel of rows
+    // [y0, y1), where rgb is NULL without a color frame.
+    template <typename Fn>
+    void forEachPoint(int y0, int y1, Fn fn) const
+    {
+        const oni_FrameDescriptor & depth = *m_depth;
+        const _depthGeometry & g = m_geometry;
+        float minDepth = m_minDepth;
+        float maxDepth = m_maxDepth > 0.0f ? m_maxDepth : 1e30f;
+        for (int y = y0; y < y1; ++y) {
+            const uint16_t * row = _depthRow(depth, y);
+            const uint8_t * colorRow = NULL;
+            if (m_color != NULL) {
+                int cy = (int) ((int64_t) y * m_color->height / depth.height);
+                colorRow = (const uint8_t *) m_color->data +
+                    (size_t) cy * m_color->strideInBytes;
+            }
+            for (int x = 0; x < depth.width; ++x) {
+                float z = row[x] * g.scale;
+                if (row[x] == 0 || z < minDepth || z > maxDepth) {
+                    continue;
+                }
+                const uint8_t * rgb = colorRow == NULL ? NULL : colorRow + 3 *
+                    (size_t) ((int64_t) x * m_color->width / depth.width);
+                fn(g.ax[x] * z, g.ay[y] * z, z, rgb);
+            }
+        }
+    }
+
+    // collect: Every valid pixel becomes a point, in row order.
+    void collect()
+    {
+        int height = m_depth->height;
+        int bands = (height + band - 1) / band;
+        m_bandPoints.resize(bands);
+        _parallelFor(height, band, [&](int y0, int y1) {
+            std::vector<oni_PointXYZRGB> & out = m_bandPoints[y0 / band];
+            out.clear();
+            forEachPoint(y0, y1, [&](float x, float y, float z, const uint8_t * rgb) {
+                oni_PointXYZRGB p = { x, y, z, 0, 0, 0, 255 };
+                if (rgb != NULL) {
+                    p.r = rgb[0];
+                    p.g = rgb[1];
+                    p.b = rgb[2];
+                }
+                out.push_back(p);
+            });
+        });
+        concatenate(m_bandPoints);
+    }
+
+    // voxelize: Each band of rows sums its points into one table per
+    // partition; then each partition merges its tables from all bands and
+    // turns the sums into centroids.
+    void voxelize()
+    {
+        int height = m_depth->height;
+        int bands = (height + band - 1) / band;
+        m_bandTables.resize((size_t) bands * _partitions);
+        float inv = 1.0f / voxelSize;
+        _parallelFor(height, band, [&](int y0, int y1) {
+            _voxelTable * tables = &m_bandTables[(size_t) (y0 / band) * _partitions];
+            for (int i = 0; i < _partitions; ++i) {
+                tables[i].clear();
+            }
+            // Neighboring pixels often share a voxel; this saves looking it up.
+            uint64_t lastKey = ~(uint64_t) 0;
+            _voxel * last = NULL;
+            forEachPoint(y0, y1, [&](float x, float y, float z, const uint8_t * rgb) {
+                uint64_t ix = (uint64_t) ((int64_t) floorf(x * inv) + _keyOffset);
+                uint64_t iy = (uint64_t) ((int64_t) floorf(y * inv) + _keyOffset);
+                uint64_t iz = (uint64_t) ((int64_t) floorf(z * inv) + _keyOffset);
+                uint64_t key = (ix & 0x1fffff) | (iy & 0x1fffff) << 21 |
+                    (iz & 0x1fffff) << 42;
+                if (key != lastKey) {
+                    uint32_t hash = _hashKey(key);
+                    last = &tables[hash % _partitions].find(key, hash);
+                    lastKey = key;
+                }
+                _voxel & v = *last;
+                v.x += x;
+                v.y += y;
+                v.z += z;
+                if (rgb != NULL) {
+                    v.r += rgb[0];
+                    v.g += rgb[1];
+                    v.b += rgb[2];
+                }
+                ++v.count;
+            });
+        });
+
+        m_partitionTables.resize(_partitions);
+        m_bandPoints.resize(_partitions);
+        bool colored = m_color != NULL;
+        _parallelFor(_partitions, 1, [&](int p0, int p1) {
+            for (int p = p0; p < p1; ++p) {
+                _voxelTable & merged = m_partitionTables[p];
+                merged.clear();
+                for (int b = 0; b < bands; ++b) {
+                    const _voxelTable & table = m_bandTables[(size_t) b * _partitions + p];
+                    for (size_t i = 0; i < table.size(); ++i) {
+                        const _voxel & src = table.at(i);
+                        _voxel & dst = merged.find(src.key, _hashKey(src.key));
+                        dst.x += src.x;
+                        dst.y += src.y;
+                        dst.z += src.z;
+                        dst.r += src.r;
+                        dst.g += src.g;
+                        dst.b += src.b;
+                        dst.count += src.count;
+                    }
+                }
+                std::vector<oni_PointXYZRGB> & out = m_bandPoints[p];
+                out.clear();
+                out.reserve(merged.size());
+                for (size_t i = 0; i < merged.size(); ++i) {
+                    const _voxel & v = merged.at(i);
+                    float n = (float) v.count;
+                    uint32_t half = v.count / 2;
+                    oni_PointXYZRGB pt = { v.x / n, v.y / n, v.z / n, 0, 0, 0, 255 };
+                    if (colored) {
+                        pt.r = (uint8_t) ((v.r + half) / v.count);
+                        pt.g = (uint8_t) ((v.g + half) / v.count);
+                        pt.b = (uint8_t) ((v.b + half) / v.count);
+                    }
+                    out.push_back(pt);
+                }
+            }
+        });
+        concatenate(m_bandPoints);
+    }
+
+    void concatenate(const std::vector<std::vector<oni_PointXYZRGB> > & parts)
+    {
+        std::vector<size_t> offsets(parts.size() + 1, 0);
+        for (size_t i = 0; i < parts.size(); ++i) {
+            offsets[i + 1] = offsets[i] + parts[i].size();
+        }
+        m_points.resize(offsets.back());
+        _parallelFor((int) parts.size(), 1, [&](int i0, int i1) {
+            for (int i = i0; i < i1; ++i) {
+                if (!parts[i].empty()) {
+                    memcpy(&m_points[offsets[i]], &parts[i][0],
+                           parts[i].size() * sizeof(oni_PointXYZRGB));
+                }
+            }
+        });
+    }
+
+    float m_minDepth;
+    float m_maxDepth;
+    // Valid during build() only.
+    const oni_FrameDescriptor * m_depth;
+    const oni_FrameDescriptor * m_color;
+    _depthGeometry m_geometry;
+    // Kept from frame to frame so that their memory is reused.
+    std::vector<_voxelTable> m_bandTables;
+    std::vector<_voxelTable> m_partitionTables;
+    std::vector<std::vector<oni_PointXYZRGB> > m_bandPoints;
+    std::vector<oni_PointXYZRGB> m_points;
+};
+
+// ==============
+// oni_PointCloud
+// ==============
+oni_PointCloud * oni_new_PointCloud(float voxelSize) {
+    if (voxelSize < 0.0f) {
+        return NULL;
+    }
+    EXC_CHECK( return new openni2_point_cloud(voxelSize); );
+    return NULL;
+}
+
+void oni_delete_PointCloud(oni_PointCloud * cloud) {
+    EXC_CHECK( delete cloud; );
+}
+
+void oni_setDepthRange_PointCloud(oni_PointCloud * cloud, float minDepth,
+                                  float maxDepth) {
+    EXC_CHECK( cloud->setDepthRange(minDepth, maxDepth); );
+}
+
+oni_Status oni_build_PointCloud(oni_PointCloud * cloud,
+                                oni_VideoFrameRef * depth,
+                                oni_VideoFrameRef * color,
+                                const oni_CameraIntrinsics * intrinsics) {
+    EXC_CHECK({
+        oni_FrameDescriptor depthDesc, colorDesc;
+        oni_Status rc = oni_getFrameDescriptor(depth, &depthDesc);
+        if (rc == openni::STATUS_OK && color != NULL) {
+            rc = oni_getFrameDescriptor(color, &colorDesc);
+        }
+        if (rc != openni::STATUS_OK) {
+            return rc;
+        }
+        return cloud->build(depthDesc, color != NULL ? &colorDesc : NULL,
+                            *intrinsics);
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_buildDescriptor_PointCloud(oni_PointCloud * cloud,
+                                          const oni_FrameDescriptor * depth,
+                                          const oni_FrameDescriptor * color,
+                                          const oni_CameraIntrinsics * intrinsics) {
+    EXC_CHECK( return cloud->build(*depth, color, *intrinsics); );
+    return openni::STATUS_ERROR;
+}
+
+const oni_PointXYZRGB * oni_getPoints_PointCloud(oni_PointCloud * cloud,
+                                                 int * count) {
+    EXC_CHECK( return cloud->points(count); );
+    return NULL;
+}
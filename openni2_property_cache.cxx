@@ -0,0 +1,281 @@
+// ============================================================================
+// openni2_property_cache.cxx: Property cache & asynchronous property queue
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <string.h>
+#include <algorithm>
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_property_cache.h"
+
+// ======================
+// openni2_property_cache
+// ======================
+openni2_property_cache::openni2_property_cache() : m_ownerCount(0)
+{
+}
+
+void openni2_property_cache::enable(const void * owner, const int * defaults,
+                                    int defaultCount, bool enabled)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    if (!enabled) {
+        m_owners.erase(owner);
+    } else if (m_owners.find(owner) == m_owners.end()) {
+        entry & e = m_owners[owner];
+        e.cacheable.insert(defaults, defaults + defaultCount);
+    }
+    m_ownerCount = (int) m_owners.size();
+}
+
+bool openni2_property_cache::setCacheable(const void * owner, int propertyId,
+                                          bool cacheable)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    std::map<const void *, entry>::iterator it = m_owners.find(owner);
+    if (it == m_owners.end()) {
+        return false;
+    }
+    if (cacheable) {
+        it->second.cacheable.insert(propertyId);
+    } else {
+        it->second.cacheable.erase(propertyId);
+        it->second.values.erase(propertyId);
+    }
+    return true;
+}
+
+bool openni2_property_cache::lookup(const void * owner, int propertyId,
+                                    void * data, int * dataSize,
+                                    oni_Status * rc, unsigned * generation)
+{
+    *generation = 0;
+    if (m_ownerCount == 0) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(m_lock);
+    std::map<const void *, entry>::iterator it = m_owners.find(owner);
+    if (it == m_owners.end()) {
+        return false;
+    }
+    *generation = it->second.generation;
+
+    std::map<int, std::vector<char> >::iterator value =
+        it->second.values.find(propertyId);
+    if (value == it->second.values.end()) {
+        return false;
+    }
+
+    int size = (int) value->second.size();
+    if (*dataSize < size) {
+        *rc = openni::STATUS_BAD_PARAMETER;
+    } else {
+        memcpy(data, &value->second[0], size);
+        *rc = openni::STATUS_OK;
+    }
+    *dataSize = size;
+    return true;
+}
+
+void openni2_property_cache::store(const void * owner, int propertyId,
+                                   const void * data, int dataSize,
+                                   unsigned generation)
+{
+    if (m_ownerCount == 0 || dataSize <= 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(m_lock);
+    std::map<const void *, entry>::iterator it = m_owners.find(owner);
+    // A set that raced with the driver read leaves a different generation; the
+    // value just read may predate it, so do not keep it.
+    if (it == m_owners.end() || it->second.generation != generation ||
+        it->second.cacheable.count(propertyId) == 0) {
+        return;
+    }
+    const char * bytes = (const char *) data;
+    it->second.values[propertyId].assign(bytes, bytes + dataSize);
+}
+
+void openni2_property_cache::invalidate(const void * owner)
+{
+    if (m_ownerCount == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(m_lock);
+    std::map<const void *, entry>::iterator it = m_owners.find(owner);
+    if (it != m_owners.end()) {
+        ++it->second.generation;
+        it->second.values.clear();
+    }
+}
+
+void openni2_property_cache::forget(const void * owner)
+{
+    enable(owner, NULL, 0, false);
+}
+
+// ======================
+// openni2_property_queue
+// ======================
+openni2_property_queue::openni2_property_queue(openni2_property_cache * cache)
+    : m_cache(cache), m_busyOwner(NULL), m_busySequence(0), m_submitted(0),
+      m_reportedThrough(0), m_stopping(false)
+{
+}
+
+openni2_property_queue::~openni2_property_queue()
+{
+    stop();
+}
+
+void openni2_property_queue::push(openni::Device * device,
+                                  openni::VideoStream * stream, int propertyId,
+                                  const void * data, int dataSize)
+{
+    const char * bytes = (const char *) data;
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    if (m_stopping) {
+        // A stop() still waiting to join the worker would wait forever if
+        // the worker were told to carry on; once it has joined, start anew.
+        if (m_worker.joinable()) {
+            return;
+        }
+        m_stopping = false;
+    }
+    if (!m_worker.joinable()) {
+        m_worker = std::thread(&openni2_property_queue::run, this);
+    }
+
+    // The earlier set is dropped rather than overwritten, so that sets of
+    // different properties still reach the driver in the order they were
+    // made (A=1, B, A=2 goes out as B, A=2).
+    for (std::deque<request>::iterator it = m_pending.begin();
+         it != m_pending.end(); ++it)
+    {
+        if (it->device == device && it->stream == stream &&
+            it->propertyId == propertyId)
+        {
+            m_pending.erase(it);
+            break;
+        }
+    }
+
+    request req;
+    req.sequence = ++m_submitted;
+    req.device = device;
+    req.stream = stream;
+    req.propertyId = propertyId;
+    req.data.assign(bytes, bytes + dataSize);
+    m_pending.push_back(req);
+    m_wake.notify_one();
+}
+
+bool openni2_property_queue::settled(uint64_t target) const
+{
+    return (m_pending.empty() || m_pending.front().sequence > target) &&
+        (m_busyOwner == NULL || m_busySequence > target);
+}
+
+oni_Status openni2_property_queue::flush()
+{
+    std::unique_lock<std::mutex> guard(m_lock);
+    // Only wait for what is already queued, so that other threads that keep
+    // pushing can't hold this up.
+    uint64_t target = m_submitted;
+    uint64_t from = m_reportedThrough;
+    std::multiset<uint64_t>::iterator self = m_flushes.insert(from);
+    while (!settled(target)) {
+        m_idle.wait(guard);
+    }
+    m_flushes.erase(self);
+
+    oni_Status rc = openni::STATUS_OK;
+    std::map<uint64_t, oni_Status>::iterator it = m_errors.upper_bound(from);
+    if (it != m_errors.end() && it->first <= target) {
+        rc = it->second;
+    }
+    if (target > m_reportedThrough) {
+        m_reportedThrough = target;
+    }
+    // Keep what a flush still waiting may yet have to return.
+    uint64_t keep = m_flushes.empty() ?
+        m_reportedThrough : std::min(m_reportedThrough, *m_flushes.begin());
+    m_errors.erase(m_errors.begin(), m_errors.upper_bound(keep));
+    return rc;
+}
+
+void openni2_property_queue::cancel(const void * owner)
+{
+    std::unique_lock<std::mutex> guard(m_lock);
+    for (std::deque<request>::iterator it = m_pending.begin();
+         it != m_pending.end(); )
+    {
+        if (it->device == owner || it->stream == owner) {
+            it = m_pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    while (m_busyOwner != NULL && m_busyOwner == owner) {
+        m_idle.wait(guard);
+    }
+    m_idle.notify_all();
+}
+
+void openni2_property_queue::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_pending.clear();
+        m_stopping = true;
+        m_wake.notify_one();
+    }
+    if (m_worker.joinable() && m_worker.get_id() != std::this_thread::get_id()) {
+        m_worker.join();
+    }
+    m_idle.notify_all();
+}
+
+void openni2_property_queue::run()
+{
+    std::unique_lock<std::mutex> guard(m_lock);
+    while (!m_stopping) {
+        if (m_pending.empty()) {
+            m_wake.wait(guard);
+            continue;
+        }
+
+        request req = m_pending.front();
+        m_pending.pop_front();
+        const void * owner = req.device != NULL ?
+            (const void *) req.device : (const void *) req.stream;
+        m_busyOwner = owner;
+        m_busySequence = req.sequence;
+        guard.unlock();
+
+        oni_Status rc = openni::STATUS_ERROR;
+        try {
+            const void * data = req.data.empty() ? NULL : &req.data[0];
+            int size = (int) req.data.size();
+            rc = req.device != NULL ?
+                req.device->setProperty(req.propertyId, data, size) :
+                req.stream->setProperty(req.propertyId, data, size);
+        } catch (std::exception &) {
+        }
+        m_cache->invalidate(owner);
+
+        guard.lock();
+        if (rc != openni::STATUS_OK) {
+            m_errors[req.sequence] = rc;
+        }
+        m_busyOwner = NULL;
+        m_idle.notify_all();
+    }
+}
@@ -0,0 +1,121 @@
+// ============================================================================
+// openni2_property_cache.h: Declaration of openni2_property_cache and
+// openni2_property_queue, classes that are internal to the C++ code for the
+// wrapper.
+// (c) Chris Hodapp, 2013
+// ============================================================================
+#ifndef OPENNI2_PROPERTY_CACHE
+#define OPENNI2_PROPERTY_CACHE
+
+#include <OpenNI.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "openni2_types_cxx.h"
+
+// openni2_property_cache: Holds the values of read-mostly properties for any
+// number of devices and streams, keyed by the address of the openni::Device or
+// openni::VideoStream that owns them.  Owners must be registered with enable()
+// before anything is cached for them.  Every property set through the wrapper
+// invalidates all cached values of its owner, since one property may change
+// others (e.g. the video mode changes the stride).
+class openni2_property_cache
+{
+public:
+    openni2_property_cache();
+
+    // enable: Start (or stop) caching for 'owner'.  'defaults' lists the
+    // property IDs that are considered cacheable until told otherwise.
+    void enable(const void * owner, const int * defaults, int defaultCount,
+                bool enabled);
+    // setCacheable: Add or remove a property from the owner's cacheable set.
+    // Returns false if caching is not enabled for 'owner'.
+    bool setCacheable(const void * owner, int propertyId, bool cacheable);
+    // lookup: Returns true (and sets 'rc') if the property was answered from
+    // the cache.  Otherwise, '*generation' is set to a token that must be
+    // passed to store() along with the value read from the driver.
+    bool lookup(const void * owner, int propertyId, void * data, int * dataSize,
+                oni_Status * rc, unsigned * generation);
+    void store(const void * owner, int propertyId, const void * data,
+               int dataSize, unsigned generation);
+    void invalidate(const void * owner);
+    // forget: Drop everything about 'owner', e.g. when it is destroyed.
+    void forget(const void * owner);
+
+private:
+    struct entry {
+        entry() : generation(0) {}
+        unsigned generation;
+        std::set<int> cacheable;
+        std::map<int, std::vector<char> > values;
+    };
+
+    std::mutex m_lock;
+    std::map<const void *, entry> m_owners;
+    // Lets callers skip the lock entirely when nothing is being cached.
+    std::atomic<int> m_ownerCount;
+};
+
+// openni2_property_queue: Applies property sets on a worker thread so that the
+// caller (typically a capture thread) never waits on the driver.  A set that is
+// still pending when another set of the same property on the same owner
+// arrives is dropped and the new one queued at the end, so a burst of changes
+// costs one transfer and sets are still applied in the order they were made.
+class openni2_property_queue
+{
+public:
+    openni2_property_queue(openni2_property_cache * cache);
+    ~openni2_property_queue();
+
+    // push: Exactly one of 'device' and 'stream' should be non-NULL.
+    void push(openni::Device * device, openni::VideoStream * stream,
+              int propertyId, const void * data, int dataSize);
+    // flush: Block until every set pushed before the call has been applied
+    // (or replaced by a later set, or cancelled), and return the first error
+    // among them that no earlier flush returned (or STATUS_OK).
+    oni_Status flush();
+    // cancel: Drop pending sets for 'owner' and wait out one in progress.
+    void cancel(const void * owner);
+    // stop: Drop all pending sets and join the worker thread.
+    void stop();
+
+private:
+    struct request {
+        uint64_t sequence;
+        openni::Device * device;
+        openni::VideoStream * stream;
+        int propertyId;
+        std::vector<char> data;
+    };
+
+    // settled: Whether no request numbered 'target' or lower is left.
+    bool settled(uint64_t target) const;
+    void run();
+
+    openni2_property_cache * m_cache;
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    // In order of 'sequence', which starts from 1.
+    std::deque<request> m_pending;
+    const void * m_busyOwner;
+    uint64_t m_busySequence;
+    uint64_t m_submitted;
+    // Failed requests, by sequence, that a flush may still have to return.
+    std::map<uint64_t, oni_Status> m_errors;
+    // Every error numbered up to this has been returned by some flush.
+    uint64_t m_reportedThrough;
+    // The 'm_reportedThrough' each flush in progress started from.
+    std::multiset<uint64_t> m_flushes;
+    bool m_stopping;
+    std::thread m_worker;
+};
+
+#endif // OPENNI2_PROPERTY_CACHE
@@ -0,0 +1,874 @@
+// ============================================================================
+// openni2_resilient_device.cxx: A device handle that remembers its
+// configuration and restores it when the device comes back after being
+// unplugged (oni_ResilientDevice)
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_internal.h"
+
+// One stream per sensor type: SENSOR_IR, SENSOR_COLOR and SENSOR_DEPTH.
+static const int _resilientStreamCount = 3;
+
+// _propertyValue: The last value set for one property, and whether the
+// device has ever accepted it ('applied'); one set while the device was away
+// has not been checked by anyone yet.
+struct _propertyValue {
+    int id;
+    std::vector<char> data;
+    bool applied;
+};
+
+// _recordProperty: Remember 'data' as the value of property 'id', replacing
+// what was there, so that each property is replayed once however often it
+// was set.
+static void _recordProperty(std::vector<_propertyValue> & values, int id,
+                            const void * data, int dataSize, bool applied)
+{
+    const char * bytes = (const char *) data;
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (values[i].id == id) {
+            values[i].data.assign(bytes, bytes + dataSize);
+            values[i].applied = applied;
+            return;
+        }
+    }
+    _propertyValue value;
+    value.id = id;
+    value.data.assign(bytes, bytes + dataSize);
+    value.applied = applied;
+    values.push_back(value);
+}
+
+// _settleProperty: After replaying property 'id', note that the device took
+// it, or forget it if not.
+static void _settleProperty(std::vector<_propertyValue> & values, int id,
+                            bool accepted)
+{
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (values[i].id == id) {
+            if (accepted) {
+                values[i].applied = true;
+            } else {
+                values.erase(values.begin() + i);
+            }
+            return;
+        }
+    }
+}
+
+// _replayRank: Stream properties are replayed video mode first, then
+// cropping (which is only valid for the resolution it was set against), then
+// the rest in the order they were first set.
+static int _replayRank(int id)
+{
+    switch (id) {
+    case openni::STREAM_PROPERTY_VIDEO_MODE:
+        return 0;
+    case openni::STREAM_PROPERTY_CROPPING:
+        return 1;
+    default:
+        return 2;
+    }
+}
+
+class openni2_resilient_device;
+
+// ================
+// _resilientStream
+// ================
+// _resilientStream: One stream of the device and what has been applied to
+// it.  The openni::VideoStream object lives as long as the handle, and is
+// destroyed and created again on each reconnect, so pointers to it that the
+// caller holds stay valid, though the stream behind them may not be there;
+// it can only be used under m_lock, or by a listener.  Its one frame
+// listener passes each frame on to the subscribers; listeners on a stream
+// don't survive it being destroyed, so the subscribers are kept here instead.
+struct _resilientStream : public openni::VideoStream::NewFrameListener
+{
+    _resilientStream(openni2_resilient_device * owner,
+                     openni::SensorType sensorType)
+        : owner(owner), sensorType(sensorType), created(false),
+          started(false), listening(false), stopping(false)
+    {
+    }
+
+    void onNewFrame(openni::VideoStream & s);
+
+    openni2_resilient_device * owner;
+    openni::SensorType sensorType;
+    openni::VideoStream stream;
+    bool created;
+    bool started;
+    bool listening;
+    // Being stopped by a caller outside m_lock (see setStarted).
+    bool stopping;
+    std::vector<_propertyValue> properties;
+
+    std::mutex subscribersLock;
+    std::vector<void (*)(oni_VideoStream *)> subscribers;
+};
+
+// ========================
+// openni2_resilient_device
+// ========================
+// openni2_resilient_device: Every change made through the handle is applied
+// to the device (if it is there) and recorded, each setting keeping only its
+// last value.  OpenNI's disconnect and connect events, which arrive on its own
+// threads, only wake a worker thread; the worker tears the device down when
+// it goes (destroying the streams and closing the device), and when it
+// returns (or every retry interval until it does) opens it again and replays
+// the recording: one call per stream and per distinct setting, and nothing
+// for settings never changed.  'm_lock' guards the
+// device, its streams and the recording.  Stopping a stream waits for its
+// listener to return, and listeners may call back into the handle, so no
+// stream is stopped under m_lock: the device is marked disconnected first,
+// after which callers only record changes and leave the streams alone, and
+// then torn down outside the lock.
+class openni2_resilient_device
+    : public openni::OpenNI::DeviceConnectedListener,
+      public openni::OpenNI::DeviceDisconnectedListener
+{
+public:
+    openni2_resilient_device()
+        : m_open(false), m_connected(false), m_anyDevice(false),
+          m_vendorId(0), m_productId(0), m_depthColorSync(-1),
+          m_depthColorSyncApplied(false),
+          m_retryMs(250), m_lost(false), m_found(false), m_stopping(false),
+          m_lostAt(0), m_awaitingFrame(false)
+    {
+        for (int i = 0; i < _resilientStreamCount; ++i) {
+            m_streams[i].reset(new _resilientStream(
+                this, (openni::SensorType) (i + 1)));
+        }
+        memset(&m_stats, 0, sizeof(m_stats));
+        m_stats.lastError = openni::STATUS_OK;
+        openni::OpenNI::addDeviceConnectedListener(this);
+        openni::OpenNI::addDeviceDisconnectedListener(this);
+        m_worker = std::thread(&openni2_resilient_device::run, this);
+    }
+
+    ~openni2_resilient_device()
+    {
+        openni::OpenNI::removeDeviceConnectedListener(this);
+        openni::OpenNI::removeDeviceDisconnectedListener(this);
+        {
+            std::lock_guard<std::mutex> guard(m_eventLock);
+            m_stopping = true;
+        }
+        m_event.notify_all();
+        m_worker.join();
+        {
+            std::unique_lock<std::mutex> guard(m_lock);
+            if (!disconnect(guard)) {
+                return;
+            }
+        }
+        teardown();
+    }
+
+    oni_Status open(const char * uri)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (m_open) {
+            return openni::STATUS_ERROR;
+        }
+        {
+            std::lock_guard<std::mutex> eventGuard(m_eventLock);
+            m_anyDevice = uri == NULL;
+            m_requestedUri = uri ? uri : "";
+        }
+        oni_Status rc = m_device.open(uri);
+        if (rc != openni::STATUS_OK) {
+            m_device.close();
+            return rc;
+        }
+        connected();
+        return openni::STATUS_OK;
+    }
+
+    oni_Status addStream(int sensorType)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        _resilientStream * s = find(sensorType);
+        if (s == NULL || !m_open) {
+            return openni::STATUS_BAD_PARAMETER;
+        }
+        if (s->created) {
+            return openni::STATUS_OK;
+        }
+        if (m_connected) {
+            oni_Status rc = create(s);
+            if (rc != openni::STATUS_OK) {
+                return rc;
+            }
+        }
+        s->created = true;
+        return openni::STATUS_OK;
+    }
+
+    oni_VideoStream * stream(int sensorType)
+    {
+        _resilientStream * s = find(sensorType);
+        return s ? &s->stream : NULL;
+    }
+
+    // getStreamProperty: Read from the stream under m_lock, so that the
+    // worker can't replace it meanwhile.
+    oni_Status getStreamProperty(int sensorType, int id, void * data,
+                                 int * dataSize)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        _resilientStream * s = find(sensorType);
+        if (s == NULL || !s->created) {
+            return openni::STATUS_BAD_PARAMETER;
+        }
+        if (!m_connected) {
+            return openni::STATUS_NO_DEVICE;
+        }
+        return oni_getProperty_VideoStream(&s->stream, id, data, dataSize);
+    }
+
+    // setStarted: Stopping happens outside m_lock, in case a listener is
+    // waiting for it; 'stopping' keeps the stream from being started or torn
+    // down meanwhile.
+    oni_Status setStarted(int sensorType, bool started)
+    {
+        std::unique_lock<std::mutex> guard(m_lock);
+        _resilientStream * s = find(sensorType);
+        if (s == NULL || !s->created) {
+            return openni::STATUS_BAD_PARAMETER;
+        }
+        while (s->stopping) {
+            m_stopped.wait(guard);
+        }
+        if (m_connected) {
+            if (started) {
+                oni_Status rc = s->stream.start();
+                if (rc != openni::STATUS_OK) {
+                    return rc;
+                }
+            } else {
+                s->started = false;
+                s->stopping = true;
+                guard.unlock();
+                s->stream.stop();
+                guard.lock();
+                s->stopping = false;
+                m_stopped.notify_all();
+            }
+        }
+        s->started = started;
+        return openni::STATUS_OK;
+    }
+
+    // setStreamProperty, setDeviceProperty: Apply now if connected, and if
+    // that worked (or there's no device to try it on) record it.
+    oni_Status setStreamProperty(int sensorType, int id, const void * data,
+                                 int dataSize)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        _resilientStream * s = find(sensorType);
+        if (s == NULL || !s->created) {
+            return openni::STATUS_BAD_PARAMETER;
+        }
+        if (m_connected) {
+            oni_Status rc = oni_setProperty_VideoStream(&s->stream, id, data,
+                                                        dataSize);
+            if (rc != openni::STATUS_OK) {
+                return rc;
+            }
+        }
+        _recordProperty(s->properties, id, data, dataSize, m_connected);
+        return openni::STATUS_OK;
+    }
+
+    oni_Status setDeviceProperty(int id, const void * data, int dataSize)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (!m_open) {
+            return openni::STATUS_BAD_PARAMETER;
+        }
+        if (m_connected) {
+            oni_Status rc = oni_setProperty_Device(&m_device, id, data,
+                                                   dataSize);
+            if (rc != openni::STATUS_OK) {
+                return rc;
+            }
+        }
+        _recordProperty(m_properties, id, data, dataSize, m_connected);
+        return openni::STATUS_OK;
+    }
+
+    oni_Status setDepthColorSync(bool enabled)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (!m_open) {
+            return openni::STATUS_BAD_PARAMETER;
+        }
+        if (m_connected) {
+            oni_Status rc = oni_setDepthColorSyncEnabled(&m_device, enabled);
+            if (rc != openni::STATUS_OK) {
+                return rc;
+            }
+        }
+        m_depthColorSync = enabled;
+        m_depthColorSyncApplied = m_connected;
+        return openni::STATUS_OK;
+    }
+
+    oni_Status subscribe(int sensorType, void (*fnPtr)(oni_VideoStream *))
+    {
+        _resilientStream * s = find(sensorType);
+        if (s == NULL || fnPtr == NULL) {
+            return openni::STATUS_BAD_PARAMETER;
+        }
+        std::lock_guard<std::mutex> guard(s->subscribersLock);
+        s->subscribers.push_back(fnPtr);
+        return openni::STATUS_OK;
+    }
+
+    void unsubscribe(int sensorType, void (*fnPtr)(oni_VideoStream *))
+    {
+        _resilientStream * s = find(sensorType);
+        if (s == NULL) {
+            return;
+        }
+        std::lock_guard<std::mutex> guard(s->subscribersLock);
+        std::vector<void (*)(oni_VideoStream *)>::iterator it =
+            std::find(s->subscribers.begin(), s->subscribers.end(), fnPtr);
+        if (it != s->subscribers.end()) {
+            s->subscribers.erase(it);
+        }
+    }
+
+    void setRetryInterval(int ms)
+    {
+        std::lock_guard<std::mutex> guard(m_eventLock);
+        m_retryMs = std::max(ms, 1);
+    }
+
+    void stats(oni_RecoveryStats * out)
+    {
+        std::lock_guard<std::mutex> guard(m_statsLock);
+        *out = m_stats;
+    }
+
+    // delivered: Called for every frame, from OpenNI's threads; the first
+    // one after a reconnect ends the outage.
+    void delivered()
+    {
+        if (!m_awaitingFrame.exchange(false)) {
+            return;
+        }
+        std::lock_guard<std::mutex> guard(m_statsLock);
+        uint64_t elapsed = oni_getHostTime() - m_lostAt;
+        m_stats.lastFirstFrameUs = elapsed;
+        m_stats.maxFirstFrameUs = std::max(m_stats.maxFirstFrameUs, elapsed);
+    }
+
+    // Overrides function in openni::OpenNI::DeviceConnectedListener
+    void onDeviceConnected(const openni::DeviceInfo * info)
+    {
+        std::lock_guard<std::mutex> guard(m_eventLock);
+        if (m_anyDevice ?
+            (info->getUsbVendorId() == m_vendorId &&
+             info->getUsbProductId() == m_productId) :
+            m_requestedUri == info->getUri()) {
+            m_foundUri = info->getUri();
+            m_found = true;
+            m_event.notify_all();
+        }
+    }
+
+    // Overrides function in openni::OpenNI::DeviceDisconnectedListener
+    void onDeviceDisconnected(const openni::DeviceInfo * info)
+    {
+        std::lock_guard<std::mutex> guard(m_eventLock);
+        if (m_uri == info->getUri()) {
+            m_lost = true;
+            m_event.notify_all();
+        }
+    }
+
+private:
+    _resilientStream * find(int sensorType)
+    {
+        if (sensorType < 1 || sensorType > _resilientStreamCount) {
+            return NULL;
+        }
+        return m_streams[sensorType - 1].get();
+    }
+
+    oni_Status create(_resilientStream * s)
+    {
+        oni_Status rc = s->stream.create(m_device, s->sensorType);
+        if (rc != openni::STATUS_OK) {
+            return rc;
+        }
+        rc = s->stream.addNewFrameListener(s);
+        if (rc != openni::STATUS_OK) {
+            oni_destroy_VideoStream(&s->stream);
+            return rc;
+        }
+        s->listening = true;
+        return openni::STATUS_OK;
+    }
+
+    // connected: Note which device is open, to know it when it goes and when
+    // it comes back.  Needs m_lock.
+    void connected()
+    {
+        const openni::DeviceInfo & info = m_device.getDeviceInfo();
+        {
+            std::lock_guard<std::mutex> guard(m_eventLock);
+            m_uri = info.getUri();
+            m_vendorId = info.getUsbVendorId();
+            m_productId = info.getUsbProductId();
+            m_open = true;
+            m_connected = true;
+        }
+        std::lock_guard<std::mutex> guard(m_statsLock);
+        m_stats.connected = true;
+    }
+
+    // disconnect: Mark the device gone, so that callers leave the streams
+    // alone, and wait for any stop already under way.  Returns false if it
+    // was not connected.  Needs m_lock, in 'guard'.
+    bool disconnect(std::unique_lock<std::mutex> & guard)
+    {
+        if (!m_connected) {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> eventGuard(m_eventLock);
+            m_connected = false;
+        }
+        for (int i = 0; i < _resilientStreamCount; ++i) {
+            while (m_streams[i]->stopping) {
+                m_stopped.wait(guard);
+            }
+        }
+        return true;
+    }
+
+    // teardown: Destroy the streams and close the device, keeping the
+    // recording.  Only once disconnected, and without m_lock: the listeners
+    // that stopping the streams waits for may be waiting for it.
+    void teardown()
+    {
+        for (int i = 0; i < _resilientStreamCount; ++i) {
+            _resilientStream * s = m_streams[i].get();
+            if (s->listening) {
+                s->stream.stop();
+                s->stream.removeNewFrameListener(s);
+                s->listening = false;
+                oni_destroy_VideoStream(&s->stream);
+            }
+        }
+        oni_close(&m_device);
+    }
+
+    // matchingUri: The URI of a connected device with the same USB vendor and
+    // product IDs as the one that went away, or "" if there is none.  Needs
+    // m_lock.
+    std::string matchingUri()
+    {
+        openni::Array<openni::DeviceInfo> devices;
+        openni::OpenNI::enumerateDevices(&devices);
+        for (int i = 0; i < devices.getSize(); ++i) {
+            if (devices[i].getUsbVendorId() == m_vendorId &&
+                devices[i].getUsbProductId() == m_productId)
+            {
+                return devices[i].getUri();
+            }
+        }
+        return std::string();
+    }
+
+    // replay: Open the device at 'uri' again and apply the recording to it:
+    // streams first, as some drivers only accept registration with both of
+    // them there, then stream properties, device properties, and starting
+    // the streams.  A setting the device accepted before failing now fails
+    // the reconnect; one made while it was away, which nothing has checked,
+    // is dropped instead, or it would fail every reconnect.  Needs m_lock.
+    oni_Status replay(const std::string & uri, int * calls)
+    {
+        *calls = 1;
+        oni_Status rc = m_device.open(uri.c_str());
+        if (rc != openni::STATUS_OK) {
+            return rc;
+        }
+        for (int i = 0; i < _resilientStreamCount; ++i) {
+            _resilientStream * s = m_streams[i].get();
+            if (!s->created) {
+                continue;
+            }
+            *calls += 2;
+            if ((rc = create(s)) != openni::STATUS_OK) {
+                return rc;
+            }
+            std::vector<_propertyValue> ordered(s->properties);
+            std::stable_sort(ordered.begin(), ordered.end(),
+                             [](const _propertyValue & a,
+                                const _propertyValue & b) {
+                                 return _replayRank(a.id) < _replayRank(b.id);
+                             });
+            for (size_t j = 0; j < ordered.size(); ++j) {
+                ++*calls;
+                rc = oni_setProperty_VideoStream(&s->stream, ordered[j].id,
+                                                 ordered[j].data.data(),
+                                                 (int) ordered[j].data.size());
+                if (rc != openni::STATUS_OK && ordered[j].applied) {
+                    return rc;
+                }
+                _settleProperty(s->properties, ordered[j].id,
+                                rc == openni::STATUS_OK);
+                if (rc != openni::STATUS_OK) {
+                    dropped(rc);
+                }
+            }
+        }
+        for (size_t j = 0; j < m_properties.size(); ) {
+            ++*calls;
+            _propertyValue & value = m_properties[j];
+            rc = oni_setProperty_Device(&m_device, value.id, value.data.data(),
+                                        (int) value.data.size());
+            if (rc == openni::STATUS_OK) {
+                value.applied = true;
+                ++j;
+            } else if (value.applied) {
+                return rc;
+            } else {
+                m_properties.erase(m_properties.begin() + j);
+                dropped(rc);
+            }
+        }
+        if (m_depthColorSync >= 0) {
+            ++*calls;
+            rc = oni_setDepthColorSyncEnabled(&m_device, m_depthColorSync != 0);
+            if (rc == openni::STATUS_OK) {
+                m_depthColorSyncApplied = true;
+            } else if (m_depthColorSyncApplied) {
+                return rc;
+            } else {
+                m_depthColorSync = -1;
+                dropped(rc);
+            }
+        }
+        for (int i = 0; i < _resilientStreamCount; ++i) {
+            _resilientStream * s = m_streams[i].get();
+            if (s->created && s->started) {
+                ++*calls;
+                if ((rc = s->stream.start()) != openni::STATUS_OK) {
+                    return rc;
+                }
+            }
+        }
+        return openni::STATUS_OK;
+    }
+
+    // dropped: Count a recorded setting the device refused on replay.
+    void dropped(oni_Status rc)
+    {
+        std::lock_guard<std::mutex> guard(m_statsLock);
+        ++m_stats.droppedSettings;
+        m_stats.lastError = rc;
+    }
+
+    void lose()
+    {
+        {
+            std::unique_lock<std::mutex> guard(m_lock);
+            if (!disconnect(guard)) {
+                return;
+            }
+        }
+        teardown();
+        m_awaitingFrame = false;
+        std::lock_guard<std::mutex> statsGuard(m_statsLock);
+        m_lostAt = oni_getHostTime();
+        m_stats.connected = false;
+        ++m_stats.disconnects;
+    }
+
+    // reconnect: Open 'uri' and replay; with no URI (any device, and no event
+    // naming one) only a device of the same model is tried.
+    void reconnect(std::string uri)
+    {
+        std::unique_lock<std::mutex> guard(m_lock);
+        if (m_connected || !m_open) {
+            return;
+        }
+        if (uri.empty() && (uri = matchingUri()).empty()) {
+            return;
+        }
+        uint64_t start = oni_getHostTime();
+        int calls;
+        m_awaitingFrame = true;
+        oni_Status rc = replay(uri, &calls);
+        if (rc != openni::STATUS_OK) {
+            // Still disconnected, so nobody else touches the streams.
+            guard.unlock();
+            teardown();
+            m_awaitingFrame = false;
+            std::lock_guard<std::mutex> statsGuard(m_statsLock);
+            ++m_stats.failedAttempts;
+            m_stats.lastError = rc;
+            return;
+        }
+        connected();
+        uint64_t end = oni_getHostTime();
+        std::lock_guard<std::mutex> statsGuard(m_statsLock);
+        ++m_stats.reconnects;
+        m_stats.replayCalls = calls;
+        m_stats.lastReplayUs = end - start;
+        m_stats.lastRecoverUs = end - m_lostAt;
+        m_stats.maxRecoverUs = std::max(m_stats.maxRecoverUs,
+                                        m_stats.lastRecoverUs);
+    }
+
+    // run: The worker.  While the device is away it tries to open it again
+    // as soon as it is seen, and every retry interval in case the event came
+    // before the device was ready (or never came).
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(m_eventLock);
+        while (!m_stopping) {
+            if (m_lost) {
+                m_lost = false;
+                lock.unlock();
+                lose();
+                lock.lock();
+                // It won't be back at once; don't waste an attempt on that.
+                m_event.wait_for(lock, std::chrono::milliseconds(m_retryMs),
+                                 [this] {
+                                     return m_stopping || m_lost || m_found;
+                                 });
+                continue;
+            }
+            bool away = m_open && !m_connected;
+            if (away) {
+                std::string uri = m_found ? m_foundUri :
+                    (m_anyDevice ? std::string() : m_requestedUri);
+                m_found = false;
+                lock.unlock();
+                reconnect(uri);
+                lock.lock();
+                if (m_connected || m_stopping || m_lost || m_found) {
+                    continue;
+                }
+                m_event.wait_for(lock, std::chrono::milliseconds(m_retryMs));
+            } else {
+                // A device seen while this one is here isn't coming back.
+                m_found = false;
+                m_event.wait(lock);
+            }
+        }
+    }
+
+    std::mutex m_lock;
+    std::condition_variable m_stopped;
+    openni::Device m_device;
+    std::unique_ptr<_resilientStream> m_streams[_resilientStreamCount];
+    std::vector<_propertyValue> m_properties;
+    // m_open, m_connected and the identity of the device are also read by
+    // the worker and the listeners, so they are written under m_eventLock too.
+    bool m_open;
+    bool m_connected;
+    bool m_anyDevice;
+    std::string m_requestedUri;
+    std::string m_uri;
+    uint16_t m_vendorId;
+    uint16_t m_productId;
+    int m_depthColorSync;
+    bool m_depthColorSyncApplied;
+
+    std::mutex m_eventLock;
+    std::condition_variable m_event;
+    int m_retryMs;
+    bool m_lost;
+    bool m_found;
+    std::string m_foundUri;
+    bool m_stopping;
+    std::thread m_worker;
+
+    std::mutex m_statsLock;
+    uint64_t m_lostAt;
+    std::atomic<bool> m_awaitingFrame;
+    oni_RecoveryStats m_stats;
+};
+
+void _resilientStream::onNewFrame(openni::VideoStream & s)
+{
+    owner->delivered();
+    std::lock_guard<std::mutex> guard(subscribersLock);
+    for (size_t i = 0; i < subscribers.size(); ++i) {
+        subscribers[i](&s);
+    }
+}
+
+// ===================
+// oni_ResilientDevice
+// ===================
+oni_ResilientDevice * oni_new_ResilientDevice() {
+    EXC_CHECK( return new openni2_resilient_device(); );
+    return NULL;
+}
+
+void oni_delete_ResilientDevice(oni_ResilientDevice * device) {
+    EXC_CHECK( delete device; );
+}
+
+oni_Status oni_open_ResilientDevice(oni_ResilientDevice * device,
+                                    const char * uri) {
+    EXC_CHECK( return device->open(uri); );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_addStream_ResilientDevice(oni_ResilientDevice * device,
+                                         oni_SensorType sensorType) {
+    EXC_CHECK( return device->addStream(sensorType); );
+    return openni::STATUS_ERROR;
+}
+
+oni_VideoStream * oni_getStream_ResilientDevice(oni_ResilientDevice * device,
+                                                oni_SensorType sensorType) {
+    EXC_CHECK( return device->stream(sensorType); );
+    return NULL;
+}
+
+oni_Status oni_getStreamProperty_ResilientDevice(oni_ResilientDevice * device,
+                                                 oni_SensorType sensorType,
+                                                 int propertyId, void * data,
+                                                 int * dataSize) {
+    EXC_CHECK( return device->getStreamProperty(sensorType, propertyId, data,
+                                                dataSize); );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_start_ResilientDevice(oni_ResilientDevice * device,
+                                     oni_SensorType sensorType) {
+    EXC_CHECK( return device->setStarted(sensorType, true); );
+    return openni::STATUS_ERROR;
+}
+
+void oni_stop_ResilientDevice(oni_ResilientDevice * device,
+                              oni_SensorType sensorType) {
+    EXC_CHECK( device->setStarted(sensorType, false); );
+}
+
+oni_Status oni_setVideoMode_ResilientDevice(oni_ResilientDevice * device,
+                                            oni_SensorType sensorType,
+                                            oni_VideoMode * videoMode) {
+    // openni::VideoMode is an OniVideoMode underneath, and setVideoMode sets
+    // it as this property.
+    EXC_CHECK( return device->setStreamProperty(
+                   sensorType, openni::STREAM_PROPERTY_VIDEO_MODE, videoMode,
+                   sizeof(OniVideoMode)); );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_setCropping_ResilientDevice(oni_ResilientDevice * device,
+                                           oni_SensorType sensorType,
+                                           int originX, int originY,
+                                           int width, int height) {
+    OniCropping cropping;
+    cropping.enabled = true;
+    cropping.originX = originX;
+    cropping.originY = originY;
+    cropping.width = width;
+    cropping.height = height;
+    EXC_CHECK( return device->setStreamProperty(
+                   sensorType, openni::STREAM_PROPERTY_CROPPING, &cropping,
+                   sizeof(cropping)); );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_resetCropping_ResilientDevice(oni_ResilientDevice * device,
+                                             oni_SensorType sensorType) {
+    OniCropping cropping;
+    memset(&cropping, 0, sizeof(cropping));
+    EXC_CHECK( return device->setStreamProperty(
+                   sensorType, openni::STREAM_PROPERTY_CROPPING, &cropping,
+                   sizeof(cropping)); );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_setMirroringEnabled_ResilientDevice(
+    oni_ResilientDevice * device, oni_SensorType sensorType, bool isEnabled) {
+    OniBool enabled = isEnabled ? TRUE : FALSE;
+    EXC_CHECK( return device->setStreamProperty(
+                   sensorType, openni::STREAM_PROPERTY_MIRRORING, &enabled,
+                   sizeof(enabled)); );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_setStreamProperty_ResilientDevice(oni_ResilientDevice * device,
+                                                 oni_SensorType sensorType,
+                                                 int propertyId,
+                                                 const void * data,
+                                                 int dataSize) {
+    EXC_CHECK( return device->setStreamProperty(sensorType, propertyId, data,
+                                                dataSize); );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_setProperty_ResilientDevice(oni_ResilientDevice * device,
+                                           int propertyId, const void * data,
+                                           int dataSize) {
+    EXC_CHECK( return device->setDeviceProperty(propertyId, data, dataSize); );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_setImageRegistrationMode_ResilientDevice(
+    oni_ResilientDevice * device, oni_ImageRegistrationMode mode) {
+    EXC_CHECK( return device->setDeviceProperty(
+                   openni::DEVICE_PROPERTY_IMAGE_REGISTRATION, &mode,
+                   sizeof(mode)); );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_setDepthColorSyncEnabled_ResilientDevice(
+    oni_ResilientDevice * device, bool isEnabled) {
+    EXC_CHECK( return device->setDepthColorSync(isEnabled); );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_addNewFrameListener_ResilientDevice(
+    oni_ResilientDevice * device, oni_SensorType sensorType,
+    oni_NewFrameListener * listener) {
+    EXC_CHECK( return device->subscribe(sensorType, listener->fnPtr); );
+    return openni::STATUS_ERROR;
+}
+
+void oni_removeNewFrameListener_ResilientDevice(
+    oni_ResilientDevice * device, oni_SensorType sensorType,
+    oni_NewFrameListener * listener) {
+    EXC_CHECK( device->unsubscribe(sensorType, listener->fnPtr); );
+}
+
+void oni_setRetryInterval_ResilientDevice(oni_ResilientDevice * device,
+                                          int intervalMs) {
+    EXC_CHECK( device->setRetryInterval(intervalMs); );
+}
+
+void oni_getStats_ResilientDevice(oni_ResilientDevice * device,
+                                  oni_RecoveryStats * stats) {
+    EXC_CHECK( device->stats(stats); );
+}
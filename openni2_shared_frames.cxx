@@ -0,0 +1,542 @@
+// ============================================================================
+// openni2_shared_frames.cxx: Cross-process frame distribution over a shared
+// memory ring (oni_FramePublisher & oni_FrameSubscriber)
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_internal.h"
+
+// =========================
+// Layout of the shared ring
+// =========================
+// OpenNI lets only one process own a device; the ring is how that process
+// hands its frames to others.  Each slot is guarded by a sequence counter (a
+// seqlock), so the publisher never waits: a subscriber that falls behind sees
+// that the frame it holds has been overwritten, or that frames were dropped.
+//
+// The ring is one header followed by 'slotCount' slots of 'slotStride' bytes,
+// each of which is a _shared_slot followed (at _slotDataOffset) by the frame.
+// Everything here is fixed-width so that 32- and 64-bit processes agree.
+static const uint32_t _ringMagic = 0x4f4e4932; // "ONI2"
+static const uint32_t _ringVersion = 1;
+static const size_t _slotDataOffset = 128;
+
+struct _shared_ring_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t slotStride;
+    uint64_t maxFrameSize;
+    // Frames published so far.  'publishedWord' is its low 32 bits, kept
+    // separately because that is what subscribers wait on with futex().
+    uint64_t published;
+    uint32_t publishedWord;
+    // Seqlock over 'info', which is written far less often than frames.
+    uint32_t infoVersion;
+    int32_t infoSensorType;
+    float infoHorizontalFov;
+    float infoVerticalFov;
+    int32_t infoMinPixelValue;
+    int32_t infoMaxPixelValue;
+    int32_t infoMirroring;
+};
+
+struct _shared_slot {
+    // Odd while the publisher is writing the slot, even otherwise.
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t sequence;
+    uint64_t timestamp;
+    int32_t dataSize;
+    int32_t width;
+    int32_t height;
+    int32_t strideInBytes;
+    int32_t sensorType;
+    int32_t pixelFormat;
+    int32_t frameIndex;
+    int32_t croppingEnabled;
+    int32_t cropOriginX;
+    int32_t cropOriginY;
+};
+
+static size_t _alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static size_t _headerSize()
+{
+    return _alignUp(sizeof(_shared_ring_header), 64);
+}
+
+static long _futex(uint32_t * addr, int op, uint32_t value,
+                   const struct timespec * timeout)
+{
+    return syscall(SYS_futex, addr, op, value, timeout, NULL, 0);
+}
+
+// ====================================================
+// openni2_frame_ring: The mapping that both ends share
+// ====================================================
+class openni2_frame_ring
+{
+public:
+    openni2_frame_ring() : m_fd(-1), m_base(NULL), m_size(0) {}
+    ~openni2_frame_ring() { unmap(); }
+
+    bool map(int fd, bool create, uint32_t slotCount, uint64_t maxFrameSize)
+    {
+        m_fd = fd;
+        if (create) {
+            uint32_t stride = (uint32_t) _alignUp(_slotDataOffset + maxFrameSize, 64);
+            m_size = _headerSize() + (size_t) slotCount * stride;
+            if (ftruncate(fd, m_size) != 0) {
+                return false;
+            }
+        } else {
+            struct stat st;
+            if (fstat(fd, &st) != 0 || (size_t) st.st_size < _headerSize()) {
+                return false;
+            }
+            m_size = st.st_size;
+        }
+
+        int prot = create ? PROT_READ | PROT_WRITE : PROT_READ;
+        void * base = mmap(NULL, m_size, prot, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+            return false;
+        }
+        m_base = (char *) base;
+
+        _shared_ring_header * h = header();
+        if (create) {
+            memset(h, 0, _headerSize());
+            h->slotCount = slotCount;
+            h->slotStride = (uint32_t) ((m_size - _headerSize()) / slotCount);
+            h->maxFrameSize = maxFrameSize;
+            h->version = _ringVersion;
+            __atomic_store_n(&h->magic, _ringMagic, __ATOMIC_RELEASE);
+        } else if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != _ringMagic ||
+                   h->version != _ringVersion || h->slotCount == 0 ||
+                   _headerSize() + (size_t) h->slotCount * h->slotStride > m_size)
+        {
+            return false;
+        }
+        return true;
+    }
+
+    void unmap()
+    {
+        if (m_base != NULL) {
+            munmap(m_base, m_size);
+            m_base = NULL;
+        }
+        if (m_fd >= 0) {
+            close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    _shared_ring_header * header() { return (_shared_ring_header *) m_base; }
+
+    _shared_slot * slot(uint32_t idx)
+    {
+        return (_shared_slot *) (m_base + _headerSize() +
+                                 (size_t) idx * header()->slotStride);
+    }
+
+    char * slotData(uint32_t idx) { return (char *) slot(idx) + _slotDataOffset; }
+
+    int m_fd;
+
+private:
+    char * m_base;
+    size_t m_size;
+};
+
+// ==================
+// oni_FramePublisher
+// ==================
+class openni2_frame_publisher : public openni::VideoStream::NewFrameListener
+{
+public:
+    openni2_frame_publisher() : m_stream(NULL) {}
+
+    // Overrides function in openni::VideoStream::NewFrameListener
+    void onNewFrame(openni::VideoStream & stream)
+    {
+        openni::VideoFrameRef ref;
+        if (stream.readFrame(&ref) == openni::STATUS_OK) {
+            oni_publish_FramePublisher(this, &ref);
+        }
+    }
+
+    openni2_frame_ring m_ring;
+    std::string m_name;
+    openni::VideoStream * m_stream;
+};
+
+oni_FramePublisher * oni_new_FramePublisher(const char * name, int slotCount,
+                                            int maxFrameSize) {
+    if (slotCount <= 0 || maxFrameSize <= 0) {
+        return NULL;
+    }
+
+    openni2_frame_publisher * pub = NULL;
+    EXC_CHECK({
+        // Truncating a ring that subscribers still have mapped would fault
+        // them (SIGBUS); unlinking it first leaves them their old mapping.
+        if (name != NULL) {
+            shm_unlink(name);
+        }
+        int fd = name != NULL ?
+            shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600) :
+            memfd_create("openni2_frames", MFD_CLOEXEC);
+        if (fd < 0) {
+            return NULL;
+        }
+
+        pub = new openni2_frame_publisher();
+        if (name != NULL) {
+            pub->m_name = name;
+        }
+        if (!pub->m_ring.map(fd, true, slotCount, maxFrameSize)) {
+            oni_delete_FramePublisher(pub);
+            return NULL;
+        }
+    });
+    return pub;
+}
+
+void oni_delete_FramePublisher(oni_FramePublisher * pub) {
+    EXC_CHECK({
+        oni_detach_FramePublisher(pub);
+        if (!pub->m_name.empty()) {
+            shm_unlink(pub->m_name.c_str());
+        }
+        delete pub;
+    });
+}
+
+int oni_getFd_FramePublisher(oni_FramePublisher * pub) {
+    return pub->m_ring.m_fd;
+}
+
+oni_Status oni_publish_FramePublisher(oni_FramePublisher * pub,
+                                      oni_VideoFrameRef * ref) {
+    EXC_CHECK({
+        oni_FrameDescriptor desc;
+        oni_Status rc = oni_getFrameDescriptor(ref, &desc);
+        if (rc != openni::STATUS_OK) {
+            return rc;
+        }
+
+        _shared_ring_header * h = pub->m_ring.header();
+        if (desc.dataSize < 0 || (uint64_t) desc.dataSize > h->maxFrameSize) {
+            return openni::STATUS_BAD_PARAMETER;
+        }
+
+        // Only this thread ever writes 'published', so a relaxed read is fine.
+        uint64_t seq = __atomic_load_n(&h->published, __ATOMIC_RELAXED);
+        uint32_t idx = (uint32_t) (seq % h->slotCount);
+        _shared_slot * slot = pub->m_ring.slot(idx);
+
+        uint32_t version = slot->version;
+        __atomic_store_n(&slot->version, version + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+
+        slot->sequence = seq;
+        slot->timestamp = desc.timestamp;
+        slot->dataSize = desc.dataSize;
+        slot->width = desc.width;
+        slot->height = desc.height;
+        slot->strideInBytes = desc.strideInBytes;
+        slot->sensorType = desc.sensorType;
+        slot->pixelFormat = desc.pixelFormat;
+        slot->frameIndex = desc.frameIndex;
+        slot->croppingEnabled = desc.croppingEnabled;
+        slot->cropOriginX = desc.cropOriginX;
+        slot->cropOriginY = desc.cropOriginY;
+        memcpy(pub->m_ring.slotData(idx), desc.data, desc.dataSize);
+
+        __atomic_store_n(&slot->version, version + 2, __ATOMIC_RELEASE);
+        __atomic_store_n(&h->published, seq + 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&h->publishedWord, (uint32_t) (seq + 1),
+                         __ATOMIC_RELEASE);
+        _futex(&h->publishedWord, FUTEX_WAKE, INT_MAX, NULL);
+        return openni::STATUS_OK;
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_setStreamInfo_FramePublisher(oni_FramePublisher * pub,
+                                            oni_VideoStream * stream) {
+    EXC_CHECK({
+        _shared_ring_header * h = pub->m_ring.header();
+        uint32_t version = h->infoVersion;
+        __atomic_store_n(&h->infoVersion, version + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        h->infoSensorType = stream->getSensorInfo().getSensorType();
+        h->infoHorizontalFov = oni_getHorizontalFieldOfView(stream);
+        h->infoVerticalFov = oni_getVerticalFieldOfView(stream);
+        h->infoMinPixelValue = oni_getMinPixelValue(stream);
+        h->infoMaxPixelValue = oni_getMaxPixelValue(stream);
+        h->infoMirroring = oni_getMirroringEnabled(stream);
+        __atomic_store_n(&h->infoVersion, version + 2, __ATOMIC_RELEASE);
+        return openni::STATUS_OK;
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_attach_FramePublisher(oni_FramePublisher * pub,
+                                     oni_VideoStream * stream) {
+    EXC_CHECK({
+        oni_detach_FramePublisher(pub);
+        oni_Status rc = stream->addNewFrameListener(pub);
+        if (rc == openni::STATUS_OK) {
+            pub->m_stream = stream;
+        }
+        return rc;
+    });
+    return openni::STATUS_ERROR;
+}
+
+void oni_detach_FramePublisher(oni_FramePublisher * pub) {
+    EXC_CHECK({
+        if (pub->m_stream != NULL) {
+            pub->m_stream->removeNewFrameListener(pub);
+            pub->m_stream = NULL;
+        }
+    });
+}
+
+// ===================
+// oni_FrameSubscriber
+// ===================
+class openni2_frame_subscriber
+{
+public:
+    openni2_frame_subscriber() : m_next(0), m_dropped(0) {}
+
+    openni2_frame_ring m_ring;
+    // Sequence number of the next frame to read.
+    uint64_t m_next;
+    uint64_t m_dropped;
+};
+
+static oni_FrameSubscriber * _newSubscriber(int fd)
+{
+    if (fd < 0) {
+        return NULL;
+    }
+    openni2_frame_subscriber * sub = new openni2_frame_subscriber();
+    if (!sub->m_ring.map(fd, false, 0, 0)) {
+        delete sub;
+        return NULL;
+    }
+    // Start from whatever is newest, rather than from frames long gone.
+    uint64_t published =
+        __atomic_load_n(&sub->m_ring.header()->published, __ATOMIC_ACQUIRE);
+    sub->m_next = published > 0 ? published - 1 : 0;
+    return sub;
+}
+
+// _readSlot: Attempt to read frame 'seq' into 'frame'.  Returns
+// STATUS_OUT_OF_FLOW if the slot is being written or already holds a
+// different frame, and STATUS_ERROR if it claims more data than a slot holds.
+static oni_Status _readSlot(openni2_frame_subscriber * sub, uint64_t seq,
+                      oni_SharedFrame * frame)
+{
+    _shared_ring_header * h = sub->m_ring.header();
+    uint32_t idx = (uint32_t) (seq % h->slotCount);
+    _shared_slot * slot = sub->m_ring.slot(idx);
+
+    uint32_t version = __atomic_load_n(&slot->version, __ATOMIC_ACQUIRE);
+    if (version & 1) {
+        return openni::STATUS_OUT_OF_FLOW;
+    }
+
+    oni_FrameDescriptor & desc = frame->desc;
+    uint64_t slotSeq = slot->sequence;
+    desc.data = sub->m_ring.slotData(idx);
+    desc.dataSize = slot->dataSize;
+    desc.width = slot->width;
+    desc.height = slot->height;
+    desc.strideInBytes = slot->strideInBytes;
+    desc.sensorType = (oni_SensorType) slot->sensorType;
+    desc.pixelFormat = (oni_PixelFormat) slot->pixelFormat;
+    desc.frameIndex = slot->frameIndex;
+    desc.timestamp = slot->timestamp;
+    desc.croppingEnabled = slot->croppingEnabled != 0;
+    desc.cropOriginX = slot->cropOriginX;
+    desc.cropOriginY = slot->cropOriginY;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->version, __ATOMIC_RELAXED) != version ||
+        slotSeq != seq)
+    {
+        return openni::STATUS_OUT_OF_FLOW;
+    }
+    // The ring is only as trustworthy as whoever else maps it.
+    if (desc.dataSize < 0 || (uint64_t) desc.dataSize > h->maxFrameSize ||
+        _slotDataOffset + (uint64_t) desc.dataSize > h->slotStride)
+    {
+        return openni::STATUS_ERROR;
+    }
+
+    frame->sequence = seq;
+    frame->_slot = (int) idx;
+    frame->_slotVersion = version;
+    return openni::STATUS_OK;
+}
+
+static oni_Status _readNext(openni2_frame_subscriber * sub,
+                            oni_SharedFrame * frame, int timeoutMs,
+                            bool latest)
+{
+    _shared_ring_header * h = sub->m_ring.header();
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeoutMs / 1000;
+    deadline.tv_nsec += (timeoutMs % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    for (;;) {
+        uint32_t word = __atomic_load_n(&h->publishedWord, __ATOMIC_ACQUIRE);
+        uint64_t published = __atomic_load_n(&h->published, __ATOMIC_ACQUIRE);
+
+        if (sub->m_next < published) {
+            // The slot the publisher writes next still holds the oldest frame,
+            // so anything at or before that one is not safe to start on.
+            uint64_t oldest = published >= h->slotCount ?
+                published - h->slotCount + 1 : 0;
+            uint64_t want = latest ? published - 1 : sub->m_next;
+            if (want < oldest) {
+                want = oldest;
+            }
+            sub->m_dropped += want - sub->m_next;
+
+            oni_Status rc = _readSlot(sub, want, frame);
+            if (rc != openni::STATUS_OUT_OF_FLOW) {
+                // A bad frame is passed over, so the next read moves on.
+                sub->m_next = want + 1;
+                frame->dropped = sub->m_dropped;
+                return rc;
+            }
+            sub->m_next = want;
+            // Overtaken while reading; go around and pick a newer frame.
+            if (__atomic_load_n(&h->publishedWord, __ATOMIC_ACQUIRE) != word) {
+                continue;
+            }
+            // Otherwise the slot is still being written: wait for the next
+            // publish like any reader that is caught up, so that a publisher
+            // that died part way through costs a timeout, not a spinning CPU.
+        }
+
+        if (timeoutMs == 0) {
+            return openni::STATUS_TIME_OUT;
+        }
+
+        struct timespec remaining, * wait = NULL;
+        if (timeoutMs > 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            remaining.tv_sec = deadline.tv_sec - now.tv_sec;
+            remaining.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+            if (remaining.tv_nsec < 0) {
+                remaining.tv_sec -= 1;
+                remaining.tv_nsec += 1000000000L;
+            }
+            if (remaining.tv_sec < 0) {
+                return openni::STATUS_TIME_OUT;
+            }
+            wait = &remaining;
+        }
+        // Shared (not private) futex: the publisher is another process.
+        _futex(&h->publishedWord, FUTEX_WAIT, word, wait);
+    }
+}
+
+oni_FrameSubscriber * oni_new_FrameSubscriber(const char * name) {
+    EXC_CHECK( return _newSubscriber(shm_open(name, O_RDONLY, 0)); );
+    return NULL;
+}
+
+oni_FrameSubscriber * oni_new_FrameSubscriber_Fd(int fd) {
+    EXC_CHECK( return _newSubscriber(fcntl(fd, F_DUPFD_CLOEXEC, 0)); );
+    return NULL;
+}
+
+void oni_delete_FrameSubscriber(oni_FrameSubscriber * sub) {
+    EXC_CHECK( delete sub; );
+}
+
+oni_Status oni_readFrame_FrameSubscriber(oni_FrameSubscriber * sub,
+                                         oni_SharedFrame * frame, int timeoutMs) {
+    EXC_CHECK( return _readNext(sub, frame, timeoutMs, false); );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_readLatest_FrameSubscriber(oni_FrameSubscriber * sub,
+                                          oni_SharedFrame * frame,
+                                          int timeoutMs) {
+    EXC_CHECK( return _readNext(sub, frame, timeoutMs, true); );
+    return openni::STATUS_ERROR;
+}
+
+bool oni_isValid_SharedFrame(oni_FrameSubscriber * sub,
+                             const oni_SharedFrame * frame) {
+    EXC_CHECK({
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        _shared_slot * slot = sub->m_ring.slot(frame->_slot);
+        return __atomic_load_n(&slot->version, __ATOMIC_RELAXED) ==
+            frame->_slotVersion;
+    });
+    return false;
+}
+
+oni_Status oni_getStreamInfo_FrameSubscriber(oni_FrameSubscriber * sub,
+                                             oni_SharedStreamInfo * info) {
+    EXC_CHECK({
+        _shared_ring_header * h = sub->m_ring.header();
+        for (;;) {
+            uint32_t version = __atomic_load_n(&h->infoVersion, __ATOMIC_ACQUIRE);
+            if (version == 0) {
+                return openni::STATUS_NOT_SUPPORTED;
+            }
+            if (version & 1) {
+                continue;
+            }
+            info->sensorType = (oni_SensorType) h->infoSensorType;
+            info->horizontalFieldOfView = h->infoHorizontalFov;
+            info->verticalFieldOfView = h->infoVerticalFov;
+            info->minPixelValue = h->infoMinPixelValue;
+            info->maxPixelValue = h->infoMaxPixelValue;
+            info->mirroringEnabled = h->infoMirroring != 0;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&h->infoVersion, __ATOMIC_RELAXED) == version) {
+                return openni::STATUS_OK;
+            }
+        }
+    });
+    return openni::STATUS_ERROR;
+}
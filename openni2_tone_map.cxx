@@ -0,0 +1,452 @@
+// ============================================================================
+// openni2_tone_map.cxx: Mapping 16-bit IR, gray and depth frames to 8 bits by
+// percentile stretch, local contrast (CLAHE) and gamma (oni_ToneMapper)
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_geometry.h"
+#include "openni2_parallel.h"
+#include "openni2_internal.h"
+
+// Histograms have at most this many bins, each covering 1 << shift values.
+static const int _toneBins = 4096;
+
+// _histogramRow: Count the 'n' pixels at 'p' into 'histogram', leaving out
+// zeros if 'skipZero'.  Values past the last bin count towards it.  Even and
+// odd pixels go to two tables, 'histogram' and the one after it, so that
+// runs of equal pixels do not wait on each other's increments.
+static void _histogramRow(const uint16_t * p, int n, int shift, int lastBin,
+                          bool skipZero, uint32_t * histogram)
+{
+    uint32_t * second = histogram + lastBin + 1;
+    int x = 0;
+    for (; x + 2 <= n; x += 2) {
+        uint16_t a = p[x], b = p[x + 1];
+        histogram[std::min(a >> shift, lastBin)] += !(skipZero && a == 0);
+        second[std::min(b >> shift, lastBin)] += !(skipZero && b == 0);
+    }
+    for (; x < n; ++x) {
+        histogram[std::min(p[x] >> shift, lastBin)] += !(skipZero && p[x] == 0);
+    }
+}
+
+// _stretchRow: Map the 'n' pixels at 'p' to round(v * scale + offset),
+// clamped to [0, 255], through 'gamma' if not NULL.  Zeros go to 0 if
+// 'skipZero'.
+static void _stretchRow(const uint16_t * p, int n, float scale, float offset,
+                        bool skipZero, const uint8_t * gamma, uint8_t * out)
+{
+    int x = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128 voffset = _mm_set1_ps(offset);
+    for (; x + 8 <= n; x += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (p + x));
+        __m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero));
+        __m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero));
+        __m128i a = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(lo, vscale), voffset));
+        __m128i b = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(hi, vscale), voffset));
+        // Signed saturation to 16 bits, then unsigned to 8, clamps both ends.
+        __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(a, b), zero);
+        if (skipZero) {
+            __m128i missing = _mm_cmpeq_epi16(v, zero);
+            bytes = _mm_andnot_si128(_mm_packs_epi16(missing, zero), bytes);
+        }
+        _mm_storel_epi64((__m128i *) (out + x), bytes);
+    }
+#endif
+    for (; x < n; ++x) {
+        float v = p[x] * scale + offset;
+        v = v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v);
+        out[x] = skipZero && p[x] == 0 ? 0 : (uint8_t) lrintf(v);
+    }
+    if (gamma != NULL) {
+        for (int i = 0; i < n; ++i) {
+            out[i] = gamma[out[i]];
+        }
+    }
+}
+
+// ===================
+// openni2_tone_mapper
+// ===================
+// openni2_tone_mapper: The stretch runs eight pixels at a time with SSE2.
+// Histograms are counted in strips and tiles are equalized in parallel (see
+// oni_setParallelism); missing depth pixels are left out of the histograms.
+class openni2_tone_mapper
+{
+public:
+    explicit openni2_tone_mapper(int maxValue)
+        : m_shift(0), m_low(1.0f), m_high(99.0f), m_reuse(false),
+          m_hasHistogram(false), m_tilesX(0), m_tilesY(0), m_clipLimit(2.0f),
+          m_rangeLow(0), m_rangeHigh(0)
+    {
+        while ((maxValue >> m_shift) >= _toneBins) {
+            ++m_shift;
+        }
+        m_bins = (maxValue >> m_shift) + 1;
+        m_histogram.assign(m_bins, 0);
+        setGamma(1.0f);
+    }
+
+    void setPercentiles(float low, float high)
+    {
+        m_low = std::min(std::max(low, 0.0f), 100.0f);
+        m_high = std::min(std::max(high, m_low), 100.0f);
+    }
+
+    void setGamma(float gamma)
+    {
+        m_useGamma = gamma > 0.0f && gamma != 1.0f;
+        for (int i = 0; i < 256; ++i) {
+            m_gamma[i] = m_useGamma ?
+                (uint8_t) lrint(255.0 * pow(i / 255.0, 1.0 / gamma)) : (uint8_t) i;
+        }
+    }
+
+    void setReuseHistogram(bool reuse)
+    {
+        m_reuse = reuse;
+        m_hasHistogram = false;
+    }
+
+    void setLocalContrast(int tilesX, int tilesY, float clipLimit)
+    {
+        m_tilesX = tilesX > 0 && tilesY > 0 ? tilesX : 0;
+        m_tilesY = tilesX > 0 && tilesY > 0 ? tilesY : 0;
+        m_clipLimit = clipLimit;
+    }
+
+    void range(int * low, int * high) const
+    {
+        if (low != NULL) {
+            *low = m_rangeLow;
+        }
+        if (high != NULL) {
+            *high = m_rangeHigh;
+        }
+    }
+
+    oni_Status map(const oni_FrameDescriptor & desc, uint8_t * out)
+    {
+        if (desc.data == NULL || _bytesPerPixel(desc.pixelFormat) != 2 ||
+            desc.width <= 0 || desc.height <= 0)
+        {
+            return openni::STATUS_NOT_SUPPORTED;
+        }
+        int w = desc.width, h = desc.height;
+        bool skipZero = desc.sensorType == openni::SENSOR_DEPTH;
+        bool local = m_tilesX > 0;
+        uint8_t * stretched = out;
+        if (local) {
+            m_stretched.resize((size_t) w * h);
+            stretched = &m_stretched[0];
+        }
+        // Gamma goes into the tile mappings when there are tiles.
+        const uint8_t * gamma = m_useGamma && !local ? m_gamma : NULL;
+
+        int strips = std::max(_parallelism(), 1);
+        int rows = (h + strips - 1) / strips;
+        strips = (h + rows - 1) / rows;
+        m_partials.assign((size_t) strips * 2 * m_bins, 0);
+        int lastBin = m_bins - 1;
+        if (m_reuse && m_hasHistogram) {
+            // One pass: stretch by the last frame's histogram while counting
+            // this one's.
+            float scale, offset;
+            stretchFor(scale, offset);
+            _parallelFor(h, rows, [&](int y0, int y1) {
+                uint32_t * histogram = &m_partials[(size_t) (y0 / rows) * 2 * m_bins];
+                for (int y = y0; y < y1; ++y) {
+                    const uint16_t * p = _depthRow(desc, y);
+                    _histogramRow(p, w, m_shift, lastBin, skipZero, histogram);
+                    _stretchRow(p, w, scale, offset, skipZero, gamma,
+                                stretched + (size_t) y * w);
+                }
+            });
+            merge(strips);
+        } else {
+            _parallelFor(h, rows, [&](int y0, int y1) {
+                uint32_t * histogram = &m_partials[(size_t) (y0 / rows) * 2 * m_bins];
+                for (int y = y0; y < y1; ++y) {
+                    _histogramRow(_depthRow(desc, y), w, m_shift, lastBin,
+                                  skipZero, histogram);
+                }
+            });
+            merge(strips);
+            float scale, offset;
+            stretchFor(scale, offset);
+            _parallelFor(h, 16, [&](int y0, int y1) {
+                for (int y = y0; y < y1; ++y) {
+                    _stretchRow(_depthRow(desc, y), w, scale, offset, skipZero,
+                                gamma, stretched + (size_t) y * w);
+                }
+            });
+        }
+        m_hasHistogram = true;
+        if (local) {
+            equalize(w, h, skipZero ? &desc : NULL, out);
+        }
+        return openni::STATUS_OK;
+    }
+
+private:
+    // merge: Add up the strips' pairs of histograms into m_histogram.
+    void merge(int strips)
+    {
+        std::fill(m_histogram.begin(), m_histogram.end(), 0);
+        for (int s = 0; s < 2 * strips; ++s) {
+            const uint32_t * partial = &m_partials[(size_t) s * m_bins];
+            for (int b = 0; b < m_bins; ++b) {
+                m_histogram[b] += partial[b];
+            }
+        }
+    }
+
+    // stretchFor: The linear map taking the percentile range of m_histogram
+    // to [0, 255], and that range into m_rangeLow and m_rangeHigh.
+    void stretchFor(float & scale, float & offset)
+    {
+        uint64_t total = 0;
+        for (int b = 0; b < m_bins; ++b) {
+            total += m_histogram[b];
+        }
+        double lowCount = total * (m_low / 100.0);
+        double highCount = total * (m_high / 100.0);
+        int lowBin = 0, highBin = m_bins - 1;
+        uint64_t sum = 0;
+        bool lowFound = false;
+        for (int b = 0; b < m_bins; ++b) {
+            sum += m_histogram[b];
+            if (!lowFound && sum > lowCount) {
+                lowBin = b;
+                lowFound = true;
+            }
+            if (sum >= highCount && sum > 0) {
+                highBin = b;
+                break;
+            }
+        }
+        m_rangeLow = lowBin << m_shift;
+        m_rangeHigh = ((highBin + 1) << m_shift) - 1;
+        if (total == 0) {
+            m_rangeLow = 0;
+            m_rangeHigh = (m_bins << m_shift) - 1;
+        }
+        scale = 255.0f / std::max(m_rangeHigh - m_rangeLow, 1);
+        offset = -m_rangeLow * scale;
+    }
+
+    // equalize: Contrast-limited adaptive histogram equalization of
+    // m_stretched into 'out'.  Each tile's histogram is clipped at
+    // m_clipLimit times its mean bin count, with the excess spread over all
+    // bins, and turned into a mapping; each pixel blends the mappings of the
+    // four tiles around it.  If 'depth' is given, its missing pixels stay 0
+    // and are left out of the histograms.
+    void equalize(int w, int h, const oni_FrameDescriptor * depth, uint8_t * out)
+    {
+        int tilesX = std::min(m_tilesX, w), tilesY = std::min(m_tilesY, h);
+        int tileW = (w + tilesX - 1) / tilesX, tileH = (h + tilesY - 1) / tilesY;
+        tilesX = (w + tileW - 1) / tileW;
+        tilesY = (h + tileH - 1) / tileH;
+        m_tileMaps.resize((size_t) tilesX * tilesY * 256);
+        const uint8_t * in = &m_stretched[0];
+        _parallelFor(tilesX * tilesY, 1, [&](int t0, int t1) {
+            for (int t = t0; t < t1; ++t) {
+                int x0 = (t % tilesX) * tileW, y0 = (t / tilesX) * tileH;
+                int x1 = std::min(x0 + tileW, w), y1 = std::min(y0 + tileH, h);
+                uint32_t histogram[256] = { 0 };
+                for (int y = y0; y < y1; ++y) {
+                    const uint8_t * p = in + (size_t) y * w;
+                    const uint16_t * d = depth != NULL ? _depthRow(*depth, y) : NULL;
+                    for (int x = x0; x < x1; ++x) {
+                        if (d == NULL || d[x] != 0) {
+                            ++histogram[p[x]];
+                        }
+                    }
+                }
+                tileMap(histogram, &m_tileMaps[(size_t) t * 256]);
+            }
+        });
+
+        // The tiles each column blends and its weight, in 1/256ths, for the
+        // right one.
+        m_columnLeft.resize(w);
+        m_columnRight.resize(w);
+        m_columnWeight.resize(w);
+        for (int x = 0; x < w; ++x) {
+            int tile;
+            blendAt(x, tileW, tilesX, tile, m_columnWeight[x]);
+            m_columnLeft[x] = tile * 256;
+            m_columnRight[x] = std::min(tile + 1, tilesX - 1) * 256;
+        }
+        _parallelFor(h, 16, [&](int y0, int y1) {
+            for (int y = y0; y < y1; ++y) {
+                int ty, wy;
+                blendAt(y, tileH, tilesY, ty, wy);
+                int ty1 = std::min(ty + 1, tilesY - 1);
+                const uint8_t * top = &m_tileMaps[(size_t) ty * tilesX * 256];
+                const uint8_t * bottom = &m_tileMaps[(size_t) ty1 * tilesX * 256];
+                const uint8_t * p = in + (size_t) y * w;
+                const uint16_t * d = depth != NULL ? _depthRow(*depth, y) : NULL;
+                uint8_t * o = out + (size_t) y * w;
+                for (int x = 0; x < w; ++x) {
+                    int l = m_columnLeft[x] + p[x], r = m_columnRight[x] + p[x];
+                    int wx = m_columnWeight[x];
+                    int a = top[l] * (256 - wx) + top[r] * wx;
+                    int b = bottom[l] * (256 - wx) + bottom[r] * wx;
+                    o[x] = (uint8_t) ((a * (256 - wy) + b * wy + 32768) >> 16);
+                }
+                if (d != NULL) {
+                    for (int x = 0; x < w; ++x) {
+                        o[x] = d[x] != 0 ? o[x] : 0;
+                    }
+                }
+            }
+        });
+    }
+
+    // blendAt: The tile whose center is at or before coordinate 'i' and how
+    // far 'i' is towards the next tile's center, in 1/256ths, clamped at the
+    // edges.
+    static void blendAt(int i, int tileSize, int tiles, int & tile, int & weight)
+    {
+        float f = (i + 0.5f) / tileSize - 0.5f;
+        if (f <= 0.0f) {
+            tile = 0;
+            weight = 0;
+        } else if (f >= tiles - 1) {
+            tile = tiles - 1;
+            weight = 0;
+        } else {
+            tile = (int) f;
+            weight = (int) ((f - tile) * 256.0f + 0.5f);
+        }
+    }
+
+    // tileMap: The clipped, equalizing mapping of one tile, through gamma.
+    void tileMap(uint32_t * histogram, uint8_t * map) const
+    {
+        uint32_t count = 0;
+        for (int v = 0; v < 256; ++v) {
+            count += histogram[v];
+        }
+        if (count == 0) {
+            for (int v = 0; v < 256; ++v) {
+                map[v] = m_gamma[v];
+            }
+            return;
+        }
+        if (m_clipLimit > 0.0f) {
+            uint32_t clip = std::max((uint32_t) (m_clipLimit * count / 256.0f), 1u);
+            uint32_t excess = 0;
+            for (int v = 0; v < 256; ++v) {
+                if (histogram[v] > clip) {
+                    excess += histogram[v] - clip;
+                    histogram[v] = clip;
+                }
+            }
+            uint32_t each = excess / 256, rest = excess % 256;
+            for (int v = 0; v < 256; ++v) {
+                histogram[v] += each + (v < (int) rest ? 1 : 0);
+            }
+        }
+        uint32_t sum = 0;
+        float scale = 255.0f / count;
+        for (int v = 0; v < 256; ++v) {
+            sum += histogram[v];
+            map[v] = m_gamma[std::min((int) (sum * scale + 0.5f), 255)];
+        }
+    }
+
+    int m_shift;
+    int m_bins;
+    float m_low;
+    float m_high;
+    bool m_useGamma;
+    uint8_t m_gamma[256];
+    bool m_reuse;
+    bool m_hasHistogram;
+    int m_tilesX;
+    int m_tilesY;
+    float m_clipLimit;
+    int m_rangeLow;
+    int m_rangeHigh;
+    std::vector<uint32_t> m_histogram;
+    std::vector<uint32_t> m_partials;
+    std::vector<uint8_t> m_stretched;
+    std::vector<uint8_t> m_tileMaps;
+    std::vector<int> m_columnLeft;
+    std::vector<int> m_columnRight;
+    std::vector<int> m_columnWeight;
+};
+
+// ==============
+// oni_ToneMapper
+// ==============
+oni_ToneMapper * oni_new_ToneMapper(int maxValue) {
+    if (maxValue < 1 || maxValue > 0xffff) {
+        return NULL;
+    }
+    EXC_CHECK( return new openni2_tone_mapper(maxValue); );
+    return NULL;
+}
+
+void oni_delete_ToneMapper(oni_ToneMapper * mapper) {
+    EXC_CHECK( delete mapper; );
+}
+
+void oni_setPercentiles_ToneMapper(oni_ToneMapper * mapper, float low,
+                                   float high) {
+    EXC_CHECK( mapper->setPercentiles(low, high); );
+}
+
+void oni_setGamma_ToneMapper(oni_ToneMapper * mapper, float gamma) {
+    EXC_CHECK( mapper->setGamma(gamma); );
+}
+
+void oni_setReuseHistogram_ToneMapper(oni_ToneMapper * mapper, bool reuse) {
+    EXC_CHECK( mapper->setReuseHistogram(reuse); );
+}
+
+void oni_setLocalContrast_ToneMapper(oni_ToneMapper * mapper, int tilesX,
+                                     int tilesY, float clipLimit) {
+    EXC_CHECK( mapper->setLocalContrast(tilesX, tilesY, clipLimit); );
+}
+
+void oni_getRange_ToneMapper(oni_ToneMapper * mapper, int * low, int * high) {
+    EXC_CHECK( mapper->range(low, high); );
+}
+
+oni_Status oni_map_ToneMapper(oni_ToneMapper * mapper, oni_VideoFrameRef * frame,
+                              uint8_t * out) {
+    EXC_CHECK({
+        oni_FrameDescriptor desc;
+        oni_Status rc = oni_getFrameDescriptor(frame, &desc);
+        if (rc != openni::STATUS_OK) {
+            return rc;
+        }
+        return mapper->map(desc, out);
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_mapDescriptor_ToneMapper(oni_ToneMapper * mapper,
+                                        const oni_FrameDescriptor * desc,
+                                        uint8_t * out) {
+    EXC_CHECK( return mapper->map(*desc, out); );
+    return openni::STATUS_ERROR;
+}
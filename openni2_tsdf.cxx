@@ -0,0 +1,925 @@
+// ============================================================================
+// openni2_tsdf.cxx: Volumetric fusion of depth frames into a truncated signed
+// distance function kept in hashed voxel blocks, and raycasting of it
+// (oni_TsdfVolume)
+// (c) Chris Hodapp, 2013
+// ============================================================================
+
+#include <OpenNI.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+#include "openni2_geometry.h"
+#include "openni2_parallel.h"
+#include "openni2_internal.h"
+
+// Voxels per block along each axis, and in all.
+static const int _blockShift = 3;
+static const int _blockSide = 1 << _blockShift;
+static const int _blockVoxels = _blockSide * _blockSide * _blockSide;
+// Block coordinates are offset by this much and kept in 21 bits each.
+static const int _blockOffset = 1 << 20;
+// Raycasting bounds each ray by the blocks projecting onto its tile of this
+// many pixels square.
+static const int _rangeTile = 8;
+// Entries in each allocation strip's cache of recently seen blocks.
+static const int _recentBlocks = 256;
+
+// TSDF values are kept as fixed point in this scale.
+static const float _tsdfScale = 32767.0f;
+
+// _tsdfVoxel: The signed distance divided by the truncation distance, in
+// [-1, 1] as fixed point, and how many observations it averages; unobserved
+// voxels have weight 0.  Four bytes, so that raycasting, which is bound by
+// memory, reads as little as possible.
+struct _tsdfVoxel {
+    int16_t tsdf;
+    uint16_t weight;
+};
+
+// _tsdfBlock: 8 x 8 x 8 voxels, x fastest.
+struct _tsdfBlock {
+    _tsdfBlock(int x, int y, int z)
+        : x(x), y(y), z(z), frame(0), dirty(false)
+    {
+        for (int i = 0; i < _blockVoxels; ++i) {
+            voxels[i].tsdf = (int16_t) _tsdfScale;
+            voxels[i].weight = 0;
+        }
+    }
+
+    _tsdfVoxel voxels[_blockVoxels];
+    const int x;
+    const int y;
+    const int z;
+    // The last frame that saw this block, so it is integrated once.
+    unsigned frame;
+    // Changed since the last raycast.
+    bool dirty;
+};
+
+// _floor: floorf() as an int, without the library call that floorf() is
+// without SSE4.1.
+static inline int _floor(float f)
+{
+    int i = (int) f;
+    return i - (f < (float) i);
+}
+
+static inline uint64_t _blockKey(int x, int y, int z)
+{
+    return ((uint64_t) (x + _blockOffset) << 42) |
+        ((uint64_t) (y + _blockOffset) << 21) | (uint64_t) (z + _blockOffset);
+}
+
+// _hashBlock: MurmurHash3's finalizer, as for the voxels of oni_PointCloud.
+static inline uint32_t _hashBlock(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return (uint32_t) key;
+}
+
+// _blockTable: Blocks found by key through open addressing with linear
+// probing.  Blocks are only added between passes, so lookups from several
+// threads at once need no lock.  Keys carry a marker bit so that 0 means
+// empty.
+class _blockTable
+{
+public:
+    _blockTable() : m_keys(1024, 0), m_index(1024, -1) {}
+
+    _tsdfBlock * find(uint64_t key) const
+    {
+        uint64_t marked = key | (1ULL << 63);
+        size_t mask = m_keys.size() - 1;
+        for (size_t slot = _hashBlock(key) & mask; m_keys[slot] != 0;
+             slot = (slot + 1) & mask)
+        {
+            if (m_keys[slot] == marked) {
+                return m_blocks[m_index[slot]].get();
+            }
+        }
+        return NULL;
+    }
+
+    // insert: The block at block coordinates (x, y, z), added if new.
+    _tsdfBlock * insert(int x, int y, int z)
+    {
+        uint64_t key = _blockKey(x, y, z);
+        _tsdfBlock * block = find(key);
+        if (block != NULL) {
+            return block;
+        }
+        if (2 * (m_blocks.size() + 1) > m_keys.size()) {
+            grow();
+        }
+        m_blocks.push_back(std::unique_ptr<_tsdfBlock>(new _tsdfBlock(x, y, z)));
+        place(key, (int) m_blocks.size() - 1);
+        return m_blocks.back().get();
+    }
+
+    void clear()
+    {
+        m_blocks.clear();
+        std::fill(m_keys.begin(), m_keys.end(), 0);
+    }
+
+    size_t size() const { return m_blocks.size(); }
+
+    const _tsdfBlock & at(size_t i) const { return *m_blocks[i]; }
+
+private:
+    void place(uint64_t key, int index)
+    {
+        size_t mask = m_keys.size() - 1;
+        size_t slot = _hashBlock(key) & mask;
+        while (m_keys[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        m_keys[slot] = key | (1ULL << 63);
+        m_index[slot] = index;
+    }
+
+    void grow()
+    {
+        m_keys.assign(m_keys.size() * 2, 0);
+        m_index.assign(m_keys.size(), -1);
+        for (size_t i = 0; i < m_blocks.size(); ++i) {
+            const _tsdfBlock & b = *m_blocks[i];
+            place(_blockKey(b.x, b.y, b.z), (int) i);
+        }
+    }
+
+    std::vector<uint64_t> m_keys;
+    std::vector<int> m_index;
+    std::vector<std::unique_ptr<_tsdfBlock> > m_blocks;
+};
+
+// _rigid: A pose as rotation rows and translation, and its inverse.
+struct _rigid {
+    float r[9];
+    float t[3];
+
+    void apply(const float * p, float * out) const
+    {
+        for (int i = 0; i < 3; ++i) {
+            out[i] = r[3 * i] * p[0] + r[3 * i + 1] * p[1] + r[3 * i + 2] * p[2] +
+                t[i];
+        }
+    }
+
+    void rotate(const float * p, float * out) const
+    {
+        for (int i = 0; i < 3; ++i) {
+            out[i] = r[3 * i] * p[0] + r[3 * i + 1] * p[1] + r[3 * i + 2] * p[2];
+        }
+    }
+};
+
+static void _makeRigid(const oni_SensorPose * pose, _rigid & toWorld,
+                       _rigid & toCamera)
+{
+    static const oni_SensorPose identity = {
+        { 1, 0, 0, 0, 1, 0, 0, 0, 1 }, { 0, 0, 0 } };
+    const oni_SensorPose & p = pose != NULL ? *pose : identity;
+    memcpy(toWorld.r, p.rotation, sizeof(toWorld.r));
+    memcpy(toWorld.t, p.translation, sizeof(toWorld.t));
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            toCamera.r[3 * i + j] = p.rotation[3 * j + i];
+        }
+    }
+    for (int i = 0; i < 3; ++i) {
+        toCamera.t[i] = -(toCamera.r[3 * i] * p.translation[0] +
+                          toCamera.r[3 * i + 1] * p.translation[1] +
+                          toCamera.r[3 * i + 2] * p.translation[2]);
+    }
+}
+
+// _integrateParams: Everything integrating one block needs about a frame.
+struct _integrateParams {
+    const oni_FrameDescriptor * desc;
+    const _depthGeometry * geometry;
+    _rigid toCamera;
+    float voxelSize;
+    float truncation;
+    float minDepth;
+    float maxDepth;
+    float maxWeight;
+};
+
+// _integrateBlock: Fold one depth frame into the voxels of 'block'.  Returns
+// whether any voxel changed.
+static bool _integrateBlock(_tsdfBlock & block, const _integrateParams & p)
+{
+    const oni_FrameDescriptor & desc = *p.desc;
+    const _depthGeometry & g = *p.geometry;
+    const _rigid & m = p.toCamera;
+    float vs = p.voxelSize;
+    float invTruncation = 1.0f / p.truncation;
+    // Camera-space step for one voxel along x.
+    float dx[3] = { m.r[0] * vs, m.r[3] * vs, m.r[6] * vs };
+    bool changed = false;
+    for (int z = 0; z < _blockSide; ++z) {
+        for (int y = 0; y < _blockSide; ++y) {
+            float world[3] = { (float) (block.x * _blockSide) * vs,
+                               (float) (block.y * _blockSide + y) * vs,
+                               (float) (block.z * _blockSide + z) * vs };
+            float c[3];
+            m.apply(world, c);
+            _tsdfVoxel * row = &block.voxels[(z * _blockSide + y) * _blockSide];
+            int x = 0;
+#ifdef __SSE2__
+            const __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+            for (; x < _blockSide; x += 4) {
+                __m128 k = _mm_add_ps(lane, _mm_set1_ps((float) x));
+                __m128 cx = _mm_add_ps(_mm_set1_ps(c[0]), _mm_mul_ps(k, _mm_set1_ps(dx[0])));
+                __m128 cy = _mm_add_ps(_mm_set1_ps(c[1]), _mm_mul_ps(k, _mm_set1_ps(dx[1])));
+                __m128 cz = _mm_add_ps(_mm_set1_ps(c[2]), _mm_mul_ps(k, _mm_set1_ps(dx[2])));
+                __m128 front = _mm_cmpgt_ps(cz, _mm_setzero_ps());
+                if (_mm_movemask_ps(front) == 0) {
+                    continue;
+                }
+                // Behind the camera, 1 / z only feeds lanes that are dropped.
+                __m128 invZ = _mm_div_ps(_mm_set1_ps(1.0f),
+                                         _mm_or_ps(_mm_and_ps(front, cz),
+                                                   _mm_andnot_ps(front, _mm_set1_ps(1.0f))));
+                __m128 u = _mm_add_ps(_mm_set1_ps(g.cx), _mm_mul_ps(
+                    _mm_set1_ps(g.fx), _mm_mul_ps(cx, invZ)));
+                __m128 v = _mm_sub_ps(_mm_set1_ps(g.cy), _mm_mul_ps(
+                    _mm_set1_ps(g.fy), _mm_mul_ps(cy, invZ)));
+                // Keep the conversion in range; out-of-frame lanes are
+                // rejected below.
+                u = _mm_min_ps(_mm_max_ps(u, _mm_set1_ps(-1.0f)), _mm_set1_ps(65536.0f));
+                v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1.0f)), _mm_set1_ps(65536.0f));
+                int32_t px[4], py[4];
+                _mm_storeu_si128((__m128i *) px, _mm_cvtps_epi32(u));
+                _mm_storeu_si128((__m128i *) py, _mm_cvtps_epi32(v));
+                int frontMask = _mm_movemask_ps(front);
+                float depth[4];
+                for (int i = 0; i < 4; ++i) {
+                    depth[i] = 0.0f;
+                    if ((frontMask >> i & 1) && px[i] >= 0 && px[i] < desc.width &&
+                        py[i] >= 0 && py[i] < desc.height)
+                    {
+                        depth[i] = _depthRow(desc, py[i])[px[i]] * g.scale;
+                    }
+                }
+                __m128 d = _mm_loadu_ps(depth);
+                __m128 sdf = _mm_sub_ps(d, cz);
+                __m128 update = _mm_and_ps(
+                    _mm_and_ps(_mm_cmpge_ps(d, _mm_set1_ps(p.minDepth)),
+                               _mm_cmple_ps(d, _mm_set1_ps(p.maxDepth))),
+                    _mm_and_ps(_mm_cmpgt_ps(d, _mm_setzero_ps()),
+                               _mm_cmpge_ps(sdf, _mm_set1_ps(-p.truncation))));
+                if (_mm_movemask_ps(update) == 0) {
+                    continue;
+                }
+                __m128 sample = _mm_min_ps(_mm_mul_ps(sdf, _mm_set1_ps(invTruncation)),
+                                           _mm_set1_ps(1.0f));
+                // Unpack four voxels: TSDF in the low, weight in the high half.
+                __m128i old = _mm_loadu_si128((const __m128i *) (row + x));
+                __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(old, 16), 16)),
+                                      _mm_set1_ps(1.0f / _tsdfScale));
+                __m128 w = _mm_cvtepi32_ps(_mm_srli_epi32(old, 16));
+                __m128 w1 = _mm_add_ps(w, _mm_set1_ps(1.0f));
+                t = _mm_div_ps(_mm_add_ps(_mm_mul_ps(t, w), sample), w1);
+                w1 = _mm_min_ps(w1, _mm_set1_ps(p.maxWeight));
+                __m128i packed = _mm_or_si128(
+                    _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(t, _mm_set1_ps(_tsdfScale))),
+                                  _mm_set1_epi32(0xffff)),
+                    _mm_slli_epi32(_mm_cvtps_epi32(w1), 16));
+                __m128i keep = _mm_castps_si128(update);
+                _mm_storeu_si128((__m128i *) (row + x),
+                                 _mm_or_si128(_mm_and_si128(keep, packed),
+                                              _mm_andnot_si128(keep, old)));
+                changed = true;
+            }
+#endif
+            for (; x < _blockSide; ++x) {
+                float px3[3] = { c[0] + x * dx[0], c[1] + x * dx[1], c[2] + x * dx[2] };
+                if (!(px3[2] > 0.0f)) {
+                    continue;
+                }
+                float u = g.cx + g.fx * px3[0] / px3[2];
+                float v = g.cy - g.fy * px3[1] / px3[2];
+                if (!(u > -0.5f && v > -0.5f && u < desc.width - 0.5f &&
+                      v < desc.height - 0.5f))
+                {
+                    continue;
+                }
+                float d = _depthRow(desc, (int) lrintf(v))[(int) lrintf(u)] * g.scale;
+                float sdf = d - px3[2];
+                if (d <= 0.0f || d < p.minDepth || d > p.maxDepth ||
+                    sdf < -p.truncation)
+                {
+                    continue;
+                }
+                float sample = sdf * invTruncation < 1.0f ? sdf * invTruncation : 1.0f;
+                float w = row[x].weight;
+                float t = (row[x].tsdf * (1.0f / _tsdfScale) * w + sample) / (w + 1.0f);
+                row[x].tsdf = (int16_t) lrintf(t * _tsdfScale);
+                row[x].weight = (uint16_t) (w + 1.0f < p.maxWeight ? w + 1.0f : p.maxWeight);
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+// ===================
+// openni2_tsdf_volume
+// ===================
+// openni2_tsdf_volume: Space is only allocated near observed surfaces, in
+// blocks of 8 x 8 x 8 voxels found through a hash table.  Integration updates
+// the blocks a frame sees in parallel (see oni_setParallelism), with SSE2
+// where available.
+class openni2_tsdf_volume
+{
+public:
+    openni2_tsdf_volume(float voxelSize, float truncation)
+        : m_voxelSize(voxelSize), m_truncation(truncation), m_minDepth(300.0f),
+          m_maxDepth(5000.0f), m_maxWeight(64.0f), m_frame(0),
+          m_rayWidth(0), m_rayHeight(0) {}
+
+    void setDepthRange(float minDepth, float maxDepth)
+    {
+        m_minDepth = minDepth;
+        m_maxDepth = maxDepth;
+        // The cached raycast was clipped to the old range.
+        m_rayWidth = m_rayHeight = 0;
+    }
+
+    void setMaxWeight(int weight)
+    {
+        m_maxWeight = (float) (weight < 1 ? 1 : weight > 65535 ? 65535 : weight);
+    }
+
+    void reset()
+    {
+        m_blocks.clear();
+        m_dirty.clear();
+        m_rayWidth = m_rayHeight = 0;
+    }
+
+    int blockCount() const
+    {
+        return (int) m_blocks.size();
+    }
+
+    oni_Status integrate(const oni_FrameDescriptor & desc,
+                         const oni_CameraIntrinsics & intrinsics,
+                         const oni_SensorPose * pose)
+    {
+        _depthGeometry g;
+        if (!_makeDepthGeometry(desc, intrinsics, &g)) {
+            return openni::STATUS_NOT_SUPPORTED;
+        }
+        _integrateParams p;
+        _rigid toWorld;
+        _makeRigid(pose, toWorld, p.toCamera);
+        p.desc = &desc;
+        p.geometry = &g;
+        p.voxelSize = m_voxelSize;
+        p.truncation = m_truncation;
+        p.minDepth = m_minDepth;
+        p.maxDepth = m_maxDepth;
+        p.maxWeight = m_maxWeight;
+
+        allocate(desc, g, toWorld);
+        std::vector<char> changed(m_visible.size());
+        _parallelFor((int) m_visible.size(), 4, [&](int b0, int b1) {
+            for (int b = b0; b < b1; ++b) {
+                changed[b] = _integrateBlock(*m_visible[b], p);
+            }
+        });
+        for (size_t b = 0; b < m_visible.size(); ++b) {
+            _tsdfBlock * block = m_visible[b];
+            if (changed[b] && !block->dirty) {
+                block->dirty = true;
+                m_dirty.push_back(block);
+            }
+        }
+        return openni::STATUS_OK;
+    }
+
+    oni_Status raycast(const oni_CameraIntrinsics & intrinsics,
+                       const oni_SensorPose * pose, oni_DepthPixel * depth,
+                       float * normals)
+    {
+        int width = intrinsics.width, height = intrinsics.height;
+        if (width <= 0 || height <= 0 || intrinsics.fx <= 0.0f ||
+            intrinsics.fy <= 0.0f)
+        {
+            return openni::STATUS_BAD_PARAMETER;
+        }
+        static const oni_SensorPose identity = {
+            { 1, 0, 0, 0, 1, 0, 0, 0, 1 }, { 0, 0, 0 } };
+        const oni_SensorPose & thePose = pose != NULL ? *pose : identity;
+        size_t pixels = (size_t) width * height;
+        // With the same view as last time, only rays through blocks that
+        // changed since can come out differently.
+        bool incremental = m_rayWidth == width && m_rayHeight == height &&
+            memcmp(&m_rayIntrinsics, &intrinsics, sizeof(intrinsics)) == 0 &&
+            memcmp(&m_rayPose, &thePose, sizeof(thePose)) == 0;
+        m_rayIntrinsics = intrinsics;
+        m_rayPose = thePose;
+        m_rayWidth = width;
+        m_rayHeight = height;
+        m_rayDepth.resize(pixels);
+        m_rayNormals.resize(pixels * 3);
+
+        _rigid toWorld, toCamera;
+        _makeRigid(&thePose, toWorld, toCamera);
+        if (incremental && m_dirty.empty()) {
+            copyRaycast(depth, normals);
+            return openni::STATUS_OK;
+        }
+        std::vector<uint8_t> redo;
+        if (incremental) {
+            incremental = markDirty(intrinsics, toCamera, redo);
+        }
+        int tilesX = (width + _rangeTile - 1) / _rangeTile;
+        std::vector<float> nearest, farthest;
+        rayRanges(intrinsics, toCamera, nearest, farthest);
+        for (size_t i = 0; i < m_dirty.size(); ++i) {
+            m_dirty[i]->dirty = false;
+        }
+        m_dirty.clear();
+
+        _parallelFor(height, 16, [&](int y0, int y1) {
+            for (int y = y0; y < y1; ++y) {
+                for (int x = 0; x < width; ++x) {
+                    size_t i = (size_t) y * width + x;
+                    if (!incremental || redo[i]) {
+                        size_t tile = (size_t) (y / _rangeTile) * tilesX + x / _rangeTile;
+                        castRay(intrinsics, toWorld, toCamera, x, y, nearest[tile],
+                                farthest[tile], m_rayDepth[i], &m_rayNormals[3 * i]);
+                    }
+                }
+            }
+        });
+        copyRaycast(depth, normals);
+        return openni::STATUS_OK;
+    }
+
+private:
+    void copyRaycast(oni_DepthPixel * depth, float * normals) const
+    {
+        memcpy(depth, &m_rayDepth[0], m_rayDepth.size() * sizeof(oni_DepthPixel));
+        if (normals != NULL) {
+            memcpy(normals, &m_rayNormals[0], m_rayNormals.size() * sizeof(float));
+        }
+    }
+
+    // blockOf: The block coordinate holding voxel coordinate 'v'.  The shift
+    // is arithmetic, so it rounds negative coordinates down too.
+    static int blockOf(int v)
+    {
+        return v >> _blockShift;
+    }
+
+    // allocate: Add every block within the truncation distance of a pixel's
+    // surface point, and list them all in m_visible.
+    void allocate(const oni_FrameDescriptor & desc, const _depthGeometry & g,
+                  const _rigid & toWorld)
+    {
+        int strips = _parallelism();
+        strips = strips < desc.height ? strips : desc.height;
+        std::vector<std::vector<uint64_t> > keys(strips);
+        float invVoxel = 1.0f / m_voxelSize;
+        // Samples along each ray, at most half a block apart.
+        float span = 2.0f * m_truncation;
+        int samples = (int) ceilf(span / (0.5f * _blockSide * m_voxelSize)) + 1;
+        _parallelFor(strips, 1, [&](int s0, int s1) {
+            for (int s = s0; s < s1; ++s) {
+                std::vector<uint64_t> & out = keys[s];
+                out.clear();
+                uint64_t recent[_recentBlocks];
+                memset(recent, 0, sizeof(recent));
+                int y0 = desc.height * s / strips, y1 = desc.height * (s + 1) / strips;
+                for (int y = y0; y < y1; ++y) {
+                    const uint16_t * row = _depthRow(desc, y);
+                    for (int x = 0; x < desc.width; ++x) {
+                        float z = row[x] * g.scale;
+                        if (row[x] == 0 || z < m_minDepth || z > m_maxDepth) {
+                            continue;
+                        }
+                        for (int k = 0; k < samples; ++k) {
+                            float zk = z - m_truncation + span * k / (samples - 1);
+                            float c[3] = { g.ax[x] * zk, g.ay[y] * zk, zk };
+                            float w[3];
+                            toWorld.apply(c, w);
+                            int b[3];
+                            for (int i = 0; i < 3; ++i) {
+                                b[i] = blockOf(_floor(w[i] * invVoxel + 0.5f));
+                            }
+                            uint64_t key = _blockKey(b[0], b[1], b[2]) | (1ULL << 63);
+                            uint64_t & seen = recent[_hashBlock(key) & (_recentBlocks - 1)];
+                            if (seen != key) {
+                                seen = key;
+                                out.push_back(key);
+                            }
+                        }
+                    }
+                }
+            }
+        });
+
+        ++m_frame;
+        m_visible.clear();
+        const uint64_t field = (1 << 21) - 1;
+        for (int s = 0; s < strips; ++s) {
+            for (size_t i = 0; i < keys[s].size(); ++i) {
+                uint64_t key = keys[s][i];
+                _tsdfBlock * block = m_blocks.insert(
+                    (int) ((key >> 42) & field) - _blockOffset,
+                    (int) ((key >> 21) & field) - _blockOffset,
+                    (int) (key & field) - _blockOffset);
+                if (block->frame != m_frame) {
+                    // A new block changes how rays step, even before any of
+                    // its voxels is observed.
+                    if (block->frame == 0) {
+                        block->dirty = true;
+                        m_dirty.push_back(block);
+                    }
+                    block->frame = m_frame;
+                    m_visible.push_back(block);
+                }
+            }
+        }
+    }
+
+    // projectBlock: The pixel bounding box ('box': x0, y0, x1, y1) and depth
+    // range of 'block', grown by 'margin' voxels on every side.  Returns
+    // false if it reaches the camera plane, where the box is unbounded.
+    bool projectBlock(const _tsdfBlock & block, int margin,
+                      const oni_CameraIntrinsics & intrinsics,
+                      const _rigid & toCamera, float * box, float & nearest,
+                      float & farthest) const
+    {
+        float side = (_blockSide - 1 + 2 * margin) * m_voxelSize;
+        box[0] = box[1] = nearest = 1e30f;
+        box[2] = box[3] = farthest = -1e30f;
+        for (int corner = 0; corner < 8; ++corner) {
+            float w[3] = {
+                (block.x * _blockSide - margin) * m_voxelSize + (corner & 1 ? side : 0.0f),
+                (block.y * _blockSide - margin) * m_voxelSize + (corner & 2 ? side : 0.0f),
+                (block.z * _blockSide - margin) * m_voxelSize + (corner & 4 ? side : 0.0f) };
+            float c[3];
+            toCamera.apply(w, c);
+            if (c[2] <= 1.0f) {
+                return false;
+            }
+            float u = intrinsics.cx + intrinsics.fx * c[0] / c[2];
+            float v = intrinsics.cy - intrinsics.fy * c[1] / c[2];
+            box[0] = u < box[0] ? u : box[0];
+            box[1] = v < box[1] ? v : box[1];
+            box[2] = u > box[2] ? u : box[2];
+            box[3] = v > box[3] ? v : box[3];
+            nearest = c[2] < nearest ? c[2] : nearest;
+            farthest = c[2] > farthest ? c[2] : farthest;
+        }
+        return true;
+    }
+
+    // markDirty: Flag in 'redo' the pixels that the changed blocks project
+    // onto.  Returns false if everything must be redone anyway.
+    bool markDirty(const oni_CameraIntrinsics & intrinsics,
+                   const _rigid & toCamera, std::vector<uint8_t> & redo) const
+    {
+        int width = intrinsics.width, height = intrinsics.height;
+        redo.assign((size_t) width * height, 0);
+        for (size_t b = 0; b < m_dirty.size(); ++b) {
+            // Rays read voxels up to one voxel away when interpolating.
+            float box[4], nearest, farthest;
+            if (!projectBlock(*m_dirty[b], 1, intrinsics, toCamera, box,
+                              nearest, farthest))
+            {
+                return false;
+            }
+            int x0 = (int) floorf(box[0]) - 1, x1 = (int) ceilf(box[2]) + 1;
+            int y0 = (int) floorf(box[1]) - 1, y1 = (int) ceilf(box[3]) + 1;
+            x0 = x0 < 0 ? 0 : x0;
+            y0 = y0 < 0 ? 0 : y0;
+            x1 = x1 > width - 1 ? width - 1 : x1;
+            y1 = y1 > height - 1 ? height - 1 : y1;
+            for (int y = y0; y <= y1; ++y) {
+                if (x0 <= x1) {
+                    memset(&redo[(size_t) y * width + x0], 1, x1 - x0 + 1);
+                }
+            }
+        }
+        return true;
+    }
+
+    // rayRanges: For each tile of the image, the range of depths where rays
+    // through it can meet a block at all.  Empty tiles get an empty range.
+    void rayRanges(const oni_CameraIntrinsics & intrinsics,
+                   const _rigid & toCamera, std::vector<float> & nearest,
+                   std::vector<float> & farthest) const
+    {
+        int tilesX = (intrinsics.width + _rangeTile - 1) / _rangeTile;
+        int tilesY = (intrinsics.height + _rangeTile - 1) / _rangeTile;
+        nearest.assign((size_t) tilesX * tilesY, 1e30f);
+        farthest.assign((size_t) tilesX * tilesY, 0.0f);
+        for (size_t b = 0; b < m_blocks.size(); ++b) {
+            float box[4], zNear, zFar;
+            int x0 = 0, y0 = 0, x1 = tilesX - 1, y1 = tilesY - 1;
+            // Interpolation reads one voxel beyond the block.
+            if (projectBlock(m_blocks.at(b), 1, intrinsics, toCamera, box,
+                             zNear, zFar))
+            {
+                if (box[2] < -1.0f || box[3] < -1.0f ||
+                    box[0] > intrinsics.width || box[1] > intrinsics.height)
+                {
+                    continue;
+                }
+                x0 = (int) floorf(box[0] - 1.0f) / _rangeTile;
+                y0 = (int) floorf(box[1] - 1.0f) / _rangeTile;
+                x1 = (int) ceilf(box[2] + 1.0f) / _rangeTile;
+                y1 = (int) ceilf(box[3] + 1.0f) / _rangeTile;
+                x0 = x0 < 0 ? 0 : x0;
+                y0 = y0 < 0 ? 0 : y0;
+                x1 = x1 > tilesX - 1 ? tilesX - 1 : x1;
+                y1 = y1 > tilesY - 1 ? tilesY - 1 : y1;
+            } else {
+                // Reaches the camera plane: it may be anywhere in view.
+                zNear = 0.0f;
+                if (zFar < 0.0f) {
+                    continue;
+                }
+            }
+            for (int y = y0; y <= y1; ++y) {
+                for (int x = x0; x <= x1; ++x) {
+                    size_t i = (size_t) y * tilesX + x;
+                    nearest[i] = zNear < nearest[i] ? zNear : nearest[i];
+                    farthest[i] = zFar > farthest[i] ? zFar : farthest[i];
+                }
+            }
+        }
+    }
+
+    // voxel: The TSDF at voxel coordinate (x, y, z); false if unobserved.
+    // 'cache' remembers the last block looked up.
+    bool voxel(int x, int y, int z, const _tsdfBlock *& cache, float & value) const
+    {
+        int bx = blockOf(x), by = blockOf(y), bz = blockOf(z);
+        if (cache == NULL || cache->x != bx || cache->y != by || cache->z != bz) {
+            cache = m_blocks.find(_blockKey(bx, by, bz));
+            if (cache == NULL) {
+                return false;
+            }
+        }
+        int i = ((z - bz * _blockSide) * _blockSide + (y - by * _blockSide)) *
+            _blockSide + (x - bx * _blockSide);
+        value = cache->voxels[i].tsdf * (1.0f / _tsdfScale);
+        return cache->voxels[i].weight > 0;
+    }
+
+    // sample: Trilinear TSDF at world point 'w', and its gradient (per voxel)
+    // unless 'gradient' is NULL; false if any of the eight voxels around it
+    // is unobserved.
+    bool sample(const float * w, const _tsdfBlock *& cache, float & value,
+                float * gradient = NULL) const
+    {
+        float invVoxel = 1.0f / m_voxelSize;
+        float u[3];
+        int v[3];
+        for (int i = 0; i < 3; ++i) {
+            float f = w[i] * invVoxel;
+            v[i] = _floor(f);
+            u[i] = f - v[i];
+        }
+        float corners[8];
+        int bx = blockOf(v[0]), by = blockOf(v[1]), bz = blockOf(v[2]);
+        int lx = v[0] - bx * _blockSide, ly = v[1] - by * _blockSide,
+            lz = v[2] - bz * _blockSide;
+        if (lx < _blockSide - 1 && ly < _blockSide - 1 && lz < _blockSide - 1) {
+            // All eight in one block, which is the usual case.
+            if (cache == NULL || cache->x != bx || cache->y != by || cache->z != bz) {
+                cache = m_blocks.find(_blockKey(bx, by, bz));
+                if (cache == NULL) {
+                    return false;
+                }
+            }
+            int base = (lz * _blockSide + ly) * _blockSide + lx;
+            for (int c = 0; c < 8; ++c) {
+                int i = base + (c & 1) + (c >> 1 & 1) * _blockSide +
+                    (c >> 2 & 1) * _blockSide * _blockSide;
+                if (cache->voxels[i].weight == 0) {
+                    return false;
+                }
+                corners[c] = cache->voxels[i].tsdf * (1.0f / _tsdfScale);
+            }
+        } else {
+            for (int c = 0; c < 8; ++c) {
+                if (!voxel(v[0] + (c & 1), v[1] + (c >> 1 & 1), v[2] + (c >> 2 & 1),
+                           cache, corners[c]))
+                {
+                    return false;
+                }
+            }
+        }
+        float x00 = corners[0] + (corners[1] - corners[0]) * u[0];
+        float x10 = corners[2] + (corners[3] - corners[2]) * u[0];
+        float x01 = corners[4] + (corners[5] - corners[4]) * u[0];
+        float x11 = corners[6] + (corners[7] - corners[6]) * u[0];
+        float y0 = x00 + (x10 - x00) * u[1];
+        float y1 = x01 + (x11 - x01) * u[1];
+        value = y0 + (y1 - y0) * u[2];
+        if (gradient != NULL) {
+            float dx0 = (corners[1] - corners[0]) +
+                ((corners[3] - corners[2]) - (corners[1] - corners[0])) * u[1];
+            float dx1 = (corners[5] - corners[4]) +
+                ((corners[7] - corners[6]) - (corners[5] - corners[4])) * u[1];
+            gradient[0] = dx0 + (dx1 - dx0) * u[2];
+            gradient[1] = (x10 - x00) + ((x11 - x01) - (x10 - x00)) * u[2];
+            gradient[2] = y1 - y0;
+        }
+        return true;
+    }
+
+    // castRay: March through pixel (x, y) over the depths from 'nearest' to
+    // 'farthest' (within the depth range), and stop at the first crossing
+    // from outside (positive) to inside.  Misses give depth 0 and NaN
+    // normals.
+    void castRay(const oni_CameraIntrinsics & intrinsics, const _rigid & toWorld,
+                 const _rigid & toCamera, int x, int y, float nearest,
+                 float farthest, oni_DepthPixel & depth, float * normal) const
+    {
+        depth = 0;
+        normal[0] = normal[1] = normal[2] = NAN;
+        // Direction per unit of camera depth.
+        float ray[3] = { (x - intrinsics.cx) / intrinsics.fx,
+                         (intrinsics.cy - y) / intrinsics.fy, 1.0f };
+        float dir[3];
+        toWorld.rotate(ray, dir);
+        float invLength = 1.0f / sqrtf(ray[0] * ray[0] + ray[1] * ray[1] + 1.0f);
+        const float * origin = toWorld.t;
+        const _tsdfBlock * cache = NULL;
+        float blockStep = 0.5f * _blockSide * m_voxelSize * invLength;
+        float invVoxel = 1.0f / m_voxelSize;
+        float t = nearest > m_minDepth ? nearest : m_minDepth;
+        float end = farthest < m_maxDepth ? farthest : m_maxDepth;
+        float previousT = t, previous = 0.0f;
+        bool havePrevious = false;
+        while (t <= end) {
+            float w[3] = { origin[0] + dir[0] * t, origin[1] + dir[1] * t,
+                           origin[2] + dir[2] * t };
+            int b[3];
+            for (int i = 0; i < 3; ++i) {
+                b[i] = blockOf(_floor(w[i] * invVoxel));
+            }
+            if (cache == NULL || cache->x != b[0] || cache->y != b[1] ||
+                cache->z != b[2])
+            {
+                const _tsdfBlock * block = m_blocks.find(_blockKey(b[0], b[1], b[2]));
+                if (block == NULL) {
+                    havePrevious = false;
+                    t += blockStep;
+                    continue;
+                }
+                cache = block;
+            }
+            float f;
+            if (!sample(w, cache, f)) {
+                havePrevious = false;
+                t += m_voxelSize * invLength;
+                continue;
+            }
+            if (f < 0.0f) {
+                if (havePrevious) {
+                    float hit = previousT + (t - previousT) * previous / (previous - f);
+                    finishHit(hit, dir, origin, toCamera, cache, depth, normal);
+                }
+                // Starting inside a surface (or behind one) gives nothing.
+                return;
+            }
+            havePrevious = true;
+            previousT = t;
+            previous = f;
+            // The TSDF bounds the distance to the surface; step most of it.
+            float step = 0.8f * f * m_truncation;
+            t += (step > m_voxelSize ? step : m_voxelSize) * invLength;
+        }
+    }
+
+    void finishHit(float t, const float * dir, const float * origin,
+                   const _rigid & toCamera, const _tsdfBlock *& cache,
+                   oni_DepthPixel & depth, float * normal) const
+    {
+        float w[3] = { origin[0] + dir[0] * t, origin[1] + dir[1] * t,
+                       origin[2] + dir[2] * t };
+        depth = (oni_DepthPixel) (t < 65535.0f ? lrintf(t) : 0);
+        float gradient[3], value;
+        if (!sample(w, cache, value, gradient)) {
+            return;
+        }
+        float n[3];
+        toCamera.rotate(gradient, n);
+        float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (!(length > 0.0f)) {
+            return;
+        }
+        for (int i = 0; i < 3; ++i) {
+            normal[i] = n[i] / length;
+        }
+    }
+
+    const float m_voxelSize;
+    const float m_truncation;
+    float m_minDepth;
+    float m_maxDepth;
+    float m_maxWeight;
+    _blockTable m_blocks;
+    unsigned m_frame;
+    // Blocks seen by the last frame, and blocks changed since the last
+    // raycast.
+    std::vector<_tsdfBlock *> m_visible;
+    std::vector<_tsdfBlock *> m_dirty;
+    // The last raycast, kept for the next incremental one.
+    oni_CameraIntrinsics m_rayIntrinsics;
+    oni_SensorPose m_rayPose;
+    int m_rayWidth;
+    int m_rayHeight;
+    std::vector<oni_DepthPixel> m_rayDepth;
+    std::vector<float> m_rayNormals;
+};
+
+// ==============
+// oni_TsdfVolume
+// ==============
+oni_TsdfVolume * oni_new_TsdfVolume(float voxelSize, float truncation) {
+    if (voxelSize <= 0.0f || truncation < voxelSize) {
+        return NULL;
+    }
+    EXC_CHECK( return new openni2_tsdf_volume(voxelSize, truncation); );
+    return NULL;
+}
+
+void oni_delete_TsdfVolume(oni_TsdfVolume * volume) {
+    EXC_CHECK( delete volume; );
+}
+
+void oni_setDepthRange_TsdfVolume(oni_TsdfVolume * volume, float minDepth,
+                                  float maxDepth) {
+    EXC_CHECK( volume->setDepthRange(minDepth, maxDepth); );
+}
+
+void oni_setMaxWeight_TsdfVolume(oni_TsdfVolume * volume, int weight) {
+    EXC_CHECK( volume->setMaxWeight(weight); );
+}
+
+void oni_reset_TsdfVolume(oni_TsdfVolume * volume) {
+    EXC_CHECK( volume->reset(); );
+}
+
+int oni_getBlockCount_TsdfVolume(oni_TsdfVolume * volume) {
+    EXC_CHECK( return volume->blockCount(); );
+    return -1;
+}
+
+oni_Status oni_integrate_TsdfVolume(oni_TsdfVolume * volume,
+                                    oni_VideoFrameRef * frame,
+                                    const oni_CameraIntrinsics * intrinsics,
+                                    const oni_SensorPose * pose) {
+    EXC_CHECK({
+        oni_FrameDescriptor desc;
+        oni_Status rc = oni_getFrameDescriptor(frame, &desc);
+        if (rc != openni::STATUS_OK) {
+            return rc;
+        }
+        return volume->integrate(desc, *intrinsics, pose);
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_integrateDescriptor_TsdfVolume(oni_TsdfVolume * volume,
+                                              const oni_FrameDescriptor * desc,
+                                              const oni_CameraIntrinsics * intrinsics,
+                                              const oni_SensorPose * pose) {
+    EXC_CHECK( return volume->integrate(*desc, *intrinsics, pose); );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_raycast_TsdfVolume(oni_TsdfVolume * volume,
+                                  const oni_CameraIntrinsics * intrinsics,
+                                  const oni_SensorPose * pose,
+                                  oni_DepthPixel * depth, float * normals) {
+    EXC_CHECK( return volume->raycast(*intrinsics, pose, depth, normals); );
+    return openni::STATUS_ERROR;
+}
@@ -64,6 +64,403 @@ typedef struct {
     oni_NewFrameListener_cxx * _obj;
 } oni_NewFrameListener;
 
+// ============================================================================
+// Batched property access  ->  oni_PropertyRequest
+// ============================================================================
+// One entry of a batch passed to oni_getProperties_* or oni_setProperties_*.
+// 'dataSize' is the size of 'data' in bytes; batched gets overwrite it with the
+// size of the property, just as oni_getProperty_* does.  'status' receives the
+// result for this entry alone.
+typedef struct {
+    int propertyId;
+    void * data;
+    int dataSize;
+    oni_Status status;
+} oni_PropertyRequest;
+
+// ============================================================================
+// openni::VideoMode (by value)  ->  oni_VideoModeInfo
+// ============================================================================
+// A plain copy of a video mode, plus the sensor it belongs to, that needs no
+// further calls into the wrapper to read.
+typedef struct {
+    oni_SensorType sensorType;
+    oni_PixelFormat pixelFormat;
+    int resolutionX;
+    int resolutionY;
+    int fps;
+} oni_VideoModeInfo;
+
+// ============================================================================
+// Capability snapshot  ->  oni_Capabilities
+// ============================================================================
+// Everything oni_getCapabilities learns about a device.  'modes' holds the
+// supported modes of every sensor, grouped by sensor; it belongs to the
+// structure and is freed by oni_release_Capabilities.
+typedef struct {
+    uint16_t usbVendorId;
+    uint16_t usbProductId;
+    char firmwareVersion[256];
+    int modeCount;
+    oni_VideoModeInfo * modes;
+} oni_Capabilities;
+
+// ============================================================================
+// Video mode selection  ->  oni_VideoModeConstraints
+// ============================================================================
+// Any field left at 0 (or NULL) does not constrain the choice.  Modes below a
+// minimum, or with a pixel format not in 'pixelFormats', are never chosen.  Of
+// the rest, the winner is the one with the most preferred pixel format (the
+// earliest in 'pixelFormats'), then the resolution closest to 'resolutionX' by
+// 'resolutionY', then the frame rate closest to 'fps'.
+typedef struct {
+    int resolutionX;
+    int resolutionY;
+    int fps;
+    int minResolutionX;
+    int minResolutionY;
+    int minFps;
+    const oni_PixelFormat * pixelFormats;
+    int pixelFormatCount;
+} oni_VideoModeConstraints;
+
+// ============================================================================
+// openni::VideoFrameRef (by value)  ->  oni_FrameDescriptor
+// ============================================================================
+// Everything about a frame in one structure, so that reading it takes a single
+// call.  'data' points into the frame and is only valid while the frame is.
+typedef struct {
+    const void * data;
+    int dataSize;
+    int width;
+    int height;
+    int strideInBytes;
+    oni_SensorType sensorType;
+    oni_PixelFormat pixelFormat;
+    int frameIndex;
+    uint64_t timestamp;
+    bool croppingEnabled;
+    int cropOriginX;
+    int cropOriginY;
+} oni_FrameDescriptor;
+
+// ============================================================================
+// Shared-memory frames  ->  oni_SharedFrame, oni_SharedStreamInfo
+// ============================================================================
+// A frame as seen by an oni_FrameSubscriber.  'desc.data' points straight into
+// the shared ring; the publisher may overwrite it at any time, so check it
+// with oni_isValid_SharedFrame after using the data.  'sequence' counts frames
+// from the start of publishing, and 'dropped' counts frames this subscriber
+// missed (in total) because it fell behind by more than the ring holds.
+typedef struct {
+    oni_FrameDescriptor desc;
+    uint64_t sequence;
+    uint64_t dropped;
+    int _slot;
+    uint32_t _slotVersion;
+} oni_SharedFrame;
+
+typedef struct {
+    oni_SensorType sensorType;
+    float horizontalFieldOfView;
+    float verticalFieldOfView;
+    int minPixelValue;
+    int maxPixelValue;
+    bool mirroringEnabled;
+} oni_SharedStreamInfo;
+
+// ============================================================================
+// Processing pipelines  ->  oni_BackpressurePolicy, oni_PipelineStageFn,
+// oni_PipelineStageStats, oni_PipelineEdgeStats
+// ============================================================================
+// What an edge does when its queue is full and another item arrives:
+// BLOCK makes the producer wait for room, DROP_OLDEST discards the oldest
+// queued item, and KEEP_LATEST discards everything queued so that the consumer
+// only ever sees the newest item.
+typedef int oni_BackpressurePolicy;
+extern const int oni_BACKPRESSURE_BLOCK;
+extern const int oni_BACKPRESSURE_DROP_OLDEST;
+extern const int oni_BACKPRESSURE_KEEP_LATEST;
+
+// oni_PipelineStageFn: The work of one stage.  It may read or replace the
+// item's payload; returning false drops the item instead of passing it on.
+// A stage is never run on two threads at once.
+typedef bool (*oni_PipelineStageFn) (void * userData, oni_PipelineItem * item);
+
+// Times are in nanoseconds.
+typedef struct {
+    uint64_t itemsProcessed;
+    uint64_t itemsDiscarded;
+    uint64_t totalTimeNs;
+    uint64_t maxTimeNs;
+} oni_PipelineStageStats;
+
+typedef struct {
+    int occupancy;
+    int capacity;
+    int highWater;
+    uint64_t itemsPushed;
+    uint64_t itemsDropped;
+} oni_PipelineEdgeStats;
+
+// ============================================================================
+// Caller-provided storage  ->  oni_VideoFrameRefStorage
+// ============================================================================
+// Room for one oni_VideoFrameRef, for oni_initVideoFrameRef.  It is at least
+// oni_VIDEOFRAMEREF_SIZE bytes and aligned to at least
+// oni_VIDEOFRAMEREF_ALIGNMENT, so it may live on the stack or inside another
+// structure.
+typedef struct {
+    uint64_t _words[4];
+} oni_VideoFrameRefStorage;
+extern const int oni_VIDEOFRAMEREF_SIZE;
+extern const int oni_VIDEOFRAMEREF_ALIGNMENT;
+
+// ============================================================================
+// Frame change detection  ->  oni_ChangeResult
+// ============================================================================
+// The frame is divided into tiles of tileSize x tileSize pixels (the last
+// column and row may be smaller).  Bit (ty * tilesX + tx) of 'bitmap' (least
+// significant bit first within each byte) is set if tile (tx, ty) changed.
+// 'score' is the fraction of all pixels that changed, from 0 to 1.  'bitmap'
+// belongs to the detector and is overwritten by its next update.
+typedef struct {
+    int tilesX;
+    int tilesY;
+    int changedTiles;
+    uint64_t changedPixels;
+    float score;
+    const uint8_t * bitmap;
+    int bitmapSize;
+} oni_ChangeResult;
+
+// ============================================================================
+// Frame statistics  ->  oni_FrameStats
+// ============================================================================
+// The first six fields are set by the caller and may all be left zero.  If
+// 'histogram' is not NULL, it receives counts of valid pixels in
+// 'histogramBins' bins of equal width covering [histogramMin, histogramMax];
+// pixels outside that range are not counted.  If 'validMask' is not NULL, it
+// receives one bit per pixel, set if the pixel is valid, with bit
+// (y * width + x) least significant first within each byte; 'validMaskSize'
+// must be at least (width * height + 7) / 8.  In depth frames, zero pixels
+// are invalid; in other frames, every pixel is valid.  'minValue', 'maxValue'
+// and 'mean' cover only valid pixels, and are 0 if there are none.
+typedef struct {
+    uint32_t * histogram;
+    int histogramBins;
+    int histogramMin;
+    int histogramMax;
+    uint8_t * validMask;
+    int validMaskSize;
+    int width;
+    int height;
+    int validCount;
+    int minValue;
+    int maxValue;
+    double mean;
+} oni_FrameStats;
+
+// ============================================================================
+// Camera intrinsics  ->  oni_CameraIntrinsics
+// ============================================================================
+// A pinhole model for a width x height image, in pixels.  A depth pixel (x, y)
+// with depth z (in mm) is the point ((x - cx) * z / fx, (cy - y) * z / fy, z)
+// in mm, the same coordinates that openni::CoordinateConverter gives: X to
+// the right, Y up and Z away from the camera.
+typedef struct {
+    int width;
+    int height;
+    float fx;
+    float fy;
+    float cx;
+    float cy;
+} oni_CameraIntrinsics;
+
+// ============================================================================
+// Point clouds  ->  oni_PointXYZRGB
+// ============================================================================
+// One point in the coordinates of oni_CameraIntrinsics (mm), with its color.
+// 'a' is always 255; it pads the point to 16 bytes.
+typedef struct {
+    float x;
+    float y;
+    float z;
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+    uint8_t a;
+} oni_PointXYZRGB;
+
+// ============================================================================
+// Plane detection  ->  oni_Plane
+// ============================================================================
+// A plane n . p + d = 0 in the coordinates of oni_CameraIntrinsics (mm).
+// The normal (nx, ny, nz) has unit length and faces the camera, so 'd' is
+// the plane's distance from it.  'inliers' counts the pixels labeled with
+// the plane, and the centroid is the mean of its points.
+typedef struct {
+    float nx;
+    float ny;
+    float nz;
+    float d;
+    float centroidX;
+    float centroidY;
+    float centroidZ;
+    int inliers;
+} oni_Plane;
+
+// ============================================================================
+// Sensor poses  ->  oni_SensorPose
+// ============================================================================
+// Where a camera sits in some world frame: a point p in the coordinates of
+// oni_CameraIntrinsics maps to rotation * p + translation, with 'rotation'
+// row-major and everything in mm.
+typedef struct {
+    float rotation[9];
+    float translation[3];
+} oni_SensorPose;
+
+// ============================================================================
+// Visual odometry  ->  oni_OdometryStats
+// ============================================================================
+// How well the last frame given to an oni_Odometry lined up with the one
+// before it.  'tracked' is 0 if too few pixels matched or the alignment was
+// degenerate, in which case the pose did not move.  'inliers' counts the
+// matched pixels at the finest level and 'rmsError' is their RMS
+// point-to-plane distance in mm; 'iterations' is summed over all levels.
+typedef struct {
+    int tracked;
+    int inliers;
+    int iterations;
+    float rmsError;
+} oni_OdometryStats;
+
+// ============================================================================
+// Blob tracking  ->  oni_Blob
+// ============================================================================
+// One connected region of foreground pixels in a depth frame.  'id' stays
+// the same from frame to frame while the blob is tracked, and 'age' counts
+// the frames it has been seen in so far (1 for a new blob).  The pixel
+// bounding box is inclusive; 'center', 'boundsMin' and 'boundsMax' are the
+// centroid and bounding box of its points in the coordinates of
+// oni_CameraIntrinsics (mm).
+typedef struct {
+    int id;
+    int age;
+    int pixels;
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+    float centroidX;
+    float centroidY;
+    float center[3];
+    float boundsMin[3];
+    float boundsMax[3];
+} oni_Blob;
+
+// ============================================================================
+// JPEG decoding  ->  oni_DecodedFrame
+// ============================================================================
+// A frame from an oni_JpegDecoder.  'desc' is the source frame's descriptor
+// with the size, stride, pixel format and data of the decoded image; 'data'
+// is NULL if 'status' says decoding failed.  'sequence' is the number
+// oni_submit_JpegDecoder returned for the frame.
+typedef struct {
+    oni_FrameDescriptor desc;
+    uint64_t sequence;
+    oni_Status status;
+    int _buffer;
+} oni_DecodedFrame;
+
+// ============================================================================
+// Frame export  ->  oni_CloudFormat, oni_ExportStats
+// ============================================================================
+// Point clouds are written as binary (little-endian) PLY or PCD files.
+typedef int oni_CloudFormat;
+extern const int oni_CLOUD_PLY;
+extern const int oni_CLOUD_PCD;
+
+// Counts since the exporter was created.  'rejected' files were refused
+// because the memory budget was used up; 'failed' ones could not be encoded
+// or written.  'pending' files are submitted but not yet written, and hold
+// 'queuedBytes' of the budget.  Latency runs from submission until the file
+// is written (not synced), over all files written or failed.
+typedef struct {
+    uint64_t submitted;
+    uint64_t rejected;
+    uint64_t written;
+    uint64_t failed;
+    int pending;
+    uint64_t queuedBytes;
+    uint64_t bytesWritten;
+    uint64_t syncs;
+    uint64_t totalLatencyNs;
+    uint64_t maxLatencyNs;
+} oni_ExportStats;
+
+// ============================================================================
+// Frame history  ->  oni_HistoryStats
+// ============================================================================
+// 'frames' are in the history now, 'hotFrames' of them still as frames
+// rather than packed, and the packed ones take 'spillBytes'.  'pushed' and
+// 'evicted' count frames since the history was created.
+typedef struct {
+    int frames;
+    int hotFrames;
+    uint64_t spillBytes;
+    uint64_t pushed;
+    uint64_t evicted;
+} oni_HistoryStats;
+
+// ============================================================================
+// Clock alignment  ->  oni_ClockStats
+// ============================================================================
+// 'samples' counts every sample; 'buckets' counts those in the current fit,
+// 'rejected' the buckets left out as outliers, and 'resets' the times the fit
+// started over (the device clock went backwards, or jumped).  The fit is
+// 'locked' once it has enough buckets and the latest one agreed with it.
+// 'skewPpm' is how much faster the device clock runs than the host's, and
+// 'jitterUs' the RMS distance of recent buckets from the fit.
+typedef struct {
+    uint64_t samples;
+    int buckets;
+    int rejected;
+    int resets;
+    bool locked;
+    float skewPpm;
+    float jitterUs;
+} oni_ClockStats;
+
+// ============================================================================
+// Resilient devices  ->  oni_RecoveryStats
+// ============================================================================
+// 'disconnects' counts the times the device went away and 'reconnects' the
+// times it was brought back; 'failedAttempts' counts tries to reopen it that
+// failed, the last with 'lastError'.  'droppedSettings' counts settings made
+// while the device was away that it refused when they were replayed; they
+// are forgotten, and 'lastError' holds why.  For the last reconnect:
+// 'replayCalls' is how many OpenNI calls restoring it took (the open
+// included) and 'lastReplayUs' how long they took.  Times to recover, in
+// microseconds, are counted from the disconnect: to the configuration being
+// restored ('lastRecoverUs', 'maxRecoverUs') and to the first frame delivered
+// after that ('lastFirstFrameUs', 'maxFirstFrameUs').
+typedef struct {
+    bool connected;
+    int disconnects;
+    int reconnects;
+    int failedAttempts;
+    int droppedSettings;
+    oni_Status lastError;
+    int replayCalls;
+    uint64_t lastReplayUs;
+    uint64_t lastRecoverUs;
+    uint64_t maxRecoverUs;
+    uint64_t lastFirstFrameUs;
+    uint64_t maxFirstFrameUs;
+} oni_RecoveryStats;
+
 // ================================
 // openni::Version  ->  oni_Version
 // ================================
@@ -36,6 +36,28 @@ typedef struct oni_DeviceStateChangedListener_cxx
     oni_DeviceStateChangedListener_cxx;
 typedef struct oni_NewFrameListener_cxx
     oni_NewFrameListener_cxx;
+// These are the wrapper's own classes, and have no OpenNI counterpart.
+typedef struct oni_FramePublisher oni_FramePublisher;
+typedef struct oni_FrameSubscriber oni_FrameSubscriber;
+typedef struct oni_FrameEvent oni_FrameEvent;
+typedef struct oni_Pipeline oni_Pipeline;
+typedef struct oni_PipelineItem oni_PipelineItem;
+typedef struct oni_Arena oni_Arena;
+typedef struct oni_ChangeDetector oni_ChangeDetector;
+typedef struct oni_DepthFilter oni_DepthFilter;
+typedef struct oni_DepthPyramid oni_DepthPyramid;
+typedef struct oni_PointCloud oni_PointCloud;
+typedef struct oni_PlaneDetector oni_PlaneDetector;
+typedef struct oni_OccupancyGrid oni_OccupancyGrid;
+typedef struct oni_TsdfVolume oni_TsdfVolume;
+typedef struct oni_Odometry oni_Odometry;
+typedef struct oni_BlobTracker oni_BlobTracker;
+typedef struct oni_ToneMapper oni_ToneMapper;
+typedef struct oni_JpegDecoder oni_JpegDecoder;
+typedef struct oni_FrameExporter oni_FrameExporter;
+typedef struct oni_FrameHistory oni_FrameHistory;
+typedef struct oni_ClockAligner oni_ClockAligner;
+typedef struct oni_ResilientDevice oni_ResilientDevice;
 
 // ========================================
 // openni::DeviceState  ->  oni_DeviceState
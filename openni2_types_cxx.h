@@ -40,6 +40,52 @@ typedef openni::OpenNI::DeviceStateChangedListener
 typedef openni::VideoStream::NewFrameListener
     oni_NewFrameListener_cxx;
 
+// ==================================================================
+// Typedefs for the wrapper's own classes (also opaque pointers in C)
+// ==================================================================
+class openni2_frame_publisher;
+class openni2_frame_subscriber;
+class openni2_frame_event;
+class openni2_pipeline;
+class openni2_pipeline_item;
+class openni2_arena;
+class openni2_change_detector;
+class openni2_depth_filter;
+class openni2_depth_pyramid;
+class openni2_point_cloud;
+class openni2_plane_detector;
+class openni2_occupancy_grid;
+class openni2_tsdf_volume;
+class openni2_odometry;
+class openni2_blob_tracker;
+class openni2_tone_mapper;
+class openni2_jpeg_decoder;
+class openni2_frame_exporter;
+class openni2_frame_history;
+class openni2_clock_aligner;
+class openni2_resilient_device;
+typedef openni2_frame_publisher oni_FramePublisher;
+typedef openni2_frame_subscriber oni_FrameSubscriber;
+typedef openni2_frame_event oni_FrameEvent;
+typedef openni2_pipeline oni_Pipeline;
+typedef openni2_pipeline_item oni_PipelineItem;
+typedef openni2_arena oni_Arena;
+typedef openni2_change_detector oni_ChangeDetector;
+typedef openni2_depth_filter oni_DepthFilter;
+typedef openni2_depth_pyramid oni_DepthPyramid;
+typedef openni2_point_cloud oni_PointCloud;
+typedef openni2_plane_detector oni_PlaneDetector;
+typedef openni2_occupancy_grid oni_OccupancyGrid;
+typedef openni2_tsdf_volume oni_TsdfVolume;
+typedef openni2_odometry oni_Odometry;
+typedef openni2_blob_tracker oni_BlobTracker;
+typedef openni2_tone_mapper oni_ToneMapper;
+typedef openni2_jpeg_decoder oni_JpegDecoder;
+typedef openni2_frame_exporter oni_FrameExporter;
+typedef openni2_frame_history oni_FrameHistory;
+typedef openni2_clock_aligner oni_ClockAligner;
+typedef openni2_resilient_device oni_ResilientDevice;
+
 // ==================
 // Typedefs for enums
 // ==================
@@ -1,4 +1,5 @@
 typedef unsigned char           uint8_t;
 typedef unsigned short int      uint16_t;
+typedef unsigned int            uint32_t;
 typedef signed char             bool;
 typedef unsigned long int       uint64_t;
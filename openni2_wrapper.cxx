@@ -4,23 +4,17 @@
 // ============================================================================
 
 #include <OpenNI.h>
+#include <math.h>
+#include <string.h>
 #include <iostream>
+#include <new>
 
 #include "openni2_types_cxx.h"
 #include "openni2_types.h"
 #include "openni2_wrapper.h"
 #include "openni2_listener_wrapper.h"
-
-// EXC_CHECK(block): Wrap the block or statement in an exception check, e.g.
-//     EXC_CHECK( delete ptr; )
-// This being a C wrapper, none of the functions may throw exceptions, so it is
-// wise to use this anyplace an exception could conceivably occur.
-#define EXC_CHECK(block) \
-    try { \
-        block \
-    } catch (std::exception & e) { \
-        std::cout << "Error: " << e.what() << std::endl; \
-    }
+#include "openni2_property_cache.h"
+#include "openni2_internal.h"
 
 // ==========================
 // Static constants for enums
@@ -69,9 +63,99 @@ void _convertDeviceInfo(const openni::DeviceInfo & devInfo,
     out->vendor = devInfo.getVendor();
 }
 
+void _convertVideoMode(const openni::VideoMode & mode,
+                       openni::SensorType sensorType, oni_VideoModeInfo * out)
+{
+    out->sensorType = sensorType;
+    out->pixelFormat = mode.getPixelFormat();
+    out->resolutionX = mode.getResolutionX();
+    out->resolutionY = mode.getResolutionY();
+    out->fps = mode.getFps();
+}
+
+// Property cache and asynchronous set queue shared by all devices and streams.
+static openni2_property_cache _propertyCache;
+static openni2_property_queue _propertyQueue(&_propertyCache);
+
+// Properties that are cached by default once caching is enabled.  All of them
+// only change when the application itself changes them.
+static const int _devicePropertyCacheDefaults[] = {
+    openni::DEVICE_PROPERTY_FIRMWARE_VERSION,
+    openni::DEVICE_PROPERTY_DRIVER_VERSION,
+    openni::DEVICE_PROPERTY_HARDWARE_VERSION,
+    openni::DEVICE_PROPERTY_SERIAL_NUMBER,
+};
+static const int _streamPropertyCacheDefaults[] = {
+    openni::STREAM_PROPERTY_CROPPING,
+    openni::STREAM_PROPERTY_HORIZONTAL_FOV,
+    openni::STREAM_PROPERTY_VERTICAL_FOV,
+    openni::STREAM_PROPERTY_VIDEO_MODE,
+    openni::STREAM_PROPERTY_MAX_VALUE,
+    openni::STREAM_PROPERTY_MIN_VALUE,
+    openni::STREAM_PROPERTY_STRIDE,
+    openni::STREAM_PROPERTY_MIRRORING,
+};
+
+// _getPropertyCached: getProperty on an openni::Device or openni::VideoStream,
+// answered from the property cache where possible.
+template <class T>
+oni_Status _getPropertyCached(T * owner, int propertyId, void * data,
+                              int * dataSize)
+{
+    oni_Status rc = openni::STATUS_ERROR;
+    unsigned generation;
+    if (_propertyCache.lookup(owner, propertyId, data, dataSize, &rc,
+                              &generation))
+    {
+        return rc;
+    }
+    rc = owner->getProperty(propertyId, data, dataSize);
+    if (rc == openni::STATUS_OK) {
+        _propertyCache.store(owner, propertyId, data, *dataSize, generation);
+    }
+    return rc;
+}
+
+// _getProperties, _setProperties: Common code for the oni_getProperties_* and
+// oni_setProperties_* functions.
+template <class T>
+oni_Status _getProperties(T * owner, oni_PropertyRequest * requests, int count)
+{
+    oni_Status rc = openni::STATUS_OK;
+    for (int i = 0; i < count; ++i) {
+        oni_PropertyRequest & req = requests[i];
+        req.status = _getPropertyCached(owner, req.propertyId, req.data,
+                                        &req.dataSize);
+        if (req.status != openni::STATUS_OK && rc == openni::STATUS_OK) {
+            rc = req.status;
+        }
+    }
+    return rc;
+}
+
+template <class T>
+oni_Status _setProperties(T * owner, oni_PropertyRequest * requests, int count)
+{
+    oni_Status rc = openni::STATUS_OK;
+    for (int i = 0; i < count; ++i) {
+        oni_PropertyRequest & req = requests[i];
+        req.status = owner->setProperty(req.propertyId, req.data, req.dataSize);
+        if (req.status != openni::STATUS_OK && rc == openni::STATUS_OK) {
+            rc = req.status;
+        }
+    }
+    _propertyCache.invalidate(owner);
+    return rc;
+}
+
 // =========================
 // openni::Array<DeviceInfo>
 // =========================
+oni_DeviceInfoArray * oni_new_DeviceInfoArray() {
+    EXC_CHECK( return new openni::Array<openni::DeviceInfo>(); );
+    return NULL;
+}
+
 void oni_delete_DeviceInfoArray(oni_DeviceInfoArray * array) {
     EXC_CHECK( delete array; );
 }
@@ -197,11 +281,19 @@ oni_Device * oni_new_Device() {
 }
 
 void oni_delete_Device(oni_Device * device) {
-    EXC_CHECK( delete device; );
+    EXC_CHECK({
+        _propertyQueue.cancel(device);
+        _propertyCache.forget(device);
+        delete device;
+    });
 }
 
 void oni_close(oni_Device * device) {
-    EXC_CHECK( device->close(); );
+    EXC_CHECK({
+        _propertyQueue.cancel(device);
+        _propertyCache.invalidate(device);
+        device->close();
+    });
 }
 
 oni_DeviceInfo oni_getDeviceInfo(oni_Device * device) {
@@ -232,7 +324,7 @@ oni_PlaybackControl * oni_getPlaybackControl(oni_Device * device) {
 
 oni_Status oni_getProperty_Device(oni_Device * device, int propertyId,
                                   void * data, int * dataSize) {
-    EXC_CHECK( return device->getProperty(propertyId, data, dataSize); )
+    EXC_CHECK( return _getPropertyCached(device, propertyId, data, dataSize); )
     return openni::STATUS_ERROR;
 }
 
@@ -283,18 +375,74 @@ oni_Status oni_open(oni_Device * device, const char * uri) {
 }
 
 oni_Status oni_setDepthColorSyncEnabled(oni_Device * device, bool isEnabled) {
-    EXC_CHECK( return device->setDepthColorSyncEnabled(isEnabled); );
+    EXC_CHECK({
+        oni_Status rc = device->setDepthColorSyncEnabled(isEnabled);
+        _propertyCache.invalidate(device);
+        return rc;
+    });
     return openni::STATUS_ERROR;
 }
 
 oni_Status oni_setImageRegistrationMode(oni_Device * device, oni_ImageRegistrationMode mode) {
-    EXC_CHECK( return device->setImageRegistrationMode(mode); );
+    EXC_CHECK({
+        oni_Status rc = device->setImageRegistrationMode(mode);
+        _propertyCache.invalidate(device);
+        return rc;
+    });
     return openni::STATUS_ERROR;
 }
 
 oni_Status oni_setProperty_Device(oni_Device * device, int propId,
                                   const void * data, int dataSize) {
-    EXC_CHECK( return device->setProperty(propId, data, dataSize); );
+    EXC_CHECK({
+        oni_Status rc = device->setProperty(propId, data, dataSize);
+        _propertyCache.invalidate(device);
+        return rc;
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_getProperties_Device(oni_Device * device,
+                                    oni_PropertyRequest * requests, int count) {
+    EXC_CHECK( return _getProperties(device, requests, count); );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_setProperties_Device(oni_Device * device,
+                                    oni_PropertyRequest * requests, int count) {
+    EXC_CHECK( return _setProperties(device, requests, count); );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_enablePropertyCache_Device(oni_Device * device, bool enabled) {
+    EXC_CHECK({
+        _propertyCache.enable(device, _devicePropertyCacheDefaults,
+                              sizeof(_devicePropertyCacheDefaults) / sizeof(int),
+                              enabled);
+        return openni::STATUS_OK;
+    });
+    return openni::STATUS_ERROR;
+}
+
+void oni_invalidatePropertyCache_Device(oni_Device * device) {
+    EXC_CHECK( _propertyCache.invalidate(device); );
+}
+
+oni_Status oni_setPropertyCacheable_Device(oni_Device * device, int propertyId,
+                                           bool cacheable) {
+    EXC_CHECK({
+        return _propertyCache.setCacheable(device, propertyId, cacheable) ?
+            openni::STATUS_OK : openni::STATUS_BAD_PARAMETER;
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_setPropertyAsync_Device(oni_Device * device, int propertyId,
+                                       const void * data, int dataSize) {
+    EXC_CHECK({
+        _propertyQueue.push(device, NULL, propertyId, data, dataSize);
+        return openni::STATUS_OK;
+    });
     return openni::STATUS_ERROR;
 }
 
@@ -464,11 +612,24 @@ oni_DeviceInfoArray * oni_enumerateDevices() {
     });
 }
 
+int oni_enumerateDevicesInto(oni_DeviceInfoArray * array) {
+    EXC_CHECK({
+        openni::OpenNI::enumerateDevices(array);
+        return array->getSize();
+    });
+    return -1;
+}
+
 const char * oni_getExtendedError() {
     EXC_CHECK( return openni::OpenNI::getExtendedError(); );
     return NULL;
 }
 
+oni_Status oni_flushPropertyQueue() {
+    EXC_CHECK( return _propertyQueue.flush(); );
+    return openni::STATUS_ERROR;
+}
+
 oni_Version oni_getVersion() {
     oni_Version ver_c;
     openni::Version ver;
@@ -498,7 +659,10 @@ void oni_removeDeviceStateChangedListener(oni_DeviceStateChangedListener listen)
 }
 
 void oni_shutdown() {
-    EXC_CHECK( openni::OpenNI::shutdown(); );
+    EXC_CHECK({
+        _propertyQueue.stop();
+        openni::OpenNI::shutdown();
+    });
 }
 
 // =======================
@@ -619,6 +783,22 @@ void oni_delete_VideoFrameRef(oni_VideoFrameRef * ref) {
     EXC_CHECK( delete ref; );
 }
 
+const int oni_VIDEOFRAMEREF_SIZE = sizeof(openni::VideoFrameRef);
+const int oni_VIDEOFRAMEREF_ALIGNMENT = alignof(openni::VideoFrameRef);
+
+static_assert(sizeof(openni::VideoFrameRef) <= sizeof(oni_VideoFrameRefStorage) &&
+              alignof(openni::VideoFrameRef) <= alignof(oni_VideoFrameRefStorage),
+              "oni_VideoFrameRefStorage is too small for openni::VideoFrameRef");
+
+oni_VideoFrameRef * oni_initVideoFrameRef(void * storage) {
+    EXC_CHECK( return new (storage) openni::VideoFrameRef(); );
+    return NULL;
+}
+
+void oni_deinitVideoFrameRef(oni_VideoFrameRef * ref) {
+    EXC_CHECK( ref->~VideoFrameRef(); );
+}
+
 oni_VideoFrameRef * oni_copy_VideoFrameRef(oni_VideoFrameRef * ref,
                                            oni_VideoFrameRef * source) {
     EXC_CHECK({
@@ -653,6 +833,30 @@ int oni_getDataSize(oni_VideoFrameRef * ref) {
     return 0;
 }
 
+oni_Status oni_getFrameDescriptor(oni_VideoFrameRef * ref,
+                                  oni_FrameDescriptor * desc) {
+    EXC_CHECK({
+        const OniFrame * frame = ref->_getFrame();
+        if (frame == NULL) {
+            return openni::STATUS_BAD_PARAMETER;
+        }
+        desc->data = frame->data;
+        desc->dataSize = frame->dataSize;
+        desc->width = frame->width;
+        desc->height = frame->height;
+        desc->strideInBytes = frame->stride;
+        desc->sensorType = (oni_SensorType) frame->sensorType;
+        desc->pixelFormat = (oni_PixelFormat) frame->videoMode.pixelFormat;
+        desc->frameIndex = frame->frameIndex;
+        desc->timestamp = frame->timestamp;
+        desc->croppingEnabled = frame->croppingEnabled != 0;
+        desc->cropOriginX = frame->cropOriginX;
+        desc->cropOriginY = frame->cropOriginY;
+        return openni::STATUS_OK;
+    });
+    return openni::STATUS_ERROR;
+}
+
 int oni_getFrameIndex(oni_VideoFrameRef * ref) {
     EXC_CHECK( return ref->getFrameIndex(); );
     return 0;
@@ -681,6 +885,13 @@ oni_VideoMode oni_getVideoMode(oni_VideoFrameRef * ref) {
     EXC_CHECK( return ref->getVideoMode(); );
 }
 
+oni_VideoModeInfo oni_getVideoModeInfo_VideoFrameRef(oni_VideoFrameRef * ref) {
+    oni_VideoModeInfo info;
+    memset(&info, 0, sizeof(info));
+    EXC_CHECK( _convertVideoMode(ref->getVideoMode(), ref->getSensorType(), &info); );
+    return info;
+}
+
 int oni_getWidth(oni_VideoFrameRef * ref) {
     EXC_CHECK( return ref->getWidth(); );
     return 0;
@@ -757,8 +968,12 @@ oni_VideoStream * oni_new_VideoStream() {
 }
 
 void oni_delete_VideoStream(oni_VideoStream * stream) {
-    EXC_CHECK( delete stream; );
-} 
+    EXC_CHECK({
+        _propertyQueue.cancel(stream);
+        _propertyCache.forget(stream);
+        delete stream;
+    });
+}
 
 oni_Status oni_addNewFrameListener(oni_VideoStream * stream,
                                    oni_NewFrameListener * listen) {
@@ -781,7 +996,35 @@ oni_Status oni_create_VideoStream(oni_VideoStream * stream, oni_Device * device,
 }
 
 void oni_destroy_VideoStream(oni_VideoStream * stream) {
-    EXC_CHECK( stream->destroy(); );
+    EXC_CHECK({
+        _propertyQueue.cancel(stream);
+        _propertyCache.invalidate(stream);
+        stream->destroy();
+    });
+}
+
+oni_Status oni_getCameraIntrinsics(oni_VideoStream * stream,
+                                   oni_CameraIntrinsics * intrinsics) {
+    EXC_CHECK({
+        openni::VideoMode mode = stream->getVideoMode();
+        float hfov = oni_getHorizontalFieldOfView(stream);
+        float vfov = oni_getVerticalFieldOfView(stream);
+        int width = mode.getResolutionX();
+        int height = mode.getResolutionY();
+        if (hfov <= 0.0f || vfov <= 0.0f || width <= 0 || height <= 0) {
+            return openni::STATUS_ERROR;
+        }
+        // The inverse of CoordinateConverter's xzFactor = 2 * tan(hfov / 2)
+        // applied per pixel, and likewise for Y.
+        intrinsics->width = width;
+        intrinsics->height = height;
+        intrinsics->fx = width / (2.0f * tanf(hfov / 2.0f));
+        intrinsics->fy = height / (2.0f * tanf(vfov / 2.0f));
+        intrinsics->cx = width / 2.0f;
+        intrinsics->cy = height / 2.0f;
+        return openni::STATUS_OK;
+    });
+    return openni::STATUS_ERROR;
 }
 
 oni_CameraSettings * oni_getCameraSettings(oni_VideoStream * stream) {
@@ -796,17 +1039,35 @@ bool oni_getCropping(oni_VideoStream * stream, int *pOriginX, int *pOriginY,
 }
 
 float oni_getHorizontalFieldOfView(oni_VideoStream * stream) {
-    EXC_CHECK( return stream->getHorizontalFieldOfView(); );
+    EXC_CHECK({
+        float fov = 0.0;
+        int size = sizeof(fov);
+        _getPropertyCached(stream, openni::STREAM_PROPERTY_HORIZONTAL_FOV,
+                           &fov, &size);
+        return fov;
+    });
     return 0.0;
 }
 
 int oni_getMaxPixelValue(oni_VideoStream * stream) {
-    EXC_CHECK( return stream->getMaxPixelValue(); );
+    EXC_CHECK({
+        int value = 0;
+        int size = sizeof(value);
+        _getPropertyCached(stream, openni::STREAM_PROPERTY_MAX_VALUE,
+                           &value, &size);
+        return value;
+    });
     return 0;
 }
 
 int oni_getMinPixelValue(oni_VideoStream * stream) {
-    EXC_CHECK( return stream->getMinPixelValue(); );
+    EXC_CHECK({
+        int value = 0;
+        int size = sizeof(value);
+        _getPropertyCached(stream, openni::STREAM_PROPERTY_MIN_VALUE,
+                           &value, &size);
+        return value;
+    });
     return 0;
 }
 
@@ -817,7 +1078,7 @@ bool oni_getMirroringEnabled(oni_VideoStream * stream) {
 
 oni_Status oni_getProperty_VideoStream(oni_VideoStream * stream, int propertyId,
                                        void *data, int *dataSize) {
-    EXC_CHECK( return stream->getProperty(propertyId, data, dataSize); );
+    EXC_CHECK( return _getPropertyCached(stream, propertyId, data, dataSize); );
     return openni::STATUS_ERROR;
 }
 
@@ -830,7 +1091,13 @@ oni_SensorInfo * oni_getSensorInfo_VideoStream(oni_VideoStream * stream) {
 }
 
 float oni_getVerticalFieldOfView(oni_VideoStream * stream) {
-    EXC_CHECK( return stream->getVerticalFieldOfView(); );
+    EXC_CHECK({
+        float fov = 0.0;
+        int size = sizeof(fov);
+        _getPropertyCached(stream, openni::STREAM_PROPERTY_VERTICAL_FOV,
+                           &fov, &size);
+        return fov;
+    });
     return 0.0;
 }
 
@@ -842,6 +1109,16 @@ oni_VideoMode * oni_getVideoMode_VideoStream(oni_VideoStream * stream) {
     return NULL;
 }
 
+oni_VideoModeInfo oni_getVideoModeInfo_VideoStream(oni_VideoStream * stream) {
+    oni_VideoModeInfo info;
+    memset(&info, 0, sizeof(info));
+    EXC_CHECK({
+        _convertVideoMode(stream->getVideoMode(),
+                          stream->getSensorInfo().getSensorType(), &info);
+    });
+    return info;
+}
+
 oni_Status oni_invoke_VideoStream(oni_VideoStream * stream, int commandId,
                                   void *data, int dataSize) {
     EXC_CHECK( return stream->invoke(commandId, data, dataSize); );
@@ -879,30 +1156,98 @@ void oni_removeNewFrameListener(oni_VideoStream * stream,
 }
 
 oni_Status oni_resetCropping(oni_VideoStream * stream) {
-    EXC_CHECK( return stream->resetCropping(); );
+    EXC_CHECK({
+        oni_Status rc = stream->resetCropping();
+        _propertyCache.invalidate(stream);
+        return rc;
+    });
     return openni::STATUS_ERROR;
 }
 
 oni_Status oni_setCropping(oni_VideoStream * stream, int originX, int originY, int width, int height) {
-    EXC_CHECK( return stream->setCropping(originX, originY, width, height); );
+    EXC_CHECK({
+        oni_Status rc = stream->setCropping(originX, originY, width, height);
+        _propertyCache.invalidate(stream);
+        return rc;
+    });
     return openni::STATUS_ERROR;
 }
 
 oni_Status oni_setMirroringEnabled(oni_VideoStream * stream, bool isEnabled) {
-    EXC_CHECK( return stream->setMirroringEnabled(isEnabled); );
+    EXC_CHECK({
+        oni_Status rc = stream->setMirroringEnabled(isEnabled);
+        _propertyCache.invalidate(stream);
+        return rc;
+    });
     return openni::STATUS_ERROR;
 }
 
 oni_Status oni_setProperty_VideoStream(oni_VideoStream * stream, int propertyId,
                                        const void *data, int dataSize) {
-    EXC_CHECK( return stream->setProperty(propertyId, data, dataSize); );
+    EXC_CHECK({
+        oni_Status rc = stream->setProperty(propertyId, data, dataSize);
+        _propertyCache.invalidate(stream);
+        return rc;
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_getProperties_VideoStream(oni_VideoStream * stream,
+                                         oni_PropertyRequest * requests,
+                                         int count) {
+    EXC_CHECK( return _getProperties(stream, requests, count); );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_setProperties_VideoStream(oni_VideoStream * stream,
+                                         oni_PropertyRequest * requests,
+                                         int count) {
+    EXC_CHECK( return _setProperties(stream, requests, count); );
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_enablePropertyCache_VideoStream(oni_VideoStream * stream,
+                                               bool enabled) {
+    EXC_CHECK({
+        _propertyCache.enable(stream, _streamPropertyCacheDefaults,
+                              sizeof(_streamPropertyCacheDefaults) / sizeof(int),
+                              enabled);
+        return openni::STATUS_OK;
+    });
+    return openni::STATUS_ERROR;
+}
+
+void oni_invalidatePropertyCache_VideoStream(oni_VideoStream * stream) {
+    EXC_CHECK( _propertyCache.invalidate(stream); );
+}
+
+oni_Status oni_setPropertyCacheable_VideoStream(oni_VideoStream * stream,
+                                                int propertyId, bool cacheable) {
+    EXC_CHECK({
+        return _propertyCache.setCacheable(stream, propertyId, cacheable) ?
+            openni::STATUS_OK : openni::STATUS_BAD_PARAMETER;
+    });
+    return openni::STATUS_ERROR;
+}
+
+oni_Status oni_setPropertyAsync_VideoStream(oni_VideoStream * stream,
+                                            int propertyId, const void *data,
+                                            int dataSize) {
+    EXC_CHECK({
+        _propertyQueue.push(NULL, stream, propertyId, data, dataSize);
+        return openni::STATUS_OK;
+    });
     return openni::STATUS_ERROR;
 }
 
 // template<class T > Status setProperty (int propertyId, const T &value)
 oni_Status oni_setVideoMode(oni_VideoStream * stream,
                             oni_VideoMode * videoMode) {
-    EXC_CHECK( return stream->setVideoMode(*videoMode); );
+    EXC_CHECK({
+        oni_Status rc = stream->setVideoMode(*videoMode);
+        _propertyCache.invalidate(stream);
+        return rc;
+    });
     return openni::STATUS_ERROR;
 }
 
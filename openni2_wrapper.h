@@ -15,6 +15,8 @@ extern "C" {
 // ==================================================
 // openni::Array<DeviceInfo>  ->  oni_DeviceInfoArray
 // ==================================================
+// oni_new_DeviceInfoArray: An empty array, for oni_enumerateDevicesInto.
+oni_DeviceInfoArray * oni_new_DeviceInfoArray();
 void oni_delete_DeviceInfoArray(oni_DeviceInfoArray * array);
 // oni_getElement_DeviceInfoArray: Do not modify returned elements.
 oni_DeviceInfo oni_getElement_DeviceInfoArray(oni_DeviceInfoArray * array, int idx);
@@ -85,9 +87,65 @@ oni_Status oni_setImageRegistrationMode(oni_Device * device,
                                         oni_ImageRegistrationMode mode);
 oni_Status oni_setProperty_Device(oni_Device * device, int propId,
                                   const void * data, int dataSize);
+// oni_getProperties_Device, oni_setProperties_Device: Process 'count' entries
+// in order and fill in the 'status' of each.  Returns oni_STATUS_OK if every
+// entry succeeded, or else the status of the first one that failed.  OpenNI
+// itself has no call that moves several properties in one driver transfer, so
+// the saving comes from crossing the wrapper once and from the property cache.
+oni_Status oni_getProperties_Device(oni_Device * device,
+                                    oni_PropertyRequest * requests, int count);
+oni_Status oni_setProperties_Device(oni_Device * device,
+                                    oni_PropertyRequest * requests, int count);
+// oni_enablePropertyCache_Device: While enabled, read-mostly properties (the
+// firmware, driver and hardware versions and the serial number) are fetched
+// from the driver once and then answered from memory.  Setting any property of
+// the device through the wrapper empties its cache.
+oni_Status oni_enablePropertyCache_Device(oni_Device * device, bool enabled);
+void oni_invalidatePropertyCache_Device(oni_Device * device);
+// oni_setPropertyCacheable_Device: Add or remove a property from the cached
+// set.  Fails with oni_STATUS_BAD_PARAMETER if caching is not enabled.
+oni_Status oni_setPropertyCacheable_Device(oni_Device * device, int propertyId,
+                                           bool cacheable);
+// oni_setPropertyAsync_Device: Copy 'data' and apply it on a background thread
+// without waiting for the driver.  See oni_flushPropertyQueue.
+oni_Status oni_setPropertyAsync_Device(oni_Device * device, int propertyId,
+                                       const void * data, int dataSize);
 // Missing from the above is conversions of the templated versions of
 // getProperty, invoke, and setProperty.
 
+// =============================================
+// Capability snapshots and video mode selection
+// =============================================
+// oni_getCapabilities: Fill in 'caps' with the device's USB IDs, firmware
+// version and the supported video modes of all of its sensors.  Release it
+// with oni_release_Capabilities.
+oni_Status oni_getCapabilities(oni_Device * device, oni_Capabilities * caps);
+// oni_getCapabilitiesCached: As oni_getCapabilities, but first look for the
+// device (by USB vendor & product ID and firmware version) in the capability
+// cache file at 'path', and add it to that file if it is not there yet.
+oni_Status oni_getCapabilitiesCached(oni_Device * device, const char * path,
+                                     oni_Capabilities * caps);
+// oni_loadCapabilities: Look up a device in the capability cache file at
+// 'path'.  Returns oni_STATUS_NO_DEVICE if it is not in the file.
+oni_Status oni_loadCapabilities(const char * path, uint16_t usbVendorId,
+                                uint16_t usbProductId,
+                                const char * firmwareVersion,
+                                oni_Capabilities * caps);
+// oni_saveCapabilities: Add or replace an entry in the capability cache file.
+oni_Status oni_saveCapabilities(const char * path, const oni_Capabilities * caps);
+void oni_release_Capabilities(oni_Capabilities * caps);
+// oni_selectVideoMode: Pick the best of the sensor's supported modes according
+// to 'constraints' (see oni_VideoModeConstraints) and copy it to 'best'.
+// Returns oni_STATUS_NOT_SUPPORTED if no mode satisfies the constraints.
+oni_Status oni_selectVideoMode(const oni_SensorInfo * info,
+                               const oni_VideoModeConstraints * constraints,
+                               oni_VideoModeInfo * best);
+// oni_selectVideoMode_Capabilities: As oni_selectVideoMode, but choosing among
+// the modes of one sensor in a capability snapshot.
+oni_Status oni_selectVideoMode_Capabilities(
+    const oni_Capabilities * caps, oni_SensorType sensorType,
+    const oni_VideoModeConstraints * constraints, oni_VideoModeInfo * best);
+
 // ===========================
 // Utility functions for enums
 // ===========================
@@ -124,7 +182,18 @@ oni_Status oni_addDeviceDisconnectedListener(oni_DeviceDisconnectedListener * li
 oni_Status oni_addDeviceStateChangedListener(oni_DeviceStateChangedListener * listen);
 // oni_enumerateDevices: You are responsible for deleting the returned array.
 oni_DeviceInfoArray * oni_enumerateDevices();
+// oni_enumerateDevicesInto: Like oni_enumerateDevices, but refills an existing
+// array (from oni_new_DeviceInfoArray) rather than allocating a new one.
+// Elements obtained from it earlier are no longer valid.  Returns the number
+// of devices, or -1 on error.
+int oni_enumerateDevicesInto(oni_DeviceInfoArray * array);
 const char * oni_getExtendedError();
+// oni_flushPropertyQueue: Wait until every set queued by the
+// oni_setPropertyAsync_* functions before the call has been applied.  Returns
+// the first error any of them produced that no earlier flush returned, or
+// oni_STATUS_OK.  Sets of the same property that are queued before the first
+// one is applied are merged, and only the last value is sent.
+oni_Status oni_flushPropertyQueue();
 oni_Version oni_getVersion();
 oni_Status oni_initialize();
 // See the notes on oni_addDevice* functions.
@@ -174,6 +243,14 @@ oni_VideoModeArray * oni_getSupportedVideoModes(const oni_SensorInfo * info);
 // oni_new_VideoFrameRef: 'other' can be NULL for default constructor.
 oni_VideoFrameRef * oni_new_VideoFrameRef(oni_VideoFrameRef * other);
 void oni_delete_VideoFrameRef(oni_VideoFrameRef * ref);
+// oni_initVideoFrameRef: Construct an empty frame reference in
+// caller-provided storage (see oni_VideoFrameRefStorage) instead of on the
+// heap, and return it.  End its life with oni_deinitVideoFrameRef, never with
+// oni_delete_VideoFrameRef.
+oni_VideoFrameRef * oni_initVideoFrameRef(void * storage);
+// oni_deinitVideoFrameRef: Release the frame and destroy the reference; the
+// storage itself is left to the caller.
+void oni_deinitVideoFrameRef(oni_VideoFrameRef * ref);
 oni_VideoFrameRef * oni_copy_VideoFrameRef(oni_VideoFrameRef * ref,
                                            oni_VideoFrameRef * source);
 int oni_getCropOriginX(oni_VideoFrameRef * ref);
@@ -181,16 +258,954 @@ int oni_getCropOriginY(oni_VideoFrameRef * ref);
 bool oni_getCroppingEnabled(oni_VideoFrameRef * ref);
 const void * oni_getData(oni_VideoFrameRef * ref);
 int oni_getDataSize(oni_VideoFrameRef * ref);
+// oni_getFrameDescriptor: Fill in 'desc' with everything the individual
+// getters for this class return, in one call.
+oni_Status oni_getFrameDescriptor(oni_VideoFrameRef * ref,
+                                  oni_FrameDescriptor * desc);
 int oni_getFrameIndex(oni_VideoFrameRef * ref);
 int oni_getHeight(oni_VideoFrameRef * ref);
 oni_SensorType oni_getSensorType_VideoFrameRef(oni_VideoFrameRef * ref);
 int oni_getStrideInBytes(oni_VideoFrameRef * ref);
 uint64_t oni_getTimestamp(oni_VideoFrameRef * ref);
 oni_VideoMode oni_getVideoMode(oni_VideoFrameRef * ref);
+// oni_getVideoModeInfo_VideoFrameRef: The frame's video mode, by value.
+oni_VideoModeInfo oni_getVideoModeInfo_VideoFrameRef(oni_VideoFrameRef * ref);
 int oni_getWidth(oni_VideoFrameRef * ref);
 bool oni_isValid_VideoFrameRef(oni_VideoFrameRef * ref);
 void oni_release_VideoFrameRef(oni_VideoFrameRef * ref);
 
+// ================================
+// Shared-memory frame distribution
+// ================================
+// An oni_FramePublisher copies each frame once into a ring of slots in shared
+// memory, which oni_FrameSubscribers in other processes read in place.  The
+// publisher never waits for them.
+// oni_new_FramePublisher: Create a ring of 'slotCount' slots, each holding up
+// to 'maxFrameSize' bytes.  If 'name' is not NULL, the ring is a POSIX shared
+// memory object of that name (e.g. "/kinect0"); otherwise it is an anonymous
+// memfd, whose descriptor (see oni_getFd_FramePublisher) is close-on-exec: a
+// child gets it across fork() but not exec(), so pass it over a Unix domain
+// socket (SCM_RIGHTS) to any other process.  An existing object of that name
+// is unlinked and replaced; subscribers still mapping it keep their (now
+// silent) mapping and must reopen the name.
+oni_FramePublisher * oni_new_FramePublisher(const char * name, int slotCount,
+                                            int maxFrameSize);
+// oni_delete_FramePublisher: Also unlinks the named shared memory object.
+void oni_delete_FramePublisher(oni_FramePublisher * pub);
+int oni_getFd_FramePublisher(oni_FramePublisher * pub);
+// oni_publish_FramePublisher: Copy the frame into the next slot.  Frames larger
+// than 'maxFrameSize' fail with oni_STATUS_BAD_PARAMETER.
+oni_Status oni_publish_FramePublisher(oni_FramePublisher * pub,
+                                      oni_VideoFrameRef * ref);
+// oni_setStreamInfo_FramePublisher: Publish the stream's sensor type, fields
+// of view, pixel value range and mirroring for subscribers.  Call this again
+// if any of those change.
+oni_Status oni_setStreamInfo_FramePublisher(oni_FramePublisher * pub,
+                                            oni_VideoStream * stream);
+// oni_attach_FramePublisher: Publish every new frame of 'stream' from a frame
+// listener.  The listener reads the frames itself, so the owning process must
+// not also call oni_readFrame on that stream.
+oni_Status oni_attach_FramePublisher(oni_FramePublisher * pub,
+                                     oni_VideoStream * stream);
+void oni_detach_FramePublisher(oni_FramePublisher * pub);
+
+oni_FrameSubscriber * oni_new_FrameSubscriber(const char * name);
+// oni_new_FrameSubscriber_Fd: Map a ring from a publisher's memfd.  The
+// subscriber makes its own copy of the descriptor.
+oni_FrameSubscriber * oni_new_FrameSubscriber_Fd(int fd);
+void oni_delete_FrameSubscriber(oni_FrameSubscriber * sub);
+// oni_readFrame_FrameSubscriber: Get the frame after the last one this
+// subscriber read, waiting up to 'timeoutMs' milliseconds (-1 for no limit)
+// for it to be published.  Returns oni_STATUS_TIME_OUT if none arrived, and
+// oni_STATUS_ERROR (passing over the frame) if its slot claims more data than
+// a slot can hold.
+oni_Status oni_readFrame_FrameSubscriber(oni_FrameSubscriber * sub,
+                                         oni_SharedFrame * frame, int timeoutMs);
+// oni_readLatest_FrameSubscriber: As above, but skip straight to the newest
+// published frame.
+oni_Status oni_readLatest_FrameSubscriber(oni_FrameSubscriber * sub,
+                                          oni_SharedFrame * frame,
+                                          int timeoutMs);
+// oni_isValid_SharedFrame: Returns false once the publisher has started to
+// overwrite the frame's slot.  Anything read from 'desc.data' before a call
+// that returns true is intact.
+bool oni_isValid_SharedFrame(oni_FrameSubscriber * sub,
+                             const oni_SharedFrame * frame);
+oni_Status oni_getStreamInfo_FrameSubscriber(oni_FrameSubscriber * sub,
+                                             oni_SharedStreamInfo * info);
+
+// ====================================
+// Frame readiness as a file descriptor
+// ====================================
+// An oni_FrameEvent queues the new frames of its streams behind a descriptor
+// that is readable while any are queued, for select, poll or epoll.
+// oni_new_FrameEvent: 'queueDepth' is how many frames may wait per stream;
+// beyond that, the oldest frame of that stream is dropped.
+oni_FrameEvent * oni_new_FrameEvent(int queueDepth);
+void oni_delete_FrameEvent(oni_FrameEvent * event);
+int oni_getFd_FrameEvent(oni_FrameEvent * event);
+// oni_attach_FrameEvent: Start queueing frames from 'stream'.  The event reads
+// the frames itself, so the application must not also call oni_readFrame on
+// that stream.
+oni_Status oni_attach_FrameEvent(oni_FrameEvent * event,
+                                 oni_VideoStream * stream);
+void oni_detach_FrameEvent(oni_FrameEvent * event, oni_VideoStream * stream);
+// oni_takeFrames_FrameEvent: Move up to 'maxFrames' queued frames, oldest
+// first, into refs[0..] (each made with oni_new_VideoFrameRef), and set
+// streams[i] to the stream that refs[i] came from ('streams' may be NULL).
+// Returns how many frames were moved.  The descriptor stays readable while
+// frames remain queued.
+int oni_takeFrames_FrameEvent(oni_FrameEvent * event, oni_VideoFrameRef ** refs,
+                              oni_VideoStream ** streams, int maxFrames);
+// oni_getDroppedCount_FrameEvent: Frames dropped so far because the queue of
+// their stream was full.
+uint64_t oni_getDroppedCount_FrameEvent(oni_FrameEvent * event);
+
+// ====================
+// Processing pipelines
+// ====================
+// An oni_Pipeline is a directed acyclic graph of stages joined by bounded
+// queues (edges), run on a pool of threads.  The graph can only be changed
+// while stopped.
+oni_Pipeline * oni_new_Pipeline();
+// oni_delete_Pipeline: Stops the pipeline first if it is running.
+void oni_delete_Pipeline(oni_Pipeline * pipeline);
+// oni_addSource_Pipeline: Add a stage that emits frames.  If 'stream' is not
+// NULL, every new frame of it is read (by a frame listener; do not call
+// oni_readFrame on it yourself) and emitted.  Otherwise, feed the stage with
+// oni_push_Pipeline.  Returns the ID of the stage, or -1 on failure.
+int oni_addSource_Pipeline(oni_Pipeline * pipeline, const char * name,
+                           oni_VideoStream * stream);
+// oni_addStage_Pipeline: Add a stage that calls 'fn' on each item.  Returns
+// the ID of the stage, or -1 on failure.  A stage without outgoing edges is a
+// sink.
+int oni_addStage_Pipeline(oni_Pipeline * pipeline, const char * name,
+                          oni_PipelineStageFn fn, void * userData);
+// oni_addDepthToWorldStage_Pipeline: A built-in stage that replaces the
+// payload with width * height * 3 floats, the world X, Y and Z (in mm) of
+// each depth pixel as oni_convertDepthToWorld1 gives them.  Frames that are
+// not DEPTH_1_MM or DEPTH_100_UM are discarded.
+int oni_addDepthToWorldStage_Pipeline(oni_Pipeline * pipeline,
+                                      const char * name,
+                                      oni_VideoStream * depth);
+// oni_connect_Pipeline: Add an edge from stage 'from' to stage 'to' that can
+// hold 'capacity' items.  Returns the ID of the edge, or -1 if it would make a
+// cycle or either stage does not exist.  Under oni_BACKPRESSURE_BLOCK, a
+// stream source blocks OpenNI's frame thread while the queue is full.
+int oni_connect_Pipeline(oni_Pipeline * pipeline, int from, int to,
+                         int capacity, oni_BackpressurePolicy policy);
+// oni_start_Pipeline: Start 'threadCount' worker threads (0 for one per
+// stage), and start taking frames from the sources.  More threads are started
+// than asked for if that is needed so that blocked stages can't deadlock.
+oni_Status oni_start_Pipeline(oni_Pipeline * pipeline, int threadCount);
+// oni_stop_Pipeline: Stop taking frames, let the running stages finish their
+// current items, and discard everything still queued.
+void oni_stop_Pipeline(oni_Pipeline * pipeline);
+// oni_push_Pipeline: Emit a frame from a source stage (the pipeline keeps its
+// own reference to the frame).  Pushes to the same source from several
+// threads are serialised.  Pushing to a source that has a stream, whose frame
+// listener is already its producer, fails with oni_STATUS_BAD_PARAMETER;
+// pushing to a stopped pipeline fails with oni_STATUS_OUT_OF_FLOW.
+oni_Status oni_push_Pipeline(oni_Pipeline * pipeline, int source,
+                             oni_VideoFrameRef * frame);
+oni_Status oni_getStageStats_Pipeline(oni_Pipeline * pipeline, int stage,
+                                      oni_PipelineStageStats * stats);
+oni_Status oni_getEdgeStats_Pipeline(oni_Pipeline * pipeline, int edge,
+                                     oni_PipelineEdgeStats * stats);
+// oni_getFrame_PipelineItem: Do not release the returned frame.
+oni_VideoFrameRef * oni_getFrame_PipelineItem(oni_PipelineItem * item);
+// oni_getPayload_PipelineItem: The payload set by an earlier stage (or NULL),
+// with its size in bytes in '*size' if 'size' is not NULL.
+void * oni_getPayload_PipelineItem(oni_PipelineItem * item, int * size);
+// oni_setPayload_PipelineItem: Replace the payload.  'release' (which may be
+// NULL) is called on it once no item refers to it any longer.
+void oni_setPayload_PipelineItem(oni_PipelineItem * item, void * payload,
+                                 int size, void (*release) (void *));
+// oni_getSequence_PipelineItem: Counts the items emitted by its source.
+uint64_t oni_getSequence_PipelineItem(oni_PipelineItem * item);
+
+// ===================================
+// Arenas for frame refs and listeners
+// ===================================
+// An oni_Arena hands out frame references and frame listeners from blocks
+// allocated up front, and takes them back for reuse.  It is safe to use from
+// several threads at once.
+oni_Arena * oni_new_Arena(int frameRefs, int listeners);
+// oni_delete_Arena: Everything obtained from the arena must have been returned
+// to it (or at least no longer be used) before this.
+void oni_delete_Arena(oni_Arena * arena);
+// oni_newVideoFrameRef_Arena: Like oni_new_VideoFrameRef.
+oni_VideoFrameRef * oni_newVideoFrameRef_Arena(oni_Arena * arena,
+                                               oni_VideoFrameRef * other);
+// oni_deleteVideoFrameRef_Arena: Release the frame and return the reference to
+// the arena.
+void oni_deleteVideoFrameRef_Arena(oni_Arena * arena, oni_VideoFrameRef * ref);
+// oni_addNewFrameListener_Arena: Like oni_addNewFrameListener, but with the
+// internal listener object taken from the arena.
+oni_Status oni_addNewFrameListener_Arena(oni_Arena * arena,
+                                         oni_VideoStream * stream,
+                                         oni_NewFrameListener * listener);
+// oni_removeNewFrameListener_Arena: Remove a listener added by
+// oni_addNewFrameListener_Arena and return its object to the arena.
+void oni_removeNewFrameListener_Arena(oni_Arena * arena,
+                                      oni_VideoStream * stream,
+                                      oni_NewFrameListener * listener);
+// oni_getBlockCount_Arena: How many blocks the arena has allocated so far; it
+// stays put once the arena is big enough for the workload.
+int oni_getBlockCount_Arena(oni_Arena * arena);
+
+// ======================
+// Frame change detection
+// ======================
+// An oni_ChangeDetector reports which tiles of a 16-bit (depth, GRAY16) or
+// GRAY8 frame changed since the frame before it.
+// oni_new_ChangeDetector: A pixel has changed if it differs from the previous
+// frame by more than 'threshold' (in pixel units, e.g. mm), and a tile has
+// changed if more than 'minChangedPixels' of its pixels have.
+oni_ChangeDetector * oni_new_ChangeDetector(int tileSize, int threshold,
+                                            int minChangedPixels);
+void oni_delete_ChangeDetector(oni_ChangeDetector * detector);
+// oni_update_ChangeDetector: Compare 'frame' with the previous frame given to
+// the detector, and remember it for next time.  The first frame, and any
+// frame whose size or format differs from the previous one, counts as changed
+// everywhere.
+oni_Status oni_update_ChangeDetector(oni_ChangeDetector * detector,
+                                     oni_VideoFrameRef * frame,
+                                     oni_ChangeResult * result);
+// oni_updateDescriptor_ChangeDetector: The same, for a frame described by an
+// oni_FrameDescriptor (e.g. from oni_getFrameDescriptor or a shared frame).
+oni_Status oni_updateDescriptor_ChangeDetector(oni_ChangeDetector * detector,
+                                               const oni_FrameDescriptor * desc,
+                                               oni_ChangeResult * result);
+// oni_reset_ChangeDetector: Forget the previous frame.
+void oni_reset_ChangeDetector(oni_ChangeDetector * detector);
+// oni_addChangeDetectionStage_Pipeline: A pipeline stage that runs 'detector'
+// on every item and sets the item's payload to a copy of the oni_ChangeResult
+// (followed by its bitmap).  If 'dropUnchanged' is true, items in which no
+// tile changed are not passed on.  'detector' must outlive the pipeline.
+int oni_addChangeDetectionStage_Pipeline(oni_Pipeline * pipeline,
+                                         const char * name,
+                                         oni_ChangeDetector * detector,
+                                         bool dropUnchanged);
+
+// =============
+// Depth filters
+// =============
+// An oni_DepthFilter runs a chain of filters over depth frames, in the order
+// they were added, and keeps their state, so use one per stream.  Each
+// oni_add*_DepthFilter returns the filter's position in the chain, or -1 if
+// its parameters are invalid.
+oni_DepthFilter * oni_new_DepthFilter();
+void oni_delete_DepthFilter(oni_DepthFilter * filter);
+// oni_addMedian_DepthFilter: Median of the 3x3 (radius 1) or 5x5 (radius 2)
+// window; missing pixels count as 0.
+int oni_addMedian_DepthFilter(oni_DepthFilter * filter, int radius);
+// oni_addBilateral_DepthFilter: Edge-preserving smoothing.  Neighbors within
+// 'radius' pixels are weighted by a Gaussian of their distance (sigmaSpace, in
+// pixels) and of their depth difference (sigmaDepth, in depth units); those
+// more than 3 sigmaDepth away are ignored.
+int oni_addBilateral_DepthFilter(oni_DepthFilter * filter, int radius,
+                                 float sigmaSpace, float sigmaDepth);
+// oni_addTemporal_DepthFilter: Exponential smoothing over time with weight
+// 'alpha' (0 to 1) for the new frame.  A pixel that moves by more than
+// 'threshold' starts over from its new value, and a pixel that goes missing
+// keeps its last value for up to 'holdFrames' frames.
+int oni_addTemporal_DepthFilter(oni_DepthFilter * filter, float alpha,
+                                int threshold, int holdFrames);
+// oni_addHoleFill_DepthFilter: Fill gaps of up to 'maxHoleSize' missing pixels
+// along each row with the farther of the two depths bordering the gap.
+int oni_addHoleFill_DepthFilter(oni_DepthFilter * filter, int maxHoleSize);
+// oni_apply_DepthFilter: Filter a depth frame.  Returns width * height pixels,
+// row after row, that stay valid until the next call on this filter, or NULL
+// if the frame is empty or not a depth frame.
+const oni_DepthPixel * oni_apply_DepthFilter(oni_DepthFilter * filter,
+                                             oni_VideoFrameRef * frame);
+const oni_DepthPixel * oni_applyDescriptor_DepthFilter(oni_DepthFilter * filter,
+                                                       const oni_FrameDescriptor * desc);
+// oni_reset_DepthFilter: Forget the temporal history.
+void oni_reset_DepthFilter(oni_DepthFilter * filter);
+// oni_setParallelism: How many threads (including the caller) the
+// row-parallel kernels use; 0, the default, means one per CPU.
+void oni_setParallelism(int threadCount);
+int oni_getParallelism();
+
+// ====================
+// Depth image pyramids
+// ====================
+// Decimation reduces each 'factor' x 'factor' block (factor 2 or 4) of a depth
+// frame to one pixel, ignoring missing (zero) pixels; a block with none gives
+// 0.  Rows and columns left over at the right and bottom edges are dropped.
+// oni_DECIMATE_MIN: The nearest valid depth in the block.
+extern const int oni_DECIMATE_MIN;
+// oni_DECIMATE_MEDIAN: The median of the valid depths (the upper middle one
+// of an even count).
+extern const int oni_DECIMATE_MEDIAN;
+// oni_DECIMATE_MEAN: The mean of the valid depths, rounded.
+extern const int oni_DECIMATE_MEAN;
+// oni_decimateDepth: Decimate a width x height image into 'out', which must
+// hold (width / factor) * (height / factor) pixels.
+oni_Status oni_decimateDepth(const oni_DepthPixel * in, int width, int height,
+                             int strideInBytes, int factor, int mode,
+                             oni_DepthPixel * out);
+// oni_new_DepthPyramid: 'levels' levels, level 0 being a copy of the last
+// frame given to it and each further level the one before it decimated by
+// 'factor'; use one per stream.  If 'lazy' is true, levels are only built
+// when first asked for after each frame.
+oni_DepthPyramid * oni_new_DepthPyramid(int levels, int factor, int mode,
+                                        bool lazy);
+void oni_delete_DepthPyramid(oni_DepthPyramid * pyramid);
+// oni_setFrame_DepthPyramid: Build the pyramid from a depth frame.
+oni_Status oni_setFrame_DepthPyramid(oni_DepthPyramid * pyramid,
+                                     oni_VideoFrameRef * frame);
+oni_Status oni_setDescriptor_DepthPyramid(oni_DepthPyramid * pyramid,
+                                          const oni_FrameDescriptor * desc);
+// oni_getLevel_DepthPyramid: The pixels of one level, packed row after row,
+// with its size in 'width' and 'height' (either may be NULL).  They are owned
+// by the pyramid and stay valid until the next frame is set.  Returns NULL if
+// no frame was set or 'level' is out of range.
+const oni_DepthPixel * oni_getLevel_DepthPyramid(oni_DepthPyramid * pyramid,
+                                                 int level, int * width,
+                                                 int * height);
+int oni_getLevelCount_DepthPyramid(oni_DepthPyramid * pyramid);
+
+// ================
+// Frame statistics
+// ================
+// oni_computeFrameStats: Min, max, mean and number of valid pixels of a
+// 16-bit frame (depth or GRAY16), along with the histogram and validity mask
+// requested in 'stats' (see oni_FrameStats), all in one pass over the pixels.
+// Unlike oni_getMinPixelValue and oni_getMaxPixelValue, which give the
+// stream's range, these describe what is actually in the frame.
+oni_Status oni_computeFrameStats(oni_VideoFrameRef * frame,
+                                 oni_FrameStats * stats);
+oni_Status oni_computeDescriptorStats(const oni_FrameDescriptor * desc,
+                                      oni_FrameStats * stats);
+
+// ===============
+// Surface normals
+// ===============
+// oni_computeNormals: Unit normals of the surface seen by a depth frame, as
+// (x, y, z) triples in the coordinates of oni_CameraIntrinsics, facing the
+// camera.  'intrinsics' are usually those from oni_getCameraIntrinsics for
+// the frame's stream.  'normals' must hold 3 * width * height floats;
+// 'curvature', if not NULL, width * height floats.  Pixels without a normal
+// (missing depth, depth edges, image borders) get NaN.
+//
+// 'method' is one of:
+// oni_NORMALS_CROSS_PRODUCT: The cross product of the vectors between the
+// neighbors 'radius' pixels away horizontally and vertically.  Cheapest.
+extern const int oni_NORMALS_CROSS_PRODUCT;
+// oni_NORMALS_INTEGRAL_IMAGE: The same, but with tangents taken between mean
+// points of (2 * radius + 1)-pixel square windows, which smooths out sensor
+// noise at a cost that does not grow with 'radius'.
+extern const int oni_NORMALS_INTEGRAL_IMAGE;
+//
+// A neighbor whose depth differs from the pixel's by more than
+// 'maxDepthChange' times the pixel's depth (e.g. 0.02) is taken to be across
+// a depth edge; 0 turns this test off.  Curvature is the surface variation
+// of the points in the (2 * radius + 1)-pixel square window that are not
+// across an edge: 0 on a plane, up to 1/3.
+oni_Status oni_computeNormals(oni_VideoFrameRef * frame,
+                              const oni_CameraIntrinsics * intrinsics,
+                              int method, int radius, float maxDepthChange,
+                              float * normals, float * curvature);
+oni_Status oni_computeDescriptorNormals(const oni_FrameDescriptor * desc,
+                                        const oni_CameraIntrinsics * intrinsics,
+                                        int method, int radius,
+                                        float maxDepthChange, float * normals,
+                                        float * curvature);
+
+// ============
+// Point clouds
+// ============
+// An oni_PointCloud turns a depth frame, and optionally a color frame, into a
+// colored point cloud.  The color frame must be RGB888 and registered to the
+// depth frame (see oni_setImageRegistrationMode); if its size differs, it is
+// scaled to the depth frame.
+// oni_new_PointCloud: If 'voxelSize' (in mm) is positive, the points are
+// downsampled to a voxel grid of that size: each occupied voxel becomes the
+// centroid of its points, with their mean color.  With 0, every valid pixel
+// becomes a point.
+oni_PointCloud * oni_new_PointCloud(float voxelSize);
+void oni_delete_PointCloud(oni_PointCloud * cloud);
+// oni_setDepthRange_PointCloud: Only keep points with depth (in mm) between
+// 'minDepth' and 'maxDepth'; a 'maxDepth' of 0, the default, means no limit.
+void oni_setDepthRange_PointCloud(oni_PointCloud * cloud, float minDepth,
+                                  float maxDepth);
+// oni_build_PointCloud: Build the cloud from a depth frame and 'color', which
+// may be NULL, in which case points are black.
+oni_Status oni_build_PointCloud(oni_PointCloud * cloud,
+                                oni_VideoFrameRef * depth,
+                                oni_VideoFrameRef * color,
+                                const oni_CameraIntrinsics * intrinsics);
+oni_Status oni_buildDescriptor_PointCloud(oni_PointCloud * cloud,
+                                          const oni_FrameDescriptor * depth,
+                                          const oni_FrameDescriptor * color,
+                                          const oni_CameraIntrinsics * intrinsics);
+// oni_getPoints_PointCloud: The points of the last build, contiguous, with
+// their number in 'count'.  They are owned by the cloud and valid until the
+// next build.  Without voxels they are in row order; with voxels, their order
+// is unspecified but the same for the same input.
+const oni_PointXYZRGB * oni_getPoints_PointCloud(oni_PointCloud * cloud,
+                                                 int * count);
+
+// ===============
+// Plane detection
+// ===============
+// An oni_PlaneDetector finds the largest planes in a depth frame by RANSAC,
+// starting from the previous frame's planes.
+// oni_new_PlaneDetector: Find up to 'maxPlanes' (at most 255) planes.  A
+// point belongs to a plane if it is within 'distanceThreshold' (in mm) of
+// it, and a plane needs at least 'minInliers' pixels to count.
+oni_PlaneDetector * oni_new_PlaneDetector(int maxPlanes, float distanceThreshold,
+                                          int minInliers);
+void oni_delete_PlaneDetector(oni_PlaneDetector * detector);
+// oni_setIterations_PlaneDetector: Draw at most this many hypotheses per
+// plane (default 200); fewer are drawn once a better plane is unlikely.
+void oni_setIterations_PlaneDetector(oni_PlaneDetector * detector,
+                                     int iterations);
+// oni_setSubsample_PlaneDetector: Search on every 'step'-th row and column
+// (default 4).
+void oni_setSubsample_PlaneDetector(oni_PlaneDetector * detector, int step);
+// oni_setTimeBudget_PlaneDetector: Stop searching once this many
+// milliseconds have passed, and return the planes found so far; 0, the
+// default, means no limit.  Sampling and labeling the frame come on top.
+void oni_setTimeBudget_PlaneDetector(oni_PlaneDetector * detector,
+                                     float milliseconds);
+// oni_setRefine_PlaneDetector: Whether to start from the previous frame's
+// planes (default true).
+void oni_setRefine_PlaneDetector(oni_PlaneDetector * detector, bool refine);
+// oni_detect_PlaneDetector: Find the planes of a depth frame, largest first,
+// into 'planes' (room for 'maxPlanes') and their number into 'count'.
+oni_Status oni_detect_PlaneDetector(oni_PlaneDetector * detector,
+                                    oni_VideoFrameRef * frame,
+                                    const oni_CameraIntrinsics * intrinsics,
+                                    oni_Plane * planes, int * count);
+oni_Status oni_detectDescriptor_PlaneDetector(oni_PlaneDetector * detector,
+                                              const oni_FrameDescriptor * desc,
+                                              const oni_CameraIntrinsics * intrinsics,
+                                              oni_Plane * planes, int * count);
+// oni_getLabels_PlaneDetector: The inlier masks of the last detection as one
+// label image, 'width' x 'height', packed: 0 for no plane, i + 1 for
+// planes[i].  Owned by the detector and valid until the next detection.
+const uint8_t * oni_getLabels_PlaneDetector(oni_PlaneDetector * detector,
+                                            int * width, int * height);
+
+// ===============
+// Occupancy grids
+// ===============
+// An oni_OccupancyGrid projects depth frames into a 2D grid on the ground.
+// The world frame is that of oni_CameraIntrinsics for a level camera: X to
+// the right, Y up (the height) and Z ahead; the grid spans X and Z.  Frames
+// from several devices, each with its own oni_SensorPose, may be integrated
+// from different threads at once.
+// oni_OCCUPANCY_UNKNOWN: No point fell into the cell.
+extern const int oni_OCCUPANCY_UNKNOWN;
+// oni_OCCUPANCY_FREE: Only ground, i.e. points below the height band, was
+// seen in the cell.
+extern const int oni_OCCUPANCY_FREE;
+// oni_OCCUPANCY_OCCUPIED: Enough points within the height band fell into the
+// cell.
+extern const int oni_OCCUPANCY_OCCUPIED;
+// oni_new_OccupancyGrid: A grid of 'columns' x 'rows' cells 'cellSize' (in
+// mm) wide, column 0 starting at X = 'originX' and row 0 at Z = 'originZ'.
+oni_OccupancyGrid * oni_new_OccupancyGrid(int columns, int rows, float cellSize,
+                                          float originX, float originZ);
+void oni_delete_OccupancyGrid(oni_OccupancyGrid * grid);
+// oni_setHeightBand_OccupancyGrid: Points with heights from 'minHeight' up
+// to 'maxHeight' (in mm) are obstacles; those below are ground, and those
+// above (e.g. ceilings) are ignored.  The default is 50 to 2000.
+void oni_setHeightBand_OccupancyGrid(oni_OccupancyGrid * grid,
+                                     float minHeight, float maxHeight);
+// oni_setMinHits_OccupancyGrid: How many obstacle points make a cell
+// occupied (default 2), so that single noisy pixels do not.
+void oni_setMinHits_OccupancyGrid(oni_OccupancyGrid * grid, int hits);
+// oni_clear_OccupancyGrid: Forget everything integrated so far, e.g. at the
+// start of each cycle.
+void oni_clear_OccupancyGrid(oni_OccupancyGrid * grid);
+// oni_integrate_OccupancyGrid: Add a depth frame taken from 'pose', which
+// may be NULL for the identity.
+oni_Status oni_integrate_OccupancyGrid(oni_OccupancyGrid * grid,
+                                       oni_VideoFrameRef * frame,
+                                       const oni_CameraIntrinsics * intrinsics,
+                                       const oni_SensorPose * pose);
+oni_Status oni_integrateDescriptor_OccupancyGrid(oni_OccupancyGrid * grid,
+                                                 const oni_FrameDescriptor * desc,
+                                                 const oni_CameraIntrinsics * intrinsics,
+                                                 const oni_SensorPose * pose);
+// oni_getOccupancy_OccupancyGrid: One oni_OCCUPANCY_* value per cell, row by
+// row.  The height map is the highest point (in mm) seen in each cell below
+// the top of the height band, NaN where none was.  Both are owned by the
+// grid; read them while nothing is being integrated.
+const uint8_t * oni_getOccupancy_OccupancyGrid(oni_OccupancyGrid * grid,
+                                               int * columns, int * rows);
+const float * oni_getHeightMap_OccupancyGrid(oni_OccupancyGrid * grid,
+                                             int * columns, int * rows);
+
+// =================
+// Volumetric fusion
+// =================
+// An oni_TsdfVolume fuses depth frames, each with the oni_SensorPose it was
+// taken from, into a truncated signed distance function (TSDF) with no fixed
+// extent, and renders it back by raycasting.
+// oni_new_TsdfVolume: Voxels 'voxelSize' wide, with distances truncated at
+// 'truncation' (both in mm), which must be at least one voxel.
+oni_TsdfVolume * oni_new_TsdfVolume(float voxelSize, float truncation);
+void oni_delete_TsdfVolume(oni_TsdfVolume * volume);
+// oni_setDepthRange_TsdfVolume: Only integrate depths (in mm) from
+// 'minDepth' to 'maxDepth', and only raycast within them; the default is
+// 300 to 5000.
+void oni_setDepthRange_TsdfVolume(oni_TsdfVolume * volume, float minDepth,
+                                  float maxDepth);
+// oni_setMaxWeight_TsdfVolume: Cap on how many observations a voxel averages
+// (default 64); lower values follow changes in the scene faster.
+void oni_setMaxWeight_TsdfVolume(oni_TsdfVolume * volume, int weight);
+// oni_reset_TsdfVolume: Drop everything fused so far.
+void oni_reset_TsdfVolume(oni_TsdfVolume * volume);
+int oni_getBlockCount_TsdfVolume(oni_TsdfVolume * volume);
+// oni_integrate_TsdfVolume: Fuse a depth frame taken from 'pose', which may
+// be NULL for the identity.
+oni_Status oni_integrate_TsdfVolume(oni_TsdfVolume * volume,
+                                    oni_VideoFrameRef * frame,
+                                    const oni_CameraIntrinsics * intrinsics,
+                                    const oni_SensorPose * pose);
+oni_Status oni_integrateDescriptor_TsdfVolume(oni_TsdfVolume * volume,
+                                              const oni_FrameDescriptor * desc,
+                                              const oni_CameraIntrinsics * intrinsics,
+                                              const oni_SensorPose * pose);
+// oni_raycast_TsdfVolume: Render the surface as seen from 'pose' through a
+// camera with 'intrinsics', into 'depth' (in mm, 0 where nothing was hit)
+// and, unless NULL, 'normals' (3 floats per pixel, facing the camera, NaN
+// where unknown), both intrinsics.width x intrinsics.height.  Raycasting
+// from the same pose and intrinsics as last time only recasts the pixels
+// that blocks changed since then project onto.
+oni_Status oni_raycast_TsdfVolume(oni_TsdfVolume * volume,
+                                  const oni_CameraIntrinsics * intrinsics,
+                                  const oni_SensorPose * pose,
+                                  oni_DepthPixel * depth, float * normals);
+
+// ===============
+// Visual odometry
+// ===============
+// An oni_Odometry follows a moving depth camera by aligning each depth frame
+// with the one before it (point-to-plane ICP).  Poses drift slowly, as with
+// any frame-to-frame tracker.
+// oni_new_Odometry: Track over a pyramid of 'levels' levels (3 is usual),
+// each half the size of the one before.
+oni_Odometry * oni_new_Odometry(int levels);
+void oni_delete_Odometry(oni_Odometry * odometry);
+// oni_setIterations_Odometry: ICP iterations at 'level', 0 being full size.
+// The defaults are 4 at level 0, 5 at level 1 and 10 at coarser levels.
+// Iteration stops early once the motion stops changing.
+void oni_setIterations_Odometry(oni_Odometry * odometry, int level,
+                                int iterations);
+// oni_setThresholds_Odometry: Pixels only pair up if their points are at
+// most 'maxDistance' (in mm) apart and their normals at most 'maxAngle'
+// degrees; the defaults are 100 mm and 30 degrees.
+void oni_setThresholds_Odometry(oni_Odometry * odometry, float maxDistance,
+                                float maxAngle);
+// oni_reset_Odometry: Forget the previous frame, so that the next one starts
+// over at 'pose' (NULL for the identity).
+void oni_reset_Odometry(oni_Odometry * odometry, const oni_SensorPose * pose);
+// oni_track_Odometry: Align a depth frame with the last one and put the pose
+// it was taken from into 'pose': the first frame's camera coordinates (or
+// those of the pose given to oni_reset_Odometry) are the world frame.  If
+// 'stats' is not NULL it says how well the frame lined up.  A frame that
+// could not be tracked keeps the last pose, but still becomes the frame the
+// next one is aligned with.
+oni_Status oni_track_Odometry(oni_Odometry * odometry, oni_VideoFrameRef * frame,
+                              const oni_CameraIntrinsics * intrinsics,
+                              oni_SensorPose * pose, oni_OdometryStats * stats);
+oni_Status oni_trackDescriptor_Odometry(oni_Odometry * odometry,
+                                        const oni_FrameDescriptor * desc,
+                                        const oni_CameraIntrinsics * intrinsics,
+                                        oni_SensorPose * pose,
+                                        oni_OdometryStats * stats);
+
+// =============
+// Blob tracking
+// =============
+// An oni_BlobTracker finds the people and objects in front of a depth
+// camera's usual view and follows them from frame to frame; use one per
+// stream.
+// oni_new_BlobTracker: Pixels more than 'threshold' mm in front of the
+// running background depth are foreground, and its 8-connected regions are
+// the blobs.  Report at most 'maxBlobs' (at most 255) blobs, of at least
+// 'minPixels' pixels each.
+oni_BlobTracker * oni_new_BlobTracker(int maxBlobs, float threshold,
+                                      int minPixels);
+void oni_delete_BlobTracker(oni_BlobTracker * tracker);
+// oni_setLearningRate_BlobTracker: How fast the background follows the
+// scene, from 0 (frozen once seen) to 1 (the last frame); the default is
+// 0.05.  Foreground pixels never update it, and pixels farther than it
+// replace it at once.
+void oni_setLearningRate_BlobTracker(oni_BlobTracker * tracker, float rate);
+// oni_setTracking_BlobTracker: A blob continues a track if its centroid is
+// within 'maxDistance' mm of where the track was expected (default 300), and
+// a track is forgotten after 'maxMissed' frames without one (default 10).
+void oni_setTracking_BlobTracker(oni_BlobTracker * tracker, float maxDistance,
+                                 int maxMissed);
+// oni_resetBackground_BlobTracker: Forget the background, so that the next
+// frame becomes it.
+void oni_resetBackground_BlobTracker(oni_BlobTracker * tracker);
+// oni_update_BlobTracker: Fold a depth frame into the background and put its
+// blobs, largest first, into 'blobs' (room for 'maxBlobs') and their number
+// into 'count'.  The first frame, and the first after a change of frame size,
+// only sets the background.
+oni_Status oni_update_BlobTracker(oni_BlobTracker * tracker,
+                                  oni_VideoFrameRef * frame,
+                                  const oni_CameraIntrinsics * intrinsics,
+                                  oni_Blob * blobs, int * count);
+oni_Status oni_updateDescriptor_BlobTracker(oni_BlobTracker * tracker,
+                                            const oni_FrameDescriptor * desc,
+                                            const oni_CameraIntrinsics * intrinsics,
+                                            oni_Blob * blobs, int * count);
+// oni_getLabels_BlobTracker: The blobs of the last frame as one label image,
+// 'width' x 'height', packed: 0 for none, i + 1 for blobs[i].  Owned by the
+// tracker and valid until the next frame.
+const uint8_t * oni_getLabels_BlobTracker(oni_BlobTracker * tracker,
+                                          int * width, int * height);
+// oni_getForeground_BlobTracker: The same for the foreground mask (1 for
+// foreground), including regions too small to be blobs.
+const uint8_t * oni_getForeground_BlobTracker(oni_BlobTracker * tracker,
+                                              int * width, int * height);
+
+// ============
+// Tone mapping
+// ============
+// An oni_ToneMapper maps 16-bit frames (IR, GRAY16 or depth) to 8 bits by
+// stretching the range between two percentiles over 0 to 255, optionally
+// followed by local contrast equalization (CLAHE) and a gamma curve.  In depth
+// frames missing (zero) pixels map to 0.
+// oni_new_ToneMapper: For pixel values up to 'maxValue' (e.g. from
+// oni_getMaxPixelValue).  Histograms have one bin per value up to 4095 and
+// proportionally wider bins beyond; larger values count as 'maxValue'.
+oni_ToneMapper * oni_new_ToneMapper(int maxValue);
+void oni_delete_ToneMapper(oni_ToneMapper * mapper);
+// oni_setPercentiles_ToneMapper: The percentiles (0 to 100) that map to 0
+// and 255; the defaults are 1 and 99.
+void oni_setPercentiles_ToneMapper(oni_ToneMapper * mapper, float low,
+                                   float high);
+// oni_setGamma_ToneMapper: Map x in [0, 1] to x ^ (1 / gamma) as the last
+// step, so that gammas above 1 brighten dark areas; the default of 1 leaves
+// the output alone.
+void oni_setGamma_ToneMapper(oni_ToneMapper * mapper, float gamma);
+// oni_setReuseHistogram_ToneMapper: If true, stretch each frame by the
+// previous frame's histogram, counting its own in the same pass, which saves
+// a pass over the frame at the cost of lagging one frame behind changes in
+// brightness.  The first frame after turning this on takes two passes.
+void oni_setReuseHistogram_ToneMapper(oni_ToneMapper * mapper, bool reuse);
+// oni_setLocalContrast_ToneMapper: Equalize the stretched image on a grid of
+// 'tilesX' x 'tilesY' tiles (0 for either turns this off, the default), with
+// each tile's histogram clipped at 'clipLimit' times its mean bin count (e.g.
+// 2; 0 for no limit) so that noise in flat areas is not blown up.  Pixels
+// blend the mappings of the four nearest tiles.
+void oni_setLocalContrast_ToneMapper(oni_ToneMapper * mapper, int tilesX,
+                                     int tilesY, float clipLimit);
+// oni_getRange_ToneMapper: The pixel values that the last frame's stretch
+// mapped to 0 and 255.
+void oni_getRange_ToneMapper(oni_ToneMapper * mapper, int * low, int * high);
+// oni_map_ToneMapper: Map a 16-bit frame into 'out', which must hold
+// width * height bytes, packed.
+oni_Status oni_map_ToneMapper(oni_ToneMapper * mapper, oni_VideoFrameRef * frame,
+                              uint8_t * out);
+oni_Status oni_mapDescriptor_ToneMapper(oni_ToneMapper * mapper,
+                                        const oni_FrameDescriptor * desc,
+                                        uint8_t * out);
+
+// =============
+// JPEG decoding
+// =============
+// An oni_JpegDecoder decodes PIXEL_FORMAT_JPEG color frames on its own worker
+// threads, several at once, and hands them back in the order they were
+// submitted, optionally scaled down by 2, 4 or 8.
+// oni_new_JpegDecoder: Start 'threadCount' workers (0 for one per core).  At
+// most 'maxPending' frames can be submitted but not yet received.  Returns
+// NULL if the library was built without libjpeg.
+oni_JpegDecoder * oni_new_JpegDecoder(int threadCount, int maxPending);
+// oni_delete_JpegDecoder: Discards pending frames.  Frames already received
+// are invalid afterwards.
+void oni_delete_JpegDecoder(oni_JpegDecoder * decoder);
+// oni_setOutput_JpegDecoder: Decode frames submitted from now on to 'format'
+// (PIXEL_FORMAT_RGB888, the default; PIXEL_FORMAT_YUV422, as UYVY with the
+// chroma of each pair averaged; or PIXEL_FORMAT_GRAY8) at 1 / 'scale' of the
+// size, where 'scale' is 1, 2, 4 or 8.  Sizes round up.
+oni_Status oni_setOutput_JpegDecoder(oni_JpegDecoder * decoder,
+                                     oni_PixelFormat format, int scale);
+// oni_submit_JpegDecoder: Queue a JPEG frame for decoding, keeping a
+// reference to it until it is decoded, and put its sequence number in
+// '*sequence' if that is not NULL.  Returns oni_STATUS_OUT_OF_FLOW if
+// 'maxPending' frames are already waiting to be received.
+oni_Status oni_submit_JpegDecoder(oni_JpegDecoder * decoder,
+                                  oni_VideoFrameRef * frame,
+                                  uint64_t * sequence);
+// oni_submitDescriptor_JpegDecoder: As above, but copy the compressed data.
+oni_Status oni_submitDescriptor_JpegDecoder(oni_JpegDecoder * decoder,
+                                            const oni_FrameDescriptor * desc,
+                                            uint64_t * sequence);
+// oni_receive_JpegDecoder: Get the oldest submitted frame, waiting up to
+// 'timeoutMs' milliseconds (-1 for no limit) for it to be decoded.  Returns
+// oni_STATUS_TIME_OUT if it was not.  A frame that failed to decode is still
+// received, with the error in 'frame->status'.
+oni_Status oni_receive_JpegDecoder(oni_JpegDecoder * decoder,
+                                   oni_DecodedFrame * frame, int timeoutMs);
+// oni_release_DecodedFrame: Give the frame's buffer back to the pool.
+void oni_release_DecodedFrame(oni_JpegDecoder * decoder,
+                              oni_DecodedFrame * frame);
+// oni_getPending_JpegDecoder: How many frames are submitted but not yet
+// received.
+int oni_getPending_JpegDecoder(oni_JpegDecoder * decoder);
+
+// ============
+// Frame export
+// ============
+// An oni_FrameExporter writes frames to disk as PNG (16-bit for depth and
+// GRAY16, 8-bit for GRAY8 and RGB888) and point clouds as PLY or PCD on its
+// own threads.  Submitting never waits: a file that would take the queued
+// work over the memory budget is refused.
+// oni_new_FrameExporter: Start 'threadCount' encoders (0 for one per core)
+// that hold at most 'maxBytes' of queued work.
+oni_FrameExporter * oni_new_FrameExporter(int threadCount, uint64_t maxBytes);
+// oni_delete_FrameExporter: Waits for everything submitted to be written (and
+// synced, with a sync interval) first.
+void oni_delete_FrameExporter(oni_FrameExporter * exporter);
+// oni_setCompression_FrameExporter: The zlib level for PNGs, 0 (none) to 9;
+// the default is 1, the fastest.
+void oni_setCompression_FrameExporter(oni_FrameExporter * exporter,
+                                      int level);
+// oni_setSyncInterval_FrameExporter: fsync written files in batches of
+// 'files' (0 for never, the default, which leaves it to the OS).
+void oni_setSyncInterval_FrameExporter(oni_FrameExporter * exporter,
+                                       int files);
+// oni_exportPng_FrameExporter: Queue the frame to be written to 'path' as a
+// PNG.  The exporter keeps a reference to the frame until it is encoded.
+// Returns oni_STATUS_OUT_OF_FLOW if the budget is used up, and
+// oni_STATUS_NOT_SUPPORTED if the library was built without zlib.
+oni_Status oni_exportPng_FrameExporter(oni_FrameExporter * exporter,
+                                       oni_VideoFrameRef * frame,
+                                       const char * path);
+// oni_exportPngDescriptor_FrameExporter: As above, but copy the pixels.
+oni_Status oni_exportPngDescriptor_FrameExporter(oni_FrameExporter * exporter,
+                                                 const oni_FrameDescriptor * desc,
+                                                 const char * path);
+// oni_exportCloud_FrameExporter: Queue a depth frame to be turned into
+// points, as oni_convertDepthToWorld1 would with 'intrinsics', on an encoder
+// thread and written to 'path'.  Missing pixels are left out.
+oni_Status oni_exportCloud_FrameExporter(oni_FrameExporter * exporter,
+                                         oni_VideoFrameRef * frame,
+                                         const oni_CameraIntrinsics * intrinsics,
+                                         oni_CloudFormat format,
+                                         const char * path);
+oni_Status oni_exportCloudDescriptor_FrameExporter(
+    oni_FrameExporter * exporter, const oni_FrameDescriptor * desc,
+    const oni_CameraIntrinsics * intrinsics, oni_CloudFormat format,
+    const char * path);
+// oni_exportPoints_FrameExporter: Queue a copy of 'count' points (e.g. from
+// oni_getPoints_PointCloud) to be written, with their colors, to 'path'.
+oni_Status oni_exportPoints_FrameExporter(oni_FrameExporter * exporter,
+                                          const oni_PointXYZRGB * points,
+                                          int count, oni_CloudFormat format,
+                                          const char * path);
+// oni_flush_FrameExporter: Wait up to 'timeoutMs' milliseconds (-1 for no
+// limit) for everything submitted so far to be written, and synced if there
+// is a sync interval.
+oni_Status oni_flush_FrameExporter(oni_FrameExporter * exporter,
+                                   int timeoutMs);
+void oni_getStats_FrameExporter(oni_FrameExporter * exporter,
+                                oni_ExportStats * stats);
+
+// =============
+// Frame history
+// =============
+// An oni_FrameHistory keeps the most recent frames of a stream by reference,
+// numbered in the order they arrive, for lookups by timestamp or frame index.
+// Lookups take no lock.
+// oni_new_FrameHistory: Keep at most 'capacity' frames, and (if 'duration'
+// is not 0) none more than 'duration' microseconds older than the newest.
+// If timestamps or frame indices go backwards (e.g. a looping recording),
+// the history starts over.
+oni_FrameHistory * oni_new_FrameHistory(int capacity, uint64_t duration);
+void oni_delete_FrameHistory(oni_FrameHistory * history);
+// oni_attach_FrameHistory: Add every new frame of 'stream' from a frame
+// listener, which reads the frames itself, so do not also call oni_readFrame
+// on that stream.
+oni_Status oni_attach_FrameHistory(oni_FrameHistory * history,
+                                   oni_VideoStream * stream);
+void oni_detach_FrameHistory(oni_FrameHistory * history);
+// oni_push_FrameHistory: Add a frame (the history keeps its own reference).
+// Only one thread may add frames at a time.
+oni_Status oni_push_FrameHistory(oni_FrameHistory * history,
+                                 oni_VideoFrameRef * frame);
+// oni_setSpill_FrameHistory: Pack the pixels of every frame but the newest
+// 'hotFrames' on a background thread and release the frame (0 turns this off,
+// the default), and evict the oldest frames while packed ones take more than
+// 'maxBytes' (0 for no limit).
+void oni_setSpill_FrameHistory(oni_FrameHistory * history, int hotFrames,
+                               uint64_t maxBytes);
+// oni_getRange_FrameHistory: The frames in the history are numbered 'first'
+// up to but not including 'end'.
+void oni_getRange_FrameHistory(oni_FrameHistory * history, uint64_t * first,
+                               uint64_t * end);
+// oni_findTimestamp_FrameHistory: The number of the frame whose timestamp is
+// nearest 'timestamp'.  Returns oni_STATUS_NO_DEVICE if the history is empty.
+oni_Status oni_findTimestamp_FrameHistory(oni_FrameHistory * history,
+                                          uint64_t timestamp,
+                                          uint64_t * sequence);
+// oni_findFrameIndex_FrameHistory: The number of the frame with this frame
+// index.  Returns oni_STATUS_NO_DEVICE if it is not in the history.
+oni_Status oni_findFrameIndex_FrameHistory(oni_FrameHistory * history,
+                                           int frameIndex,
+                                           uint64_t * sequence);
+// oni_getDescriptor_FrameHistory: The descriptor of a frame, with 'data'
+// NULL; 'dataSize' is what oni_copyFrame_FrameHistory needs.  This and the
+// functions below return oni_STATUS_NO_DEVICE once the frame is evicted.
+oni_Status oni_getDescriptor_FrameHistory(oni_FrameHistory * history,
+                                          uint64_t sequence,
+                                          oni_FrameDescriptor * desc);
+// oni_getFrame_FrameHistory: Point 'frame' at the frame itself.  Returns
+// oni_STATUS_NOT_SUPPORTED if it has been spilled.
+oni_Status oni_getFrame_FrameHistory(oni_FrameHistory * history,
+                                     uint64_t sequence,
+                                     oni_VideoFrameRef * frame);
+// oni_copyFrame_FrameHistory: Copy (or unpack) the frame's pixels into
+// 'buffer', which holds 'size' bytes, and describe them in 'desc'.  Spilled
+// 16-bit frames come back with packed rows.
+oni_Status oni_copyFrame_FrameHistory(oni_FrameHistory * history,
+                                      uint64_t sequence, void * buffer,
+                                      int size, oni_FrameDescriptor * desc);
+void oni_getStats_FrameHistory(oni_FrameHistory * history,
+                               oni_HistoryStats * stats);
+
+// ===============
+// Clock alignment
+// ===============
+// An oni_ClockAligner (one per device) maps the device's timestamps to the
+// host's CLOCK_MONOTONIC, in microseconds, learning the mapping from when
+// frames arrive.  Mapped times include the minimum transfer latency, so
+// frames from several devices of the same kind can be matched on host time.
+oni_ClockAligner * oni_new_ClockAligner();
+void oni_delete_ClockAligner(oni_ClockAligner * aligner);
+// oni_setWindow_ClockAligner: Bucket samples by 'bucketMs' milliseconds of
+// device time (default 250), and halve the weight of buckets every
+// 'halfLife' seconds (default 30).
+void oni_setWindow_ClockAligner(oni_ClockAligner * aligner, int bucketMs,
+                                float halfLife);
+void oni_reset_ClockAligner(oni_ClockAligner * aligner);
+// oni_observe_ClockAligner: Add a sample of the frame's timestamp against the
+// host clock now.  Call this as soon as the frame is read, e.g. in a new-frame
+// listener.
+oni_Status oni_observe_ClockAligner(oni_ClockAligner * aligner,
+                                    oni_VideoFrameRef * frame);
+// oni_addSample_ClockAligner: Add a sample taken elsewhere; 'hostTimestamp'
+// is on the clock oni_getHostTime reads.
+void oni_addSample_ClockAligner(oni_ClockAligner * aligner,
+                                uint64_t deviceTimestamp,
+                                uint64_t hostTimestamp);
+// oni_toHost_ClockAligner: A device timestamp in host microseconds, or 0
+// before the first sample.
+uint64_t oni_toHost_ClockAligner(oni_ClockAligner * aligner,
+                                 uint64_t deviceTimestamp);
+// oni_toDevice_ClockAligner: The reverse, e.g. to look a host time up in an
+// oni_FrameHistory of the device's frames.
+uint64_t oni_toDevice_ClockAligner(oni_ClockAligner * aligner,
+                                   uint64_t hostTimestamp);
+// oni_getFrameDescriptor_ClockAligner: Like oni_getFrameDescriptor, but with
+// 'timestamp' in host microseconds.
+oni_Status oni_getFrameDescriptor_ClockAligner(oni_ClockAligner * aligner,
+                                               oni_VideoFrameRef * frame,
+                                               oni_FrameDescriptor * desc);
+void oni_getStats_ClockAligner(oni_ClockAligner * aligner,
+                               oni_ClockStats * stats);
+// oni_getHostTime: CLOCK_MONOTONIC, in microseconds.
+uint64_t oni_getHostTime();
+
+// =================
+// Resilient devices
+// =================
+// An oni_ResilientDevice is a device and its streams (one per sensor type)
+// that survive the device being unplugged: settings and listeners made through
+// the handle are replayed when it comes back, on the same oni_VideoStreams.
+// Changes made while it is away return oni_STATUS_OK, and any it refuses on
+// its return are dropped (see oni_RecoveryStats).  Anything done to the device
+// or its streams directly is lost on a reconnect.
+oni_ResilientDevice * oni_new_ResilientDevice();
+void oni_delete_ResilientDevice(oni_ResilientDevice * device);
+// oni_open_ResilientDevice: Open the device as oni_open would.  With a 'uri',
+// the device comes back when a device with that URI appears; with NULL (any
+// device), when one with the same USB vendor and product IDs does.
+oni_Status oni_open_ResilientDevice(oni_ResilientDevice * device,
+                                    const char * uri);
+// oni_addStream_ResilientDevice: Create the stream for 'sensorType'.
+oni_Status oni_addStream_ResilientDevice(oni_ResilientDevice * device,
+                                         oni_SensorType sensorType);
+// oni_getStream_ResilientDevice: The stream for 'sensorType'.  The device owns
+// it, and destroys and creates it again behind the same pointer on a
+// reconnect, so it may only be used (e.g. with oni_readFrame) inside a
+// listener added with oni_addNewFrameListener_ResilientDevice, which is
+// passed this pointer.
+oni_VideoStream * oni_getStream_ResilientDevice(oni_ResilientDevice * device,
+                                                oni_SensorType sensorType);
+// oni_getStreamProperty_ResilientDevice: As oni_getProperty_VideoStream on the
+// stream for 'sensorType'; oni_STATUS_NO_DEVICE while the device is away.
+oni_Status oni_getStreamProperty_ResilientDevice(oni_ResilientDevice * device,
+                                                 oni_SensorType sensorType,
+                                                 int propertyId, void * data,
+                                                 int * dataSize);
+oni_Status oni_start_ResilientDevice(oni_ResilientDevice * device,
+                                     oni_SensorType sensorType);
+void oni_stop_ResilientDevice(oni_ResilientDevice * device,
+                              oni_SensorType sensorType);
+// oni_setVideoMode_ResilientDevice, oni_setCropping_ResilientDevice,
+// oni_resetCropping_ResilientDevice, oni_setMirroringEnabled_ResilientDevice,
+// oni_setStreamProperty_ResilientDevice: As oni_setVideoMode and the rest on
+// the stream for 'sensorType'.  On a reconnect, the video mode is restored
+// first and cropping next.
+oni_Status oni_setVideoMode_ResilientDevice(oni_ResilientDevice * device,
+                                            oni_SensorType sensorType,
+                                            oni_VideoMode * videoMode);
+oni_Status oni_setCropping_ResilientDevice(oni_ResilientDevice * device,
+                                           oni_SensorType sensorType,
+                                           int originX, int originY,
+                                           int width, int height);
+oni_Status oni_resetCropping_ResilientDevice(oni_ResilientDevice * device,
+                                             oni_SensorType sensorType);
+oni_Status oni_setMirroringEnabled_ResilientDevice(
+    oni_ResilientDevice * device, oni_SensorType sensorType, bool isEnabled);
+oni_Status oni_setStreamProperty_ResilientDevice(oni_ResilientDevice * device,
+                                                 oni_SensorType sensorType,
+                                                 int propertyId,
+                                                 const void * data,
+                                                 int dataSize);
+// oni_setProperty_ResilientDevice, oni_setImageRegistrationMode_ResilientDevice,
+// oni_setDepthColorSyncEnabled_ResilientDevice: As the oni_Device versions.
+// These are restored after the streams are created.
+oni_Status oni_setProperty_ResilientDevice(oni_ResilientDevice * device,
+                                           int propertyId, const void * data,
+                                           int dataSize);
+oni_Status oni_setImageRegistrationMode_ResilientDevice(
+    oni_ResilientDevice * device, oni_ImageRegistrationMode mode);
+oni_Status oni_setDepthColorSyncEnabled_ResilientDevice(
+    oni_ResilientDevice * device, bool isEnabled);
+// oni_addNewFrameListener_ResilientDevice: Call 'listener->fnPtr' with the
+// stream for 'sensorType' on each new frame, as oni_addNewFrameListener would,
+// across reconnects.  Listeners may call the handle's other functions, but
+// must not add or remove listeners or stop their own stream.
+oni_Status oni_addNewFrameListener_ResilientDevice(
+    oni_ResilientDevice * device, oni_SensorType sensorType,
+    oni_NewFrameListener * listener);
+// oni_removeNewFrameListener_ResilientDevice: Remove a listener with the same
+// 'fnPtr'.  It is not called again once this returns.
+void oni_removeNewFrameListener_ResilientDevice(
+    oni_ResilientDevice * device, oni_SensorType sensorType,
+    oni_NewFrameListener * listener);
+// oni_setRetryInterval_ResilientDevice: While the device is away, try to
+// reopen it every 'intervalMs' milliseconds (default 250) as well as when it
+// is reported connected.
+void oni_setRetryInterval_ResilientDevice(oni_ResilientDevice * device,
+                                          int intervalMs);
+void oni_getStats_ResilientDevice(oni_ResilientDevice * device,
+                                  oni_RecoveryStats * stats);
+
 // ====================================
 // openni::VideoMode  ->  oni_VideoMode
 // ====================================
@@ -223,6 +1238,10 @@ oni_Status oni_addNewFrameListener(oni_VideoStream * stream,
 oni_Status oni_create_VideoStream(oni_VideoStream * stream, oni_Device * device,
                                   oni_SensorType sensorType);
 void oni_destroy_VideoStream(oni_VideoStream * stream);
+// oni_getCameraIntrinsics: Pinhole intrinsics for the stream's current video
+// mode, derived from its fields of view.
+oni_Status oni_getCameraIntrinsics(oni_VideoStream * stream,
+                                   oni_CameraIntrinsics * intrinsics);
 // oni_getCameraSettings: You do not own the returned object.
 oni_CameraSettings * oni_getCameraSettings(oni_VideoStream * stream);
 bool oni_getCropping(oni_VideoStream * stream, int *pOriginX, int *pOriginY,
@@ -237,6 +1256,9 @@ oni_SensorInfo * oni_getSensorInfo_VideoStream(oni_VideoStream * stream);
 float oni_getVerticalFieldOfView(oni_VideoStream * stream);
 // oni_getVideoMode_VideoStream: You must delete this object when done.
 oni_VideoMode * oni_getVideoMode_VideoStream(oni_VideoStream * stream);
+// oni_getVideoModeInfo_VideoStream: The same, by value, so nothing needs to be
+// deleted.  All fields are 0 on error.
+oni_VideoModeInfo oni_getVideoModeInfo_VideoStream(oni_VideoStream * stream);
 oni_Status oni_invoke_VideoStream(oni_VideoStream * stream, int commandId,
                                   void *data, int dataSize);
 bool oni_isCommandSupported_VideoStream(oni_VideoStream * stream, int commandId);
@@ -253,6 +1275,27 @@ oni_Status oni_setCropping(oni_VideoStream * stream, int originX, int originY,
 oni_Status oni_setMirroringEnabled(oni_VideoStream * stream, bool isEnabled);
 oni_Status oni_setProperty_VideoStream(oni_VideoStream * stream, int propertyId,
                                        const void *data, int dataSize);
+// oni_getProperties_VideoStream, oni_setProperties_VideoStream,
+// oni_enablePropertyCache_VideoStream, oni_invalidatePropertyCache_VideoStream,
+// oni_setPropertyCacheable_VideoStream, oni_setPropertyAsync_VideoStream: As
+// with the _Device versions.  The default cached set for a stream is the
+// fields of view, the pixel value range, the video mode, the stride, cropping
+// and mirroring.  oni_setVideoMode, oni_setCropping, oni_resetCropping and
+// oni_setMirroringEnabled also empty the stream's cache.
+oni_Status oni_getProperties_VideoStream(oni_VideoStream * stream,
+                                         oni_PropertyRequest * requests,
+                                         int count);
+oni_Status oni_setProperties_VideoStream(oni_VideoStream * stream,
+                                         oni_PropertyRequest * requests,
+                                         int count);
+oni_Status oni_enablePropertyCache_VideoStream(oni_VideoStream * stream,
+                                               bool enabled);
+void oni_invalidatePropertyCache_VideoStream(oni_VideoStream * stream);
+oni_Status oni_setPropertyCacheable_VideoStream(oni_VideoStream * stream,
+                                                int propertyId, bool cacheable);
+oni_Status oni_setPropertyAsync_VideoStream(oni_VideoStream * stream,
+                                            int propertyId, const void *data,
+                                            int dataSize);
 oni_Status oni_setVideoMode(oni_VideoStream * stream,
                             oni_VideoMode * videoMode);
 oni_Status oni_start_VideoStream(oni_VideoStream * stream);
@@ -0,0 +1,205 @@
+// ============================================================================
+// openni2_wrapper_inline.hpp: Optional, header-only C++ fast path alongside
+// the C interface.  The functions here take the same handles as the C
+// functions (e.g. oni::getWidth(ref) for oni_getWidth(ref)) but are inline
+// calls straight into OpenNI, so the compiler can fold them into the caller.
+// Unlike the C functions they do not catch exceptions, and property gets do
+// not go through the property cache (property sets do, so that it is emptied
+// as the C setters would).  Property IDs with a known type have typed
+// templates whose type checks happen at compile time, e.g.
+//     float hfov;
+//     oni::getProperty<openni::STREAM_PROPERTY_HORIZONTAL_FOV>(stream, &hfov);
+// (c) Chris Hodapp, 2013
+// ============================================================================
+#ifndef OPENNI2_WRAPPER_INLINE
+#define OPENNI2_WRAPPER_INLINE
+
+#include <OpenNI.h>
+#include <type_traits>
+
+#include "openni2_types_cxx.h"
+#include "openni2_types.h"
+#include "openni2_wrapper.h"
+
+namespace oni {
+
+// ===============
+// Property traits
+// ===============
+// device_property<Id>::type and stream_property<Id>::type: The value type of a
+// property.  IDs without a specialization don't compile with the typed
+// templates; use the untyped overloads for those.
+template <int Id> struct device_property;
+template <int Id> struct stream_property;
+
+#define ONI_INLINE_PROPERTY(traits, id, valueType)  \
+    template <> struct traits<openni::id> { typedef valueType type; }
+
+// Strings are ONI_MAX_STR (256) bytes in OpenNI.
+typedef char property_string[256];
+
+ONI_INLINE_PROPERTY(device_property, DEVICE_PROPERTY_FIRMWARE_VERSION, property_string);
+ONI_INLINE_PROPERTY(device_property, DEVICE_PROPERTY_SERIAL_NUMBER, property_string);
+ONI_INLINE_PROPERTY(device_property, DEVICE_PROPERTY_ERROR_STATE, int);
+ONI_INLINE_PROPERTY(device_property, DEVICE_PROPERTY_IMAGE_REGISTRATION, int);
+ONI_INLINE_PROPERTY(device_property, DEVICE_PROPERTY_PLAYBACK_SPEED, float);
+ONI_INLINE_PROPERTY(device_property, DEVICE_PROPERTY_PLAYBACK_REPEAT_ENABLED, int);
+
+ONI_INLINE_PROPERTY(stream_property, STREAM_PROPERTY_HORIZONTAL_FOV, float);
+ONI_INLINE_PROPERTY(stream_property, STREAM_PROPERTY_VERTICAL_FOV, float);
+ONI_INLINE_PROPERTY(stream_property, STREAM_PROPERTY_MAX_VALUE, int);
+ONI_INLINE_PROPERTY(stream_property, STREAM_PROPERTY_MIN_VALUE, int);
+ONI_INLINE_PROPERTY(stream_property, STREAM_PROPERTY_STRIDE, int);
+ONI_INLINE_PROPERTY(stream_property, STREAM_PROPERTY_MIRRORING, int);
+ONI_INLINE_PROPERTY(stream_property, STREAM_PROPERTY_NUMBER_OF_FRAMES, int);
+ONI_INLINE_PROPERTY(stream_property, STREAM_PROPERTY_AUTO_WHITE_BALANCE, int);
+ONI_INLINE_PROPERTY(stream_property, STREAM_PROPERTY_AUTO_EXPOSURE, int);
+
+#undef ONI_INLINE_PROPERTY
+
+// property_value<T, Want>: Whether a T may be passed for a property of type
+// 'Want': the same type, or an enum of its size (e.g. ImageRegistrationMode
+// for an int).
+template <class T, class Want, bool = std::is_enum<T>::value>
+struct property_value : std::is_same<T, Want> {};
+template <class T, class Want>
+struct property_value<T, Want, true>
+    : std::integral_constant<bool, sizeof(T) == sizeof(Want)> {};
+
+// ================
+// Typed properties
+// ================
+template <int Id, class T>
+inline oni_Status getProperty(oni_Device * device, T * value)
+{
+    static_assert(property_value<T, typename device_property<Id>::type>::value,
+                  "wrong value type for this device property");
+    return device->getProperty(Id, value);
+}
+
+template <int Id, class T>
+inline oni_Status setProperty(oni_Device * device, const T & value)
+{
+    static_assert(property_value<T, typename device_property<Id>::type>::value,
+                  "wrong value type for this device property");
+    return oni_setProperty_Device(device, Id, &value, sizeof(T));
+}
+
+template <int Id, class T>
+inline oni_Status getProperty(oni_VideoStream * stream, T * value)
+{
+    static_assert(property_value<T, typename stream_property<Id>::type>::value,
+                  "wrong value type for this stream property");
+    return stream->getProperty(Id, value);
+}
+
+template <int Id, class T>
+inline oni_Status setProperty(oni_VideoStream * stream, const T & value)
+{
+    static_assert(property_value<T, typename stream_property<Id>::type>::value,
+                  "wrong value type for this stream property");
+    return oni_setProperty_VideoStream(stream, Id, &value, sizeof(T));
+}
+
+// ===============================
+// Untyped properties and commands
+// ===============================
+// For IDs that have no traits (e.g. vendor-specific ones).  OpenNI checks the
+// size at run time.
+template <class T>
+inline oni_Status getProperty(oni_Device * device, int propertyId, T * value)
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "property values are copied as raw bytes");
+    return device->getProperty(propertyId, value);
+}
+
+template <class T>
+inline oni_Status setProperty(oni_Device * device, int propertyId,
+                              const T & value)
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "property values are copied as raw bytes");
+    return oni_setProperty_Device(device, propertyId, &value, sizeof(T));
+}
+
+template <class T>
+inline oni_Status getProperty(oni_VideoStream * stream, int propertyId,
+                              T * value)
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "property values are copied as raw bytes");
+    return stream->getProperty(propertyId, value);
+}
+
+template <class T>
+inline oni_Status setProperty(oni_VideoStream * stream, int propertyId,
+                              const T & value)
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "property values are copied as raw bytes");
+    return oni_setProperty_VideoStream(stream, propertyId, &value,
+                                       sizeof(T));
+}
+
+template <class T>
+inline oni_Status invoke(oni_Device * device, int commandId, const T & data)
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "command data is copied as raw bytes");
+    return device->invoke(commandId, data);
+}
+
+template <class T>
+inline oni_Status invoke(oni_VideoStream * stream, int commandId, T & data)
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "command data is copied as raw bytes");
+    return stream->invoke(commandId, data);
+}
+
+// =================
+// oni_VideoFrameRef
+// =================
+inline bool isValid(oni_VideoFrameRef * ref) { return ref->isValid(); }
+inline const void * getData(oni_VideoFrameRef * ref) { return ref->getData(); }
+inline int getDataSize(oni_VideoFrameRef * ref) { return ref->getDataSize(); }
+inline int getWidth(oni_VideoFrameRef * ref) { return ref->getWidth(); }
+inline int getHeight(oni_VideoFrameRef * ref) { return ref->getHeight(); }
+inline int getStrideInBytes(oni_VideoFrameRef * ref) { return ref->getStrideInBytes(); }
+inline int getFrameIndex(oni_VideoFrameRef * ref) { return ref->getFrameIndex(); }
+inline uint64_t getTimestamp(oni_VideoFrameRef * ref) { return ref->getTimestamp(); }
+inline oni_SensorType getSensorType(oni_VideoFrameRef * ref) { return ref->getSensorType(); }
+inline bool getCroppingEnabled(oni_VideoFrameRef * ref) { return ref->getCroppingEnabled(); }
+inline int getCropOriginX(oni_VideoFrameRef * ref) { return ref->getCropOriginX(); }
+inline int getCropOriginY(oni_VideoFrameRef * ref) { return ref->getCropOriginY(); }
+
+// row: Row 'y' of the frame as pixels of type 'Pixel', e.g.
+// oni::row<oni_DepthPixel>(ref, y).
+template <class Pixel>
+inline const Pixel * row(oni_VideoFrameRef * ref, int y)
+{
+    return (const Pixel *) ((const char *) ref->getData() +
+                            y * ref->getStrideInBytes());
+}
+
+// ===============
+// oni_VideoStream
+// ===============
+inline bool isValid(oni_VideoStream * stream) { return stream->isValid(); }
+inline float getHorizontalFieldOfView(oni_VideoStream * stream) { return stream->getHorizontalFieldOfView(); }
+inline float getVerticalFieldOfView(oni_VideoStream * stream) { return stream->getVerticalFieldOfView(); }
+inline int getMaxPixelValue(oni_VideoStream * stream) { return stream->getMaxPixelValue(); }
+inline int getMinPixelValue(oni_VideoStream * stream) { return stream->getMinPixelValue(); }
+inline bool getMirroringEnabled(oni_VideoStream * stream) { return stream->getMirroringEnabled(); }
+inline oni_Status readFrame(oni_VideoStream * stream, oni_VideoFrameRef * ref) { return stream->readFrame(ref); }
+
+// ==========
+// oni_Device
+// ==========
+inline bool isValid(oni_Device * device) { return device->isValid(); }
+inline bool isFile(oni_Device * device) { return device->isFile(); }
+
+} // namespace oni
+
+#endif // OPENNI2_WRAPPER_INLINE